@@ -1004,6 +1004,32 @@ void C_FlushDisplay()
 		NotifyStrings[i].timeout = 0;
 }
 
+// The client writes its log as it prints, so there is nothing waiting.
+void C_FlushLog()
+{
+	if (LOG.is_open())
+		LOG.flush();
+}
+
+void C_CloseLog()
+{
+	LOG.close();
+}
+
+bool C_OpenLog(const char *filename)
+{
+	if (LOG.is_open())
+		LOG.close();
+
+	LOG.open(filename, std::ios::app);
+	if (!LOG.is_open())
+		return false;
+
+	LOG << std::endl;
+	LOG.flush();
+	return true;
+}
+
 void C_Ticker()
 {
 	int surface_height = I_GetSurfaceHeight();
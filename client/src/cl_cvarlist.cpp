@@ -380,6 +380,15 @@ CVAR(				cl_autoscreenshot, "0", "Automatically capture a screenshot at the end
 CVAR(				cl_splitnetdemos, "0", "Create separate netdemos for each map",
 					CVARTYPE_BOOL, CVAR_CLIENTARCHIVE)
 
+CVAR_RANGE(			cl_netdemosnapspacing, "20", "Seconds between the snapshots used for seeking in new netdemos",
+					CVARTYPE_INT, CVAR_CLIENTARCHIVE | CVAR_NOENABLEDISABLE, 1.0f, 60.0f)
+
+CVAR(				cl_netdemodeltas, "0", "Store netdemo snapshots as differences from the previous snapshot",
+					CVARTYPE_BOOL, CVAR_CLIENTARCHIVE)
+
+CVAR_RANGE(			cl_netdemokeyframes, "10", "Number of delta snapshots between full netdemo snapshots",
+					CVARTYPE_INT, CVAR_CLIENTARCHIVE | CVAR_NOENABLEDISABLE, 1.0f, 100.0f)
+
 // Mouse settings
 // --------------
 
@@ -38,9 +38,13 @@
 #include "st_stuff.h"
 #include "p_mobj.h"
 #include "g_level.h"
+#include "m_delta.h"
 
 EXTERN_CVAR(sv_maxclients)
 EXTERN_CVAR(sv_maxplayers)
+EXTERN_CVAR(cl_netdemodeltas)
+EXTERN_CVAR(cl_netdemokeyframes)
+EXTERN_CVAR(cl_netdemosnapspacing)
 
 extern std::string server_host;
 extern std::string digest;
@@ -51,7 +55,7 @@ argb_t CL_GetPlayerColor(player_t*);
 
 NetDemo::NetDemo() :
 	state(st_stopped), oldstate(st_stopped), filename(""),
-	demofp(NULL)
+	demofp(NULL), snapshots_since_keyframe(0)
 {
     memset(&header, 0, sizeof(header));
 }
@@ -79,6 +83,8 @@ void NetDemo::copy(NetDemo &to, const NetDemo &from)
 	to.captured			= from.captured;
 	to.snapshot_index	= from.snapshot_index;
 	to.map_index		= from.map_index;
+	to.snapshot_base	= from.snapshot_base;
+	to.snapshots_since_keyframe = from.snapshots_since_keyframe;
 	memcpy(&to.header, &from.header, sizeof(header));
 }
 
@@ -126,6 +132,8 @@ void NetDemo::cleanUp()
 	
 	snapshot_index.clear();
 	map_index.clear();
+	snapshot_base.clear();
+	snapshots_since_keyframe = 0;
 	state = oldstate = NetDemo::st_stopped;
 }
 
@@ -171,7 +179,8 @@ bool NetDemo::writeHeader()
 	strncpy(header.identifier, "ODAD", 4);
 	header.version = NETDEMOVER;
 	header.compression = 0;
-	header.snapshot_spacing = NetDemo::SNAPSHOT_SPACING;
+	if (!header.snapshot_spacing)
+		header.snapshot_spacing = NetDemo::SNAPSHOT_SPACING;
 
 	netdemo_header_t tmpheader;
 	memcpy(&tmpheader, &header, sizeof(header));
@@ -426,6 +435,10 @@ bool NetDemo::startRecording(const std::string &filename)
 	}
 
 	memset(&header, 0, sizeof(header));
+	header.snapshot_spacing = cl_netdemosnapspacing.asInt() * TICRATE;
+	snapshot_base.clear();
+	snapshots_since_keyframe = 0;
+
 	// Note: The header is not finalized at this point.  Write it anyway to
 	// reserve space in the output file for it and overwrite it later.
 	if (!writeHeader())
@@ -510,10 +523,12 @@ bool NetDemo::startPlaying(const std::string &filename)
 		return false;
 	}
 
-    if (header.version != NETDEMOVER)
-    {
-        // Do nothing since there is only one version of netdemo files currently
-    }
+	// older versions differ only in lacking msg_snapshotdelta chunks
+	if (header.version > NETDEMOVER)
+	{
+		error("Netdemo was recorded with a newer version of Odamex.");
+		return false;
+	}
 
 	// read the demo's index
 	if (fseek(demofp, header.snapshot_index_offset, SEEK_SET) != 0)
@@ -781,13 +796,7 @@ void NetDemo::writeMessages()
 	static buf_t netbuf_localcmd(1024);
 
 	if (atSnapshotInterval())
-	{
-		size_t length;
-		writeSnapshotData(snapbuf, length);
-		writeSnapshotIndexEntry();
-			
-		writeChunk(snapbuf, length, NetDemo::msg_snapshot);
-	}
+		writeSnapshot(false);
 
 	if (connected)
 	{	
@@ -931,7 +940,7 @@ void NetDemo::readMessages(buf_t* netbuffer)
 	// get the values for type, len and tic
 	readMessageHeader(type, len, tic);
 	
-	while (type == NetDemo::msg_snapshot)
+	while (type == NetDemo::msg_snapshot || type == NetDemo::msg_snapshotdelta)
 	{
 		// skip over snapshots and read the next message instead
 		fseek(demofp, len, SEEK_CUR);
@@ -1369,20 +1378,29 @@ void NetDemo::readSnapshot(const netdemo_index_entry_t *snap)
 	uint32_t len = 0, tic = 0;
 	readMessageHeader(type, len, tic);
 
-	if (len > NetDemo::MAX_SNAPSHOT_SIZE)
+	// keyframes recorded with cl_netdemodeltas can be larger than snapbuf
+	std::vector<byte> buf;
+
+	if (type == NetDemo::msg_snapshotdelta)
 	{
-		fatalError("Snapshot too large to read");
-		return;
+		if (!reconstructSnapshot(snap, buf))
+		{
+			fatalError("Unable to rebuild snapshot from netdemo file");
+			return;
+		}
 	}
-		
-	size_t cnt = fread(snapbuf, 1, len, demofp);
-	if (cnt < len)
+	else
 	{
-		fatalError("Unable to read snapshot from data file");
-		return;
+		buf.resize(len);
+		size_t cnt = len ? fread(&buf[0], 1, len, demofp) : 0;
+		if (len == 0 || cnt < len)
+		{
+			fatalError("Unable to read snapshot from data file");
+			return;
+		}
 	}
 
-	readSnapshotData(snapbuf, len);
+	readSnapshotData(&buf[0], buf.size());
 	netdemotic = snap->ticnum - header.starting_gametic;
 }
 
@@ -1438,27 +1456,216 @@ void NetDemo::writeMapChange()
 {
 	if (connected && gamestate == GS_LEVEL)
 	{
-		size_t length;
-		writeSnapshotData(snapbuf, length);
 		writeMapIndexEntry();
-		writeSnapshotIndexEntry();
-		
-		writeChunk(snapbuf, length, NetDemo::msg_snapshot);
+		writeSnapshot(true);
 	}
 }
 
 void NetDemo::writeIntermission()
 {
 	if (connected && gamestate == GS_INTERMISSION)
+		writeSnapshot(true);
+}
+
+
+//
+// CL_PackSnapshot()
+//
+//   Wraps raw snapshot data in an LZO-compressed buffer in the same form
+//   that FLZOMemFile::WriteToBuffer produces.
+//
+static void CL_PackSnapshot(const std::vector<byte> &data, std::vector<byte> &out)
+{
+	FLZOMemFile memfile;
+	memfile.Open();
+	if (!data.empty())
+		memfile.Write(&data[0], data.size());
+	memfile.Close();
+
+	out.resize(memfile.Length());
+	memfile.WriteToBuffer(&out[0], out.size());
+}
+
+
+//
+// CL_UnpackSnapshot()
+//
+//   The reverse of CL_PackSnapshot().  Returns false if the sizes stored in
+//   the buffer do not agree with its length.
+//
+static bool CL_UnpackSnapshot(std::vector<byte> &data, std::vector<byte> &out)
+{
+	if (data.size() < 8)
+		return false;
+
+	DWORD compressed_len = BELONG(((DWORD*)&data[0])[0]);
+	DWORD expanded_len = BELONG(((DWORD*)&data[0])[1]);
+	if ((compressed_len ? compressed_len : expanded_len) > data.size() - 8)
+		return false;
+
+	FLZOMemFile memfile;
+	memfile.Open(&data[0]);		// open for reading
+
+	out.resize(expanded_len);
+	if (expanded_len)
+		memfile.Read(&out[0], expanded_len);
+	return true;
+}
+
+
+//
+// writeSnapshot()
+//
+//   Writes a snapshot chunk and its index entry.  With cl_netdemodeltas
+//   enabled, only the first snapshot after a keyframe is stored whole; the
+//   rest are stored as msg_snapshotdelta chunks holding the difference from
+//   the snapshot before them.  A keyframe is forced every
+//   cl_netdemokeyframes snapshots so that seeking never has to apply more
+//   than that many deltas.
+//
+
+void NetDemo::writeSnapshot(bool keyframe)
+{
+	writeSnapshotIndexEntry();
+
+	if (!cl_netdemodeltas)
 	{
 		size_t length;
 		writeSnapshotData(snapbuf, length);
-		writeSnapshotIndexEntry();
-		
 		writeChunk(snapbuf, length, NetDemo::msg_snapshot);
+
+		snapshot_base.clear();
+		return;
+	}
+
+	// Both the level snapshot and the outer archive are left uncompressed
+	// so that unchanged parts of the game state serialize to the same bytes
+	// as last time.  The chunk written to the file is compressed instead.
+	FLZOMemFile memfile(true);
+	memfile.Open();			// open for writing
+	serializeSnapshot(memfile, false);
+
+	std::vector<byte> data(memfile.Length());
+	memfile.WriteToBuffer(&data[0], data.size());
+	data.erase(data.begin(), data.begin() + 8);
+
+	if (snapshot_base.empty() ||
+		snapshots_since_keyframe >= cl_netdemokeyframes.asInt())
+		keyframe = true;
+
+	std::vector<byte> chunk;
+	if (keyframe)
+	{
+		CL_PackSnapshot(data, chunk);
+		writeChunk(&chunk[0], chunk.size(), NetDemo::msg_snapshot);
+		snapshots_since_keyframe = 0;
+	}
+	else
+	{
+		std::vector<byte> delta;
+		M_EncodeDelta(&snapshot_base[0], snapshot_base.size(),
+					  &data[0], data.size(), delta);
+		CL_PackSnapshot(delta, chunk);
+		writeChunk(&chunk[0], chunk.size(), NetDemo::msg_snapshotdelta);
+		snapshots_since_keyframe++;
 	}
+
+	snapshot_base.swap(data);
 }
 
+
+//
+// readSnapshotChunk()
+//
+//   Reads the snapshot chunk that snap points to into data.
+//
+
+bool NetDemo::readSnapshotChunk(const netdemo_index_entry_t *snap,
+								netdemo_message_t &type, std::vector<byte> &data)
+{
+	if (fseek(demofp, snap->offset, SEEK_SET) != 0)
+		return false;
+
+	uint32_t len = 0, tic = 0;
+	if (!readMessageHeader(type, len, tic))
+		return false;
+
+	if (type != NetDemo::msg_snapshot && type != NetDemo::msg_snapshotdelta)
+		return false;
+
+	data.resize(len);
+	return len == 0 || fread(&data[0], 1, len, demofp) == len;
+}
+
+
+//
+// reconstructSnapshot()
+//
+//   Rebuilds the snapshot at snap by walking back through the snapshot
+//   index to the nearest keyframe and applying every delta after it in
+//   order.  buf receives the snapshot in the form that readSnapshotData()
+//   expects.
+//
+
+bool NetDemo::reconstructSnapshot(const netdemo_index_entry_t *snap,
+								  std::vector<byte> &buf)
+{
+	if (snapshot_index.empty() || snap < &snapshot_index[0] ||
+		snap > &snapshot_index.back())
+		return false;
+
+	size_t target = snap - &snapshot_index[0];
+	size_t first = target;
+
+	std::list<std::vector<byte> > deltas;
+	std::vector<byte> chunk;
+	netdemo_message_t type;
+
+	while (true)
+	{
+		if (!readSnapshotChunk(&snapshot_index[first], type, chunk))
+			return false;
+		if (type == NetDemo::msg_snapshot)
+			break;
+		if (first == 0)
+			return false;
+
+		deltas.push_front(std::vector<byte>());
+		if (!CL_UnpackSnapshot(chunk, deltas.front()))
+			return false;
+		first--;
+	}
+
+	std::vector<byte> data, next;
+	if (!CL_UnpackSnapshot(chunk, data))
+		return false;
+
+	for (std::list<std::vector<byte> >::const_iterator it = deltas.begin();
+		 it != deltas.end(); ++it)
+	{
+		static const byte empty = 0;
+		const byte *base = data.empty() ? &empty : &data[0];
+		const byte *delta = it->empty() ? &empty : &(*it)[0];
+
+		if (!M_ApplyDelta(base, data.size(), delta, it->size(), next))
+			return false;
+		data.swap(next);
+	}
+
+	DPrintf("Rebuilt netdemo snapshot %d from a keyframe and %d deltas\n",
+			(int)target, (int)deltas.size());
+
+	// store the data uncompressed in the form that FLZOMemFile::Open expects
+	buf.resize(data.size() + 8);
+	((DWORD*)&buf[0])[0] = BELONG((DWORD)0);
+	((DWORD*)&buf[0])[1] = BELONG((DWORD)data.size());
+	if (!data.empty())
+		memcpy(&buf[8], &data[0], data.size());
+
+	return true;
+}
+
+
 //
 // writeSnapshotData()
 //
@@ -1469,11 +1676,29 @@ void NetDemo::writeIntermission()
 
 void NetDemo::writeSnapshotData(byte *buf, size_t &length)
 {
-	G_SnapshotLevel();
-
 	FLZOMemFile memfile;
 	memfile.Open();			// open for writing
 
+	serializeSnapshot(memfile, true);
+
+	// get the size of the snapshot data	
+	length = memfile.Length();
+	memfile.WriteToBuffer(buf, NetDemo::MAX_SNAPSHOT_SIZE);
+}
+
+
+//
+// serializeSnapshot()
+//
+//   Archives the entire state of the game into memfile, which must be open
+//   for writing.  The level snapshot inside it is compressed only if
+//   compress is true.
+//
+
+void NetDemo::serializeSnapshot(FLZOMemFile &memfile, bool compress)
+{
+	G_SnapshotLevel(compress);
+
 	FArchive arc(memfile);
 
 	// Save the server cvars
@@ -1509,11 +1734,8 @@ void NetDemo::writeSnapshotData(byte *buf, size_t &length)
 	
 	arc << level.time;
 
-	for (int i = 0; i < NUM_WORLDVARS; i++)
-		arc << ACS_WorldVars[i];
-
-	for (int i = 0; i < NUM_GLOBALVARS; i++)
-		arc << ACS_GlobalVars[i];
+	arc.WriteArray(ACS_WorldVars, NUM_WORLDVARS);
+	arc.WriteArray(ACS_GlobalVars, NUM_GLOBALVARS);
 
 	byte check = 0x1d;
 	arc << check;          // consistancy marker
@@ -1522,10 +1744,6 @@ void NetDemo::writeSnapshotData(byte *buf, size_t &length)
 
 	arc.Close();
 
-	// get the size of the snapshot data	
-	length = memfile.Length();
-	memfile.WriteToBuffer(buf, NetDemo::MAX_SNAPSHOT_SIZE);
-			
     if (level.info->snapshot != NULL)
     {
         delete level.info->snapshot;
@@ -1603,11 +1821,8 @@ void NetDemo::readSnapshotData(byte *buf, size_t length)
 
 	arc >> level.time;
 
-	for (int i = 0; i < NUM_WORLDVARS; i++)
-		arc >> ACS_WorldVars[i];
-
-	for (int i = 0; i < NUM_GLOBALVARS; i++)
-		arc >> ACS_GlobalVars[i];
+	arc.ReadArray(ACS_WorldVars, NUM_WORLDVARS);
+	arc.ReadArray(ACS_GlobalVars, NUM_GLOBALVARS);
 
 	multiplayer = true;
 
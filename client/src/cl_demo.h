@@ -8,6 +8,8 @@
 #include <vector>
 #include <list>
 
+class FLZOMemFile;
+
 class NetDemo
 {
 public:
@@ -58,7 +60,8 @@ private:
 	typedef enum
 	{
 		msg_packet		= 0xAA,
-		msg_snapshot
+		msg_snapshot,
+		msg_snapshotdelta		// snapshot stored as a delta from the previous one
 	} netdemo_message_t;
 
 	typedef struct
@@ -86,6 +89,12 @@ private:
 	
 	void readSnapshotData(byte *buf, size_t length);
 	void writeSnapshotData(byte *buf, size_t &length);
+	void serializeSnapshot(FLZOMemFile &memfile, bool compress);
+
+	void writeSnapshot(bool keyframe);
+	bool readSnapshotChunk(const netdemo_index_entry_t *snap, netdemo_message_t &type,
+	                       std::vector<byte> &data);
+	bool reconstructSnapshot(const netdemo_index_entry_t *snap, std::vector<byte> &buf);
 	
 	void writeSnapshotIndexEntry();
 	void writeMapIndexEntry();
@@ -144,6 +153,11 @@ private:
 	
 	byte				snapbuf[NetDemo::MAX_SNAPSHOT_SIZE];
 	int					netdemotic;
+
+	// uncompressed contents of the last snapshot written, which the next
+	// msg_snapshotdelta is made against
+	std::vector<byte>	snapshot_base;
+	int					snapshots_since_keyframe;
 };
 
 
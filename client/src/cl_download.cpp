@@ -24,6 +24,8 @@
 
 #include <sstream>
 #include <iomanip>
+#include <map>
+#include <vector>
 
 #include "c_dispatch.h"
 #include "cmdlib.h"
@@ -34,6 +36,7 @@
 #include "md5.h"
 #include "m_argv.h"
 #include "m_fileio.h"
+#include "minilzo.h"
 
 #ifdef _XBOX
 #include "i_xbox.h"
@@ -44,6 +47,8 @@ EXTERN_CVAR (cl_serverdownload)
 EXTERN_CVAR (cl_waddownloaddir)
 
 void CL_Reconnect(void);
+void CL_ClosePartialDownload();
+std::string FormatNBytes(float b);
 
 // GhostlyDeath <October 26, 2008> -- VC6 Compiler Error
 // C2552: 'identifier' : non-aggregates cannot be initialized with initializer list
@@ -66,13 +71,23 @@ struct download_s
 		std::string filename;
 		std::string md5;
 		buf_t *buf;
-		size_t got_bytes;
+		size_t got_bytes;		// everything before this has been received
         dtime_t timeout;
 		int retrycount;
-		
+
+		// which WAD_BLOCK_SIZE blocks of the file have been received
+		std::vector<bool> blocks;
+		size_t received;		// bytes in received blocks
+		size_t highest;			// end of the furthest chunk received
+		FILE *part;				// partial file, if it is being kept
+		bool mapdirty;
+		dtime_t lastchunk, lastack, lastsave;
+		std::map<size_t, dtime_t> naked;	// when each missing range was reported
+
 		download_s()
 		{
 			buf = NULL;
+			part = NULL;
 			this->clear();
 			timeout = 0;
 		}
@@ -83,11 +98,17 @@ struct download_s
 
 		void clear()
 		{
+			CL_ClosePartialDownload();
+
 			filename = "";
 			md5 = "";
 			got_bytes = 0;
             timeout = 0;
             retrycount = 0;
+			blocks.clear();
+			received = highest = 0;
+			lastchunk = lastack = lastsave = 0;
+			naked.clear();
             
 			if (buf != NULL)
 			{
@@ -98,6 +119,243 @@ struct download_s
 } download;
 
 
+//
+// Partial downloads
+//
+// While a WAD is downloaded with a known checksum, what has been received
+// so far is also written to <name>.part in the user directory, and which
+// blocks of it are valid to <name>.part.map, so that the download can pick
+// up where it left off after a reconnect or a restart.  The map starts
+// with a line of "odamex-partial md5 length" followed by one bit per block.
+//
+
+static const dtime_t DOWNLOAD_ACK_INTERVAL = 50 * 1000000LL;	// 50 ms
+static const dtime_t DOWNLOAD_NAK_INTERVAL = 500 * 1000000LL;
+static const dtime_t DOWNLOAD_SAVE_INTERVAL = 1000 * 1000000LL;
+
+// Most missing ranges reported in one clc_wadack.
+static const size_t DOWNLOAD_MAX_NAKS = 32;
+
+// Only servers that advertise SVCAP_WADACK understand clc_wadack.  Older
+// ones send the file in order and are asked to start again from the first
+// missing byte when a chunk is lost.
+static bool CL_WindowedDownload()
+{
+	return (servercaps & SVCAP_WADACK) != 0;
+}
+
+static std::string CL_PartialFileName(const std::string &filename)
+{
+	return I_GetUserFileName((filename + ".part").c_str());
+}
+
+static std::string CL_PartialMapName(const std::string &filename)
+{
+	return I_GetUserFileName((filename + ".part.map").c_str());
+}
+
+static size_t CL_DownloadBlockSize(size_t block)
+{
+	size_t length = download.buf->maxsize();
+	return std::min((size_t)WAD_BLOCK_SIZE, length - block * WAD_BLOCK_SIZE);
+}
+
+static void CL_SavePartialMap()
+{
+	if (download.part == NULL || !download.mapdirty)
+		return;
+
+	fflush(download.part);
+
+	FILE *fp = fopen(CL_PartialMapName(download.filename).c_str(), "wb");
+	if (fp == NULL)
+		return;
+
+	fprintf(fp, "odamex-partial %s %u\n", download.md5.c_str(),
+		(unsigned)download.buf->maxsize());
+
+	std::vector<byte> bits((download.blocks.size() + 7) / 8, 0);
+	for (size_t i = 0; i < download.blocks.size(); i++)
+		if (download.blocks[i])
+			bits[i / 8] |= 1 << (i % 8);
+
+	if (!bits.empty())
+		fwrite(&bits[0], 1, bits.size(), fp);
+	fclose(fp);
+
+	download.mapdirty = false;
+}
+
+void CL_ClosePartialDownload()
+{
+	if (download.part == NULL)
+		return;
+
+	CL_SavePartialMap();
+	fclose(download.part);
+	download.part = NULL;
+}
+
+static void CL_RemovePartialDownload()
+{
+	std::string filename = download.filename;
+
+	if (download.part != NULL)
+	{
+		fclose(download.part);
+		download.part = NULL;
+	}
+
+	remove(CL_PartialFileName(filename).c_str());
+	remove(CL_PartialMapName(filename).c_str());
+}
+
+// Start keeping a partial file for a download that starts from scratch.
+static void CL_CreatePartialDownload()
+{
+	CL_ClosePartialDownload();
+
+	if (download.md5.empty())
+		return;
+
+	download.part = fopen(CL_PartialFileName(download.filename).c_str(), "w+b");
+	download.mapdirty = true;
+	CL_SavePartialMap();
+}
+
+//
+// CL_LoadPartialDownload
+//
+// Picks up what was received of the current download before, if its
+// partial file is for the same checksum.
+//
+static bool CL_LoadPartialDownload()
+{
+	if (download.md5.empty())
+		return false;
+
+	FILE *fp = fopen(CL_PartialMapName(download.filename).c_str(), "rb");
+	if (fp == NULL)
+		return false;
+
+	char md5[64];
+	unsigned length = 0;
+	bool valid = fscanf(fp, "odamex-partial %63s %u", md5, &length) == 2 &&
+		fgetc(fp) == '\n' && download.md5 == md5 && length > 0 &&
+		length <= 100*1024*1024;
+
+	std::vector<byte> bits;
+	if (valid)
+	{
+		bits.resize(((length + WAD_BLOCK_SIZE - 1) / WAD_BLOCK_SIZE + 7) / 8);
+		valid = fread(&bits[0], 1, bits.size(), fp) == bits.size();
+	}
+	fclose(fp);
+
+	if (!valid)
+		return false;
+
+	download.part = fopen(CL_PartialFileName(download.filename).c_str(), "r+b");
+	if (download.part == NULL || M_FileLength(download.part) < 0)
+	{
+		CL_RemovePartialDownload();
+		return false;
+	}
+
+	download.buf = new buf_t((size_t)length);
+	memset(download.buf->ptr(), 0, length);
+	fread(download.buf->ptr(), 1, length, download.part);
+
+	download.blocks.assign((length + WAD_BLOCK_SIZE - 1) / WAD_BLOCK_SIZE, false);
+	download.received = download.highest = 0;
+
+	for (size_t i = 0; i < download.blocks.size(); i++)
+	{
+		if (!(bits[i / 8] & (1 << (i % 8))))
+			continue;
+
+		download.blocks[i] = true;
+		download.received += CL_DownloadBlockSize(i);
+		download.highest = i * WAD_BLOCK_SIZE + CL_DownloadBlockSize(i);
+	}
+
+	download.got_bytes = 0;
+	for (size_t i = 0; i < download.blocks.size() && download.blocks[i]; i++)
+		download.got_bytes += CL_DownloadBlockSize(i);
+
+	download.mapdirty = false;
+
+	Printf(PRINT_HIGH, "Resuming download of %s (%s of %s)...\n", download.filename.c_str(),
+		FormatNBytes(download.received).c_str(), FormatNBytes(length).c_str());
+
+	return true;
+}
+
+//
+// CL_SendDownloadAck
+//
+// Tells the server what has been received: everything before got_bytes,
+// the end of the furthest chunk, and the first few missing ranges before
+// that, each reported again only if it is still missing a while later.
+// Once chunks stop arriving, the rest of the file is reported missing too,
+// in case the last ones were lost.
+//
+static void CL_SendDownloadAck()
+{
+	const dtime_t now = I_GetTime();
+	const size_t length = download.buf->maxsize();
+
+	std::vector<std::pair<size_t, size_t> > naks;
+
+	size_t block = download.got_bytes / WAD_BLOCK_SIZE;
+	size_t lastblock = (download.highest + WAD_BLOCK_SIZE - 1) / WAD_BLOCK_SIZE;
+
+	if (now - download.lastchunk > DOWNLOAD_NAK_INTERVAL)
+		lastblock = download.blocks.size();
+
+	while (block < lastblock && naks.size() < DOWNLOAD_MAX_NAKS)
+	{
+		if (download.blocks[block])
+		{
+			block++;
+			continue;
+		}
+
+		size_t start = block;
+		while (block < lastblock && !download.blocks[block])
+			block++;
+
+		size_t offset = start * WAD_BLOCK_SIZE;
+		size_t end = std::min(block * WAD_BLOCK_SIZE, length);
+
+		std::map<size_t, dtime_t>::iterator it = download.naked.find(offset);
+		if (it != download.naked.end() && now - it->second < DOWNLOAD_NAK_INTERVAL)
+			continue;
+
+		download.naked[offset] = now;
+		naks.push_back(std::make_pair(offset, end - offset));
+	}
+
+	// forget ranges that have been filled in
+	while (!download.naked.empty() && download.naked.begin()->first < download.got_bytes)
+		download.naked.erase(download.naked.begin());
+
+	MSG_WriteMarker(&net_buffer, clc_wadack);
+	MSG_WriteLong(&net_buffer, download.got_bytes);
+	MSG_WriteLong(&net_buffer, download.highest);
+	MSG_WriteByte(&net_buffer, naks.size());
+	for (size_t i = 0; i < naks.size(); i++)
+	{
+		MSG_WriteLong(&net_buffer, naks[i].first);
+		MSG_WriteLong(&net_buffer, naks[i].second);
+	}
+
+	NET_SendPacket(net_buffer, serveraddr);
+
+	download.lastack = now;
+}
+
+
 extern std::string DownloadStr;
 
 // Pretty prints supplied byte amount into a string
@@ -158,6 +416,7 @@ void IntDownloadComplete(void)
 		Printf(PRINT_HIGH, " %s on server\n", download.md5.c_str());
 		Printf(PRINT_HIGH, "Download failed: bad checksum\n");
 
+		CL_RemovePartialDownload();
 		download.clear();
         CL_QuitNetGame();
 
@@ -217,6 +476,7 @@ void IntDownloadComplete(void)
 
     Printf(PRINT_HIGH, "Saved download as \"%s\"\n", filename.c_str());
 
+	CL_RemovePartialDownload();
 	download.clear();
     CL_QuitNetGame();
     CL_Reconnect();
@@ -236,9 +496,12 @@ void CL_RequestDownload(std::string filename, std::string filehash)
 		if ((download.filename != filename) ||
 			(download.md5 != filehash))
 		{
+			download.clear();
 			download.filename = filename;
 			download.md5 = filehash;
-			download.got_bytes = 0;
+
+			// Carry on from a partial file left by an earlier attempt
+			CL_LoadPartialDownload();
 		}
 
 		// denis todo clear previous downloads
@@ -258,7 +521,7 @@ void CL_RequestDownload(std::string filename, std::string filehash)
 		// work
 
 		if ((download.buf != NULL) &&
-			(download.got_bytes >= download.buf->maxsize()))
+			(download.received >= download.buf->maxsize()))
 		{
 			IntDownloadComplete();
 		}
@@ -288,7 +551,7 @@ void CL_DownloadStart()
 	}
 
     // [Russell] - Allow resumeable downloads
-	if (download.got_bytes == 0)
+	if (download.buf == NULL || download.buf->maxsize() != file_len || download.received == 0)
     {
         if (download.buf != NULL)
         {
@@ -299,11 +562,17 @@ void CL_DownloadStart()
         download.buf = new buf_t ((size_t)file_len);
 
         memset(download.buf->ptr(), 0, file_len);
+
+		download.blocks.assign((file_len + WAD_BLOCK_SIZE - 1) / WAD_BLOCK_SIZE, false);
+		download.got_bytes = download.received = download.highest = 0;
+		download.naked.clear();
+
+		CL_CreatePartialDownload();
     }
     else
         Printf(PRINT_HIGH, "Resuming download of %s...\n", download.filename.c_str());
 
-
+	download.lastchunk = I_GetTime();
 
 	Printf(PRINT_HIGH, "Downloading %s bytes...\n",
         FormatNBytes(file_len).c_str());
@@ -329,6 +598,20 @@ void CL_DownloadTicker()
 		return;
     }
 
+	if (download.buf != NULL)
+	{
+		dtime_t now = I_GetTime();
+
+		if (CL_WindowedDownload() && now - download.lastack >= DOWNLOAD_ACK_INTERVAL)
+			CL_SendDownloadAck();
+
+		if (now - download.lastsave >= DOWNLOAD_SAVE_INTERVAL)
+		{
+			CL_SavePartialMap();
+			download.lastsave = now;
+		}
+	}
+
     if (download.timeout)
     {
         // Calculate how many seconds have elapsed since the last server 
@@ -374,46 +657,86 @@ void CL_DownloadTicker()
 }
 
 //
-// CL_Download
-// denis - get a little chunk of the file and store it, much like a hampster. Well, hamster; but hampsters can dance and sing. Also much like Scraps, the Ice Age squirrel thing, stores his acorn. Only with a bit more success. Actually, quite a bit more success, specifically as in that the world doesn't crack apart when we store our chunk and it does when Scraps stores his (or her?) acorn. But when Scraps does it, it is funnier. The rest of Ice Age mostly sucks.
+// CL_CheckDownloadChunk
 //
-void CL_Download()
+// Makes sure a chunk of len bytes at offset that arrived intact can be
+// stored, aborting the download if not.
+//
+static bool CL_CheckDownloadChunk(DWORD offset, size_t len, size_t left, bool intact)
 {
-	DWORD offset = MSG_ReadLong();
-	size_t len = MSG_ReadShort();
-	size_t left = MSG_BytesLeft();
-	void *p = MSG_ReadChunk(len);
-
-	if(gamestate != GS_DOWNLOAD)
-		return;
-
 	if (download.buf == NULL)
 	{
 		// We must have not received the svc_wadinfo message
 		Printf(PRINT_HIGH, "Unable to start download, aborting\n");
 		download.clear();
 		CL_QuitNetGame();
-		return;
+		return false;
 	}
 
 	// check ranges
-	if(offset + len > download.buf->maxsize() || len > left || p == NULL)
+	if(offset + len > download.buf->maxsize() || !intact)
 	{
 		Printf(PRINT_HIGH, "Bad download packet (%d, %d) encountered (%d), aborting\n", (int)offset, (int)left, (int)download.buf->size());
 
 		download.clear();
 		CL_QuitNetGame();
-		return;
+		return false;
 	}
 
-	// Reset retransmission timer
-	CL_DownloadTick();
-	
+	return true;
+}
+
+//
+// CL_RecordWindowedChunk
+//
+// Marks the blocks of a chunk from a windowed download as received.
+// Returns false if it held nothing new.
+//
+static bool CL_RecordWindowedChunk(DWORD offset, size_t len)
+{
+	// Only whole blocks count as received; chunks start on a block and
+	// hold whole blocks, except for the last one in the file.
+	size_t end = offset + len;
+	size_t first = (offset + WAD_BLOCK_SIZE - 1) / WAD_BLOCK_SIZE;
+	size_t last = (end == download.buf->maxsize()) ? download.blocks.size() : end / WAD_BLOCK_SIZE;
+	bool fresh = false;
+
+	for (size_t i = first; i < last; i++)
+	{
+		if (download.blocks[i])
+			continue;
+
+		download.blocks[i] = true;
+		download.received += CL_DownloadBlockSize(i);
+		fresh = true;
+	}
+
+	if (!fresh)
+		return false;
+
+	download.highest = std::max(download.highest, end);
+
+	while (download.got_bytes < download.buf->maxsize() &&
+		   download.blocks[download.got_bytes / WAD_BLOCK_SIZE])
+		download.got_bytes += CL_DownloadBlockSize(download.got_bytes / WAD_BLOCK_SIZE);
+
+	return true;
+}
+
+//
+// CL_RecordLegacyChunk
+//
+// Takes a chunk from a server without SVCAP_WADACK, which sends the file in
+// order in chunks that need not be whole blocks.  Returns false if it is not
+// the next one, re-requesting the file from got_bytes after a gap.
+//
+static bool CL_RecordLegacyChunk(DWORD offset, size_t len)
+{
 	if (offset < download.got_bytes)
-        return;
-	
+		return false;
+
 	// check for missing packet, re-request
-	if(offset > download.got_bytes)
+	if (offset > download.got_bytes)
 	{
 		DPrintf("Missed a packet after %d bytes (got %d), re-requesting\n", download.got_bytes, offset);
 		MSG_WriteMarker(&net_buffer, clc_wantwad);
@@ -421,19 +744,51 @@ void CL_Download()
 		MSG_WriteString(&net_buffer, download.md5.c_str());
 		MSG_WriteLong(&net_buffer, download.got_bytes);
 		NET_SendPacket(net_buffer, serveraddr);
-		return;
+		return false;
 	}
 
+	download.got_bytes += len;
+	download.received = download.highest = download.got_bytes;
+
+	// keep the block map of the partial file in step
+	size_t last = (download.got_bytes == download.buf->maxsize()) ?
+		download.blocks.size() : download.got_bytes / WAD_BLOCK_SIZE;
+	for (size_t i = offset / WAD_BLOCK_SIZE; i < last; i++)
+		download.blocks[i] = true;
+
+	return true;
+}
+
+//
+// CL_StoreDownloadChunk
+//
+static void CL_StoreDownloadChunk(DWORD offset, const void *p, size_t len)
+{
+	// Reset retransmission timer
+	CL_DownloadTick();
+
+	download.lastchunk = I_GetTime();
+
+	if (CL_WindowedDownload() ? !CL_RecordWindowedChunk(offset, len) :
+								!CL_RecordLegacyChunk(offset, len))
+		return;
+
 	// send keepalive
 	NET_SendPacket(net_buffer, serveraddr);
 
 	// copy into downloaded buffer
 	memcpy(download.buf->ptr() + offset, p, len);
-	download.got_bytes += len;
+
+	if (download.part != NULL)
+	{
+		fseek(download.part, offset, SEEK_SET);
+		fwrite(p, 1, len, download.part);
+		download.mapdirty = true;
+	}
 
 	// calculate percentage for the user
 	static size_t old_percent = 0;
-	size_t percent = (download.got_bytes*100)/download.buf->maxsize();
+	size_t percent = (download.received*100)/download.buf->maxsize();
 	if(percent != old_percent)
 	{
         SetDownloadPercentage(percent);
@@ -446,10 +801,67 @@ void CL_Download()
 	// pause at 100% if the server disconnected you previously, you can
 	// reconnect a couple of times and this will let the checksum system do its
 	// work
-	if(download.got_bytes >= download.buf->maxsize())
+	if(download.received >= download.buf->maxsize())
 	{
+		// let the server know it has everything
+		if (CL_WindowedDownload())
+			CL_SendDownloadAck();
         IntDownloadComplete();
 	}
 }
 
+//
+// CL_Download
+// denis - get a little chunk of the file and store it, much like a hampster. Well, hamster; but hampsters can dance and sing. Also much like Scraps, the Ice Age squirrel thing, stores his acorn. Only with a bit more success. Actually, quite a bit more success, specifically as in that the world doesn't crack apart when we store our chunk and it does when Scraps stores his (or her?) acorn. But when Scraps does it, it is funnier. The rest of Ice Age mostly sucks.
+//
+void CL_Download()
+{
+	DWORD offset = MSG_ReadLong();
+	size_t len = MSG_ReadShort();
+	size_t left = MSG_BytesLeft();
+	void *p = MSG_ReadChunk(len);
+
+	if(gamestate != GS_DOWNLOAD)
+		return;
+
+	if (!CL_CheckDownloadChunk(offset, len, left, len <= left && p != NULL))
+		return;
+
+	CL_StoreDownloadChunk(offset, p, len);
+}
+
+//
+// CL_DownloadCompressed
+//
+// Get a chunk of the file that the server sends precompressed with minilzo
+//
+void CL_DownloadCompressed()
+{
+	static byte data[65536];
+
+	DWORD offset = MSG_ReadLong();
+	size_t len = (unsigned short)MSG_ReadShort();
+	size_t zlen = (unsigned short)MSG_ReadShort();
+	size_t left = MSG_BytesLeft();
+	void *p = MSG_ReadChunk(zlen);
+
+	if(gamestate != GS_DOWNLOAD)
+		return;
+
+	if (!CL_CheckDownloadChunk(offset, len, left, zlen <= left && p != NULL))
+		return;
+
+	lzo_uint newlen = sizeof(data);
+	int r = lzo1x_decompress_safe((lzo_bytep)p, zlen, data, &newlen, NULL);
+
+	// a bad block is left to be asked for again
+	if (r != LZO_E_OK || newlen != len)
+	{
+		DPrintf("Bad compressed download chunk at %u (error %d)\n", (unsigned)offset, r);
+		return;
+	}
+
+	CL_StoreDownloadChunk(offset, data, len);
+}
+
 VERSION_CONTROL (cl_download_cpp, "$Id$")
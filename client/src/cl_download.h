@@ -28,5 +28,6 @@
 void CL_DownloadStart();
 void CL_DownloadTicker();
 void CL_Download();
+void CL_DownloadCompressed();
 
 #endif // __CL_DOWNLOAD__
@@ -94,6 +94,7 @@ extern bool step_mode;
 short version = 0;
 int gameversion = 0;				// GhostlyDeath -- Bigger Game Version
 int gameversiontosend = 0;		// If the server is 0.4, let's fake our client info
+int servercaps = 0;
 
 buf_t     net_buffer(MAX_UDP_PACKET);
 
@@ -917,8 +918,7 @@ BEGIN_COMMAND (serverinfo)
     // Data
 	for (size_t i = 0; i < server_cvars.size(); i++)
 	{
-		cvar_t *dummy;
-		Cvar = cvar_t::FindCVar(server_cvars[i].c_str(), &dummy);
+		Cvar = cvar_t::FindCVar(server_cvars[i].c_str());
 
 		Printf(PRINT_HIGH,
 				"%*s - %s\n",
@@ -1656,6 +1656,9 @@ bool CL_PrepareConnect(void)
     for (i = 0; i < patch_count; ++i)
         newpatchfiles[i] = MSG_ReadString();
 
+	// servers that predate SVCAP_* flags send none
+	servercaps = MSG_BytesLeft() >= 4 ? MSG_ReadLong() : 0;
+
     // TODO: Allow deh/bex file downloads
 	D_DoomWadReboot(newwadfiles, newpatchfiles, newwadhashes);
 
@@ -2247,8 +2250,10 @@ void CL_SpawnMobj()
 
 	if (type == MT_ZDOOMBRIDGE)
 	{
+		mo->UnlinkFromWorld();
 		mo->radius = int(MSG_ReadByte()) << FRACBITS;
 		mo->height = int(MSG_ReadByte()) << FRACBITS;
+		mo->LinkToWorld();
 	}
 }
 
@@ -3054,7 +3059,7 @@ void CL_ReadPacketHeader(void)
 
 void CL_GetServerSettings(void)
 {
-	cvar_t *var = NULL, *prev = NULL;
+	cvar_t *var = NULL;
 
 	// TODO: REMOVE IN 0.7 - We don't need this loop anymore
 	while (MSG_ReadByte() != 2)
@@ -3062,7 +3067,7 @@ void CL_GetServerSettings(void)
 		std::string CvarName = MSG_ReadString();
 		std::string CvarValue = MSG_ReadString();
 
-		var = cvar_t::FindCVar(CvarName.c_str(), &prev);
+		var = cvar_t::FindCVar(CvarName.c_str());
 
 		// GhostlyDeath <June 19, 2008> -- Read CVAR or dump it
 		if (var)
@@ -3618,6 +3623,7 @@ void CL_InitCommands(void)
 
 	cmds[svc_wadinfo]			= &CL_DownloadStart;
 	cmds[svc_wadchunk]			= &CL_Download;
+	cmds[svc_wadzchunk]			= &CL_DownloadCompressed;
 
 	cmds[svc_challenge]			= &CL_Clear;
 	cmds[svc_launcher_challenge]= &CL_Clear;
@@ -3872,9 +3878,7 @@ void CL_LocalDemoTic()
 
 	if(clientPlayer->mo)
 	{
-		clientPlayer->mo->x = x;
-		clientPlayer->mo->y = y;
-		clientPlayer->mo->z = z;
+		clientPlayer->mo->SetOrigin(x, y, z);
 		clientPlayer->mo->momx = momx;
 		clientPlayer->mo->momy = momy;
 		clientPlayer->mo->momz = momz;
@@ -40,6 +40,8 @@ extern int       last_received;
 
 extern buf_t     net_buffer;
 
+extern int       servercaps;	// SVCAP_* flags of the server
+
 extern NetDemo	netdemo;
 
 #define MAXSAVETICS 70
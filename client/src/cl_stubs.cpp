@@ -50,6 +50,7 @@ void SV_SendDamageMobj(AActor *target, int pain) {}
 void SV_CTFEvent(flag_t f, flag_score_t event, player_t &who) {}
 void SV_UpdateFrags(player_t &player) {}
 void SV_ActorTarget(AActor *actor) {}
+void SV_QueueCorpse(AActor *mo) {}
 void SV_SendDestroyActor(AActor *mo) {}
 void SV_ExplodeMissile(AActor *mo) {}
 void SV_SendPlayerInfo(player_t &player) {}
@@ -684,6 +684,7 @@ void STACK_ARGS D_Shutdown()
 	UndoDehPatch();
 
 	// close all open WAD files
+	P_FinishLevelTasks();
 	W_Close();
 
 //	V_UnloadFonts();
@@ -1504,7 +1504,6 @@ void G_LoadGame (char* name)
 
 void G_DoLoadGame (void)
 {
-    unsigned int i;
 	char text[16];
 
 	gameaction = ga_nothing;
@@ -1568,11 +1567,8 @@ void G_DoLoadGame (void)
 	arc >> level.time;
 
 
-	for (i = 0; i < NUM_WORLDVARS; i++)
-		arc >> ACS_WorldVars[i];
-
-	for (i = 0; i < NUM_GLOBALVARS; i++)
-		arc >> ACS_GlobalVars[i];
+	arc.ReadArray(ACS_WorldVars, NUM_WORLDVARS);
+	arc.ReadArray(ACS_GlobalVars, NUM_GLOBALVARS);
 
 	arc >> text[9];
 
@@ -1617,7 +1613,6 @@ void G_DoSaveGame (void)
 {
 	std::string name;
 	char *description;
-	int i;
 
 	G_SnapshotLevel ();
 
@@ -1659,11 +1654,8 @@ void G_DoSaveGame (void)
 
 	arc << level.time;
 
-	for (i = 0; i < NUM_WORLDVARS; i++)
-		arc << ACS_WorldVars[i];
-
-	for (i = 0; i < NUM_GLOBALVARS; i++)
-		arc << ACS_GlobalVars[i];
+	arc.WriteArray(ACS_WorldVars, NUM_WORLDVARS);
+	arc.WriteArray(ACS_GlobalVars, NUM_GLOBALVARS);
 
 
 	arc << (BYTE)0x1d;			// consistancy marker
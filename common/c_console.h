@@ -69,6 +69,16 @@ void C_HideConsole (void);
 void C_AdjustBottom (void);
 void C_FlushDisplay (void);
 
+// Wait until everything printed so far has been written to the log file.
+// Must be called before opening, closing or writing to LOG directly.
+void C_FlushLog (void);
+
+// Close LOG, or reopen it for appending to filename, once everything
+// printed so far has been written to it.  C_OpenLog returns false if the
+// file could not be opened.
+void C_CloseLog (void);
+bool C_OpenLog (const char *filename);
+
 void C_InitTicker (const char *label, unsigned int max);
 void C_SetTicker (unsigned int at);
 
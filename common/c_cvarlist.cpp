@@ -286,5 +286,37 @@ CVAR(				waddirs, "", "Allow custom WAD directories to be specified",
 // Experimental settings (all categories)
 // =======================================
 
+CVAR(				sv_sightcache, "1", "Remember the results of monster sight checks for the rest of " \
+					"the tic, disable to compare against uncached sight checks",
+					CVARTYPE_BOOL, CVAR_ARCHIVE)
+
+CVAR(				sv_sightbatch, "1", "Trace the sight checks monsters are about to make at the " \
+					"start of each tic across all CPU cores (requires sv_sightcache)",
+					CVARTYPE_BOOL, CVAR_ARCHIVE)
+
+CVAR(				sv_ailod, "0", "Let idle monsters far away from every player think less often, " \
+					"or not at all if no player can see them (never used for demos)",
+					CVARTYPE_BOOL, CVAR_ARCHIVE)
+
+CVAR_RANGE(			sv_ailoddist, "2048", "Distance from the nearest player beyond which idle monsters " \
+					"think less often when sv_ailod is enabled",
+					CVARTYPE_INT, CVAR_ARCHIVE | CVAR_NOENABLEDISABLE, 0.0f, 65536.0f)
+
+CVAR_RANGE(			sv_ailodinterval, "4", "Number of tics between thinks for idle monsters far away " \
+					"from every player when sv_ailod is enabled",
+					CVARTYPE_INT, CVAR_ARCHIVE | CVAR_NOENABLEDISABLE, 1.0f, 35.0f)
+
+CVAR(				sv_buildreject, "0", "Build a REJECT table from the map geometry when a map " \
+					"ships an empty one (never used for demos)",
+					CVARTYPE_BOOL, CVAR_ARCHIVE)
+
+CVAR_FUNC_DECL(		sv_acsprofile, "0", "Time every pass through an ACS script and every tic of " \
+					"running scripts, see the acsprofile command",
+					CVARTYPE_BOOL, CVAR_NULL)
+
+CVAR(				wad_hashcache, "1", "Remember the MD5 sums of WAD files by path, size and " \
+					"modification time instead of rehashing them on every WAD change",
+					CVARTYPE_BOOL, CVAR_ARCHIVE)
+
 
 VERSION_CONTROL (c_cvarlist_cpp, "$Id$")
@@ -67,6 +67,63 @@ cvar_t* GetFirstCvar(void)
 	return ad.GetCVars();
 }
 
+// Case-insensitive hash index over the cvar list. Chains run through
+// cvar_t::m_HashNext. Being POD, the table is zero-filled before any cvar
+// constructor runs, regardless of static initialization order.
+#define CVAR_HASH_SIZE 1024
+
+static cvar_t *CVarHash[CVAR_HASH_SIZE];
+
+static unsigned int CVarHashName(const char *name)
+{
+	return HashStringNoCase(name) & (CVAR_HASH_SIZE - 1);
+}
+
+//
+// cvar_t::Link
+//
+// Puts this cvar at the head of the cvar list and of its hash chain, so that
+// it shadows any older cvar of the same name.
+//
+void cvar_t::Link()
+{
+	m_Next = ad.GetCVars();
+	ad.GetCVars() = this;
+
+	cvar_t **bucket = &CVarHash[CVarHashName(m_Name.c_str())];
+	m_HashNext = *bucket;
+	*bucket = this;
+}
+
+//
+// cvar_t::Unlink
+//
+// Removes this cvar from the cvar list and its hash chain. Does nothing if
+// it has already been removed.
+//
+void cvar_t::Unlink()
+{
+	for (cvar_t **link = &ad.GetCVars(); *link; link = &(*link)->m_Next)
+	{
+		if (*link == this)
+		{
+			*link = m_Next;
+			break;
+		}
+	}
+
+	for (cvar_t **link = &CVarHash[CVarHashName(m_Name.c_str())]; *link; link = &(*link)->m_HashNext)
+	{
+		if (*link == this)
+		{
+			*link = m_HashNext;
+			break;
+		}
+	}
+
+	m_Next = m_HashNext = NULL;
+}
+
 int cvar_defflags;
 
 cvar_t::cvar_t(const char* var_name, const char* def, const char* help, cvartype_t type,
@@ -84,8 +141,7 @@ cvar_t::cvar_t(const char* var_name, const char* def, const char* help, cvartype
 void cvar_t::InitSelf(const char* var_name, const char* def, const char* help, cvartype_t type,
 		DWORD var_flags, void (*callback)(cvar_t &), float minval, float maxval)
 {
-	cvar_t* dummy;
-	cvar_t* var = FindCVar(var_name, &dummy);
+	cvar_t* var = FindCVar(var_name);
 
 	m_Callback = callback;
 	m_String = "";
@@ -115,8 +171,7 @@ void cvar_t::InitSelf(const char* var_name, const char* def, const char* help, c
 	{
 		C_AddTabCommand(var_name);
 		m_Name = var_name;
-		m_Next = ad.GetCVars();
-		ad.GetCVars() = this;
+		Link();
 	}
 	else
 		m_Name = "";
@@ -138,19 +193,7 @@ void cvar_t::InitSelf(const char* var_name, const char* def, const char* help, c
 cvar_t::~cvar_t ()
 {
 	if (m_Name.length())
-	{
-		cvar_t *var, *dummy = NULL;
-
-		var = FindCVar (m_Name.c_str(), &dummy);
-
-		if (var == this)
-		{
-			if (dummy)
-				dummy->m_Next = m_Next;
-			else
-				ad.GetCVars() = m_Next;
-		}
-	}
+		Unlink();
 }
 
 void cvar_t::ForceSet(const char* valstr)
@@ -260,10 +303,10 @@ void cvar_t::RestoreDefault ()
 //
 void cvar_t::Transfer(const char *fromname, const char *toname)
 {
-	cvar_t *from, *to, *dummy;
+	cvar_t *from, *to;
 
-	from = FindCVar(fromname, &dummy);
-	to = FindCVar(toname, &dummy);
+	from = FindCVar(fromname);
+	to = FindCVar(toname);
 
 	if (from && to)
 	{
@@ -271,19 +314,15 @@ void cvar_t::Transfer(const char *fromname, const char *toname)
 		to->ForceSet(from->m_String.c_str());
 
 		// remove the old cvar
-		cvar_t *cur = ad.GetCVars();
-		while (cur->m_Next != from)
-			cur = cur->m_Next;
-
-		cur->m_Next = from->m_Next;
+		from->Unlink();
 	}
 }
 
 cvar_t *cvar_t::cvar_set (const char *var_name, const char *val)
 {
-	cvar_t *var, *dummy;
+	cvar_t *var;
 
-	if ( (var = FindCVar (var_name, &dummy)) )
+	if ( (var = FindCVar (var_name)) )
 		var->Set (val);
 
 	return var;
@@ -291,9 +330,9 @@ cvar_t *cvar_t::cvar_set (const char *var_name, const char *val)
 
 cvar_t *cvar_t::cvar_forceset (const char *var_name, const char *val)
 {
-	cvar_t *var, *dummy;
+	cvar_t *var;
 
-	if ( (var = FindCVar (var_name, &dummy)) )
+	if ( (var = FindCVar (var_name)) )
 		var->ForceSet (val);
 
 	return var;
@@ -485,21 +524,17 @@ void cvar_t::C_RestoreCVars (void)
 	UnlatchCVars();
 }
 
-cvar_t *cvar_t::FindCVar (const char *var_name, cvar_t **prev)
+cvar_t *cvar_t::FindCVar (const char *var_name)
 {
-	cvar_t *var;
-
 	if (var_name == NULL)
 		return NULL;
 
-	var = ad.GetCVars();
-	*prev = NULL;
+	cvar_t *var = CVarHash[CVarHashName(var_name)];
 	while (var)
 	{
-		if (iequals(var->m_Name, var_name))
+		if (stricmp(var->m_Name.c_str(), var_name) == 0)
 			break;
-		*prev = var;
-		var = var->m_Next;
+		var = var->m_HashNext;
 	}
 	return var;
 }
@@ -632,9 +667,7 @@ BEGIN_COMMAND (set)
 	}
 	else
 	{
-		cvar_t *var, *prev;
-
-		var = cvar_t::FindCVar (argv[1], &prev);
+		cvar_t *var = cvar_t::FindCVar (argv[1]);
 		if (!var)
 			var = new cvar_t(argv[1], NULL, "", CVARTYPE_NONE,  CVAR_AUTO | CVAR_UNSETTABLE | cvar_defflags);
 
@@ -680,7 +713,6 @@ END_COMMAND (set)
 
 BEGIN_COMMAND (get)
 {
-    cvar_t *prev;
 	cvar_t *var;
 
     if (argc < 2)
@@ -689,7 +721,7 @@ BEGIN_COMMAND (get)
         return;
 	}
 
-    var = cvar_t::FindCVar (argv[1], &prev);
+    var = cvar_t::FindCVar (argv[1]);
 
 	if (var)
 	{
@@ -716,7 +748,6 @@ END_COMMAND (get)
 
 BEGIN_COMMAND (toggle)
 {
-    cvar_t *prev;
 	cvar_t *var;
 
     if (argc < 2)
@@ -725,7 +756,7 @@ BEGIN_COMMAND (toggle)
         return;
 	}
 
-    var = cvar_t::FindCVar (argv[1], &prev);
+    var = cvar_t::FindCVar (argv[1]);
 
 	if (!var)
 	{
@@ -762,7 +793,6 @@ END_COMMAND (cvarlist)
 
 BEGIN_COMMAND (help)
 {
-    cvar_t *prev;
     cvar_t *var;
 
     if (argc < 2)
@@ -771,7 +801,7 @@ BEGIN_COMMAND (help)
         return;
     }
 
-    var = cvar_t::FindCVar (argv[1], &prev);
+    var = cvar_t::FindCVar (argv[1]);
 
     if (!var)
     {
@@ -135,8 +135,8 @@ public:
 	// that might possibly have been changed during the course of demo playback.
 	static void C_RestoreCVars (void);
 
-	// Finds a named cvar
-	static cvar_t *FindCVar (const char *var_name, cvar_t **prev);
+	// Finds a named cvar (case-insensitive hash lookup)
+	static cvar_t *FindCVar (const char *var_name);
 
 	// Called from G_InitNew()
 	static void UnlatchCVars (void);
@@ -173,8 +173,12 @@ private:
 	void InitSelf(const char* name, const char* def, const char* help, cvartype_t,
 				DWORD flags, void (*callback)(cvar_t &), float minval = -FLT_MAX, float maxval = FLT_MAX);
 
+	void Link ();
+	void Unlink ();
+
 	void (*m_Callback)(cvar_t &);
 	cvar_t *m_Next;
+	cvar_t *m_HashNext;
 
     cvartype_t m_Type;
 
@@ -192,7 +196,7 @@ private:
  protected:
 
 	cvar_t () :
-			m_Flags(0), m_Callback(NULL), m_Next(NULL), m_Type(CVARTYPE_NONE), m_Value(0.f),
+			m_Flags(0), m_Callback(NULL), m_Next(NULL), m_HashNext(NULL), m_Type(CVARTYPE_NONE), m_Value(0.f),
 			m_MinValue(-FLT_MAX), m_MaxValue(FLT_MAX)
 	 { }
 };
@@ -127,31 +127,153 @@ int GetActionBit (unsigned int key)
 
 bool safemode = false;
 
-void C_DoCommand (const char *cmd)
+static const char *C_ParseToken (const char *data, char *token);
+
+// Case-insensitive hash index over the command map, so that dispatching a
+// command neither builds a lowercased std::string nor walks the map. Chains
+// run through DConsoleCommand::m_HashNext.
+#define COMMAND_HASH_SIZE 512
+
+static DConsoleCommand *CommandHash[COMMAND_HASH_SIZE];
+
+static unsigned int C_HashCommandName (const char *name)
 {
-	size_t argc, argsize;
-	char **argv;
-	char *args, *arg, *realargs;
-	const char *data;
-	DConsoleCommand *com;
-	int check = -1;
+	return HashStringNoCase(name) & (COMMAND_HASH_SIZE - 1);
+}
+
+DConsoleCommand *DConsoleCommand::FindCommand (const char *name)
+{
+	DConsoleCommand *com = CommandHash[C_HashCommandName(name)];
+	while (com)
+	{
+		if (stricmp(com->m_Name.c_str(), name) == 0)
+			break;
+		com = com->m_HashNext;
+	}
+	return com;
+}
+
+//
+// DConsoleCommand::Link
+//
+// Adds this command to the hash index, replacing any command of the same
+// name the way the assignment into Commands() does.
+//
+void DConsoleCommand::Link ()
+{
+	DConsoleCommand *old = FindCommand(m_Name.c_str());
+	if (old)
+		old->Unlink();
+
+	DConsoleCommand **bucket = &CommandHash[C_HashCommandName(m_Name.c_str())];
+	m_HashNext = *bucket;
+	*bucket = this;
+}
+
+void DConsoleCommand::Unlink ()
+{
+	DConsoleCommand **link = &CommandHash[C_HashCommandName(m_Name.c_str())];
+	for (; *link; link = &(*link)->m_HashNext)
+	{
+		if (*link == this)
+		{
+			*link = m_HashNext;
+			break;
+		}
+	}
+	m_HashNext = NULL;
+}
+
+// Scratch space for C_DoCommand.  Commands can run further commands (exec,
+// alias, if), so there is one frame per nesting level.  Frames are kept for
+// reuse, which means that once they have grown to fit the longest command
+// seen, dispatching a command allocates nothing.
+struct cmdframe_t
+{
+	std::vector<char> line;			// copy of the command text
+	std::vector<char> tokens;		// NUL-terminated tokens, back to back
+	std::vector<size_t> offsets;	// start of each token in tokens
+	std::vector<char *> argv;		// argv[0] is left free, see below
+};
+
+static std::vector<cmdframe_t *> cmdframes;
+static size_t cmddepth;
+
+class cmddepth_guard
+{
+public:
+	cmddepth_guard() { cmddepth++; }
+	~cmddepth_guard() { cmddepth--; }
+};
+
+void C_DoCommand (const char *cmd, size_t length)
+{
+	if (cmddepth == cmdframes.size())
+		cmdframes.push_back(new cmdframe_t);
+
+	cmdframe_t &frame = *cmdframes[cmddepth];
+	cmddepth_guard guard;
 
-	data = ParseString (cmd);
-	if (!data)
+	frame.line.assign(cmd, cmd + length);
+	frame.line.push_back(0);
+
+	char *line = &frame.line[0];
+	const char *data = line;
+	size_t restoffset = length;
+	size_t used = 0;
+
+	// Tokenize the command in a single pass.  A token is never longer than
+	// the text it was parsed from, unless it is a $<cvar> substitution.
+	frame.offsets.clear();
+	while (true)
+	{
+		size_t remaining = length - (data - line) + 1;
+		if (frame.tokens.size() < used + remaining)
+			frame.tokens.resize(used + remaining);
+
+		data = C_ParseToken(data, &frame.tokens[used]);
+		if (!data)
+			break;
+
+		size_t toklen = strlen(&frame.tokens[used]);
+
+		if (frame.tokens[used] == '$')
+		{
+			cvar_t *var = cvar_t::FindCVar(&frame.tokens[used + 1]);
+			if (var)
+			{
+				toklen = strlen(var->cstring());
+				if (frame.tokens.size() < used + toklen + 1)
+					frame.tokens.resize(used + toklen + 1);
+				memcpy(&frame.tokens[used], var->cstring(), toklen + 1);
+			}
+		}
+
+		if (frame.offsets.empty())
+			restoffset = data - line;
+
+		frame.offsets.push_back(used);
+		used += toklen + 1;
+	}
+
+	if (frame.offsets.empty())
 		return;
 
+	const char *first = &frame.tokens[0];
+	int check = -1;
+
 	// Check if this is an action
-	if (*com_token == '+')
+	if (*first == '+')
 	{
-		check = GetActionBit (MakeKey (com_token + 1));
+		check = GetActionBit (MakeKey (first + 1));
 		//if (Actions[check] < 255)
 		//	Actions[check]++;
 		if (check != -1)
 			Actions[check] = 1;
 	}
-	else if (*com_token == '-')
+	else if (*first == '-')
 	{
-		check = GetActionBit (MakeKey (com_token + 1));
+		check = GetActionBit (MakeKey (first + 1));
 		//if (Actions[check])
 		//	Actions[check]--;
 		if (check != -1)
@@ -161,106 +283,79 @@ void C_DoCommand (const char *cmd)
 			AddCommandString ("centerview");
 	}
 
-	// Check if this is a normal command
-	if (check == -1)
-	{
-		argc = 1;
-		argsize = strlen (com_token) + 1;
+	if (check != -1)
+		return;
 
-		realargs = new char[strlen (data) + 1];
-		strcpy (realargs, data);
+	// Check if this is a normal command
+	size_t argc = frame.offsets.size();
 
-		while ( (data = ParseString (data)) )
-		{
-			argc++;
-			argsize += strlen (com_token) + 1;
-		}
+	// argv[0] is reserved so that a cvar name used as a command can be
+	// handed to set or get as argv[1] without copying the arguments.
+	frame.argv.resize(argc + 1);
+	frame.argv[0] = NULL;
+	for (size_t i = 0; i < argc; i++)
+		frame.argv[i + 1] = &frame.tokens[frame.offsets[i]];
 
-		args = new char[argsize];
-		argv = new char *[argc];
+	char **argv = &frame.argv[1];
+	char *realargs = line + restoffset;
+	DConsoleCommand *com;
 
-		arg = args;
-		data = cmd;
-		argsize = 0;
-		while ( (data = ParseString (data)) )
+	// Checking for matching commands follows this search order:
+	//	1. Check the Commands map
+	//	2. Check the CVars list
+	if ( (com = DConsoleCommand::FindCommand (argv[0])) )
+	{
+		if(safemode
+		&& stricmp(argv[0], "if")!=0
+		&& stricmp(argv[0], "exec")!=0)
 		{
-			strcpy (arg, com_token);
-			argv[argsize] = arg;
-			arg += strlen (arg);
-			*arg++ = 0;
-			argsize++;
+			Printf (PRINT_HIGH, "Not a cvar command \"%s\"\n", argv[0]);
+			return;
 		}
+	}
+	else if (cvar_t::FindCVar (argv[0]))
+	{
+		// Hand a cvar name used as a command to set or get
+		const char *redirect = argc >= 2 ? "set" : "get";
 
-		// Checking for matching commands follows this search order:
-		//	1. Check the Commands map
-		//	2. Check the CVars list
-		command_map_t::iterator c = Commands().find(StdStringToLower(argv[0]));
-
-		if (c != Commands().end())
+		if ( !(com = DConsoleCommand::FindCommand (redirect)) )
 		{
-			com = c->second;
-
-			if(!safemode
-			|| stricmp(argv[0], "if")==0
-			|| stricmp(argv[0], "exec")==0)
-			{
-				com->argc = argc;
-				com->argv = argv;
-				com->args = realargs;
-				com->m_Instigator = consoleplayer().mo;
-				com->Run ();
-			}
-			else
-			{
-				Printf (PRINT_HIGH, "Not a cvar command \"%s\"\n", argv[0]);
-			}
+			Printf(PRINT_HIGH, "%s command not found\n", redirect);
+			return;
 		}
-		else
-		{
-			// Check for any CVars that match the command
-			cvar_t *var, *dummy;
 
-			if ( (var = cvar_t::FindCVar (argv[0], &dummy)) )
-			{
-				if (argc >= 2)
-				{
-					c = Commands().find("set");
-					if (c != Commands().end())
-					{
-						com = c->second;
-						com->argc = argc + 1;
-						com->argv = argv - 1;	// Hack
-						com->m_Instigator = consoleplayer().mo;
-						com->Run();
-					}
-					else
-						Printf(PRINT_HIGH, "set command not found\n");
-				}
-				else
-				{
-					c = Commands().find("get");
-					if (c != Commands().end())
-					{
-						com = c->second;
-						com->argc = argc + 1;
-						com->argv = argv - 1;	// Hack
-						com->m_Instigator = consoleplayer().mo;
-						com->Run();
-					}
-					else
-						Printf(PRINT_HIGH, "get command not found\n");
-				}
-			}
-			else
-			{
-				// We don't know how to handle this command
-				Printf (PRINT_HIGH, "Unknown command \"%s\"\n", argv[0]);
-			}
-		}
-		delete[] argv;
-		delete[] args;
-		delete[] realargs;
+		argv[-1] = const_cast<char *>(redirect);
+		argv--;
+		argc++;
+	}
+	else
+	{
+		// We don't know how to handle this command
+		Printf (PRINT_HIGH, "Unknown command \"%s\"\n", argv[0]);
+		return;
 	}
+
+	// A command may run itself again through AddCommandString, so put its
+	// arguments back once it returns rather than leave it pointing at the
+	// frame of the nested call.
+	size_t oldargc = com->argc;
+	char **oldargv = com->argv;
+	char *oldargs = com->args;
+
+	com->argc = argc;
+	com->argv = argv;
+	com->args = realargs;
+	com->m_Instigator = consoleplayer().mo;
+	com->Run ();
+
+	com->argc = oldargc;
+	com->argv = oldargv;
+	com->args = oldargs;
+}
+
+void C_DoCommand (const char *cmd)
+{
+	C_DoCommand(cmd, strlen(cmd));
 }
 
 void AddCommandString(const std::string &str, bool onlycvars)
@@ -273,9 +368,6 @@ void AddCommandString(const std::string &str, bool onlycvars)
 	const char* cstart = str.c_str();
 	const char* cend;
 
-	// stores a copy of the current substring
-	char* command = new char[totallen + 1];
-
 	// scan for a command ending
 	while (*cstart)
 	{
@@ -330,11 +422,7 @@ void AddCommandString(const std::string &str, bool onlycvars)
 		while (cend > cstart && *cend == ' ')
 			cend--;
 
-		size_t clength = cend - cstart + 1;
-		memcpy(command, cstart, clength);
-		command[clength] = '\0';
-
-		C_DoCommand(command);
+		C_DoCommand(cstart, cend - cstart + 1);
 
 		if (onlycvars)
 			safemode = false;
@@ -349,8 +437,6 @@ void AddCommandString(const std::string &str, bool onlycvars)
 		else
 			cstart = cp;
 	}
-
-	delete[] command;
 }
 
 #define MAX_EXEC_DEPTH 32
@@ -447,8 +533,7 @@ BEGIN_COMMAND (if)
 	if (argc < 4)
 		return;
 
-	cvar_t *var, *dummy;
-	var = cvar_t::FindCVar (argv[1], &dummy);
+	cvar_t *var = cvar_t::FindCVar (argv[1]);
 
 	if (!var)
 	{
@@ -487,14 +572,16 @@ bool ValidEscape(char data)
 	return (data == '"' || data == ';' || data == '\\');
 }
 
-// ParseString2 is adapted from COM_Parse
-// found in the Quake2 source distribution
-const char *ParseString2(const char *data)
+// C_ParseToken is adapted from COM_Parse
+// found in the Quake2 source distribution.
+// It copies the first token of data into token, which must have room for
+// the rest of data, and returns what is left to parse.
+static const char *C_ParseToken(const char *data, char *token)
 {
 	int len;
 
 	len = 0;
-	com_token[0] = 0;
+	token[0] = 0;
 
 	// Skip whitespace.
 	while (*data <= ' ')
@@ -515,7 +602,7 @@ const char *ParseString2(const char *data)
 	if (data[0] == '\\' && ValidEscape(data[1]))
 	{
 		// [AM] Handle escaped chars.
-		com_token[len] = data[1];
+		token[len] = data[1];
 		data += 2;
 		len++;
 	}
@@ -532,7 +619,7 @@ const char *ParseString2(const char *data)
 			if (data[0] == '\\' && ValidEscape(data[1]))
 			{
 				// [AM] Handle escaped chars.
-				com_token[len] = data[1];
+				token[len] = data[1];
 				data++; // Skip one _additional_ char.
 				len++;
 				continue;
@@ -540,12 +627,12 @@ const char *ParseString2(const char *data)
 			else if (*data == '"')
 			{
 				// Closing quote, that's the entire token.
-				com_token[len] = 0;
+				token[len] = 0;
 				data++; // Skip the closing quote.
 				return data;
 			}
 			// None of the above, copy the char and continue.
-			com_token[len] = *data;
+			token[len] = *data;
 			len++;
 		}
 	}
@@ -560,7 +647,7 @@ const char *ParseString2(const char *data)
 		if (data[0] == '\\' && ValidEscape(data[1]))
 		{
 			// [AM] Handle escaped chars.
-			com_token[len] = data[1];
+			token[len] = data[1];
 			data += 2; // Skip two chars.
 			len++;
 			continue;
@@ -571,29 +658,35 @@ const char *ParseString2(const char *data)
 			break;
 		}
 		// None of the above, copy the char and continue.
-		com_token[len] = *data;
+		token[len] = *data;
 		data++;
 		len++;
 	}
 	// We're done, cap the token with a null and
 	// return the remaining data to parse.
-	com_token[len] = 0;
+	token[len] = 0;
 	return data;
 }
 
+// ParseString2 parses the first token of data into com_token
+const char *ParseString2(const char *data)
+{
+	return C_ParseToken(data, com_token);
+}
+
 // ParseString calls ParseString2 to remove the first
 // token from an input string. If this token is of
 // the form $<cvar>, it will be replaced by the
 // contents of <cvar>.
 const char *ParseString (const char *data)
 {
-	cvar_t *var, *dummy;
+	cvar_t *var;
 
 	if ( (data = ParseString2 (data)) )
 	{
 		if (com_token[0] == '$')
 		{
-			if ( (var = cvar_t::FindCVar (&com_token[1], &dummy)) )
+			if ( (var = cvar_t::FindCVar (&com_token[1])) )
 			{
 				strcpy (com_token, var->cstring());
 			}
@@ -625,13 +718,19 @@ DConsoleCommand::DConsoleCommand (const char *name)
 	}
 
 	m_Name = name;
+	m_Instigator = NULL;
+	argc = 0;
+	argv = NULL;
+	args = NULL;
 
 	Commands()[name] = this;
+	Link();
 	C_AddTabCommand(name);
 }
 
 DConsoleCommand::~DConsoleCommand ()
 {
+	Unlink();
 	C_RemoveTabCommand (m_Name.c_str());
 }
 
@@ -922,19 +1021,16 @@ BEGIN_COMMAND (logfile)
     	time (&rawtime);
     	timeinfo = localtime (&rawtime);
     	Printf (PRINT_HIGH, "Log file %s closed on %s\n", LOG_FILE, asctime (timeinfo));
-		LOG.close();
+		C_CloseLog();
 	}
 
 	LOG_FILE = (argc > 1 ? argv[1] : DEFAULT_LOG_FILE);
-	LOG.open (LOG_FILE, std::ios::app);
 
-	if (!LOG.is_open())
+	if (!C_OpenLog (LOG_FILE))
 		Printf (PRINT_HIGH, "Unable to create logfile: %s\n", LOG_FILE);
 	else {
 		time (&rawtime);
     	timeinfo = localtime (&rawtime);
-    	LOG.flush();
-    	LOG << std::endl;
 		Printf (PRINT_HIGH, "Logging in file %s started %s\n", LOG_FILE, asctime (timeinfo));
     }
 }
@@ -949,7 +1045,7 @@ BEGIN_COMMAND (stoplog)
 		time (&rawtime);
     	timeinfo = localtime (&rawtime);
 		Printf (PRINT_HIGH, "Logging to file %s stopped %s\n", LOG_FILE, asctime (timeinfo));
-		LOG.close();
+		C_CloseLog();
 	}
 }
 END_COMMAND (stoplog)
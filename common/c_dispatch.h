@@ -36,6 +36,10 @@ void C_ExecCmdLineParams (bool onlyset, bool onlylogfile);
 // for map changing, etc
 void AddCommandString (const std::string &cmd, bool onlycvar = false);
 
+// execute a single command, without splitting it at semicolons
+void C_DoCommand (const char *cmd);
+void C_DoCommand (const char *cmd, size_t length);
+
 // parse a command string
 const char *ParseString (const char *data);
 
@@ -56,6 +60,9 @@ public:
 	virtual bool IsAlias () { return false; }
 	void PrintCommand () { Printf (PRINT_HIGH, "%s\n", m_Name.c_str()); }
 
+	// Finds a command or alias by name (case-insensitive hash lookup)
+	static DConsoleCommand *FindCommand (const char *name);
+
 	std::string m_Name;
 
 protected:
@@ -66,7 +73,13 @@ protected:
 	char **argv;
 	char *args;
 
-	friend void C_DoCommand (const char *cmd);
+	friend void C_DoCommand (const char *cmd, size_t length);
+
+private:
+	void Link ();
+	void Unlink ();
+
+	DConsoleCommand *m_HashNext;
 };
 
 #define BEGIN_COMMAND(n) \
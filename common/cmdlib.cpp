@@ -748,5 +748,22 @@ uint32_t Log2(uint32_t n)
 		return (t = (n >> 8)) ? 8 + LogTable256[t] : LogTable256[n];
 }
 
+//
+// HashStringNoCase
+//
+// 32-bit FNV-1a hash of a string with every letter lowercased, for hash
+// tables of case-insensitive names.
+//
+uint32_t HashStringNoCase(const char *str)
+{
+	uint32_t hash = 2166136261u;
+	while (*str)
+	{
+		hash ^= (unsigned char)tolower(*str++);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
 
 VERSION_CONTROL (cmdlib_cpp, "$Id$")
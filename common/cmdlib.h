@@ -105,5 +105,6 @@ void StripColorCodes(std::string& str);
 
 uint32_t CRC32(const uint8_t* buf, uint32_t len);
 uint32_t Log2(uint32_t n);
+uint32_t HashStringNoCase(const char *str);
 
 #endif
@@ -668,7 +668,7 @@ std::string D_CleanseFileName(const std::string &filename, const std::string &ex
 // found and matches the supplied hash (or the hash was empty). An empty
 // string is returned if no matching file is found.
 //
-static std::string D_FindResourceFile(const std::string& filename, const std::string& hash = "")
+std::string D_FindResourceFile(const std::string& filename, const std::string& hash)
 {
 	// was a path to the file supplied?
 	std::string dir;
@@ -71,6 +71,7 @@ extern const char *D_DrawIcon;
 void D_AddSearchDir(std::vector<std::string> &dirs, const char *dir, const char separator);
 void D_DoDefDehackedPatch (const std::vector<std::string> &patch_files = std::vector<std::string>());
 std::string D_CleanseFileName(const std::string &filename, const std::string &ext = "");
+std::string D_FindResourceFile(const std::string &filename, const std::string &hash = "");
 
 extern std::vector<std::string> wadfiles, wadhashes;
 extern std::vector<std::string> patchfiles, patchhashes;
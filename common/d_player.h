@@ -385,7 +385,56 @@ typedef player_s player_t;
 typedef player_t::client_t client_t;
 
 // Bookkeeping on players - state.
-typedef std::list<player_t> Players;
+//
+// Players
+//
+// The list of players. A player_t never moves once it has been added, so
+// references to it stay good until it is erased. Players are also indexed
+// by id for idplayer(). Since ids are assigned after a player is added,
+// the index is a cache: every hit is checked against player_t::id and a
+// miss falls back to searching the list, filling in the index.
+//
+class Players
+{
+public:
+	typedef std::list<player_t>					list_type;
+	typedef list_type::iterator					iterator;
+	typedef list_type::const_iterator			const_iterator;
+	typedef list_type::reverse_iterator			reverse_iterator;
+	typedef list_type::const_reverse_iterator	const_reverse_iterator;
+	typedef list_type::size_type				size_type;
+
+	Players()									{ ClearIndex(); }
+
+	iterator begin()							{ return list.begin(); }
+	const_iterator begin() const				{ return list.begin(); }
+	iterator end()								{ return list.end(); }
+	const_iterator end() const					{ return list.end(); }
+	reverse_iterator rbegin()					{ return list.rbegin(); }
+	const_reverse_iterator rbegin() const		{ return list.rbegin(); }
+	reverse_iterator rend()						{ return list.rend(); }
+	const_reverse_iterator rend() const			{ return list.rend(); }
+
+	size_type size() const						{ return list.size(); }
+	bool empty() const							{ return list.empty(); }
+	player_t &front()							{ return list.front(); }
+	player_t &back()							{ return list.back(); }
+
+	void push_back(const player_t &player)		{ list.push_back(player); }
+	iterator erase(iterator it);
+	void clear()								{ list.clear(); ClearIndex(); }
+	void resize(size_type count)				{ list.resize(count); ClearIndex(); }
+
+	// returns NULL if there is no player with the given id
+	player_t *find(byte id);
+
+private:
+	void ClearIndex();
+
+	list_type	list;
+	player_t	*byid[256];
+};
+
 extern Players players;
 
 // Player taking events, and displaying.
@@ -243,6 +243,11 @@ unsigned int FLZOFile::Tell() const
 	return m_Pos;
 }
 
+unsigned int FLZOFile::BytesLeft() const
+{
+	return (m_Mode == EReading && m_Pos < m_BufferSize) ? m_BufferSize - m_Pos : 0;
+}
+
 FFile& FLZOFile::Seek(int pos, ESeekPos ofs)
 {
 	if (ofs == ESeekRelative)
@@ -345,15 +350,17 @@ void FLZOFile::Explode()
 	}
 }
 
-FLZOMemFile::FLZOMemFile() :
+FLZOMemFile::FLZOMemFile(bool dontcompress) :
 	FLZOFile()
 {
+	m_NoCompress = dontcompress;
 	m_SourceFromMem = false;
 	m_ImplodedBuffer = NULL;
 }
 
 FLZOMemFile::~FLZOMemFile()
 {
+	M_Free(m_ImplodedBuffer);
 }
 
 bool FLZOMemFile::Open(const char* name, EOpenMode mode)
@@ -506,6 +513,7 @@ FArchive::FArchive(FFile& file)
 	m_File = &file;
 	m_MaxObjectCount = m_ObjectCount = 0;
 	m_ObjectMap = NULL;
+	m_BufferPos = m_BufferLen = 0;
 
 	if (file.Mode() == FFile::EReading)
 	{
@@ -548,23 +556,138 @@ FArchive::~FArchive()
 
 void FArchive::Write(const void* mem, unsigned int len)
 {
-	m_File->Write(mem, len);
+	if (!m_Storing)
+	{
+		m_File->Write(mem, len);	// let the file report the error
+		return;
+	}
+
+	if (m_BufferPos + len <= EBufferSize)
+	{
+		memcpy(m_Buffer + m_BufferPos, mem, len);
+		m_BufferPos += len;
+		return;
+	}
+
+	FlushBuffer();
+
+	if (len >= EBufferSize)
+	{
+		m_File->Write(mem, len);
+	}
+	else
+	{
+		memcpy(m_Buffer, mem, len);
+		m_BufferPos = len;
+	}
 }
 
 void FArchive::Read(void* mem, unsigned int len)
 {
-	m_File->Read(mem, len);
+	if (m_Storing)
+	{
+		m_File->Read(mem, len);		// let the file report the error
+		return;
+	}
+
+	unsigned int avail = m_BufferLen - m_BufferPos;
+	if (len <= avail)
+	{
+		memcpy(mem, m_Buffer + m_BufferPos, len);
+		m_BufferPos += len;
+		return;
+	}
+
+	memcpy(mem, m_Buffer + m_BufferPos, avail);
+	mem = (byte*)mem + avail;
+	len -= avail;
+	m_BufferPos = m_BufferLen = 0;
+
+	unsigned int ahead = m_File->BytesLeft();
+	if (ahead > EBufferSize)
+		ahead = EBufferSize;
+
+	// Large reads, reads the file cannot satisfy (so that it reports the
+	// error) and files that do not support reading ahead go straight to it.
+	if (len >= EBufferSize || ahead < len)
+	{
+		m_File->Read(mem, len);
+		return;
+	}
+
+	m_File->Read(m_Buffer, ahead);
+	m_BufferLen = ahead;
+
+	memcpy(mem, m_Buffer, len);
+	m_BufferPos = len;
+}
+
+//
+// FlushBuffer
+//
+// Hands any staged bytes to the file when storing.  When loading, the
+// file is moved back over bytes that were read ahead but not used, so
+// that it is left where the archive stopped reading.
+//
+void FArchive::FlushBuffer()
+{
+	if (m_Storing)
+	{
+		if (m_BufferPos)
+			m_File->Write(m_Buffer, m_BufferPos);
+	}
+	else if (m_BufferLen > m_BufferPos)
+	{
+		m_File->Seek(-(int)(m_BufferLen - m_BufferPos), FFile::ESeekRelative);
+	}
+
+	m_BufferPos = m_BufferLen = 0;
 }
 
 void FArchive::Close()
 {
 	if (m_File)
 	{
+		FlushBuffer();
 		m_File->Close();
 		m_File = NULL;
 	}
 }
 
+void FArchive::WriteArray(const WORD* values, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++)
+	{
+		WORD w = values[i];
+		SWAP_WORD(w);
+		PutBytes(&w, sizeof(WORD));
+	}
+}
+
+void FArchive::WriteArray(const DWORD* values, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++)
+	{
+		DWORD w = values[i];
+		SWAP_DWORD(w);
+		PutBytes(&w, sizeof(DWORD));
+	}
+}
+
+void FArchive::ReadArray(WORD* values, unsigned int count)
+{
+	Read(values, count * sizeof(WORD));
+	for (unsigned int i = 0; i < count; i++)
+		SWAP_WORD(values[i]);
+}
+
+void FArchive::ReadArray(DWORD* values, unsigned int count)
+{
+	Read(values, count * sizeof(DWORD));
+	for (unsigned int i = 0; i < count; i++)
+		SWAP_DWORD(values[i]);
+}
+
 void FArchive::WriteCount(DWORD count)
 {
 	do
@@ -572,7 +695,7 @@ void FArchive::WriteCount(DWORD count)
 		byte out = count & 0x7f;
 		if (count >= 0x80)
 			out |= 0x80;
-		Write(&out, sizeof(byte));
+		PutBytes(&out, sizeof(byte));
 		count >>= 7;
 	} while (count);
 
@@ -586,7 +709,7 @@ DWORD FArchive::ReadCount()
 
 	do
 	{
-		Read(&in, sizeof(BYTE));
+		GetBytes(&in, sizeof(BYTE));
 		count |= (in & 0x7f) << ofs;
 		ofs += 7;
 	} while (in & 0x80);
@@ -628,26 +751,26 @@ FArchive &FArchive::operator>> (std::string &s)
 
 FArchive &FArchive::operator<< (BYTE c)
 {
-	Write (&c, sizeof(BYTE));
+	PutBytes (&c, sizeof(BYTE));
 	return *this;
 }
 
 FArchive &FArchive::operator>> (BYTE &c)
 {
-	Read (&c, sizeof(BYTE));
+	GetBytes (&c, sizeof(BYTE));
 	return *this;
 }
 
 FArchive &FArchive::operator<< (WORD w)
 {
 	SWAP_WORD(w);
-	Write (&w, sizeof(WORD));
+	PutBytes (&w, sizeof(WORD));
 	return *this;
 }
 
 FArchive &FArchive::operator>> (WORD &w)
 {
-	Read (&w, sizeof(WORD));
+	GetBytes (&w, sizeof(WORD));
 	SWAP_WORD(w);
 	return *this;
 }
@@ -655,13 +778,13 @@ FArchive &FArchive::operator>> (WORD &w)
 FArchive &FArchive::operator<< (DWORD w)
 {
 	SWAP_DWORD(w);
-	Write (&w, sizeof(DWORD));
+	PutBytes (&w, sizeof(DWORD));
 	return *this;
 }
 
 FArchive &FArchive::operator>> (DWORD &w)
 {
-	Read (&w, sizeof(DWORD));
+	GetBytes (&w, sizeof(DWORD));
 	SWAP_DWORD(w);
 	return *this;
 }
@@ -669,13 +792,13 @@ FArchive &FArchive::operator>> (DWORD &w)
 FArchive &FArchive::operator<< (QWORD w)
 {
 	SWAP_QWORD(w);
-	Write (&w, sizeof(QWORD));
+	PutBytes (&w, sizeof(QWORD));
 	return *this;
 }
 
 FArchive &FArchive::operator>> (QWORD &w)
 {
-	Read (&w, sizeof(QWORD));
+	GetBytes (&w, sizeof(QWORD));
 	SWAP_QWORD(w);
 	return *this;
 }
@@ -683,13 +806,13 @@ FArchive &FArchive::operator>> (QWORD &w)
 FArchive &FArchive::operator<< (float w)
 {
 	SWAP_SIZE(&w, sizeof(float));
-	Write (&w, sizeof(float));
+	PutBytes (&w, sizeof(float));
 	return *this;
 }
 
 FArchive &FArchive::operator>> (float &w)
 {
-	Read (&w, sizeof(float));
+	GetBytes (&w, sizeof(float));
 	SWAP_SIZE(&w, sizeof(float));
 	return *this;
 }
@@ -697,35 +820,29 @@ FArchive &FArchive::operator>> (float &w)
 FArchive &FArchive::operator<< (double w)
 {
 	SWAP_SIZE(&w, sizeof(double));
-	Write (&w, sizeof(double));
+	PutBytes (&w, sizeof(double));
 	return *this;
 }
 
 FArchive &FArchive::operator>> (double &w)
 {
-	Read (&w, sizeof(double));
+	GetBytes (&w, sizeof(double));
 	SWAP_SIZE(&w, sizeof(double));
 	return *this;
 }
 
 FArchive& FArchive::operator<< (argb_t color)
 {
-	byte a = color.geta(), r = color.getr(), g = color.getg(), b = color.getb();
-	Write(&b, 1);
-	Write(&g, 1);
-	Write(&r, 1);
-	Write(&a, 1);
+	byte bgra[4] = { color.getb(), color.getg(), color.getr(), color.geta() };
+	PutBytes(bgra, 4);
 	return *this;
 }
 
 FArchive& FArchive::operator>> (argb_t& color)
 {
-	byte a, r, g, b;
-	Read(&b, 1);
-	Read(&g, 1);
-	Read(&r, 1);
-	Read(&a, 1);
-	color = argb_t(a, r, g, b);
+	byte bgra[4];
+	GetBytes(bgra, 4);
+	color = argb_t(bgra[3], bgra[2], bgra[1], bgra[0]);
 	return *this;
 }
 
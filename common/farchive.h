@@ -29,6 +29,7 @@
 #include "dobject.h"
 
 #include <string>
+#include <cstring>
 
 class DObject;
 
@@ -64,6 +65,10 @@ public:
 	virtual	unsigned int Tell() const = 0;
 	virtual	FFile& Seek(int, ESeekPos) = 0;
 	inline	FFile& Seek(unsigned int i, ESeekPos p) { return Seek((int)i, p); }
+
+	// Number of bytes that can still be read, used by FArchive to read
+	// ahead.  Files that cannot tell return 0 and are read unbuffered.
+	virtual unsigned int BytesLeft() const { return 0; }
 };
 
 class FLZOFile : public FFile
@@ -85,6 +90,7 @@ public:
 	virtual FFile& Read(void*, unsigned int);
 	virtual unsigned int Tell() const;
 	virtual FFile& Seek(int, ESeekPos);
+	virtual unsigned int BytesLeft() const;
 
 protected:
 	unsigned int m_Pos;
@@ -107,7 +113,7 @@ private:
 class FLZOMemFile : public FLZOFile
 {
 public:
-	FLZOMemFile();
+	FLZOMemFile(bool dontcompress = false);
 
 	virtual ~FLZOMemFile();
 
@@ -151,6 +157,24 @@ public:
 	void WriteCount(DWORD count);
 	DWORD ReadCount();
 
+	// Bulk versions of operator<< and >> for arrays of values.
+	void WriteArray(const BYTE* values, unsigned int count) { Write(values, count); }
+	void WriteArray(const WORD* values, unsigned int count);
+	void WriteArray(const DWORD* values, unsigned int count);
+	void ReadArray(BYTE* values, unsigned int count) { Read(values, count); }
+	void ReadArray(WORD* values, unsigned int count);
+	void ReadArray(DWORD* values, unsigned int count);
+
+	inline void WriteArray(const SWORD* values, unsigned int count) { WriteArray((const WORD*)values, count); }
+	inline void WriteArray(const SDWORD* values, unsigned int count) { WriteArray((const DWORD*)values, count); }
+	inline void ReadArray(SWORD* values, unsigned int count) { ReadArray((WORD*)values, count); }
+	inline void ReadArray(SDWORD* values, unsigned int count) { ReadArray((DWORD*)values, count); }
+
+	#ifdef _WIN32
+	inline void WriteArray(const int* values, unsigned int count) { WriteArray((const DWORD*)values, count); }
+	inline void ReadArray(int* values, unsigned int count) { ReadArray((DWORD*)values, count); }
+	#endif
+
 	FArchive& operator<< (BYTE c);
 	FArchive& operator<< (WORD s);
 	FArchive& operator<< (DWORD i);
@@ -203,6 +227,34 @@ public:
 protected:
 	enum { EObjectHashSize = 137 };
 
+	// Primitives are staged in m_Buffer and handed to the file a chunk at
+	// a time, rather than with a virtual FFile call for every value.
+	enum { EBufferSize = 4096 };
+
+	inline void PutBytes(const void* mem, unsigned int len)
+	{
+		if (m_Storing && m_BufferPos + len <= EBufferSize)
+		{
+			memcpy(m_Buffer + m_BufferPos, mem, len);
+			m_BufferPos += len;
+		}
+		else
+			Write(mem, len);
+	}
+
+	inline void GetBytes(void* mem, unsigned int len)
+	{
+		if (m_BufferPos + len <= m_BufferLen)
+		{
+			memcpy(mem, m_Buffer + m_BufferPos, len);
+			m_BufferPos += len;
+		}
+		else
+			Read(mem, len);
+	}
+
+	void FlushBuffer();
+
 	DWORD FindObjectIndex(const DObject* obj) const;
 	DWORD MapObject(const DObject* obj);
 	DWORD WriteClass(const TypeInfo* info);
@@ -235,6 +287,10 @@ protected:
 	} *m_ObjectMap;
 	size_t m_ObjectHash[EObjectHashSize];
 
+	byte m_Buffer[EBufferSize];
+	unsigned int m_BufferPos;	// bytes waiting to be written, or the next byte to read
+	unsigned int m_BufferLen;	// bytes read ahead into m_Buffer
+
 private:
 	FArchive(const FArchive &src) {}
 	void operator= (const FArchive &src) {}
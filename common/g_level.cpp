@@ -887,8 +887,7 @@ void G_SerializeLevel(FArchive &arc, bool hubLoad, bool noStorePlayers)
 
 		G_AirControlChanged();
 
-		for (int i = 0; i < NUM_MAPVARS; i++)
-			arc << level.vars[i];
+		arc.WriteArray(level.vars, NUM_MAPVARS);
 
 		if (!noStorePlayers)
 			arc << playernum;
@@ -906,8 +905,7 @@ void G_SerializeLevel(FArchive &arc, bool hubLoad, bool noStorePlayers)
 
 		G_AirControlChanged();
 
-		for (int i = 0; i < NUM_MAPVARS; i++)
-			arc >> level.vars[i];
+		arc.ReadArray(level.vars, NUM_MAPVARS);
 
 		if (!noStorePlayers)
 		{
@@ -925,12 +923,13 @@ void G_SerializeLevel(FArchive &arc, bool hubLoad, bool noStorePlayers)
 	P_SerializeSounds(arc);
 }
 
-// Archives the current level
-void G_SnapshotLevel ()
+// Archives the current level.  An uncompressed snapshot is used by netdemos
+// that store snapshots as deltas, since LZO output does not diff well.
+void G_SnapshotLevel (bool compress)
 {
 	delete level.info->snapshot;
 
-	level.info->snapshot = new FLZOMemFile;
+	level.info->snapshot = new FLZOMemFile(!compress);
 	level.info->snapshot->Open ();
 
 	FArchive arc (*level.info->snapshot);
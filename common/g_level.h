@@ -226,7 +226,7 @@ void G_ParseMapInfo (void);
 void G_ParseMusInfo (void);
 
 void G_ClearSnapshots (void);
-void G_SnapshotLevel (void);
+void G_SnapshotLevel (bool compress = true);
 void G_UnSnapshotLevel (bool keepPlayers);
 void G_SerializeSnapshots (FArchive &arc);
 
@@ -27,6 +27,26 @@
 //
 //-----------------------------------------------------------------------------
 
+#include <cstddef>
+
+#include "i_crash.h"
+
+static crashhook_t crashhook = NULL;
+
+void I_SetCrashHook(crashhook_t hook)
+{
+	crashhook = hook;
+}
+
+static void I_RunCrashHook()
+{
+	crashhook_t hook = crashhook;
+	crashhook = NULL;	// never run it twice, in case it crashes too
+
+	if (hook)
+		hook();
+}
+
 #if defined _WIN32 && !defined _XBOX && defined _MSC_VER
 
 #include <csignal>
@@ -43,6 +63,8 @@ typedef BOOL(WINAPI* MINIDUMPWRITEDUMP)(HANDLE hProcess, DWORD dwPid, HANDLE hFi
 // Write the minidump to a file.
 void writeMinidump(EXCEPTION_POINTERS* exceptionPtrs)
 {
+	I_RunCrashHook();
+
 	// Grab the debugging library.
 	HMODULE dbghelp = LoadLibrary("dbghelp.dll");
 	if (dbghelp == NULL)
@@ -268,6 +290,8 @@ void sigactionCallback(int sig, siginfo_t* si, void* ctx)
 	sigaction(SIGSEGV, &act, NULL);
 	sigaction(SIGBUS, &act, NULL);
 
+	I_RunCrashHook();
+
 	// Write out the backtrace
 	writeBacktrace(sig, si);
 
@@ -26,4 +26,9 @@
 
 void I_SetCrashCallbacks();
 
+// Called by the crash handler before the process dies, to save anything
+// that would otherwise be lost, such as unwritten log output.
+typedef void (*crashhook_t)();
+void I_SetCrashHook(crashhook_t hook);
+
 #endif
@@ -954,7 +954,8 @@ void InitNetMessageFormats()
       MSG(clc_launcher_challenge, "x"),
       MSG(clc_challenge,          "x"),
       MSG(clc_spy,                "x"),
-      MSG(clc_privmsg,            "x")
+      MSG(clc_privmsg,            "x"),
+      MSG(clc_wadack,             "x")
    };
 
    msg_info_t svc_messages[] = {
@@ -1018,6 +1019,7 @@ void InitNetMessageFormats()
 	MSG(svc_damagemobj,         "x"),
 	MSG(svc_wadinfo,            "x"),
 	MSG(svc_wadchunk,           "x"),
+	MSG(svc_wadzchunk,          "x"),
 	MSG(svc_compressed,         "x"),
 	MSG(svc_launcher_challenge, "x"),
 	MSG(svc_challenge,          "x"),
@@ -33,6 +33,14 @@
 // Max packet size to send and receive, in bytes
 #define	MAX_UDP_PACKET 8192
 
+// WAD downloads are sent in chunks made of whole blocks of this size
+// (except for the last block of the file), which clients track.
+#define WAD_BLOCK_SIZE 256
+
+// Features a server supports, sent after the patch files in its reply to a
+// connecting client's launcher query.  Older servers send nothing there.
+#define SVCAP_WADACK	1	// takes clc_wadack and windowed WAD downloads
+
 #define SERVERPORT  10666
 #define CLIENTPORT  10667
 
@@ -134,6 +142,7 @@ enum svc_t
 	// for downloading
 	svc_wadinfo,			// denis - [ulong:filesize]
 	svc_wadchunk,			// denis - [ulong:offset], [ushort:len], [byte[]:data]
+	svc_wadzchunk,			// [ulong:offset], [ushort:len], [ushort:zlen], [byte[]:minilzo data]
 		
 	// netdemos - NullPoint
 	svc_netdemocap = 100,
@@ -183,6 +192,7 @@ enum clc_t
 	clc_ready,				// [AM] Toggle ready state.
 	clc_spy,				// [SL] Tell server to send info about this player
 	clc_privmsg,			// [AM] Targeted chat to a specific player.
+	clc_wadack,				// [ulong:have], [ulong:highest], [byte:count], count * ([ulong:offset], [ulong:len])
 
 	// for when launcher packets go astray
 	clc_launcher_challenge = 212,
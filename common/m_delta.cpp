@@ -0,0 +1,194 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2015 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Binary deltas between two versions of a buffer.
+//
+//	A delta starts with the lengths of target and base, followed by a list
+//	of operations. Each operation is a varint holding (length << 1 | copy).
+//	A copy is followed by a varint offset into base; a literal is followed
+//	by its bytes.
+//
+//-----------------------------------------------------------------------------
+
+#include <cstring>
+
+#include "m_delta.h"
+#include "version.h"
+
+// Matches are found by hashing base in blocks of this many bytes.
+static const size_t DELTA_BLOCK = 16;
+
+static unsigned int M_HashDeltaBlock(const byte *p)
+{
+	unsigned int hash = 2166136261u;
+	for (size_t i = 0; i < DELTA_BLOCK; i++)
+		hash = (hash ^ p[i]) * 16777619u;
+	return hash;
+}
+
+static void M_WriteDeltaVarint(std::vector<byte> &out, size_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back((byte)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((byte)value);
+}
+
+static bool M_ReadDeltaVarint(const byte *&p, const byte *end, size_t &value)
+{
+	value = 0;
+	for (int shift = 0; p < end && shift < 35; shift += 7)
+	{
+		byte b = *p++;
+		value |= (size_t)(b & 0x7F) << shift;
+		if (!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+static void M_WriteDeltaLiteral(std::vector<byte> &out, const byte *data, size_t len)
+{
+	if (len == 0)
+		return;
+	M_WriteDeltaVarint(out, len << 1);
+	out.insert(out.end(), data, data + len);
+}
+
+//
+// M_EncodeDelta
+//
+// Every aligned block of base goes into a hash table. target is then scanned
+// a byte at a time; the place just after the previous match is tried first,
+// since most of a changed buffer stays in step with the old one, and the
+// hash table is used to pick up again after data was inserted or removed.
+// Each match is grown in both directions before it is written.
+//
+void M_EncodeDelta(const byte *base, size_t baselen,
+                   const byte *target, size_t targetlen,
+                   std::vector<byte> &delta)
+{
+	delta.clear();
+	M_WriteDeltaVarint(delta, targetlen);
+	M_WriteDeltaVarint(delta, baselen);
+
+	size_t numblocks = baselen / DELTA_BLOCK;
+	size_t tablesize = 1;
+	while (tablesize < numblocks * 2)
+		tablesize <<= 1;
+
+	std::vector<int> table(tablesize, -1);
+	for (size_t i = numblocks; i-- > 0; )
+		table[M_HashDeltaBlock(base + i * DELTA_BLOCK) & (tablesize - 1)] = (int)(i * DELTA_BLOCK);
+
+	size_t pos = 0, literal = 0, expected = 0;
+
+	while (pos + DELTA_BLOCK <= targetlen)
+	{
+		size_t match;
+
+		if (expected + DELTA_BLOCK <= baselen &&
+			memcmp(base + expected, target + pos, DELTA_BLOCK) == 0)
+		{
+			match = expected;
+		}
+		else
+		{
+			int candidate = numblocks ? table[M_HashDeltaBlock(target + pos) & (tablesize - 1)] : -1;
+			if (candidate < 0 || memcmp(base + candidate, target + pos, DELTA_BLOCK) != 0)
+			{
+				pos++;
+				continue;
+			}
+			match = (size_t)candidate;
+		}
+
+		while (pos > literal && match > 0 && base[match - 1] == target[pos - 1])
+		{
+			pos--;
+			match--;
+		}
+
+		size_t len = DELTA_BLOCK;
+		while (pos + len < targetlen && match + len < baselen &&
+			   base[match + len] == target[pos + len])
+			len++;
+
+		M_WriteDeltaLiteral(delta, target + literal, pos - literal);
+		M_WriteDeltaVarint(delta, (len << 1) | 1);
+		M_WriteDeltaVarint(delta, match);
+
+		pos += len;
+		literal = pos;
+		expected = match + len;
+	}
+
+	M_WriteDeltaLiteral(delta, target + literal, targetlen - literal);
+}
+
+//
+// M_ApplyDelta
+//
+bool M_ApplyDelta(const byte *base, size_t baselen,
+                  const byte *delta, size_t deltalen,
+                  std::vector<byte> &target)
+{
+	const byte *p = delta, *end = delta + deltalen;
+	size_t targetlen, expectedbase;
+
+	target.clear();
+
+	if (!M_ReadDeltaVarint(p, end, targetlen) ||
+		!M_ReadDeltaVarint(p, end, expectedbase) || expectedbase != baselen)
+		return false;
+
+	target.reserve(targetlen);
+
+	while (p < end)
+	{
+		size_t op;
+		if (!M_ReadDeltaVarint(p, end, op))
+			return false;
+
+		size_t len = op >> 1;
+		if (len > targetlen - target.size())
+			return false;
+
+		if (op & 1)
+		{
+			size_t offset;
+			if (!M_ReadDeltaVarint(p, end, offset) ||
+				offset > baselen || len > baselen - offset)
+				return false;
+			target.insert(target.end(), base + offset, base + offset + len);
+		}
+		else
+		{
+			if (len > (size_t)(end - p))
+				return false;
+			target.insert(target.end(), p, p + len);
+			p += len;
+		}
+	}
+
+	return target.size() == targetlen;
+}
+
+VERSION_CONTROL (m_delta_cpp, "$Id$")
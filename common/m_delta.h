@@ -0,0 +1,42 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2015 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Binary deltas between two versions of a buffer.
+//	M_EncodeDelta describes target as runs copied from base plus literal
+//	bytes, so the delta is small when most of target also appears in base.
+//	M_ApplyDelta rebuilds target from the same base and returns false if
+//	the delta is damaged or was made against a different base.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __M_DELTA_H__
+#define __M_DELTA_H__
+
+#include <vector>
+
+#include "doomtype.h"
+
+void M_EncodeDelta(const byte *base, size_t baselen,
+                   const byte *target, size_t targetlen,
+                   std::vector<byte> &delta);
+
+bool M_ApplyDelta(const byte *base, size_t baselen,
+                  const byte *delta, size_t deltalen,
+                  std::vector<byte> &target);
+
+#endif	// __M_DELTA_H__
@@ -0,0 +1,212 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2015 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Worker thread pool for splitting independent work across CPU cores.
+//
+//-----------------------------------------------------------------------------
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "m_parallel.h"
+#include "m_argv.h"
+
+// Never use more than this many worker threads, regardless of core count.
+static const size_t MAX_PARALLEL_WORKERS = 15;
+
+//
+// ParallelPool
+//
+// The workers sleep on a condition variable until a new job generation is
+// posted, then pull indices from a shared counter until none are left.
+// The pool is created on first use and never destroyed; its threads are
+// detached so that they do not hold up exiting.
+//
+class ParallelPool
+{
+public:
+	ParallelPool(size_t workers) :
+		numworkers(workers), generation(0), busy(0),
+		func(NULL), data(NULL), count(0), next(0), inuse(false)
+	{
+		for (size_t i = 0; i < numworkers; i++)
+			std::thread(&ParallelPool::WorkerLoop, this).detach();
+	}
+
+	size_t Threads() const
+	{
+		return numworkers + 1;
+	}
+
+	bool Run(size_t jobcount, parallelfunc_t jobfunc, void *jobdata)
+	{
+		if (numworkers == 0 || inuse.exchange(true))
+			return false;
+
+		{
+			std::lock_guard<std::mutex> lk(lock);
+			func = jobfunc;
+			data = jobdata;
+			count = jobcount;
+			next = 0;
+			busy = numworkers;
+			generation++;
+		}
+		wake.notify_all();
+
+		DoWork();
+
+		{
+			std::unique_lock<std::mutex> lk(lock);
+			while (busy > 0)
+				done.wait(lk);
+		}
+
+		inuse = false;
+		return true;
+	}
+
+private:
+	void DoWork()
+	{
+		size_t i;
+		while ((i = next++) < count)
+			func(i, data);
+	}
+
+	void WorkerLoop()
+	{
+		unsigned int seen = 0;
+
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lk(lock);
+				while (generation == seen)
+					wake.wait(lk);
+				seen = generation;
+			}
+
+			DoWork();
+
+			std::lock_guard<std::mutex> lk(lock);
+			if (--busy == 0)
+				done.notify_one();
+		}
+	}
+
+	size_t						numworkers;
+
+	std::mutex					lock;
+	std::condition_variable		wake;
+	std::condition_variable		done;
+	unsigned int				generation;
+	size_t						busy;
+
+	parallelfunc_t				func;
+	void						*data;
+	size_t						count;
+	std::atomic<size_t>			next;
+
+	std::atomic<bool>			inuse;
+};
+
+static ParallelPool *pool = NULL;
+static std::once_flag pool_once;
+
+static void M_CreateParallelPool()
+{
+	size_t workers = 0;
+
+	// -nothreads keeps everything on the main thread
+	if (!Args.CheckParm("-nothreads"))
+	{
+		size_t cores = std::thread::hardware_concurrency();
+		if (cores > 1)
+			workers = cores - 1;
+		if (workers > MAX_PARALLEL_WORKERS)
+			workers = MAX_PARALLEL_WORKERS;
+	}
+
+	pool = new ParallelPool(workers);
+}
+
+//
+// M_ParallelThreads
+//
+size_t M_ParallelThreads()
+{
+	std::call_once(pool_once, M_CreateParallelPool);
+	return pool->Threads();
+}
+
+//
+// M_ParallelFor
+//
+void M_ParallelFor(size_t count, parallelfunc_t func, void *data)
+{
+	if (count == 0)
+		return;
+
+	std::call_once(pool_once, M_CreateParallelPool);
+
+	if (count > 1 && pool->Run(count, func, data))
+		return;
+
+	for (size_t i = 0; i < count; i++)
+		func(i, data);
+}
+
+struct paralleltask_t
+{
+	std::thread thread;
+};
+
+//
+// M_StartParallelTask
+//
+// Returns NULL if the job already ran on the calling thread.
+//
+paralleltask_t *M_StartParallelTask(parallelfunc_t func, void *data)
+{
+	if (M_ParallelThreads() <= 1)
+	{
+		func(0, data);
+		return NULL;
+	}
+
+	paralleltask_t *task = new paralleltask_t;
+	task->thread = std::thread(func, (size_t)0, data);
+	return task;
+}
+
+//
+// M_FinishParallelTask
+//
+void M_FinishParallelTask(paralleltask_t *task)
+{
+	if (task == NULL)
+		return;
+
+	task->thread.join();
+	delete task;
+}
+
+VERSION_CONTROL (m_parallel_cpp, "$Id$")
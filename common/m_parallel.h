@@ -0,0 +1,53 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2015 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Worker thread pool for splitting independent work across CPU cores.
+//	M_ParallelFor calls func once for every index in [0, count) and returns
+//	when all of them have finished. The calling thread takes part in the
+//	work. Nested calls, or calls made while another thread is using the
+//	pool, simply run on the calling thread.
+//
+//	M_StartParallelTask runs a single job on a thread of its own while the
+//	caller carries on, for overlapping otherwise unrelated stages of work.
+//	M_FinishParallelTask waits for it. Without worker threads the job runs
+//	to completion inside M_StartParallelTask.
+//
+//	func must not touch game state that other indices write to and must
+//	not throw (no I_Error).
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __M_PARALLEL_H__
+#define __M_PARALLEL_H__
+
+#include <cstddef>
+
+typedef void (*parallelfunc_t)(size_t index, void *data);
+
+void M_ParallelFor(size_t count, parallelfunc_t func, void *data);
+
+// Number of threads that M_ParallelFor can spread work across, including
+// the calling thread.
+size_t M_ParallelThreads();
+
+struct paralleltask_t;
+
+paralleltask_t *M_StartParallelTask(parallelfunc_t func, void *data);
+void M_FinishParallelTask(paralleltask_t *task);
+
+#endif	// __M_PARALLEL_H__
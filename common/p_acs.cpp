@@ -39,6 +39,12 @@
 #include "i_system.h"
 #include "m_vectors.h"
 
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
 #define CLAMPCOLOR(c)	(EColorRange)((unsigned)(c)>CR_UNTRANSLATED?CR_UNTRANSLATED:(c))
 #define LANGREGIONMASK	MAKE_ID(0,0,0xff,0xff)
 
@@ -420,6 +426,10 @@ FBehavior::FBehavior (BYTE *object, int len)
 	Functions = NULL;
 	Arrays = NULL;
 	Chunks = NULL;
+	Code = NULL;
+	CodeOfs = NULL;
+	OfsToCode = NULL;
+	CodeSize = 0;
 
 	if (object[0] != 'A' || object[1] != 'C' || object[2] != 'S')
 	{
@@ -527,7 +537,8 @@ FBehavior::FBehavior (BYTE *object, int len)
 		Functions = FindChunk(MAKE_ID('F','U','N','C'));
 		if (Functions != NULL)
 		{
-			NumFunctions = LELONG(((DWORD *)Functions)[1]);
+			// The chunk length is in bytes; DecodePCodes walks every entry
+			NumFunctions = LELONG(((DWORD *)Functions)[1]) / sizeof(ScriptFunction);
 			Functions += 8;
 		}
 
@@ -574,6 +585,8 @@ FBehavior::FBehavior (BYTE *object, int len)
 		}
 	}
 
+	DecodePCodes ();
+
 	DPrintf ("Loaded %d scripts, %d Functions\n", NumScripts, NumFunctions);
 }
 
@@ -593,6 +606,10 @@ FBehavior::~FBehavior ()
 		delete[] Arrays;
 		Arrays = NULL;
 	}
+
+	delete[] Code;
+	delete[] CodeOfs;
+	delete[] OfsToCode;
 }
 
 int STACK_ARGS FBehavior::SortScripts (const void *a, const void *b)
@@ -612,7 +629,7 @@ int *FBehavior::FindScript (int script) const
 	const ScriptPtr *ptr = BinarySearch<ScriptPtr, WORD>
 		((ScriptPtr *)Scripts, NumScripts, &ScriptPtr::Number, (WORD)script);
 
-	return ptr ? (int *)(ptr->Address + Data) : NULL;
+	return ptr ? Ofs2PC (ptr->Address) : NULL;
 }
 
 ScriptFunction *FBehavior::GetFunction (int funcnum) const
@@ -848,17 +865,439 @@ void FBehavior::StartTypedScripts (WORD type, AActor *activator, int arg0, int a
 		if (ptr->Type == type)
 		{
 			P_GetScriptGoing (activator, NULL, ptr->Number,
-				(int *)(ptr->Address + Data), 0, arg0, arg1, arg2, 0, true);
+				Ofs2PC (ptr->Address), 0, arg0, arg1, arg2, 0, true);
+		}
+	}
+}
+
+//---- P-code decoder ----//
+
+// Reads p-codes and operands from the raw BEHAVIOR lump, honoring the
+// operand widths of the lump's format.
+class FPCodeReader
+{
+public:
+	FPCodeReader (const BYTE *data, DWORD size, DWORD ofs, ACSFormat fmt)
+		: Data (data), Size (size), Ofs (ofs), Format (fmt), Overrun (false) {}
+
+	DWORD Offset () const { return Ofs; }
+	bool Overran () const { return Overrun; }
+
+	int Byte ()
+	{
+		if (Ofs + 1 > Size)
+			return Fail ();
+		return Data[Ofs++];
+	}
+
+	// NEXTWORD: little endian
+	int Word ()
+	{
+		int val = RawWord ();
+		return LELONG (val);
+	}
+
+	// pc[n]: native byte order
+	int RawWord ()
+	{
+		if (Ofs + 4 > Size)
+			return Fail ();
+		int val;
+		memcpy (&val, Data + Ofs, 4);
+		Ofs += 4;
+		return val;
+	}
+
+	// NEXTBYTE: p-codes and most small operands
+	int Code ()
+	{
+		return Format == ACS_LittleEnhanced ? Byte () : Word ();
+	}
+
+private:
+	const BYTE *Data;
+	DWORD Size;
+	DWORD Ofs;
+	ACSFormat Format;
+	bool Overrun;
+
+	int Fail ()
+	{
+		Overrun = true;
+		Ofs = Size;
+		return 0;
+	}
+};
+
+void FBehavior::DecodePCodes ()
+{
+	std::vector<int> code;
+	std::vector<DWORD> codeofs;
+	std::vector<int> ofstocode (DataSize, -1);
+	std::vector<DWORD> pending;
+	std::vector<std::pair<size_t, DWORD> > jumps;	// Code slot, lump offset
+	int i;
+
+	// Slot 0 stops any script that is sent somewhere that was never decoded
+	code.push_back (DLevelScript::PCD_TERMINATE);
+	codeofs.push_back (0);
+
+	for (i = 0; i < NumScripts; ++i)
+		pending.push_back (((ScriptPtr *)(Scripts + 8*i))->Address);
+
+	for (i = 0; i < NumFunctions; ++i)
+	{
+		if (((ScriptFunction *)Functions)[i].Address != 0)
+			pending.push_back (((ScriptFunction *)Functions)[i].Address);
+	}
+
+	while (!pending.empty ())
+	{
+		DWORD ofs = pending.back ();
+		pending.pop_back ();
+
+		if (ofs < (DWORD)DataSize && ofstocode[ofs] >= 0)
+			continue;
+
+		// Decode straight-line code until control can no longer fall through
+		bool more = true;
+		while (more)
+		{
+			size_t start = code.size ();
+
+			if (ofs >= (DWORD)DataSize)
+			{
+				code.push_back (DLevelScript::PCD_TERMINATE);
+				codeofs.push_back (ofs);
+				break;
+			}
+
+			if (ofstocode[ofs] >= 0)
+			{
+				code.push_back (DLevelScript::PCD_DECODEDGOTO);
+				code.push_back (ofstocode[ofs]);
+				codeofs.resize (code.size (), ofs);
+				break;
+			}
+
+			FPCodeReader rd (Data, DataSize, ofs, Format);
+			int pcd = rd.Code ();
+
+			ofstocode[ofs] = start;
+			code.push_back (pcd);
+
+			switch (pcd)
+			{
+			case DLevelScript::PCD_TERMINATE:
+			case DLevelScript::PCD_RESTART:
+			case DLevelScript::PCD_RETURNVOID:
+			case DLevelScript::PCD_RETURNVAL:
+				more = false;
+				break;
+
+			case DLevelScript::PCD_PUSHNUMBER:
+			case DLevelScript::PCD_DELAYDIRECT:
+			case DLevelScript::PCD_TAGWAITDIRECT:
+			case DLevelScript::PCD_POLYWAITDIRECT:
+			case DLevelScript::PCD_SCRIPTWAITDIRECT:
+				code.push_back (rd.Word ());
+				break;
+
+			case DLevelScript::PCD_PUSHBYTE:
+			case DLevelScript::PCD_DELAYDIRECTB:
+				code.push_back (rd.Byte ());
+				break;
+
+			case DLevelScript::PCD_PUSH2BYTES:
+			case DLevelScript::PCD_PUSH3BYTES:
+			case DLevelScript::PCD_PUSH4BYTES:
+			case DLevelScript::PCD_PUSH5BYTES:
+				for (i = DLevelScript::PCD_PUSH2BYTES - 2; i < pcd; ++i)
+					code.push_back (rd.Byte ());
+				break;
+
+			case DLevelScript::PCD_PUSHBYTES:
+			{
+				int count = rd.Byte ();
+				code.push_back (count);
+				for (i = 0; i < count; ++i)
+					code.push_back (rd.Byte ());
+				break;
+			}
+
+			case DLevelScript::PCD_LSPEC1:
+			case DLevelScript::PCD_LSPEC2:
+			case DLevelScript::PCD_LSPEC3:
+			case DLevelScript::PCD_LSPEC4:
+			case DLevelScript::PCD_LSPEC5:
+			case DLevelScript::PCD_CALL:
+			case DLevelScript::PCD_CALLDISCARD:
+			case DLevelScript::PCD_ASSIGNSCRIPTVAR:
+			case DLevelScript::PCD_ASSIGNMAPVAR:
+			case DLevelScript::PCD_ASSIGNWORLDVAR:
+			case DLevelScript::PCD_ASSIGNGLOBALVAR:
+			case DLevelScript::PCD_ASSIGNMAPARRAY:
+			case DLevelScript::PCD_PUSHSCRIPTVAR:
+			case DLevelScript::PCD_PUSHMAPVAR:
+			case DLevelScript::PCD_PUSHWORLDVAR:
+			case DLevelScript::PCD_PUSHGLOBALVAR:
+			case DLevelScript::PCD_PUSHMAPARRAY:
+			case DLevelScript::PCD_ADDSCRIPTVAR:
+			case DLevelScript::PCD_ADDMAPVAR:
+			case DLevelScript::PCD_ADDWORLDVAR:
+			case DLevelScript::PCD_ADDGLOBALVAR:
+			case DLevelScript::PCD_ADDMAPARRAY:
+			case DLevelScript::PCD_SUBSCRIPTVAR:
+			case DLevelScript::PCD_SUBMAPVAR:
+			case DLevelScript::PCD_SUBWORLDVAR:
+			case DLevelScript::PCD_SUBGLOBALVAR:
+			case DLevelScript::PCD_SUBMAPARRAY:
+			case DLevelScript::PCD_MULSCRIPTVAR:
+			case DLevelScript::PCD_MULMAPVAR:
+			case DLevelScript::PCD_MULWORLDVAR:
+			case DLevelScript::PCD_MULGLOBALVAR:
+			case DLevelScript::PCD_MULMAPARRAY:
+			case DLevelScript::PCD_DIVSCRIPTVAR:
+			case DLevelScript::PCD_DIVMAPVAR:
+			case DLevelScript::PCD_DIVWORLDVAR:
+			case DLevelScript::PCD_DIVGLOBALVAR:
+			case DLevelScript::PCD_DIVMAPARRAY:
+			case DLevelScript::PCD_MODSCRIPTVAR:
+			case DLevelScript::PCD_MODMAPVAR:
+			case DLevelScript::PCD_MODWORLDVAR:
+			case DLevelScript::PCD_MODGLOBALVAR:
+			case DLevelScript::PCD_MODMAPARRAY:
+			case DLevelScript::PCD_INCSCRIPTVAR:
+			case DLevelScript::PCD_INCMAPVAR:
+			case DLevelScript::PCD_INCWORLDVAR:
+			case DLevelScript::PCD_INCGLOBALVAR:
+			case DLevelScript::PCD_INCMAPARRAY:
+			case DLevelScript::PCD_DECSCRIPTVAR:
+			case DLevelScript::PCD_DECMAPVAR:
+			case DLevelScript::PCD_DECWORLDVAR:
+			case DLevelScript::PCD_DECGLOBALVAR:
+			case DLevelScript::PCD_DECMAPARRAY:
+				code.push_back (rd.Code ());
+				break;
+
+			case DLevelScript::PCD_LSPEC1DIRECT:
+			case DLevelScript::PCD_LSPEC2DIRECT:
+			case DLevelScript::PCD_LSPEC3DIRECT:
+			case DLevelScript::PCD_LSPEC4DIRECT:
+			case DLevelScript::PCD_LSPEC5DIRECT:
+				code.push_back (rd.Code ());
+				for (i = DLevelScript::PCD_LSPEC1DIRECT - 1; i < pcd; ++i)
+					code.push_back (rd.RawWord ());
+				break;
+
+			case DLevelScript::PCD_LSPEC1DIRECTB:
+			case DLevelScript::PCD_LSPEC2DIRECTB:
+			case DLevelScript::PCD_LSPEC3DIRECTB:
+			case DLevelScript::PCD_LSPEC4DIRECTB:
+			case DLevelScript::PCD_LSPEC5DIRECTB:
+				for (i = DLevelScript::PCD_LSPEC1DIRECTB - 2; i < pcd; ++i)
+					code.push_back (rd.Byte ());
+				break;
+
+			case DLevelScript::PCD_RANDOMDIRECTB:
+				code.push_back (rd.Byte ());
+				code.push_back (rd.Byte ());
+				break;
+
+			case DLevelScript::PCD_SETGRAVITYDIRECT:
+			case DLevelScript::PCD_SETAIRCONTROLDIRECT:
+			case DLevelScript::PCD_CHECKINVENTORYDIRECT:
+				code.push_back (rd.RawWord ());
+				break;
+
+			case DLevelScript::PCD_RANDOMDIRECT:
+			case DLevelScript::PCD_THINGCOUNTDIRECT:
+			case DLevelScript::PCD_CHANGEFLOORDIRECT:
+			case DLevelScript::PCD_CHANGECEILINGDIRECT:
+			case DLevelScript::PCD_GIVEINVENTORYDIRECT:
+			case DLevelScript::PCD_TAKEINVENTORYDIRECT:
+				code.push_back (rd.RawWord ());
+				code.push_back (rd.RawWord ());
+				break;
+
+			case DLevelScript::PCD_SETMUSICDIRECT:
+			case DLevelScript::PCD_LOCALSETMUSICDIRECT:
+				code.push_back (rd.RawWord ());
+				code.push_back (rd.RawWord ());
+				code.push_back (rd.RawWord ());
+				break;
+
+			case DLevelScript::PCD_GOTO:
+			case DLevelScript::PCD_IFGOTO:
+			case DLevelScript::PCD_IFNOTGOTO:
+			case DLevelScript::PCD_CASEGOTO:
+			{
+				if (pcd == DLevelScript::PCD_CASEGOTO)
+					code.push_back (rd.Word ());
+				DWORD target = rd.RawWord ();
+				jumps.push_back (std::make_pair (code.size (), target));
+				code.push_back (0);
+				pending.push_back (target);
+				more = (pcd != DLevelScript::PCD_GOTO);
+				break;
+			}
+
+			default:
+				if ((unsigned)pcd >= (unsigned)DLevelScript::PCODE_COMMAND_COUNT)
+				{
+					code.back () = DLevelScript::PCD_DECODEDUNKNOWN;
+					code.push_back (pcd);
+					more = false;
+				}
+				break;
+			}
+
+			if (rd.Overran ())
+			{
+				// Ran off the end of the lump in the middle of an instruction
+				code.resize (start);
+				code.push_back (DLevelScript::PCD_TERMINATE);
+				while (!jumps.empty () && jumps.back ().first >= start)
+					jumps.pop_back ();
+				more = false;
+			}
+
+			codeofs.resize (code.size (), ofs);
+			ofs = rd.Offset ();
 		}
 	}
+
+	for (i = 0; i < (int)jumps.size (); ++i)
+	{
+		DWORD target = jumps[i].second;
+		code[jumps[i].first] = target < (DWORD)DataSize ? ofstocode[target] : 0;
+	}
+
+	CodeSize = code.size ();
+	Code = new int[CodeSize];
+	CodeOfs = new DWORD[CodeSize];
+	OfsToCode = new int[DataSize];
+
+	std::copy (code.begin (), code.end (), Code);
+	std::copy (codeofs.begin (), codeofs.end (), CodeOfs);
+	for (i = 0; i < DataSize; ++i)
+		OfsToCode[i] = ofstocode[i] >= 0 ? ofstocode[i] : 0;
+
+	DPrintf ("Decoded %d bytes of ACS into %d words\n", DataSize, CodeSize);
+}
+
+//---- ACS profiler ----//
+
+struct acsprofile_t
+{
+	std::string map;
+	int script;
+	unsigned int runs;
+	unsigned int suspends;
+	unsigned int delays;
+	unsigned int waits;
+	QWORD instructions;
+	dtime_t time;
+	dtime_t maxtime;
+};
+
+typedef std::map<std::pair<std::string, int>, acsprofile_t> acsprofiles_t;
+
+// Mirrors sv_acsprofile so the interpreter only tests a bool
+static bool acsprofiling = false;
+static acsprofiles_t acsprofiles;
+static unsigned int acsprofiletics;
+static dtime_t acsprofiletime;
+static dtime_t acsprofileworst;
+static std::string acsprofileworstmap;
+static int acsprofileworsttic;
+
+static void P_ResetACSProfile()
+{
+	acsprofiles.clear();
+	acsprofiletics = 0;
+	acsprofiletime = 0;
+	acsprofileworst = 0;
+	acsprofileworstmap.clear();
+	acsprofileworsttic = 0;
+}
+
+CVAR_FUNC_IMPL (sv_acsprofile)
+{
+	acsprofiling = (var != 0.0f);
+}
+
+//
+// P_ProfileScript
+// Records one pass through RunScript that executed p-codes
+//
+static void P_ProfileScript(int script, int instructions, dtime_t time,
+                            DLevelScript::EScriptState state)
+{
+	acsprofile_t &prof = acsprofiles[std::make_pair(std::string(level.mapname), script)];
+
+	if (prof.runs == 0)
+	{
+		prof.map = level.mapname;
+		prof.script = script;
+	}
+
+	prof.runs++;
+	prof.instructions += instructions;
+	prof.time += time;
+	if (time > prof.maxtime)
+		prof.maxtime = time;
+
+	if (state == DLevelScript::SCRIPT_Suspended)
+		prof.suspends++;
+	else if (state == DLevelScript::SCRIPT_Delayed)
+		prof.delays++;
+	else if (state != DLevelScript::SCRIPT_Running && state != DLevelScript::SCRIPT_PleaseRemove)
+		prof.waits++;
+}
+
+//
+// P_ProfileACSTic
+// Records the time all running scripts took during one tic
+//
+static void P_ProfileACSTic(dtime_t time)
+{
+	acsprofiletics++;
+	acsprofiletime += time;
+
+	if (time > acsprofileworst)
+	{
+		acsprofileworst = time;
+		acsprofileworstmap = level.mapname;
+		acsprofileworsttic = level.time;
+	}
 }
 
 //---- The ACS Interpreter ----//
 
 
 
-#define NEXTWORD	(LELONG(*pc++))
-#define NEXTBYTE	(fmt==ACS_LittleEnhanced?getbyte(pc):NEXTWORD)
+// Operands were widened to native ints by FBehavior::DecodePCodes
+#define NEXTWORD	(*pc++)
+#define NEXTBYTE	(*pc++)
+
+// GCC and Clang can jump from the end of one handler straight to the next
+// through a table of label addresses; other compilers use the switch.
+// Define ACS_NO_THREADED_DISPATCH to build the switch with them as well.
+#if defined(__GNUC__) && !defined(ACS_NO_THREADED_DISPATCH)
+#define ACS_THREADED_DISPATCH
+#endif
+
+#ifdef ACS_THREADED_DISPATCH
+#define PCODE(x)	case x: pcode_##x:
+#define NEXTPCODE \
+	if (state != SCRIPT_Running || ++runaway > 500000) break; \
+	pcd = NEXTBYTE; \
+	goto *pcodelabels[pcd]
+#else
+#define PCODE(x)	case x:
+#define NEXTPCODE	break
+#endif
 #define STACK(a)	(Stack[sp - (a)])
 #define PushToStack(a)	(Stack[sp++] = (a))
 
@@ -928,6 +1367,7 @@ void DACSThinker::Serialize (FArchive &arc)
 void DACSThinker::RunThink ()
 {
 	DLevelScript *script = Scripts;
+	const dtime_t start = acsprofiling ? I_GetTime () : 0;
 
 	while (script)
 	{
@@ -935,6 +1375,9 @@ void DACSThinker::RunThink ()
 		script->RunScript ();
 		script = next;
 	}
+
+	if (acsprofiling)
+		P_ProfileACSTic (I_GetTime () - start);
 }
 
 // FlashFader class - not sure where to put this so it goes here for now...
@@ -1186,8 +1629,7 @@ void DLevelScript::Serialize (FArchive &arc)
 			<< activationline
 			<< lineSide;
 			
-		for (i = 0; i < LOCAL_SIZE; i++)
-			arc << localvars[i];
+		arc.WriteArray(localvars, LOCAL_SIZE);
 
 		i = level.behavior->PC2Ofs(pc);
 		arc << i;
@@ -1203,8 +1645,7 @@ void DLevelScript::Serialize (FArchive &arc)
 			>> activationline
 			>> lineSide;
 			
-		for (i = 0; i < LOCAL_SIZE; i++)
-			arc >> localvars[i];	
+		arc.ReadArray(localvars, LOCAL_SIZE);
 	
 		arc >> i;
 		pc = level.behavior->Ofs2PC (i);
@@ -1536,13 +1977,6 @@ void DLevelScript::DoFadeRange(int r1, int g1, int b1, int a1,
 }
 
 
-inline int getbyte (int *&pc)
-{
-	int res = *(BYTE *)pc;
-	pc = (int *)((BYTE *)pc+1);
-	return res;
-}
-
 void DLevelScript::RunScript ()
 {
 	DACSThinker *controller = DACSThinker::ActiveThinker;
@@ -1604,9 +2038,9 @@ void DLevelScript::RunScript ()
 		break;
 	}
 
+	const dtime_t profilestart = acsprofiling ? I_GetTime () : 0;
 	int *pc = this->pc;
 	int sp = this->sp;
-	const ACSFormat fmt = level.behavior->GetFormat();
 	int runaway = 0;	// used to prevent infinite loops
 	int pcd;
 	char work[4096], *workwhere = work;
@@ -1614,6 +2048,76 @@ void DLevelScript::RunScript ()
 //	int optstart = -1;
 	int temp;
 
+#ifdef ACS_THREADED_DISPATCH
+	// Handler for every p-code the decoder can produce, in enum order
+	static void *const pcodelabels[PCODE_DECODED_COUNT] =
+	{
+/*  0*/	&&pcode_PCD_NOP, &&pcode_PCD_TERMINATE, &&pcode_PCD_SUSPEND, &&pcode_PCD_PUSHNUMBER,
+		&&pcode_PCD_LSPEC1, &&pcode_PCD_LSPEC2, &&pcode_PCD_LSPEC3, &&pcode_PCD_LSPEC4,
+		&&pcode_PCD_LSPEC5, &&pcode_PCD_LSPEC1DIRECT, &&pcode_PCD_LSPEC2DIRECT, &&pcode_PCD_LSPEC3DIRECT,
+		&&pcode_PCD_LSPEC4DIRECT, &&pcode_PCD_LSPEC5DIRECT, &&pcode_PCD_ADD, &&pcode_PCD_SUBTRACT,
+		&&pcode_PCD_MULTIPLY, &&pcode_PCD_DIVIDE, &&pcode_PCD_MODULUS, &&pcode_PCD_EQ,
+/* 20*/	&&pcode_PCD_NE, &&pcode_PCD_LT, &&pcode_PCD_GT, &&pcode_PCD_LE,
+		&&pcode_PCD_GE, &&pcode_PCD_ASSIGNSCRIPTVAR, &&pcode_PCD_ASSIGNMAPVAR, &&pcode_PCD_ASSIGNWORLDVAR,
+		&&pcode_PCD_PUSHSCRIPTVAR, &&pcode_PCD_PUSHMAPVAR, &&pcode_PCD_PUSHWORLDVAR, &&pcode_PCD_ADDSCRIPTVAR,
+		&&pcode_PCD_ADDMAPVAR, &&pcode_PCD_ADDWORLDVAR, &&pcode_PCD_SUBSCRIPTVAR, &&pcode_PCD_SUBMAPVAR,
+		&&pcode_PCD_SUBWORLDVAR, &&pcode_PCD_MULSCRIPTVAR, &&pcode_PCD_MULMAPVAR, &&pcode_PCD_MULWORLDVAR,
+/* 40*/	&&pcode_PCD_DIVSCRIPTVAR, &&pcode_PCD_DIVMAPVAR, &&pcode_PCD_DIVWORLDVAR, &&pcode_PCD_MODSCRIPTVAR,
+		&&pcode_PCD_MODMAPVAR, &&pcode_PCD_MODWORLDVAR, &&pcode_PCD_INCSCRIPTVAR, &&pcode_PCD_INCMAPVAR,
+		&&pcode_PCD_INCWORLDVAR, &&pcode_PCD_DECSCRIPTVAR, &&pcode_PCD_DECMAPVAR, &&pcode_PCD_DECWORLDVAR,
+		&&pcode_PCD_GOTO, &&pcode_PCD_IFGOTO, &&pcode_PCD_DROP, &&pcode_PCD_DELAY,
+		&&pcode_PCD_DELAYDIRECT, &&pcode_PCD_RANDOM, &&pcode_PCD_RANDOMDIRECT, &&pcode_PCD_THINGCOUNT,
+/* 60*/	&&pcode_PCD_THINGCOUNTDIRECT, &&pcode_PCD_TAGWAIT, &&pcode_PCD_TAGWAITDIRECT, &&pcode_PCD_POLYWAIT,
+		&&pcode_PCD_POLYWAITDIRECT, &&pcode_PCD_CHANGEFLOOR, &&pcode_PCD_CHANGEFLOORDIRECT, &&pcode_PCD_CHANGECEILING,
+		&&pcode_PCD_CHANGECEILINGDIRECT, &&pcode_PCD_RESTART, &&pcode_PCD_ANDLOGICAL, &&pcode_PCD_ORLOGICAL,
+		&&pcode_PCD_ANDBITWISE, &&pcode_PCD_ORBITWISE, &&pcode_PCD_EORBITWISE, &&pcode_PCD_NEGATELOGICAL,
+		&&pcode_PCD_LSHIFT, &&pcode_PCD_RSHIFT, &&pcode_PCD_UNARYMINUS, &&pcode_PCD_IFNOTGOTO,
+/* 80*/	&&pcode_PCD_LINESIDE, &&pcode_PCD_SCRIPTWAIT, &&pcode_PCD_SCRIPTWAITDIRECT, &&pcode_PCD_CLEARLINESPECIAL,
+		&&pcode_PCD_CASEGOTO, &&pcode_PCD_BEGINPRINT, &&pcode_PCD_ENDPRINT, &&pcode_PCD_PRINTSTRING,
+		&&pcode_PCD_PRINTNUMBER, &&pcode_PCD_PRINTCHARACTER, &&pcode_PCD_PLAYERCOUNT, &&pcode_PCD_GAMETYPE,
+		&&pcode_PCD_GAMESKILL, &&pcode_PCD_TIMER, &&pcode_PCD_SECTORSOUND, &&pcode_PCD_AMBIENTSOUND,
+		&&pcode_PCD_SOUNDSEQUENCE, &&pcode_PCD_SETLINETEXTURE, &&pcode_PCD_SETLINEBLOCKING, &&pcode_PCD_SETLINESPECIAL,
+/*100*/	&&pcode_PCD_THINGSOUND, &&pcode_PCD_ENDPRINTBOLD, &&pcode_PCD_ACTIVATORSOUND, &&pcode_PCD_LOCALAMBIENTSOUND,
+		&&pcode_PCD_SETLINEMONSTERBLOCKING, &&pcode_default, &&pcode_default, &&pcode_default,
+		&&pcode_default, &&pcode_default, &&pcode_default, &&pcode_default,
+		&&pcode_default, &&pcode_default, &&pcode_default, &&pcode_default,
+		&&pcode_default, &&pcode_default, &&pcode_default, &&pcode_default,
+/*120*/	&&pcode_PCD_PLAYERHEALTH, &&pcode_PCD_PLAYERARMORPOINTS, &&pcode_PCD_PLAYERFRAGS, &&pcode_default,
+		&&pcode_default, &&pcode_default, &&pcode_default, &&pcode_default,
+		&&pcode_default, &&pcode_default, &&pcode_default, &&pcode_PCD_PRINTNAME,
+		&&pcode_PCD_MUSICCHANGE, &&pcode_default, &&pcode_default, &&pcode_PCD_SINGLEPLAYER,
+		&&pcode_PCD_FIXEDMUL, &&pcode_PCD_FIXEDDIV, &&pcode_PCD_SETGRAVITY, &&pcode_PCD_SETGRAVITYDIRECT,
+/*140*/	&&pcode_PCD_SETAIRCONTROL, &&pcode_PCD_SETAIRCONTROLDIRECT, &&pcode_PCD_CLEARINVENTORY, &&pcode_PCD_GIVEINVENTORY,
+		&&pcode_PCD_GIVEINVENTORYDIRECT, &&pcode_PCD_TAKEINVENTORY, &&pcode_PCD_TAKEINVENTORYDIRECT, &&pcode_PCD_CHECKINVENTORY,
+		&&pcode_PCD_CHECKINVENTORYDIRECT, &&pcode_default, &&pcode_default, &&pcode_default,
+		&&pcode_default, &&pcode_PCD_SETMUSIC, &&pcode_PCD_SETMUSICDIRECT, &&pcode_PCD_LOCALSETMUSIC,
+		&&pcode_PCD_LOCALSETMUSICDIRECT, &&pcode_PCD_PRINTFIXED, &&pcode_PCD_PRINTLOCALIZED, &&pcode_default,
+/*160*/	&&pcode_default, &&pcode_default, &&pcode_default, &&pcode_default,
+		&&pcode_default, &&pcode_default, &&pcode_default, &&pcode_PCD_PUSHBYTE,
+		&&pcode_PCD_LSPEC1DIRECTB, &&pcode_PCD_LSPEC2DIRECTB, &&pcode_PCD_LSPEC3DIRECTB, &&pcode_PCD_LSPEC4DIRECTB,
+		&&pcode_PCD_LSPEC5DIRECTB, &&pcode_PCD_DELAYDIRECTB, &&pcode_PCD_RANDOMDIRECTB, &&pcode_PCD_PUSHBYTES,
+		&&pcode_PCD_PUSH2BYTES, &&pcode_PCD_PUSH3BYTES, &&pcode_PCD_PUSH4BYTES, &&pcode_PCD_PUSH5BYTES,
+/*180*/	&&pcode_PCD_SETTHINGSPECIAL, &&pcode_PCD_ASSIGNGLOBALVAR, &&pcode_PCD_PUSHGLOBALVAR, &&pcode_PCD_ADDGLOBALVAR,
+		&&pcode_PCD_SUBGLOBALVAR, &&pcode_PCD_MULGLOBALVAR, &&pcode_PCD_DIVGLOBALVAR, &&pcode_PCD_MODGLOBALVAR,
+		&&pcode_PCD_INCGLOBALVAR, &&pcode_PCD_DECGLOBALVAR, &&pcode_PCD_FADETO, &&pcode_PCD_FADERANGE,
+		&&pcode_PCD_CANCELFADE, &&pcode_default, &&pcode_PCD_SETFLOORTRIGGER, &&pcode_PCD_SETCEILINGTRIGGER,
+		&&pcode_PCD_GETACTORX, &&pcode_PCD_GETACTORY, &&pcode_PCD_GETACTORZ, &&pcode_default,
+/*200*/	&&pcode_default, &&pcode_default, &&pcode_default, &&pcode_PCD_CALL,
+		&&pcode_PCD_CALLDISCARD, &&pcode_PCD_RETURNVOID, &&pcode_PCD_RETURNVAL, &&pcode_PCD_PUSHMAPARRAY,
+		&&pcode_PCD_ASSIGNMAPARRAY, &&pcode_PCD_ADDMAPARRAY, &&pcode_PCD_SUBMAPARRAY, &&pcode_PCD_MULMAPARRAY,
+		&&pcode_PCD_DIVMAPARRAY, &&pcode_PCD_MODMAPARRAY, &&pcode_PCD_INCMAPARRAY, &&pcode_PCD_DECMAPARRAY,
+		&&pcode_PCD_DUP, &&pcode_PCD_SWAP, &&pcode_default, &&pcode_default,
+/*220*/	&&pcode_PCD_SIN, &&pcode_PCD_COS, &&pcode_PCD_VECTORANGLE, &&pcode_default,
+		&&pcode_default, &&pcode_default, &&pcode_default, &&pcode_default,
+		&&pcode_default, &&pcode_default, &&pcode_default, &&pcode_default,
+		&&pcode_default, &&pcode_default, &&pcode_default, &&pcode_default,
+		&&pcode_default, &&pcode_default, &&pcode_default, &&pcode_default,
+/*240*/	&&pcode_default, &&pcode_default, &&pcode_default, &&pcode_default,
+		&&pcode_default, &&pcode_default, &&pcode_default, &&pcode_PCD_PLAYERNUMBER,
+		&&pcode_PCD_ACTIVATORTID, &&pcode_PCD_DECODEDGOTO, &&pcode_PCD_DECODEDUNKNOWN
+	};
+#endif
+
 	while (state == SCRIPT_Running)
 	{
 		if (++runaway > 500000)
@@ -1624,184 +2128,197 @@ void DLevelScript::RunScript ()
 		}
 
 		pcd = NEXTBYTE;
+#ifdef ACS_THREADED_DISPATCH
+		goto *pcodelabels[pcd];
+#endif
 		switch (pcd)
 		{
+		PCODE (PCD_DECODEDGOTO)
+			// Falls through to code decoded elsewhere; not a real p-code,
+			// so it does not count toward the runaway limit.
+			pc = level.behavior->CodePtr (*pc);
+			runaway--;
+			NEXTPCODE;
+
+		PCODE (PCD_DECODEDUNKNOWN)
+			pcd = NEXTWORD;
+			// fall through
 		default:
+#ifdef ACS_THREADED_DISPATCH
+		pcode_default:
+#endif
 			Printf (PRINT_HIGH,"Unknown P-Code %d in script %d\n", pcd, script);
 			// fall through
-		case PCD_TERMINATE:
+		PCODE (PCD_TERMINATE)
 			state = SCRIPT_PleaseRemove;
 			break;
 
-		case PCD_NOP:
-			break;
+		PCODE (PCD_NOP)
+			NEXTPCODE;
 
-		case PCD_SUSPEND:
+		PCODE (PCD_SUSPEND)
 			state = SCRIPT_Suspended;
 			break;
 
-		case PCD_PUSHNUMBER:
+		PCODE (PCD_PUSHNUMBER)
 			PushToStack (NEXTWORD);
-			break;
+			NEXTPCODE;
 
-		case PCD_PUSHBYTE:
-			PushToStack (*(BYTE *)pc);
-			pc = (int *)((BYTE *)pc + 1);
-			break;
+		PCODE (PCD_PUSHBYTE)
+			PushToStack (NEXTBYTE);
+			NEXTPCODE;
 
-		case PCD_PUSH2BYTES:
-			Stack[sp] = ((BYTE *)pc)[0];
-			Stack[sp+1] = ((BYTE *)pc)[1];
+		PCODE (PCD_PUSH2BYTES)
+			Stack[sp] = pc[0];
+			Stack[sp+1] = pc[1];
 			sp += 2;
-			pc = (int *)((BYTE *)pc + 2);
-			break;
+			pc += 2;
+			NEXTPCODE;
 
-		case PCD_PUSH3BYTES:
-			Stack[sp] = ((BYTE *)pc)[0];
-			Stack[sp+1] = ((BYTE *)pc)[1];
-			Stack[sp+2] = ((BYTE *)pc)[2];
+		PCODE (PCD_PUSH3BYTES)
+			Stack[sp] = pc[0];
+			Stack[sp+1] = pc[1];
+			Stack[sp+2] = pc[2];
 			sp += 3;
-			pc = (int *)((BYTE *)pc + 3);
-			break;
+			pc += 3;
+			NEXTPCODE;
 
-		case PCD_PUSH4BYTES:
-			Stack[sp] = ((BYTE *)pc)[0];
-			Stack[sp+1] = ((BYTE *)pc)[1];
-			Stack[sp+2] = ((BYTE *)pc)[2];
-			Stack[sp+3] = ((BYTE *)pc)[3];
+		PCODE (PCD_PUSH4BYTES)
+			Stack[sp] = pc[0];
+			Stack[sp+1] = pc[1];
+			Stack[sp+2] = pc[2];
+			Stack[sp+3] = pc[3];
 			sp += 4;
-			pc = (int *)((BYTE *)pc + 4);
-			break;
-
-		case PCD_PUSH5BYTES:
-			Stack[sp] = ((BYTE *)pc)[0];
-			Stack[sp+1] = ((BYTE *)pc)[1];
-			Stack[sp+2] = ((BYTE *)pc)[2];
-			Stack[sp+3] = ((BYTE *)pc)[3];
-			Stack[sp+4] = ((BYTE *)pc)[4];
+			pc += 4;
+			NEXTPCODE;
+
+		PCODE (PCD_PUSH5BYTES)
+			Stack[sp] = pc[0];
+			Stack[sp+1] = pc[1];
+			Stack[sp+2] = pc[2];
+			Stack[sp+3] = pc[3];
+			Stack[sp+4] = pc[4];
 			sp += 5;
-			pc = (int *)((BYTE *)pc + 5);
-			break;
+			pc += 5;
+			NEXTPCODE;
 
-		case PCD_PUSHBYTES:
-			temp = *(BYTE *)pc;
-			pc = (int *)((BYTE *)pc + temp + 1);
-			for (temp = -temp; temp; temp++)
+		PCODE (PCD_PUSHBYTES)
+			for (temp = NEXTBYTE; temp; temp--)
 			{
-				PushToStack (*((BYTE *)pc + temp));
+				PushToStack (NEXTBYTE);
 			}
-			break;
+			NEXTPCODE;
 
-		case PCD_DUP:
+		PCODE (PCD_DUP)
 			Stack[sp] = Stack[sp-1];
 			sp++;
-			break;
+			NEXTPCODE;
 
-		case PCD_SWAP:
+		PCODE (PCD_SWAP)
 			std::swap(Stack[sp-2], Stack[sp-1]);
-			break;
+			NEXTPCODE;
 
-		case PCD_LSPEC1:
+		PCODE (PCD_LSPEC1)
 			LineSpecials[NEXTBYTE] (activationline, activator,
 									STACK(1), 0, 0, 0, 0);
 			sp -= 1;
 			break;
 
-		case PCD_LSPEC2:
+		PCODE (PCD_LSPEC2)
 			LineSpecials[NEXTBYTE] (activationline, activator,
 									STACK(2), STACK(1), 0, 0, 0);
 			sp -= 2;
 			break;
 
-		case PCD_LSPEC3:
+		PCODE (PCD_LSPEC3)
 			LineSpecials[NEXTBYTE] (activationline, activator,
 									STACK(3), STACK(2), STACK(1), 0, 0);
 			sp -= 3;
 			break;
 
-		case PCD_LSPEC4:
+		PCODE (PCD_LSPEC4)
 			LineSpecials[NEXTBYTE] (activationline, activator,
 									STACK(4), STACK(3), STACK(2),
 									STACK(1), 0);
 			sp -= 4;
 			break;
 
-		case PCD_LSPEC5:
+		PCODE (PCD_LSPEC5)
 			LineSpecials[NEXTBYTE] (activationline, activator,
 									STACK(5), STACK(4), STACK(3),
 									STACK(2), STACK(1));
 			sp -= 5;
 			break;
 
-		case PCD_LSPEC1DIRECT:
+		PCODE (PCD_LSPEC1DIRECT)
 			temp = NEXTBYTE;
 			LineSpecials[temp] (activationline, activator,
 								pc[0], 0, 0, 0, 0);
 			pc += 1;
 			break;
 
-		case PCD_LSPEC2DIRECT:
+		PCODE (PCD_LSPEC2DIRECT)
 			temp = NEXTBYTE;
 			LineSpecials[temp] (activationline, activator,
 								pc[0], pc[1], 0, 0, 0);
 			pc += 2;
 			break;
 
-		case PCD_LSPEC3DIRECT:
+		PCODE (PCD_LSPEC3DIRECT)
 			temp = NEXTBYTE;
 			LineSpecials[temp] (activationline, activator,
 								pc[0], pc[1], pc[2], 0, 0);
 			pc += 3;
 			break;
 
-		case PCD_LSPEC4DIRECT:
+		PCODE (PCD_LSPEC4DIRECT)
 			temp = NEXTBYTE;
 			LineSpecials[temp] (activationline, activator,
 								pc[0], pc[1], pc[2], pc[3], 0);
 			pc += 4;
 			break;
 
-		case PCD_LSPEC5DIRECT:
+		PCODE (PCD_LSPEC5DIRECT)
 			temp = NEXTBYTE;
 			LineSpecials[temp] (activationline, activator,
 								pc[0], pc[1], pc[2], pc[3], pc[4]);
 			pc += 5;
 			break;
 
-		case PCD_LSPEC1DIRECTB:
-			LineSpecials[((BYTE *)pc)[0]] (activationline, activator,
-				((BYTE *)pc)[1], 0, 0, 0, 0);
-			pc = (int *)((BYTE *)pc + 2);
+		PCODE (PCD_LSPEC1DIRECTB)
+			LineSpecials[pc[0]] (activationline, activator,
+				pc[1], 0, 0, 0, 0);
+			pc += 2;
 			break;
 
-		case PCD_LSPEC2DIRECTB:
-			LineSpecials[((BYTE *)pc)[0]] (activationline, activator,
-				((BYTE *)pc)[1], ((BYTE *)pc)[2], 0, 0, 0);
-			pc = (int *)((BYTE *)pc + 3);
+		PCODE (PCD_LSPEC2DIRECTB)
+			LineSpecials[pc[0]] (activationline, activator,
+				pc[1], pc[2], 0, 0, 0);
+			pc += 3;
 			break;
 
-		case PCD_LSPEC3DIRECTB:
-			LineSpecials[((BYTE *)pc)[0]] (activationline, activator,
-				((BYTE *)pc)[1], ((BYTE *)pc)[2], ((BYTE *)pc)[3], 0, 0);
-			pc = (int *)((BYTE *)pc + 4);
+		PCODE (PCD_LSPEC3DIRECTB)
+			LineSpecials[pc[0]] (activationline, activator,
+				pc[1], pc[2], pc[3], 0, 0);
+			pc += 4;
 			break;
 
-		case PCD_LSPEC4DIRECTB:
-			LineSpecials[((BYTE *)pc)[0]] (activationline, activator,
-				((BYTE *)pc)[1], ((BYTE *)pc)[2], ((BYTE *)pc)[3],
-				((BYTE *)pc)[4], 0);
-			pc = (int *)((BYTE *)pc + 5);
+		PCODE (PCD_LSPEC4DIRECTB)
+			LineSpecials[pc[0]] (activationline, activator,
+				pc[1], pc[2], pc[3],
+				pc[4], 0);
+			pc += 5;
 			break;
 
-		case PCD_LSPEC5DIRECTB:
-			LineSpecials[((BYTE *)pc)[0]] (activationline, activator,
-				((BYTE *)pc)[1], ((BYTE *)pc)[2], ((BYTE *)pc)[3],
-				((BYTE *)pc)[4], ((BYTE *)pc)[5]);
-			pc = (int *)((BYTE *)pc + 6);
+		PCODE (PCD_LSPEC5DIRECTB)
+			LineSpecials[pc[0]] (activationline, activator,
+				pc[1], pc[2], pc[3],
+				pc[4], pc[5]);
+			pc += 6;
 			break;
 
-		case PCD_CALL:
-		case PCD_CALLDISCARD:
+		PCODE (PCD_CALL)
+		PCODE (PCD_CALLDISCARD)
 			{
 				int funcnum;
 				int i;
@@ -1838,8 +2355,8 @@ void DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_RETURNVOID:
-		case PCD_RETURNVAL:
+		PCODE (PCD_RETURNVOID)
+		PCODE (PCD_RETURNVAL)
 			{
 				int value;
 				CallReturn *retState;
@@ -1872,128 +2389,128 @@ void DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_ADD:
+		PCODE (PCD_ADD)
 			STACK(2) = STACK(2) + STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_SUBTRACT:
+		PCODE (PCD_SUBTRACT)
 			STACK(2) = STACK(2) - STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_MULTIPLY:
+		PCODE (PCD_MULTIPLY)
 			STACK(2) = STACK(2) * STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_DIVIDE:
+		PCODE (PCD_DIVIDE)
 			STACK(2) = STACK(2) / STACK(1);
 			sp--;
 			break;
 
-		case PCD_MODULUS:
+		PCODE (PCD_MODULUS)
 			STACK(2) = STACK(2) % STACK(1);
 			sp--;
 			break;
 
-		case PCD_EQ:
+		PCODE (PCD_EQ)
 			STACK(2) = (STACK(2) == STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_NE:
+		PCODE (PCD_NE)
 			STACK(2) = (STACK(2) != STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_LT:
+		PCODE (PCD_LT)
 			STACK(2) = (STACK(2) < STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_GT:
+		PCODE (PCD_GT)
 			STACK(2) = (STACK(2) > STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_LE:
+		PCODE (PCD_LE)
 			STACK(2) = (STACK(2) <= STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_GE:
+		PCODE (PCD_GE)
 			STACK(2) = (STACK(2) >= STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ASSIGNSCRIPTVAR:
+		PCODE (PCD_ASSIGNSCRIPTVAR)
 			locals[NEXTBYTE] = STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
 
-		case PCD_ASSIGNMAPVAR:
+		PCODE (PCD_ASSIGNMAPVAR)
 			level.vars[NEXTBYTE] = STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ASSIGNWORLDVAR:
+		PCODE (PCD_ASSIGNWORLDVAR)
 			ACS_WorldVars[NEXTBYTE] = STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ASSIGNGLOBALVAR:
+		PCODE (PCD_ASSIGNGLOBALVAR)
 			ACS_GlobalVars[NEXTBYTE] = STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ASSIGNMAPARRAY:
+		PCODE (PCD_ASSIGNMAPARRAY)
 			level.behavior->SetArrayVal (ACS_WorldVars[NEXTBYTE], STACK(2), STACK(1));
 			sp -= 2;
 			break;
 
-		case PCD_PUSHSCRIPTVAR:
+		PCODE (PCD_PUSHSCRIPTVAR)
 			PushToStack (locals[NEXTBYTE]);
-			break;
+			NEXTPCODE;
 
-		case PCD_PUSHMAPVAR:
+		PCODE (PCD_PUSHMAPVAR)
 			PushToStack (level.vars[NEXTBYTE]);
-			break;
+			NEXTPCODE;
 
-		case PCD_PUSHWORLDVAR:
+		PCODE (PCD_PUSHWORLDVAR)
 			PushToStack (ACS_WorldVars[NEXTBYTE]);
-			break;
+			NEXTPCODE;
 
-		case PCD_PUSHGLOBALVAR:
+		PCODE (PCD_PUSHGLOBALVAR)
 			PushToStack (ACS_GlobalVars[NEXTBYTE]);
-			break;
+			NEXTPCODE;
 
-		case PCD_PUSHMAPARRAY:
+		PCODE (PCD_PUSHMAPARRAY)
 			STACK(1) = level.behavior->GetArrayVal (level.vars[NEXTBYTE], STACK(1));
 			break;
 
-		case PCD_ADDSCRIPTVAR:
+		PCODE (PCD_ADDSCRIPTVAR)
 			locals[NEXTBYTE] += STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ADDMAPVAR:
+		PCODE (PCD_ADDMAPVAR)
 			level.vars[NEXTBYTE] += STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ADDWORLDVAR:
+		PCODE (PCD_ADDWORLDVAR)
 			ACS_WorldVars[NEXTBYTE] += STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ADDGLOBALVAR:
+		PCODE (PCD_ADDGLOBALVAR)
 			ACS_GlobalVars[NEXTBYTE] += STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ADDMAPARRAY:
+		PCODE (PCD_ADDMAPARRAY)
 			{
 				int a = ACS_WorldVars[NEXTBYTE];
 				int i = STACK(2);
@@ -2003,27 +2520,27 @@ void DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_SUBSCRIPTVAR:
+		PCODE (PCD_SUBSCRIPTVAR)
 			locals[NEXTBYTE] -= STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_SUBMAPVAR:
+		PCODE (PCD_SUBMAPVAR)
 			level.vars[NEXTBYTE] -= STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_SUBWORLDVAR:
+		PCODE (PCD_SUBWORLDVAR)
 			ACS_WorldVars[NEXTBYTE] -= STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_SUBGLOBALVAR:
+		PCODE (PCD_SUBGLOBALVAR)
 			ACS_GlobalVars[NEXTBYTE] -= STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_SUBMAPARRAY:
+		PCODE (PCD_SUBMAPARRAY)
 			{
 				int a = ACS_WorldVars[NEXTBYTE];
 				int i = STACK(2);
@@ -2033,27 +2550,27 @@ void DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_MULSCRIPTVAR:
+		PCODE (PCD_MULSCRIPTVAR)
 			locals[NEXTBYTE] *= STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_MULMAPVAR:
+		PCODE (PCD_MULMAPVAR)
 			level.vars[NEXTBYTE] *= STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_MULWORLDVAR:
+		PCODE (PCD_MULWORLDVAR)
 			ACS_WorldVars[NEXTBYTE] *= STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_MULGLOBALVAR:
+		PCODE (PCD_MULGLOBALVAR)
 			ACS_GlobalVars[NEXTBYTE] *= STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_MULMAPARRAY:
+		PCODE (PCD_MULMAPARRAY)
 			{
 				int a = ACS_WorldVars[NEXTBYTE];
 				int i = STACK(2);
@@ -2063,27 +2580,27 @@ void DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_DIVSCRIPTVAR:
+		PCODE (PCD_DIVSCRIPTVAR)
 			locals[NEXTBYTE] /= STACK(1);
 			sp--;
 			break;
 
-		case PCD_DIVMAPVAR:
+		PCODE (PCD_DIVMAPVAR)
 			level.vars[NEXTBYTE] /= STACK(1);
 			sp--;
 			break;
 
-		case PCD_DIVWORLDVAR:
+		PCODE (PCD_DIVWORLDVAR)
 			ACS_WorldVars[NEXTBYTE] /= STACK(1);
 			sp--;
 			break;
 
-		case PCD_DIVGLOBALVAR:
+		PCODE (PCD_DIVGLOBALVAR)
 			ACS_GlobalVars[NEXTBYTE] /= STACK(1);
 			sp--;
 			break;
 
-		case PCD_DIVMAPARRAY:
+		PCODE (PCD_DIVMAPARRAY)
 			{
 				int a = ACS_WorldVars[NEXTBYTE];
 				int i = STACK(2);
@@ -2093,27 +2610,27 @@ void DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_MODSCRIPTVAR:
+		PCODE (PCD_MODSCRIPTVAR)
 			locals[NEXTBYTE] %= STACK(1);
 			sp--;
 			break;
 
-		case PCD_MODMAPVAR:
+		PCODE (PCD_MODMAPVAR)
 			level.vars[NEXTBYTE] %= STACK(1);
 			sp--;
 			break;
 
-		case PCD_MODWORLDVAR:
+		PCODE (PCD_MODWORLDVAR)
 			ACS_WorldVars[NEXTBYTE] %= STACK(1);
 			sp--;
 			break;
 
-		case PCD_MODGLOBALVAR:
+		PCODE (PCD_MODGLOBALVAR)
 			ACS_GlobalVars[NEXTBYTE] %= STACK(1);
 			sp--;
 			break;
 
-		case PCD_MODMAPARRAY:
+		PCODE (PCD_MODMAPARRAY)
 			{
 				int a = ACS_WorldVars[NEXTBYTE];
 				int i = STACK(2);
@@ -2123,23 +2640,23 @@ void DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_INCSCRIPTVAR:
+		PCODE (PCD_INCSCRIPTVAR)
 			++locals[NEXTBYTE];
-			break;
+			NEXTPCODE;
 
-		case PCD_INCMAPVAR:
+		PCODE (PCD_INCMAPVAR)
 			++level.vars[NEXTBYTE];
-			break;
+			NEXTPCODE;
 
-		case PCD_INCWORLDVAR:
+		PCODE (PCD_INCWORLDVAR)
 			++ACS_WorldVars[NEXTBYTE];
-			break;
+			NEXTPCODE;
 
-		case PCD_INCGLOBALVAR:
+		PCODE (PCD_INCGLOBALVAR)
 			++ACS_GlobalVars[NEXTBYTE];
-			break;
+			NEXTPCODE;
 
-		case PCD_INCMAPARRAY:
+		PCODE (PCD_INCMAPARRAY)
 			{
 				int a = ACS_WorldVars[NEXTBYTE];
 				int i = STACK(2);
@@ -2149,23 +2666,23 @@ void DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_DECSCRIPTVAR:
+		PCODE (PCD_DECSCRIPTVAR)
 			--locals[NEXTBYTE];
-			break;
+			NEXTPCODE;
 
-		case PCD_DECMAPVAR:
+		PCODE (PCD_DECMAPVAR)
 			--level.vars[NEXTBYTE];
-			break;
+			NEXTPCODE;
 
-		case PCD_DECWORLDVAR:
+		PCODE (PCD_DECWORLDVAR)
 			--ACS_WorldVars[NEXTBYTE];
-			break;
+			NEXTPCODE;
 
-		case PCD_DECGLOBALVAR:
+		PCODE (PCD_DECGLOBALVAR)
 			--ACS_GlobalVars[NEXTBYTE];
-			break;
+			NEXTPCODE;
 
-		case PCD_DECMAPARRAY:
+		PCODE (PCD_DECMAPARRAY)
 			{
 				int a = ACS_WorldVars[NEXTBYTE];
 				int i = STACK(2);
@@ -2175,166 +2692,165 @@ void DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_GOTO:
-			pc = level.behavior->Ofs2PC (*pc);
-			break;
+		PCODE (PCD_GOTO)
+			pc = level.behavior->CodePtr (*pc);
+			NEXTPCODE;
 
-		case PCD_IFGOTO:
+		PCODE (PCD_IFGOTO)
 			if (STACK(1))
-				pc = level.behavior->Ofs2PC (*pc);
+				pc = level.behavior->CodePtr (*pc);
 			else
 				pc++;
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_DROP:
+		PCODE (PCD_DROP)
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_DELAY:
+		PCODE (PCD_DELAY)
 			state = SCRIPT_Delayed;
 			statedata = STACK(1);
 			sp--;
 			break;
 
-		case PCD_DELAYDIRECT:
+		PCODE (PCD_DELAYDIRECT)
 			state = SCRIPT_Delayed;
 			statedata = NEXTWORD;
 			break;
 
-		case PCD_DELAYDIRECTB:
+		PCODE (PCD_DELAYDIRECTB)
 			state = SCRIPT_Delayed;
-			statedata = *(BYTE *)pc;
-			pc = (int *)((BYTE *)pc + 1);
+			statedata = NEXTBYTE;
 			break;
 
-		case PCD_RANDOM:
+		PCODE (PCD_RANDOM)
 			STACK(2) = Random (STACK(2), STACK(1));
 			sp--;
 			break;
 
-		case PCD_RANDOMDIRECT:
+		PCODE (PCD_RANDOMDIRECT)
 			PushToStack (Random (pc[0], pc[1]));
 			pc += 2;
 			break;
 
-		case PCD_RANDOMDIRECTB:
-			PushToStack (Random (((BYTE *)pc)[0], ((BYTE *)pc)[1]));
-			pc = (int *)((BYTE *)pc + 2);
+		PCODE (PCD_RANDOMDIRECTB)
+			PushToStack (Random (pc[0], pc[1]));
+			pc += 2;
 			break;
 
-		case PCD_THINGCOUNT:
+		PCODE (PCD_THINGCOUNT)
 			STACK(2) = ThingCount (STACK(2), STACK(1));
 			sp--;
 			break;
 
-		case PCD_THINGCOUNTDIRECT:
+		PCODE (PCD_THINGCOUNTDIRECT)
 			PushToStack (ThingCount (pc[0], pc[1]));
 			pc += 2;
 			break;
 
-		case PCD_TAGWAIT:
+		PCODE (PCD_TAGWAIT)
 			state = SCRIPT_TagWait;
 			statedata = STACK(1);
 			sp--;
 			break;
 
-		case PCD_TAGWAITDIRECT:
+		PCODE (PCD_TAGWAITDIRECT)
 			state = SCRIPT_TagWait;
 			statedata = NEXTWORD;
 			break;
 
-		case PCD_POLYWAIT:
+		PCODE (PCD_POLYWAIT)
 			state = SCRIPT_PolyWait;
 			statedata = STACK(1);
 			sp--;
 			break;
 
-		case PCD_POLYWAITDIRECT:
+		PCODE (PCD_POLYWAITDIRECT)
 			state = SCRIPT_PolyWait;
 			statedata = NEXTWORD;
 			break;
 
-		case PCD_CHANGEFLOOR:
+		PCODE (PCD_CHANGEFLOOR)
 			ChangeFlat (STACK(2), STACK(1), 0);
 			sp -= 2;
 			break;
 
-		case PCD_CHANGEFLOORDIRECT:
+		PCODE (PCD_CHANGEFLOORDIRECT)
 			ChangeFlat (pc[0], pc[1], 0);
 			pc += 2;
 			break;
 
-		case PCD_CHANGECEILING:
+		PCODE (PCD_CHANGECEILING)
 			ChangeFlat (STACK(2), STACK(1), 1);
 			sp -= 2;
 			break;
 
-		case PCD_CHANGECEILINGDIRECT:
+		PCODE (PCD_CHANGECEILINGDIRECT)
 			ChangeFlat (pc[0], pc[1], 1);
 			pc += 2;
 			break;
 
-		case PCD_RESTART:
+		PCODE (PCD_RESTART)
 			pc = level.behavior->FindScript (script);
 			break;
 
-		case PCD_ANDLOGICAL:
+		PCODE (PCD_ANDLOGICAL)
 			STACK(2) = (STACK(2) && STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ORLOGICAL:
+		PCODE (PCD_ORLOGICAL)
 			STACK(2) = (STACK(2) || STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ANDBITWISE:
+		PCODE (PCD_ANDBITWISE)
 			STACK(2) = (STACK(2) & STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ORBITWISE:
+		PCODE (PCD_ORBITWISE)
 			STACK(2) = (STACK(2) | STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_EORBITWISE:
+		PCODE (PCD_EORBITWISE)
 			STACK(2) = (STACK(2) ^ STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_NEGATELOGICAL:
+		PCODE (PCD_NEGATELOGICAL)
 			STACK(1) = !STACK(1);
-			break;
+			NEXTPCODE;
 
-		case PCD_LSHIFT:
+		PCODE (PCD_LSHIFT)
 			STACK(2) = (STACK(2) << STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_RSHIFT:
+		PCODE (PCD_RSHIFT)
 			STACK(2) = (STACK(2) >> STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_UNARYMINUS:
+		PCODE (PCD_UNARYMINUS)
 			STACK(1) = -STACK(1);
-			break;
+			NEXTPCODE;
 
-		case PCD_IFNOTGOTO:
+		PCODE (PCD_IFNOTGOTO)
 			if (!STACK(1))
-				pc = level.behavior->Ofs2PC (*pc);
+				pc = level.behavior->CodePtr (*pc);
 			else
 				pc++;
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_LINESIDE:
+		PCODE (PCD_LINESIDE)
 			PushToStack (lineSide);
 			break;
 
-		case PCD_SCRIPTWAIT:
+		PCODE (PCD_SCRIPTWAIT)
 			statedata = STACK(1);
 			if (controller->RunningScripts[statedata])
 				state = SCRIPT_ScriptWait;
@@ -2344,36 +2860,36 @@ void DLevelScript::RunScript ()
 			PutLast ();
 			break;
 
-		case PCD_SCRIPTWAITDIRECT:
+		PCODE (PCD_SCRIPTWAITDIRECT)
 			state = SCRIPT_ScriptWait;
 			statedata = NEXTWORD;
 			PutLast ();
 			break;
 
-		case PCD_CLEARLINESPECIAL:
+		PCODE (PCD_CLEARLINESPECIAL)
 			if (activationline)
 				activationline->special = 0;
 			break;
 
-		case PCD_CASEGOTO:
+		PCODE (PCD_CASEGOTO)
 			if (STACK(1) == NEXTWORD)
 			{
-				pc = level.behavior->Ofs2PC (*pc);
+				pc = level.behavior->CodePtr (*pc);
 				sp--;
 			}
 			else
 			{
 				pc++;
 			}
-			break;
+			NEXTPCODE;
 
-		case PCD_BEGINPRINT:
+		PCODE (PCD_BEGINPRINT)
 			workwhere = work;
 			work[0] = 0;
 			break;
 
-		case PCD_PRINTSTRING:
-		case PCD_PRINTLOCALIZED:
+		PCODE (PCD_PRINTSTRING)
+		PCODE (PCD_PRINTLOCALIZED)
 			lookup = (pcd == PCD_PRINTSTRING ?
 				level.behavior->LookupString (STACK(1)) :
 				level.behavior->LocalizeString (STACK(1)));
@@ -2384,26 +2900,26 @@ void DLevelScript::RunScript ()
 			--sp;
 			break;
 
-		case PCD_PRINTNUMBER:
+		PCODE (PCD_PRINTNUMBER)
 			workwhere += sprintf (workwhere, "%d", STACK(1));
 			--sp;
 			break;
 
-		case PCD_PRINTCHARACTER:
+		PCODE (PCD_PRINTCHARACTER)
 			workwhere[0] = STACK(1);
 			workwhere[1] = 0;
 			workwhere++;
 			--sp;
 			break;
 
-		case PCD_PRINTFIXED:
+		PCODE (PCD_PRINTFIXED)
 			workwhere += sprintf (workwhere, "%g", FIXED2FLOAT(STACK(1)));
 			--sp;
 			break;
 
 		// [BC] Print activator's name
 		// [RH] Fancied up a bit
-		case PCD_PRINTNAME:
+		PCODE (PCD_PRINTNAME)
 			{
 				player_t *player = NULL;
 
@@ -2443,8 +2959,8 @@ void DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_ENDPRINT:
-		case PCD_ENDPRINTBOLD:
+		PCODE (PCD_ENDPRINT)
+		PCODE (PCD_ENDPRINTBOLD)
 		//case PCD_MOREHUDMESSAGE:
 			strbin (work);
 			if (pcd != PCD_MOREHUDMESSAGE)
@@ -2520,11 +3036,11 @@ void DLevelScript::RunScript ()
 			pc++;
 			break;
         */
-		case PCD_PLAYERCOUNT:
+		PCODE (PCD_PLAYERCOUNT)
 			PushToStack (CountPlayers ());
 			break;
 
-		case PCD_GAMETYPE:
+		PCODE (PCD_GAMETYPE)
 		    if (sv_gametype == 3)
                 PushToStack (GAME_NET_CTF);
             else if (sv_gametype == 2)
@@ -2537,27 +3053,27 @@ void DLevelScript::RunScript ()
 				PushToStack (GAME_SINGLE_PLAYER);
 			break;
 
-		case PCD_GAMESKILL:
+		PCODE (PCD_GAMESKILL)
 			PushToStack (sv_skill);
 			break;
 
 // [BC] Start ST PCD's
-		case PCD_PLAYERHEALTH:
+		PCODE (PCD_PLAYERHEALTH)
 			if (activator)
 				PushToStack (activator->health);
 			break;
 
-		case PCD_PLAYERARMORPOINTS:
+		PCODE (PCD_PLAYERARMORPOINTS)
 			if (activator && activator->player)
 				PushToStack (activator->player->armorpoints);
 			break;
 
-		case PCD_PLAYERFRAGS:
+		PCODE (PCD_PLAYERFRAGS)
 			if (activator && activator->player)
 				PushToStack (activator->player->fragcount);
 			break;
 
-		case PCD_MUSICCHANGE:
+		PCODE (PCD_MUSICCHANGE)
 			lookup = level.behavior->LookupString (STACK(2));
 			if (lookup != NULL)
 			{
@@ -2566,16 +3082,16 @@ void DLevelScript::RunScript ()
 			sp -= 2;
 			break;
 
-		case PCD_SINGLEPLAYER:
+		PCODE (PCD_SINGLEPLAYER)
 			PushToStack (!multiplayer);
 			break;
 // [BC] End ST PCD's
 
-		case PCD_TIMER:
+		PCODE (PCD_TIMER)
 			PushToStack (level.time);
 			break;
 
-		case PCD_SECTORSOUND:
+		PCODE (PCD_SECTORSOUND)
 			lookup = level.behavior->LookupString (STACK(2));
 			if (lookup != NULL)
 			{
@@ -2600,7 +3116,7 @@ void DLevelScript::RunScript ()
 			sp -= 2;
 			break;
 
-		case PCD_AMBIENTSOUND:
+		PCODE (PCD_AMBIENTSOUND)
 			lookup = level.behavior->LookupString (STACK(2));
 			if (lookup != NULL)
 			{
@@ -2611,7 +3127,7 @@ void DLevelScript::RunScript ()
 			sp -= 2;
 			break;
 
-		case PCD_LOCALAMBIENTSOUND:
+		PCODE (PCD_LOCALAMBIENTSOUND)
 			lookup = level.behavior->LookupString (STACK(2));
 			if (lookup != NULL && consoleplayer().camera == activator)
 			{
@@ -2622,7 +3138,7 @@ void DLevelScript::RunScript ()
 			sp -= 2;
 			break;
 
-		case PCD_ACTIVATORSOUND:
+		PCODE (PCD_ACTIVATORSOUND)
 			lookup = level.behavior->LookupString (STACK(2));
 			if (lookup != NULL)
 			{
@@ -2633,7 +3149,7 @@ void DLevelScript::RunScript ()
 			sp -= 2;
 			break;
 
-		case PCD_SOUNDSEQUENCE:
+		PCODE (PCD_SOUNDSEQUENCE)
 			lookup = level.behavior->LookupString (STACK(1));
 			if (lookup != NULL)
 			{
@@ -2647,12 +3163,12 @@ void DLevelScript::RunScript ()
 			sp--;
 			break;
 
-		case PCD_SETLINETEXTURE:
+		PCODE (PCD_SETLINETEXTURE)
 			SetLineTexture (STACK(4), STACK(3), STACK(2), STACK(1));
 			sp -= 4;
 			break;
 
-		case PCD_SETLINEBLOCKING:
+		PCODE (PCD_SETLINEBLOCKING)
 			{
 				int line = -1;
 
@@ -2678,7 +3194,7 @@ void DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_SETLINEMONSTERBLOCKING:
+		PCODE (PCD_SETLINEMONSTERBLOCKING)
 			{
 				int line = -1;
 
@@ -2694,7 +3210,7 @@ void DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_SETLINESPECIAL:
+		PCODE (PCD_SETLINESPECIAL)
 			{
 				int linenum = -1;
 
@@ -2712,7 +3228,7 @@ void DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_SETTHINGSPECIAL:
+		PCODE (PCD_SETTHINGSPECIAL)
 			{
 				FActorIterator iterator (STACK(7));
 				AActor *actor;
@@ -2730,7 +3246,7 @@ void DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_THINGSOUND:
+		PCODE (PCD_THINGSOUND)
 			lookup = level.behavior->LookupString (STACK(2));
 			if (lookup != NULL)
 			{
@@ -2748,33 +3264,33 @@ void DLevelScript::RunScript ()
 			break;
 
 
-		case PCD_FIXEDMUL:
+		PCODE (PCD_FIXEDMUL)
 			STACK(2) = FixedMul (STACK(2), STACK(1));
 			sp--;
 			break;
 
-		case PCD_FIXEDDIV:
+		PCODE (PCD_FIXEDDIV)
 			STACK(2) = FixedDiv (STACK(2), STACK(1));
 			sp--;
 			break;
 
-		case PCD_SETGRAVITY:
+		PCODE (PCD_SETGRAVITY)
 			level.gravity = (float)STACK(1) / 65536.f;
 			sp--;
 			break;
 
-		case PCD_SETGRAVITYDIRECT:
+		PCODE (PCD_SETGRAVITYDIRECT)
 			level.gravity = (float)pc[0] / 65536.f;
 			pc++;
 			break;
 
-		case PCD_SETAIRCONTROL:
+		PCODE (PCD_SETAIRCONTROL)
 			level.aircontrol = STACK(1);
 			sp--;
 			G_AirControlChanged ();
 			break;
 
-		case PCD_SETAIRCONTROLDIRECT:
+		PCODE (PCD_SETAIRCONTROLDIRECT)
 			level.aircontrol = pc[0];
 			pc++;
 			G_AirControlChanged ();
@@ -2800,50 +3316,50 @@ void DLevelScript::RunScript ()
 			pc += 4;
 			break;*/
 
-		case PCD_CLEARINVENTORY:
+		PCODE (PCD_CLEARINVENTORY)
 			ClearInventory (activator);
 			break;
 
-		case PCD_GIVEINVENTORY:
+		PCODE (PCD_GIVEINVENTORY)
 			GiveInventory (activator, level.behavior->LookupString (STACK(2)), STACK(1));
 			sp -= 2;
 			break;
 
-		case PCD_GIVEINVENTORYDIRECT:
+		PCODE (PCD_GIVEINVENTORYDIRECT)
 			GiveInventory (activator, level.behavior->LookupString (pc[0]), pc[1]);
 			pc += 2;
 			break;
 
-		case PCD_TAKEINVENTORY:
+		PCODE (PCD_TAKEINVENTORY)
 			TakeInventory (activator, level.behavior->LookupString (STACK(2)), STACK(1));
 			sp -= 2;
 			break;
 
-		case PCD_TAKEINVENTORYDIRECT:
+		PCODE (PCD_TAKEINVENTORYDIRECT)
 			TakeInventory (activator, level.behavior->LookupString (pc[0]), pc[1]);
 			pc += 2;
 			break;
 
-		case PCD_CHECKINVENTORY:
+		PCODE (PCD_CHECKINVENTORY)
 			STACK(1) = CheckInventory (activator, level.behavior->LookupString (STACK(1)));
 			break;
 
-		case PCD_CHECKINVENTORYDIRECT:
+		PCODE (PCD_CHECKINVENTORYDIRECT)
 			PushToStack (CheckInventory (activator, level.behavior->LookupString (pc[0])));
 			pc += 1;
 			break;
 
-		case PCD_SETMUSIC:
+		PCODE (PCD_SETMUSIC)
 			S_ChangeMusic (level.behavior->LookupString (STACK(3)), STACK(2));
 			sp -= 3;
 			break;
 
-		case PCD_SETMUSICDIRECT:
+		PCODE (PCD_SETMUSICDIRECT)
 			S_ChangeMusic (level.behavior->LookupString (pc[0]), pc[1]);
 			pc += 3;
 			break;
 
-		case PCD_LOCALSETMUSIC:
+		PCODE (PCD_LOCALSETMUSIC)
 			if (activator == consoleplayer().mo)
 			{
 				S_ChangeMusic (level.behavior->LookupString (STACK(3)), STACK(2));
@@ -2851,7 +3367,7 @@ void DLevelScript::RunScript ()
 			sp -= 3;
 			break;
 
-		case PCD_LOCALSETMUSICDIRECT:
+		PCODE (PCD_LOCALSETMUSICDIRECT)
 			if (activator == consoleplayer().mo)
 			{
 				S_ChangeMusic (level.behavior->LookupString (pc[0]), pc[1]);
@@ -2859,18 +3375,18 @@ void DLevelScript::RunScript ()
 			pc += 3;
 			break;
 
-		case PCD_FADETO:
+		PCODE (PCD_FADETO)
 			DoFadeTo (STACK(5), STACK(4), STACK(3), STACK(2), STACK(1));
 			sp -= 5;
 			break;
 
-		case PCD_FADERANGE:
+		PCODE (PCD_FADERANGE)
 			DoFadeRange (STACK(9), STACK(8), STACK(7), STACK(6),
 						 STACK(5), STACK(4), STACK(3), STACK(2), STACK(1));
 			sp -= 9;
 			break;
 
-		case PCD_CANCELFADE:
+		PCODE (PCD_CANCELFADE)
 			{
 				TThinkerIterator<DFlashFader> iterator;
 				DFlashFader *fader;
@@ -2889,9 +3405,9 @@ void DLevelScript::RunScript ()
 			STACK(1) = I_PlayMovie (level.behavior->LookupString (STACK(1)));
 			break;
         */
-		case PCD_GETACTORX:
-		case PCD_GETACTORY:
-		case PCD_GETACTORZ:
+		PCODE (PCD_GETACTORX)
+		PCODE (PCD_GETACTORY)
+		PCODE (PCD_GETACTORZ)
 			{
 				AActor *actor;
 
@@ -2915,13 +3431,13 @@ void DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_SETFLOORTRIGGER:
+		PCODE (PCD_SETFLOORTRIGGER)
 			new DPlaneWatcher (activator, activationline, lineSide, false, STACK(8),
 				STACK(7), STACK(6), STACK(5), STACK(4), STACK(3), STACK(2), STACK(1));
 			sp -= 8;
 			break;
 
-		case PCD_SETCEILINGTRIGGER:
+		PCODE (PCD_SETCEILINGTRIGGER)
 			new DPlaneWatcher (activator, activationline, lineSide, true, STACK(8),
 				STACK(7), STACK(6), STACK(5), STACK(4), STACK(3), STACK(2), STACK(1));
 			sp -= 8;
@@ -3039,27 +3555,27 @@ void DLevelScript::RunScript ()
 			break;
         */
 
-		case PCD_SIN:
+		PCODE (PCD_SIN)
 			STACK(1) = finesine[(STACK(1)<<16)>>ANGLETOFINESHIFT];
 			break;
 
-		case PCD_COS:
+		PCODE (PCD_COS)
 			STACK(1) = finecosine[(STACK(1)<<16)>>ANGLETOFINESHIFT];
 			break;
 
-		case PCD_VECTORANGLE:
+		PCODE (PCD_VECTORANGLE)
 			STACK(2) = R_PointToAngle2 (0, 0, STACK(2), STACK(1)) >> 16;
 			sp--;
 			break;
 
-		case PCD_PLAYERNUMBER:
+		PCODE (PCD_PLAYERNUMBER)
 			if (activator == NULL || activator->player == NULL)
 				PushToStack(-1);
 			else
 				PushToStack(activator->player->GetPlayerNumber());
 			break;
 
-		case PCD_ACTIVATORTID:
+		PCODE (PCD_ACTIVATORTID)
 			if (activator == NULL)
 				PushToStack(0);
 			else
@@ -3116,6 +3632,10 @@ void DLevelScript::RunScript ()
 	this->pc = pc;
 	this->sp = sp;
 
+	// runaway is the number of p-codes executed on this pass
+	if (acsprofiling && runaway > 0)
+		P_ProfileScript (script, runaway, I_GetTime () - profilestart, state);
+
 	if (state == SCRIPT_PleaseRemove)
 	{
 		Unlink ();
@@ -3445,5 +3965,88 @@ void DACSThinker::DumpScriptStatus ()
 }
 
 
+static bool P_CompareACSProfiles(const acsprofile_t *a, const acsprofile_t *b)
+{
+	return a->time > b->time;
+}
+
+//
+// P_DumpACSProfile
+// Prints the collected script statistics, most expensive first, and
+// optionally writes them to a CSV file as well
+//
+static void P_DumpACSProfile(const char *csvname)
+{
+	std::vector<const acsprofile_t *> sorted;
+	for (acsprofiles_t::const_iterator it = acsprofiles.begin(); it != acsprofiles.end(); ++it)
+		sorted.push_back(&it->second);
+	std::sort(sorted.begin(), sorted.end(), P_CompareACSProfiles);
+
+	Printf(PRINT_HIGH, "ACS profile: %u tics, %.3f ms total, worst tic %.3f ms (%s, tic %d)\n",
+		acsprofiletics, acsprofiletime / 1000000.0, acsprofileworst / 1000000.0,
+		acsprofileworstmap.empty() ? "-" : acsprofileworstmap.c_str(), acsprofileworsttic);
+	Printf(PRINT_HIGH, "%-8s %6s %8s %12s %10s %10s %10s %8s %8s %8s\n",
+		"map", "script", "runs", "pcodes", "total ms", "avg us", "max us",
+		"suspend", "delay", "wait");
+
+	for (size_t i = 0; i < sorted.size(); i++)
+	{
+		const acsprofile_t *prof = sorted[i];
+		Printf(PRINT_HIGH, "%-8s %6d %8u %12llu %10.3f %10.2f %10.2f %8u %8u %8u\n",
+			prof->map.c_str(), prof->script, prof->runs,
+			(unsigned long long)prof->instructions, prof->time / 1000000.0,
+			prof->time / 1000.0 / prof->runs, prof->maxtime / 1000.0,
+			prof->suspends, prof->delays, prof->waits);
+	}
+
+	if (csvname == NULL)
+		return;
+
+	FILE *fp = fopen(csvname, "w");
+	if (fp == NULL)
+	{
+		Printf(PRINT_HIGH, "Could not open %s for writing.\n", csvname);
+		return;
+	}
+
+	fprintf(fp, "map,script,runs,pcodes,total_ms,avg_us,max_us,suspends,delays,waits\n");
+	for (size_t i = 0; i < sorted.size(); i++)
+	{
+		const acsprofile_t *prof = sorted[i];
+		fprintf(fp, "%s,%d,%u,%llu,%.3f,%.2f,%.2f,%u,%u,%u\n",
+			prof->map.c_str(), prof->script, prof->runs,
+			(unsigned long long)prof->instructions, prof->time / 1000000.0,
+			prof->time / 1000.0 / prof->runs, prof->maxtime / 1000.0,
+			prof->suspends, prof->delays, prof->waits);
+	}
+	fclose(fp);
+
+	Printf(PRINT_HIGH, "Wrote %u scripts to %s.\n", (unsigned int)sorted.size(), csvname);
+}
+
+BEGIN_COMMAND (acsprofile)
+{
+	if (argc > 1 && stricmp(argv[1], "start") == 0)
+	{
+		P_ResetACSProfile();
+		sv_acsprofile.Set(1.0f);
+		Printf(PRINT_HIGH, "ACS profiling started.\n");
+	}
+	else if (argc > 1 && stricmp(argv[1], "stop") == 0)
+	{
+		sv_acsprofile.Set(0.0f);
+		Printf(PRINT_HIGH, "ACS profiling stopped.\n");
+	}
+	else if (argc > 1 && stricmp(argv[1], "dump") == 0)
+	{
+		P_DumpACSProfile(argc > 2 ? argv[2] : NULL);
+	}
+	else
+	{
+		Printf(PRINT_HIGH, "Usage: acsprofile start|stop|dump [file.csv]\n");
+	}
+}
+END_COMMAND (acsprofile)
+
 VERSION_CONTROL (p_acs_cpp, "$Id$")
 
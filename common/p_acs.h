@@ -73,8 +73,9 @@ public:
 	const char *LookupString (DWORD index, DWORD ofs=0) const;
 	const char *LocalizeString (DWORD index) const;
 	void StartTypedScripts (WORD type, AActor *activator, int arg0=0, int arg1=0, int arg2=0) const;
-	DWORD PC2Ofs (int *pc) const { return (BYTE *)pc - Data; }
-	int *Ofs2PC (DWORD ofs) const { return (int *)(Data + ofs); }
+	DWORD PC2Ofs (int *pc) const { return CodeOfs[pc - Code]; }
+	int *Ofs2PC (DWORD ofs) const { return Code + (ofs < (DWORD)DataSize ? OfsToCode[ofs] : 0); }
+	int *CodePtr (int index) const { return Code + index; }
 	ACSFormat GetFormat() const { return Format; }
 	ScriptFunction *GetFunction (int funcnum) const;
 	int GetArrayVal (int arraynum, int index) const;
@@ -97,6 +98,18 @@ private:
 	DWORD LanguageNeutral;
 	DWORD Localized;
 
+	// Scripts and functions are decoded once at load into a stream of
+	// native ints: the p-code followed by its operands, each widened to a
+	// full int, with jump targets resolved to indices into Code. pc values
+	// handed out by FindScript/Ofs2PC point into this stream; PC2Ofs maps
+	// them back to lump offsets so savegames are unchanged.
+	int *Code;
+	DWORD *CodeOfs;		// lump offset of the instruction at each Code slot
+	int *OfsToCode;		// Code index of the instruction at each lump offset
+	int CodeSize;
+
+	void DecodePCodes ();
+
 	static int STACK_ARGS SortScripts (const void *a, const void *b);
 	void AddLanguage (DWORD lang);
 	DWORD FindLanguage (DWORD lang, bool ignoreregion) const;
@@ -365,7 +378,12 @@ public:
 		PCD_PLAYERNUMBER,
 		PCD_ACTIVATORTID,
 
-		PCODE_COMMAND_COUNT
+		PCODE_COMMAND_COUNT,
+
+		// Internal p-codes only produced by FBehavior::DecodePCodes
+		PCD_DECODEDGOTO = PCODE_COMMAND_COUNT,	// continue at an already decoded index
+		PCD_DECODEDUNKNOWN,						// out of range p-code, original value follows
+		PCODE_DECODED_COUNT
 	};
 
 	// Some constants used by ACS scripts
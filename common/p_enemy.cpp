@@ -24,6 +24,7 @@
 //-----------------------------------------------------------------------------
 
 #include <math.h>
+#include <vector>
 #include "m_random.h"
 #include "m_alloc.h"
 #include "i_system.h"
@@ -39,6 +40,7 @@
 #include "p_mobj.h"
 
 #include "d_player.h"
+#include "c_dispatch.h"
 
 extern bool HasBehavior;
 
@@ -46,6 +48,11 @@ EXTERN_CVAR (sv_allowexit)
 EXTERN_CVAR (sv_fastmonsters)
 EXTERN_CVAR (co_realactorheight)
 EXTERN_CVAR (co_zdoomphys)
+EXTERN_CVAR (sv_sightcache)
+EXTERN_CVAR (sv_sightbatch)
+EXTERN_CVAR (sv_ailod)
+EXTERN_CVAR (sv_ailoddist)
+EXTERN_CVAR (sv_ailodinterval)
 
 enum dirtype_t
 {
@@ -332,8 +339,7 @@ BOOL P_Move (AActor *actor)
 
 	if (try_ok && friction > ORIG_FRICTION)
 	{
-		actor->x = origx;
-		actor->y = origy;
+		actor->SetOrigin(origx, origy, actor->z);
 		movefactor *= FRACUNIT / ORIG_FRICTION_FACTOR / 4;
 		actor->momx += FixedMul (deltax, movefactor);
 		actor->momy += FixedMul (deltay, movefactor);
@@ -922,6 +928,167 @@ void A_Chase (AActor *actor)
 }
 
 
+//
+// AI level of detail
+//
+// With sv_ailod enabled, idle monsters (waiting in A_Look with nothing to
+// chase) that are further than sv_ailoddist from every player only count
+// down their state every sv_ailodinterval tics, and stop counting down
+// altogether if the REJECT table says that no player's sector can see
+// theirs. Noise reaching their sector (P_NoiseAlert) or a player coming
+// close puts them back to full rate. Never used for demos.
+//
+enum ailodtier_t
+{
+	AILOD_FULL,
+	AILOD_REDUCED,
+	AILOD_ASLEEP,
+	NUMAILODTIERS
+};
+
+static const char *ailod_tiernames[NUMAILODTIERS] = { "full", "reduced", "asleep" };
+static int ailod_tic = -1;
+static unsigned int ailod_counts[NUMAILODTIERS];
+static unsigned int ailod_lastcounts[NUMAILODTIERS];
+
+static ailodtier_t P_AILodTier (AActor *actor)
+{
+	if (!sv_ailod || demorecording || demoplayback || !serverside)
+		return AILOD_FULL;
+
+	if (actor->target || actor->state->action != A_Look ||
+		actor->subsector->sector->soundtarget)
+		return AILOD_FULL;
+
+	const fixed_t lodist = (fixed_t)(sv_ailoddist * FRACUNIT);
+	const int secnum = actor->subsector->sector - sectors;
+	bool seen = false;
+
+	for (Players::iterator it = players.begin(); it != players.end(); ++it)
+	{
+		if (!it->ingame() || it->spectator || !it->mo || !it->mo->subsector)
+			continue;
+
+		if (P_AproxDistance(it->mo->x - actor->x, it->mo->y - actor->y) < lodist)
+			return AILOD_FULL;
+
+		const int pnum = (it->mo->subsector->sector - sectors) * numsectors + secnum;
+		if (rejectempty || !(rejectmatrix[pnum >> 3] & (1 << (pnum & 7))))
+			seen = true;
+	}
+
+	return seen ? AILOD_REDUCED : AILOD_ASLEEP;
+}
+
+//
+// P_AILodSkipThink
+//
+// Returns true if the monster should not advance its state this tic.
+//
+bool P_AILodSkipThink (AActor *actor)
+{
+	if (!(actor->flags & MF_COUNTKILL) || actor->health <= 0)
+		return false;
+
+	if (ailod_tic != level.time)
+	{
+		memcpy(ailod_lastcounts, ailod_counts, sizeof(ailod_counts));
+		memset(ailod_counts, 0, sizeof(ailod_counts));
+		ailod_tic = level.time;
+	}
+
+	ailodtier_t tier = P_AILodTier(actor);
+	ailod_counts[tier]++;
+
+	if (tier == AILOD_ASLEEP)
+		return true;
+
+	if (tier == AILOD_REDUCED)
+		return (level.time + actor->netid) % MAX(1, (int)sv_ailodinterval) != 0;
+
+	return false;
+}
+
+BEGIN_COMMAND (ailod)
+{
+	Printf(PRINT_HIGH, "AI level of detail is %s.\n", sv_ailod ? "enabled" : "disabled");
+	Printf(PRINT_HIGH, "Monsters in each tier last tic:\n");
+	for (int i = 0; i < NUMAILODTIERS; i++)
+		Printf(PRINT_HIGH, "  %-8s %u\n", ailod_tiernames[i], ailod_lastcounts[i]);
+}
+END_COMMAND (ailod)
+
+
+// Monsters whose next state starts next tic, noted as they think.
+static std::vector<AActor::AActorPtr> sightcandidates;
+
+//
+// P_NoteSightCandidate
+//
+// Called for each actor that has just thought and whose state ends next
+// tic. Remembers monsters about to enter A_Look or A_Chase so that their
+// sight checks can be queued without another walk over the thinkers.
+//
+void P_NoteSightCandidate (AActor *actor)
+{
+	if (!sv_sightcache || !sv_sightbatch || clientside || !serverside)
+		return;
+
+	actionf_p1 action = states[actor->state->nextstate].action;
+
+	if (action == A_Look || action == A_Chase)
+		sightcandidates.push_back(actor->ptr());
+}
+
+//
+// P_QueueMonsterSightChecks
+//
+// Queues the sight checks that monsters entering A_Look or A_Chase this
+// tic are about to make and traces them all at once, before any thinker
+// runs. Only the monsters noted by P_NoteSightCandidate during the last
+// thinker pass are looked at. See P_FlushSightChecks.
+//
+void P_QueueMonsterSightChecks (void)
+{
+	if (!sv_sightcache || !sv_sightbatch || clientside || !serverside)
+	{
+		sightcandidates.clear();
+		return;
+	}
+
+	for (size_t i = 0; i < sightcandidates.size(); i++)
+	{
+		AActor *mo = sightcandidates[i];
+
+		// gone, or no longer about to change state this tic
+		if (!mo || mo->tics != 1 || mo->health <= 0 || !mo->subsector || (mo->flags2 & MF2_DORMANT))
+			continue;
+
+		actionf_p1 action = states[mo->state->nextstate].action;
+
+		if (action == A_Look)
+		{
+			AActor *targ = mo->subsector->sector->soundtarget;
+			if (targ && (mo->flags & MF_AMBUSH))
+				P_QueueSightCheck (mo, targ);
+
+			for (Players::iterator it = players.begin(); it != players.end(); ++it)
+			{
+				if (it->ingame() && !it->spectator && it->health > 0 && it->mo)
+					P_QueueSightCheck (mo, it->mo);
+			}
+		}
+		else if (action == A_Chase && mo->target)
+		{
+			P_QueueSightCheck (mo, mo->target);
+		}
+	}
+
+	sightcandidates.clear();
+	P_FlushSightChecks ();
+}
+
+
 //
 // A_FaceTarget
 //
@@ -1192,8 +1359,7 @@ void A_SkelMissile (AActor *actor)
 		AActor *mo = P_SpawnMissile (actor, actor->target, MT_TRACER);
 		actor->z -= 16*FRACUNIT;	// back to normal
 
-		mo->x += mo->momx;
-		mo->y += mo->momy;
+		mo->SetOrigin(mo->x + mo->momx, mo->y + mo->momy, mo->z);
 		mo->tracer = actor->target;
 	}
 }
@@ -1410,8 +1576,10 @@ void A_VileChase (AActor *actor)
 					if ((demoplayback || demorecording) && democlassic) {
 						corpsehit->height <<= 2;
 					} else {
+						corpsehit->UnlinkFromWorld();
 						corpsehit->height = P_ThingInfoHeight(info);	// [RH] Use real mobj height
 						corpsehit->radius = info->radius;	// [RH] Use real radius
+						corpsehit->LinkToWorld();
 					}
 
 					corpsehit->flags = info->flags;
@@ -1532,8 +1700,9 @@ void A_VileAttack (AActor *actor)
 		return;
 
 	// move the fire between the vile and the player
-	fire->x = actor->target->x - FixedMul (24*FRACUNIT, finecosine[an]);
-	fire->y = actor->target->y - FixedMul (24*FRACUNIT, finesine[an]);
+	fire->SetOrigin(actor->target->x - FixedMul (24*FRACUNIT, finecosine[an]),
+					actor->target->y - FixedMul (24*FRACUNIT, finesine[an]),
+					fire->z);
 	P_RadiusAttack (fire, actor, 70, 70, true, MOD_UNKNOWN);
 }
 
@@ -75,6 +75,7 @@ void SV_SendKillMobj(AActor *source, AActor *target, AActor *inflictor, bool joi
 void SV_SendDamagePlayer(player_t *player, int pain);
 void SV_SendDamageMobj(AActor *target, int pain);
 void SV_ActorTarget(AActor *actor);
+void SV_QueueCorpse(AActor *mo);
 void PickupMessage(AActor *toucher, const char *message);
 void WeaponPickupMessage(AActor *toucher, weapontype_t &Weapon);
 
@@ -1175,20 +1176,20 @@ void P_KillMobj(AActor *source, AActor *target, AActor *inflictor, bool joinkill
 void P_DamageMobj(AActor *target, AActor *inflictor, AActor *source, int damage, int mod, int flags)
 {
     unsigned	ang;
-	int 		saved;
+	int 		saved;
 	player_t*   splayer; // shorthand for source->player
 	player_t*   tplayer; // shorthand for target->player
 	fixed_t 	thrust;
-
+
 	if (!serverside)
     {
 		return;
     }
-
-    if (source)
-        splayer = source->player;
-
-    tplayer = target->player;
+
+    if (source)
+        splayer = source->player;
+
+    tplayer = target->player;
 
 	if (!(target->flags & MF_SHOOTABLE))
     {
@@ -1379,12 +1380,16 @@ void P_DamageMobj(AActor *target, AActor *inflictor, AActor *source, int damage,
 }
 
 //The player has left the game (in-game to spectator, or in-game disconnect)
-void P_PlayerLeavesGame(player_s* player)
-{
-	if (level.behavior)
-	{
-		level.behavior->StartTypedScripts(SCRIPT_Disconnect, player->mo, player->GetPlayerNumber());
-	}
+void P_PlayerLeavesGame(player_s* player)
+{
+	// a body left lying here counts against sv_maxcorpses
+	if (serverside && player->mo && player->mo->health <= 0)
+		SV_QueueCorpse(player->mo);
+
+	if (level.behavior)
+	{
+		level.behavior->StartTypedScripts(SCRIPT_Disconnect, player->mo, player->GetPlayerNumber());
+	}
 }
 
 VERSION_CONTROL (p_interaction_cpp, "$Id$")
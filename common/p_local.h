@@ -30,6 +30,8 @@
 #endif
 
 #include <set>
+#include <string>
+#include <vector>
 
 #define FLOATSPEED		(FRACUNIT*4)
 
@@ -186,8 +188,42 @@ extern fixed_t			lowfloor;
 
 void P_LineOpening (const line_t *linedef, fixed_t x, fixed_t y, fixed_t refx=MINFIXED, fixed_t refy=0);
 
+struct lineopening_t
+{
+	fixed_t		top;
+	fixed_t		bottom;
+	fixed_t		range;
+	fixed_t		lowfloor;
+	sector_t	*bottomsec;
+};
+
+bool P_GetLineOpening (lineopening_t *open, const line_t *linedef, fixed_t x, fixed_t y,
+					   fixed_t refx=MINFIXED, fixed_t refy=0);
+
 BOOL P_BlockLinesIterator (int x, int y, BOOL(*func)(line_t*) );
-BOOL P_BlockThingsIterator (int x, int y, BOOL(*func)(AActor*), AActor *start=NULL);
+
+//
+// blockthing_t
+//
+// A packed copy of an actor's entry in a mapblock's thing chain.  The
+// position and radius are those the actor was linked with, which allows
+// the blockmap iterators to reject far away actors without touching them.
+// Actors must therefore only be moved or grown through SetOrigin or
+// UnlinkFromWorld/LinkToWorld; shrinking one in place is harmless.
+//
+struct blockthing_t
+{
+	AActor*		actor;
+	fixed_t		x;
+	fixed_t		y;
+	fixed_t		radius;
+};
+
+typedef std::vector<blockthing_t> blockthinglist_t;
+
+BOOL P_BlockThingsIterator (int x, int y, BOOL(*func)(AActor*), AActor *start=NULL,
+							BOOL(*reject)(const blockthing_t*)=NULL);
+void P_ClearBlockThings ();
 
 #define PT_ADDLINES 	1
 #define PT_ADDTHINGS	2
@@ -238,6 +274,13 @@ BOOL	P_TryMove (AActor* thing, fixed_t x, fixed_t y, bool dropoff, bool onfloor
 BOOL	P_TeleportMove (AActor* thing, fixed_t x, fixed_t y, fixed_t z, BOOL telefrag);	// [RH] Added z and telefrag parameters
 void	P_SlideMove (AActor* mo);
 bool	P_CheckSight (const AActor* t1, const AActor* t2);
+void	P_InvalidateSightCache ();
+void	P_SightCacheTick ();
+void	P_QueueSightCheck (const AActor* t1, const AActor* t2);
+void	P_FlushSightChecks ();
+void	P_NoteSightCandidate (AActor *actor);
+void	P_QueueMonsterSightChecks ();
+bool	P_AILodSkipThink (AActor *actor);
 void	P_UseLines (player_t* player);
 void	P_ApplyTorque(AActor *mo);
 void	P_CopySector(sector_t *dest, sector_t *src);
@@ -299,6 +342,9 @@ BOOL	Check_Sides(AActor *, int, int);					// phares
 //
 extern byte*			rejectmatrix;	// for fast sight rejection
 extern BOOL				rejectempty;
+void P_BuildReject (size_t lumpnum, std::string &maphash);
+bool P_LoadXNODData (const byte *data, size_t len);
+void P_BuildNodes (size_t lumpnum, std::string &maphash);
 extern int*				blockmaplump;	// offsets in blockmap are from here
 extern int*				blockmap;
 extern int				bmapwidth;
@@ -306,6 +352,7 @@ extern int				bmapheight; 	// in mapblocks
 extern fixed_t			bmaporgx;
 extern fixed_t			bmaporgy;		// origin of block map
 extern AActor** 		blocklinks; 	// for thing chains
+extern std::vector<blockthinglist_t> blockthings;	// packed thing chains
 
 extern std::set<short>	movable_sectors;
 
@@ -103,6 +103,18 @@ CVAR_FUNC_IMPL (sv_gravity)
 	level.gravity = var;
 }
 
+//
+// PIT_RejectDistantThing
+//
+// Rejects a packed blockmap entry that is too far from tmthing at (tmx, tmy)
+// to touch it, using the same test as PIT_CheckThing and PIT_StompThing.
+//
+static BOOL PIT_RejectDistantThing (const blockthing_t *bt)
+{
+	fixed_t blockdist = bt->radius + tmthing->radius;
+	return abs(bt->x - tmx) >= blockdist || abs(bt->y - tmy) >= blockdist;
+}
+
 //
 // TELEPORT MOVE
 //
@@ -216,7 +228,7 @@ BOOL P_TeleportMove (AActor *thing, fixed_t x, fixed_t y, fixed_t z, BOOL telefr
 
 	for (bx=xl ; bx<=xh ; bx++)
 		for (by=yl ; by<=yh ; by++)
-			if (!P_BlockThingsIterator(bx,by,PIT_StompThing))
+			if (!P_BlockThingsIterator(bx,by,PIT_StompThing,NULL,PIT_RejectDistantThing))
 				return false;
 
 	// the move is ok,
@@ -801,7 +813,7 @@ bool P_CheckPosition (AActor *thing, fixed_t x, fixed_t y)
 				AActor *robin = NULL;
 				do
 				{
-					if (!P_BlockThingsIterator (bx, by, PIT_CheckThing, robin))
+					if (!P_BlockThingsIterator (bx, by, PIT_CheckThing, robin, PIT_RejectDistantThing))
 					{ // [RH] If a thing can be stepped up on, we need to continue checking
 					  // other things in the blocks and see if we hit something that is
 					  // definitely blocking. Otherwise, we need to check the lines, or we
@@ -860,7 +872,7 @@ bool P_CheckPosition (AActor *thing, fixed_t x, fixed_t y)
 		// vanilla Doom's check for blocking things
 		for (int bx=xl ; bx<=xh ; bx++)
 			for (int by=yl ; by<=yh ; by++)
-				if (!P_BlockThingsIterator(bx,by,PIT_CheckThing))
+				if (!P_BlockThingsIterator(bx,by,PIT_CheckThing,NULL,PIT_RejectDistantThing))
 					return false;
 
 		if (tmflags & MF_NOCLIP)
@@ -934,7 +946,7 @@ bool P_TestMobjZ (AActor *actor)
 
 	for (bx = xl; bx <= xh; bx++)
 		for (by = yl; by <= yh; by++)
-			if (!P_BlockThingsIterator (bx, by, PIT_CheckOnmobjZ))
+			if (!P_BlockThingsIterator (bx, by, PIT_CheckOnmobjZ, NULL, PIT_RejectDistantThing))
 				return false;
 
 	return true;
@@ -2770,6 +2782,25 @@ static BOOL PIT_DoomRadiusAttack(AActor* thing)
 }
 
 
+//
+// PIT_RejectDistantBombTarget
+//
+// Rejects a packed blockmap entry that is out of range of the explosion,
+// using the same test as PIT_DoomRadiusAttack.
+//
+static BOOL PIT_RejectDistantBombTarget(const blockthing_t* bt)
+{
+	fixed_t dx = abs(bt->x - bombspot->x);
+	fixed_t dy = abs(bt->y - bombspot->y);
+	fixed_t dist = (MAX(dx, dy) - bt->radius) >> FRACBITS;
+
+	if (dist < 0)
+		dist = 0;
+
+	return dist >= bombdamage;
+}
+
+
 //
 // PIT_ZDoomRadiusAttack
 //
@@ -2883,6 +2914,8 @@ void P_RadiusAttack(AActor *spot, AActor *source, int damage, int distance,
 	// decide which radius attack function to use
 	BOOL (*pAttackFunc)(AActor*) = co_zdoomphys ?
 		PIT_ZDoomRadiusAttack : PIT_DoomRadiusAttack;
+	BOOL (*pRejectFunc)(const blockthing_t*) = co_zdoomphys ?
+		NULL : PIT_RejectDistantBombTarget;
 
 	if (co_blockmapfix)
 	{
@@ -2896,11 +2929,11 @@ void P_RadiusAttack(AActor *spot, AActor *source, int damage, int distance,
 		{
 			for (int x=xl ; x<=xh ; x++)
 			{
-				AActor *mobj = blocklinks[y*bmapwidth+x];
-				while (mobj)
+				const blockthinglist_t &list = blockthings[y*bmapwidth+x];
+				for (size_t i = 0; i < list.size(); i++)
 				{
-					actorset.insert(mobj);
-					mobj = mobj->bmapnode.Next(x, y);
+					if (list[i].actor && (!pRejectFunc || !pRejectFunc(&list[i])))
+						actorset.insert(list[i].actor);
 				}
 			}
 		}
@@ -2916,7 +2949,7 @@ void P_RadiusAttack(AActor *spot, AActor *source, int damage, int distance,
 	{
 		for (int y=yl ; y<=yh ; y++)
 			for (int x=xl ; x<=xh ; x++)
-				P_BlockThingsIterator (x, y, pAttackFunc);
+				P_BlockThingsIterator (x, y, pAttackFunc, NULL, pRejectFunc);
 	}
 }
 
@@ -3546,6 +3579,7 @@ void P_ChangeCeilingHeight(sector_t *sector, fixed_t amount)
 
 	plane_t *plane = &sector->ceilingplane;
 	plane->d -= FixedMul(amount, plane->c);
+	P_InvalidateSightCache();
 
 	// The sector's ceilingheight variable is still used for (among other things)
 	// calculating wall texture offsets
@@ -3559,6 +3593,7 @@ void P_ChangeFloorHeight(sector_t *sector, fixed_t amount)
 
 	plane_t *plane = &sector->floorplane;
 	plane->d -= FixedMul(amount, plane->c);
+	P_InvalidateSightCache();
 
 	// The sector's floorheight variable is still used for (among other things)
 	// calculating wall texture offsets
@@ -3702,6 +3737,8 @@ void P_CopySector(sector_t *dest, sector_t *src)
 	if (!dest || !src)
 		return;
 
+	P_InvalidateSightCache();
+
 	dest->floorheight			= src->floorheight;
 	dest->ceilingheight			= src->ceilingheight;
 	dest->floorpic				= src->floorpic;
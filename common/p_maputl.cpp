@@ -25,6 +25,8 @@
 //-----------------------------------------------------------------------------
 
 
+#include <algorithm>
+
 #include "m_bbox.h"
 
 #include "doomdef.h"
@@ -96,6 +98,62 @@ subsector_t* P_PointInSubsector(fixed_t x, fixed_t y)
 }
 
 
+//
+// Packed per-mapblock thing lists
+//
+// [SL] Each entry of blockthings mirrors the corresponding blocklinks chain,
+// with the most recently linked actor stored last.  Iterating an array from
+// back to front visits actors in exactly the same order as walking the chain.
+//
+// While an iterator is running, unlinked actors are only nulled out so that
+// the array indices of the remaining actors stay put.  The emptied slots are
+// compacted once the outermost iterator has finished.
+//
+std::vector<blockthinglist_t> blockthings;
+
+static int blockthings_iterating = 0;
+static std::vector<size_t> blockthings_dirty;
+
+void P_ClearBlockThings()
+{
+	blockthings.clear();
+	blockthings.resize(bmapwidth * bmapheight);
+	blockthings_dirty.clear();
+	blockthings_iterating = 0;
+}
+
+static void P_CompactBlockThings()
+{
+	for (size_t i = 0; i < blockthings_dirty.size(); i++)
+	{
+		if (blockthings_dirty[i] >= blockthings.size())
+			continue;
+
+		blockthinglist_t &list = blockthings[blockthings_dirty[i]];
+
+		size_t dest = 0;
+		for (size_t src = 0; src < list.size(); src++)
+		{
+			if (list[src].actor)
+				list[dest++] = list[src];
+		}
+		list.resize(dest);
+	}
+
+	blockthings_dirty.clear();
+}
+
+static blockthing_t* P_FindBlockThing(blockthinglist_t &list, AActor *actor)
+{
+	for (size_t i = list.size(); i-- > 0; )
+	{
+		if (list[i].actor == actor)
+			return &list[i];
+	}
+
+	return NULL;
+}
+
 AActor::ActorBlockMapListNode::ActorBlockMapListNode(AActor *mo) :
 	actor(mo)
 {
@@ -155,6 +213,13 @@ void AActor::ActorBlockMapListNode::Link()
 				
 		        prev[thisidx] = headptr;
 		        *headptr = actor;
+
+				blockthing_t bt;
+				bt.actor = actor;
+				bt.x = actor->x;
+				bt.y = actor->y;
+				bt.radius = actor->radius;
+				blockthings[bmy * bmapwidth + bmx].push_back(bt);
 			}
 		}
 	}
@@ -188,6 +253,26 @@ void AActor::ActorBlockMapListNode::Unlink()
 				size_t nextidx = nextactor->bmapnode.getIndex(bmx, bmy);
 				nextactor->bmapnode.prev[nextidx] = prevactor;
 			}
+
+			size_t blocknum = bmy * bmapwidth + bmx;
+			if (blocknum >= blockthings.size())
+				continue;
+
+			blockthinglist_t &list = blockthings[blocknum];
+			blockthing_t *bt = P_FindBlockThing(list, actor);
+			if (!bt)
+				continue;
+
+			if (blockthings_iterating)
+			{
+				// keep the indices stable for the running iterator
+				bt->actor = NULL;
+				blockthings_dirty.push_back(blocknum);
+			}
+			else
+			{
+				list.erase(list.begin() + (bt - &list[0]));
+			}
 		}
 	}
 }
@@ -452,13 +537,19 @@ fixed_t openrange;
 fixed_t lowfloor;
 sector_t *openbottomsec;
 
-void P_LineOpening (const line_t *linedef, fixed_t x, fixed_t y, fixed_t refx, fixed_t refy)
+//
+// P_GetLineOpening
+// Same as P_LineOpening, but fills in the given lineopening_t instead of
+// the globals so that it can be used from other threads. Returns false
+// for one-sided lines, leaving everything but range untouched.
+//
+bool P_GetLineOpening (lineopening_t *open, const line_t *linedef, fixed_t x, fixed_t y, fixed_t refx, fixed_t refy)
 {
 	if (linedef->sidenum[1] == R_NOSIDE)
 	{
 		// single sided line
-		openrange = 0;
-		return;
+		open->range = 0;
+		return false;
 	}
 
 	sector_t *front = linedef->frontsector;
@@ -469,7 +560,7 @@ void P_LineOpening (const line_t *linedef, fixed_t x, fixed_t y, fixed_t refx, f
 	fixed_t bc = P_CeilingHeight(x, y, back);
 	fixed_t bf = P_FloorHeight(x, y, back);
 
-	opentop = MIN<fixed_t>(fc, bc);
+	open->top = MIN<fixed_t>(fc, bc);
 
 	bool fflevel = P_IsPlaneLevel(&front->floorplane);
 	bool bflevel = P_IsPlaneLevel(&back->floorplane);
@@ -494,18 +585,36 @@ void P_LineOpening (const line_t *linedef, fixed_t x, fixed_t y, fixed_t refx, f
 
 	if (usefront)
 	{
-		openbottom = ff;
-		lowfloor = bf;
-		openbottomsec = front;
+		open->bottom = ff;
+		open->lowfloor = bf;
+		open->bottomsec = front;
 	}
 	else
 	{
-		openbottom = bf;
-		lowfloor = ff;
-		openbottomsec = back;
+		open->bottom = bf;
+		open->lowfloor = ff;
+		open->bottomsec = back;
+	}
+
+	open->range = open->top - open->bottom;
+	return true;
+}
+
+void P_LineOpening (const line_t *linedef, fixed_t x, fixed_t y, fixed_t refx, fixed_t refy)
+{
+	lineopening_t open;
+
+	if (!P_GetLineOpening(&open, linedef, x, y, refx, refy))
+	{
+		openrange = 0;
+		return;
 	}
 
-	openrange = opentop - openbottom;
+	opentop = open.top;
+	openbottom = open.bottom;
+	openrange = open.range;
+	lowfloor = open.lowfloor;
+	openbottomsec = open.bottomsec;
 }
 
 //
@@ -711,22 +820,77 @@ BOOL P_BlockLinesIterator (int x, int y, BOOL(*func)(line_t*))
 //
 // P_BlockThingsIterator
 //
-BOOL P_BlockThingsIterator (int x, int y, BOOL(*func)(AActor*), AActor *actor)
+// Calls func for each actor in the mapblock, starting with the actor start
+// if it is given.  Actors for which the optional reject function returns
+// true are skipped without being passed to func.  The reject function only
+// sees the packed blockthing_t entry and must not have side effects.
+//
+BOOL P_BlockThingsIterator (int x, int y, BOOL(*func)(AActor*), AActor *start,
+							BOOL(*reject)(const blockthing_t*))
 {
 	if (x<0 || y<0 || x>=bmapwidth || y>=bmapheight)
 		return true;
-	else
- 	{
-		AActor *mobj = (actor != NULL ? actor : blocklinks[y*bmapwidth+x]);
-		while (mobj)
- 		{
- 			if (!func (mobj))
- 				return false;
-
-			mobj = mobj->bmapnode.Next(x, y);
+
+	size_t blocknum = y*bmapwidth+x;
+	blockthinglist_t &list = blockthings[blocknum];
+
+	size_t i = list.size();
+	if (start != NULL)
+	{
+		blockthing_t *bt = P_FindBlockThing(list, start);
+		if (!bt)
+		{
+			// start is no longer in this block, so walk the chain as vanilla did
+			for (AActor *mobj = start; mobj; mobj = mobj->bmapnode.Next(x, y))
+				if (!func (mobj))
+					return false;
+			return true;
 		}
+		i = bt - &list[0] + 1;
 	}
-	return true;
+
+	BOOL result = true;
+	blockthings_iterating++;
+
+	while (i-- > 0)
+	{
+		const blockthing_t *bt = &list[i];
+
+		#if ODAMEX_DEBUG
+		if (bt->actor && (bt->x != bt->actor->x || bt->y != bt->actor->y ||
+						  bt->radius < bt->actor->radius))
+			throw CFatalError("P_BlockThingsIterator: actor moved without being relinked");
+		#endif
+
+		if (!bt->actor || (reject && reject(bt)))
+			continue;
+
+		AActor *mobj = bt->actor;
+		if (!func (mobj))
+		{
+			result = false;
+			break;
+		}
+
+		// [SL] The chain would continue from the actor's new head position
+		// if func relinked it into this block, so mimic that here.
+		if (list[i].actor != mobj)
+		{
+			for (size_t j = list.size(); j-- > i + 1; )
+			{
+				if (list[j].actor == mobj)
+				{
+					i = j;
+					break;
+				}
+			}
+		}
+	}
+
+	if (--blockthings_iterating == 0 && !blockthings_dirty.empty())
+		P_CompactBlockThings();
+
+	return result;
 }
 
 
@@ -869,13 +1033,12 @@ BOOL PIT_AddThingIntercepts (AActor* thing)
 
 
 //
-// P_TraverseIntercepts
-// Returns true if the traverser function returns true
-// for all lines.
+// P_TraverseInterceptsLinear
+// The original traversal: scans the whole list for the closest intercept
+// that has not been visited yet on every step.
 //
-BOOL P_TraverseIntercepts (traverser_t func, fixed_t maxfrac)
+static BOOL P_TraverseInterceptsLinear (traverser_t func, fixed_t maxfrac, size_t count)
 {
-	size_t 				count = intercepts.Size();
 	fixed_t 			dist;
 	size_t		scan;
 	intercept_t*		in = 0;
@@ -905,6 +1068,72 @@ BOOL P_TraverseIntercepts (traverser_t func, fixed_t maxfrac)
 	return true;				// everything was traversed
 }
 
+//
+// Intercepts are visited through a binary heap ordered by frac and then by
+// position in the list, which is the same order the linear scan picks them
+// in. If the traverser function starts a new path traversal of its own,
+// intercepts is refilled and the rest of the outer traversal falls back to
+// the linear scan so that it sees exactly what it always did.
+//
+struct interceptorder_t
+{
+	fixed_t		frac;
+	size_t		index;
+};
+
+struct InterceptAfter
+{
+	bool operator() (const interceptorder_t &a, const interceptorder_t &b) const
+	{
+		return a.frac > b.frac || (a.frac == b.frac && a.index > b.index);
+	}
+};
+
+static std::vector<interceptorder_t> interceptheap;
+static unsigned int intercepts_generation;
+
+//
+// P_TraverseIntercepts
+// Returns true if the traverser function returns true
+// for all lines.
+//
+BOOL P_TraverseIntercepts (traverser_t func, fixed_t maxfrac)
+{
+	size_t 				count = intercepts.Size();
+
+	const unsigned int generation = intercepts_generation;
+
+	interceptheap.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		interceptheap[i].frac = intercepts[i].frac;
+		interceptheap[i].index = i;
+	}
+	std::make_heap(interceptheap.begin(), interceptheap.end(), InterceptAfter());
+
+	while (count--)
+	{
+		if (intercepts_generation != generation)
+			return P_TraverseInterceptsLinear(func, maxfrac, count + 1);
+
+		std::pop_heap(interceptheap.begin(), interceptheap.end(), InterceptAfter());
+		const interceptorder_t next = interceptheap.back();
+		interceptheap.pop_back();
+
+		if (next.frac > maxfrac)
+			return true;		// checked everything in range
+
+		intercept_t* in = &intercepts[next.index];
+
+		if ( !func (in) )
+			return false;		// don't bother going farther
+
+		in->frac = MAXINT;
+	}
+
+	return true;				// everything was traversed
+}
+
 
 
 
@@ -943,6 +1172,7 @@ BOOL P_PathTraverse (fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2, int flags,
 	validcount++;
 
 	intercepts.Clear();
+	intercepts_generation++;
 
 	if ( ((x1-bmaporgx)&(MAPBLOCKSIZE-1)) == 0)
 		x1 += FRACUNIT; // don't side exactly on a line
@@ -1195,5 +1425,6 @@ bool P_ActorInFOV(AActor* origin, AActor* mo , float f, fixed_t dist)
 	return true;
 }
 
+
 VERSION_CONTROL (p_maputl_cpp, "$Id$")
 
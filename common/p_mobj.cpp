@@ -78,8 +78,17 @@ int             iquetail;
 NetIDHandler ServerNetID;
 
 // denis - fast netid lookup
-typedef std::map<size_t, AActor::AActorPtr> netid_map_t;
-netid_map_t actor_by_netid;
+// Indexed directly by netid. Every slot remembers the generation it was
+// set in, and P_ClearAllNetIds starts a new generation instead of touching
+// all of them, so entries left over from before the clear are never found.
+struct netidslot_t
+{
+	AActor::AActorPtr	actor;
+	unsigned int		generation;
+};
+
+static netidslot_t actor_by_netid[MAX_NETID + 1];
+static unsigned int netid_generation = 1;
 
 IMPLEMENT_SERIAL(AActor, DThinker)
 
@@ -329,7 +338,15 @@ void P_AnimationTick(AActor *mo)
 //
 void P_ClearAllNetIds()
 {
-	actor_by_netid.clear();
+	if (++netid_generation == 0)
+	{
+		for (size_t i = 0; i <= MAX_NETID; i++)
+		{
+			actor_by_netid[i].actor = AActor::AActorPtr();
+			actor_by_netid[i].generation = 0;
+		}
+		netid_generation = 1;
+	}
 }
 
 //
@@ -338,12 +355,10 @@ void P_ClearAllNetIds()
 //
 AActor* P_FindThingById(size_t id)
 {
-	netid_map_t::iterator i = actor_by_netid.find(id);
-
-	if(i == actor_by_netid.end())
+	if (id > MAX_NETID || actor_by_netid[id].generation != netid_generation)
 		return AActor::AActorPtr();
-	else
-		return i->second;
+
+	return actor_by_netid[id].actor;
 }
 
 //
@@ -352,7 +367,12 @@ AActor* P_FindThingById(size_t id)
 void P_SetThingId(AActor *mo, size_t newnetid)
 {
 	mo->netid = newnetid;
-	actor_by_netid[newnetid] = mo->ptr();
+
+	if (newnetid > MAX_NETID)
+		return;
+
+	actor_by_netid[newnetid].actor = mo->ptr();
+	actor_by_netid[newnetid].generation = netid_generation;
 }
 
 
@@ -700,6 +720,10 @@ void AActor::RunThink ()
 	if (flags2 & MF2_DORMANT)
 		return;
 
+	// far away idle monsters may think less often (sv_ailod)
+	if (P_AILodSkipThink(this))
+		return;
+
     // cycle through states,
     // calling action functions at transitions
 	if (tics != -1)
@@ -707,6 +731,10 @@ void AActor::RunThink ()
 		// run P_AnimationTick on everything except players who aren't voodoo dolls
 		if (!(player && this == player->mo))
 			P_AnimationTick(this);
+
+		// its next state starts next tic (sv_sightbatch)
+		if (tics == 1)
+			P_NoteSightCandidate(this);
 	}
 	else
 	{
@@ -1967,9 +1995,7 @@ bool P_CheckMissileSpawn (AActor* th)
 
 	// move a little forward so an angle can
 	// be computed if it immediately explodes
-	th->x += th->momx>>1;
-	th->y += th->momy>>1;
-	th->z += th->momz>>1;
+	th->SetOrigin(th->x + (th->momx>>1), th->y + (th->momy>>1), th->z + (th->momz>>1));
 
 	// killough 3/15/98: no dropoff (really = don't care for missiles)
 
@@ -2620,8 +2646,10 @@ void P_SpawnMapThing (mapthing2_t *mthing, int position)
 	// [SL] ZDoom Custom Bridge Things
 	if (i == MT_ZDOOMBRIDGE)
 	{
+		mobj->UnlinkFromWorld();
 		mobj->radius = mobj->args[0] << FRACBITS;
 		mobj->height = mobj->args[1] << FRACBITS;
+		mobj->LinkToWorld();
 	}
 
 	// [AM] Adjust monster health based on server setting
@@ -0,0 +1,651 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2015 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	BSP node builder for maps that come without usable NODES, SSECTORS
+//	and SEGS lumps.
+//
+//	Every sidedef of every linedef starts out as a seg. A set of segs
+//	that does not enclose a convex region is divided along the line of
+//	one of its segs, picked from a sample by how few segs it splits and
+//	how evenly it divides the rest, until every set is convex and becomes
+//	a subsector. Partitions always run along whole linedefs, so nodes keep
+//	whole map unit coordinates as they do with other node builders.
+//
+//	Once the top of the tree is built, the subtrees below it are built on
+//	the worker threads and joined together afterwards. The result is
+//	stored as ZDBSP extended nodes, which are loaded with P_LoadXNODData
+//	and cached in the user's directory keyed by the hash of the map lumps.
+//
+//-----------------------------------------------------------------------------
+
+#include <map>
+#include <math.h>
+#include <set>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "doomtype.h"
+#include "doomstat.h"
+#include "i_system.h"
+#include "m_bbox.h"
+#include "m_fileio.h"
+#include "m_parallel.h"
+#include "p_local.h"
+#include "p_setup.h"
+#include "r_state.h"
+#include "z_zone.h"
+
+// Points closer to a partition than this (in fixed point units) are
+// taken to be on it.
+static const double NB_EPSILON = FRACUNIT / 256.0;
+
+// Cost of splitting one seg compared with putting one more seg on the
+// larger side of a partition.
+static const int NB_SPLIT_COST = 8;
+
+// Most segs tried as the partition of each node.
+static const size_t NB_MAX_CANDIDATES = 64;
+
+// Maps with fewer segs than this are built on a single thread.
+static const size_t NB_PARALLEL_SEGS = 2000;
+
+// Marks a child that is the root of a subtree built on another thread.
+static const unsigned int NB_SUBTREE = 0x40000000;
+
+struct nbvertex_t
+{
+	fixed_t			x, y;
+};
+
+struct nbseg_t
+{
+	int				v1, v2;
+	int				linedef;
+	int				side;
+};
+
+struct nbnode_t
+{
+	fixed_t			x, y, dx, dy;
+	fixed_t			bbox[2][4];
+	unsigned int	children[2];
+};
+
+struct nbpartition_t
+{
+	fixed_t			x, y, dx, dy;
+	double			len;			// in map units
+};
+
+//
+// A tree, or a subtree of one, being built by one thread
+//
+struct nbtree_t
+{
+	const std::vector<nbvertex_t> *shared;	// vertices from before this tree
+	std::vector<nbvertex_t>		vertexes;	// vertices made by its splits
+	std::vector<nbseg_t>		segs;		// segs of its subsectors, in order
+	std::vector<unsigned int>	subsectors;	// seg count of each subsector
+	std::vector<nbnode_t>		nodes;
+
+	std::vector<nbseg_t>		input;		// segs to build from
+	unsigned int				root;
+
+	// subtrees left for other threads, below subtreedepth (top tree only)
+	std::vector<nbtree_t>		*subtrees;
+	int							subtreedepth;
+};
+
+static inline const nbvertex_t &NB_Vertex(const nbtree_t &tree, int v)
+{
+	const size_t numshared = tree.shared->size();
+	return (size_t)v < numshared ? (*tree.shared)[v] : tree.vertexes[v - numshared];
+}
+
+//
+// NB_Partition
+//
+// The line a seg lies on, running the same way as the seg.
+//
+static nbpartition_t NB_Partition(const nbseg_t &seg)
+{
+	const line_t *line = &lines[seg.linedef];
+	const vertex_t *from = seg.side ? line->v2 : line->v1;
+	const vertex_t *to = seg.side ? line->v1 : line->v2;
+	nbpartition_t part;
+
+	part.x = from->x;
+	part.y = from->y;
+	part.dx = to->x - from->x;
+	part.dy = to->y - from->y;
+	part.len = sqrt(FIXED2DOUBLE(part.dx) * FIXED2DOUBLE(part.dx) +
+					FIXED2DOUBLE(part.dy) * FIXED2DOUBLE(part.dy));
+	return part;
+}
+
+//
+// NB_Dist
+//
+// Distance of a point from a partition, positive on its front (right)
+// side as R_PointOnSide sees it.
+//
+static inline double NB_Dist(const nbpartition_t &part, const nbvertex_t &v)
+{
+	return (FIXED2DOUBLE(part.dy) * ((double)v.x - part.x) -
+			FIXED2DOUBLE(part.dx) * ((double)v.y - part.y)) / part.len;
+}
+
+enum { NB_FRONT, NB_BACK, NB_SPLIT };
+
+static int NB_Classify(const nbtree_t &tree, const nbseg_t &seg,
+					   const nbpartition_t &part, double *d1, double *d2)
+{
+	const nbvertex_t &v1 = NB_Vertex(tree, seg.v1);
+	const nbvertex_t &v2 = NB_Vertex(tree, seg.v2);
+
+	*d1 = NB_Dist(part, v1);
+	*d2 = NB_Dist(part, v2);
+
+	if (fabs(*d1) <= NB_EPSILON && fabs(*d2) <= NB_EPSILON)
+	{
+		// on the partition: segs facing the same way go in front
+		double dot = ((double)v2.x - v1.x) * part.dx + ((double)v2.y - v1.y) * part.dy;
+		return dot > 0 ? NB_FRONT : NB_BACK;
+	}
+
+	if (*d1 >= -NB_EPSILON && *d2 >= -NB_EPSILON)
+		return NB_FRONT;
+	if (*d1 <= NB_EPSILON && *d2 <= NB_EPSILON)
+		return NB_BACK;
+	return NB_SPLIT;
+}
+
+//
+// NB_Evaluate
+//
+// Cost of dividing segs along part, or -1 if nothing would end up behind
+// it. Gives up with MAXINT as soon as the cost reaches bestcost.
+//
+static int NB_Evaluate(const nbtree_t &tree, const std::vector<nbseg_t> &segs,
+					   const nbpartition_t &part, int bestcost)
+{
+	int front = 0, back = 0, splits = 0;
+	double d1, d2;
+
+	for (size_t i = 0; i < segs.size(); i++)
+	{
+		switch (NB_Classify(tree, segs[i], part, &d1, &d2))
+		{
+		case NB_FRONT:
+			front++;
+			break;
+		case NB_BACK:
+			back++;
+			break;
+		default:
+			front++;
+			back++;
+			if (++splits * NB_SPLIT_COST >= bestcost)
+				return MAXINT;
+			break;
+		}
+	}
+
+	if (back == 0)
+		return -1;
+
+	return splits * NB_SPLIT_COST + abs(front - back);
+}
+
+//
+// NB_ChoosePartition
+//
+// Picks the seg whose line divides segs best, or returns -1 if none of
+// them divides it because the segs already make up a convex region.
+// Large sets only try a sample of their segs unless none of those works.
+//
+static int NB_ChoosePartition(const nbtree_t &tree, const std::vector<nbseg_t> &segs)
+{
+	const size_t step = MAX<size_t>(1, segs.size() / NB_MAX_CANDIDATES);
+	std::set<int> tried;
+	int best = -1, bestcost = MAXINT;
+
+	for (size_t pass = 0; pass < 2 && best < 0; pass++)
+	{
+		for (size_t i = 0; i < segs.size(); i += pass ? 1 : step)
+		{
+			// segs of the same side of a linedef share its line
+			if (!tried.insert(segs[i].linedef * 2 + segs[i].side).second)
+				continue;
+
+			int cost = NB_Evaluate(tree, segs, NB_Partition(segs[i]), bestcost);
+			if (cost >= 0 && cost < bestcost)
+			{
+				best = i;
+				bestcost = cost;
+			}
+		}
+	}
+
+	return best;
+}
+
+//
+// NB_Divide
+//
+// Sorts segs into those in front of and behind part, splitting the ones
+// that cross it. Both sides of a two-sided linedef share the new vertex.
+//
+static void NB_Divide(nbtree_t &tree, const std::vector<nbseg_t> &segs, const nbpartition_t &part,
+					  std::vector<nbseg_t> &front, std::vector<nbseg_t> &back)
+{
+	std::map<std::pair<int, int>, int> splits;
+	double d1, d2;
+
+	for (size_t i = 0; i < segs.size(); i++)
+	{
+		const nbseg_t &seg = segs[i];
+
+		switch (NB_Classify(tree, seg, part, &d1, &d2))
+		{
+		case NB_FRONT:
+			front.push_back(seg);
+			continue;
+		case NB_BACK:
+			back.push_back(seg);
+			continue;
+		}
+
+		std::pair<int, int> key(MIN(seg.v1, seg.v2), MAX(seg.v1, seg.v2));
+		std::map<std::pair<int, int>, int>::iterator it = splits.find(key);
+		int v;
+
+		if (it != splits.end())
+			v = it->second;
+		else
+		{
+			// always work from the same end so that the result does not
+			// depend on which side of the line is split first
+			nbvertex_t a = NB_Vertex(tree, key.first);
+			nbvertex_t b = NB_Vertex(tree, key.second);
+			double da = NB_Dist(part, a), db = NB_Dist(part, b);
+			double t = da / (da - db);
+			nbvertex_t nv;
+
+			nv.x = (fixed_t)floor(a.x + t * ((double)b.x - a.x) + 0.5);
+			nv.y = (fixed_t)floor(a.y + t * ((double)b.y - a.y) + 0.5);
+
+			v = tree.shared->size() + tree.vertexes.size();
+			tree.vertexes.push_back(nv);
+			splits[key] = v;
+		}
+
+		nbseg_t first = seg, second = seg;
+		first.v2 = v;
+		second.v1 = v;
+
+		if (d1 > 0)
+		{
+			front.push_back(first);
+			back.push_back(second);
+		}
+		else
+		{
+			back.push_back(first);
+			front.push_back(second);
+		}
+	}
+}
+
+static void NB_Bounds(const nbtree_t &tree, const std::vector<nbseg_t> &segs, fixed_t *bbox)
+{
+	bbox[BOXTOP] = bbox[BOXRIGHT] = MININT;
+	bbox[BOXBOTTOM] = bbox[BOXLEFT] = MAXINT;
+
+	for (size_t i = 0; i < segs.size(); i++)
+	{
+		const nbvertex_t *ends[2] = { &NB_Vertex(tree, segs[i].v1), &NB_Vertex(tree, segs[i].v2) };
+
+		for (int j = 0; j < 2; j++)
+		{
+			bbox[BOXTOP] = MAX(bbox[BOXTOP], ends[j]->y);
+			bbox[BOXBOTTOM] = MIN(bbox[BOXBOTTOM], ends[j]->y);
+			bbox[BOXLEFT] = MIN(bbox[BOXLEFT], ends[j]->x);
+			bbox[BOXRIGHT] = MAX(bbox[BOXRIGHT], ends[j]->x);
+		}
+	}
+}
+
+//
+// NB_Build
+//
+// Builds the (sub)tree for segs, which it empties, and returns the child
+// number that refers to it.
+//
+static unsigned int NB_Build(nbtree_t &tree, std::vector<nbseg_t> &segs, int depth)
+{
+	if (tree.subtrees != NULL && depth >= tree.subtreedepth)
+	{
+		tree.subtrees->push_back(nbtree_t());
+		tree.subtrees->back().input.swap(segs);
+		return NB_SUBTREE | (tree.subtrees->size() - 1);
+	}
+
+	int partition = NB_ChoosePartition(tree, segs);
+
+	if (partition < 0)
+	{
+		tree.subsectors.push_back(segs.size());
+		tree.segs.insert(tree.segs.end(), segs.begin(), segs.end());
+		std::vector<nbseg_t>().swap(segs);
+		return (tree.subsectors.size() - 1) | NF_SUBSECTOR;
+	}
+
+	nbpartition_t part = NB_Partition(segs[partition]);
+	std::vector<nbseg_t> front, back;
+
+	NB_Divide(tree, segs, part, front, back);
+	std::vector<nbseg_t>().swap(segs);
+
+	nbnode_t node;
+	node.x = part.x;
+	node.y = part.y;
+	node.dx = part.dx;
+	node.dy = part.dy;
+	NB_Bounds(tree, front, node.bbox[0]);
+	NB_Bounds(tree, back, node.bbox[1]);
+
+	node.children[0] = NB_Build(tree, front, depth + 1);
+	node.children[1] = NB_Build(tree, back, depth + 1);
+
+	tree.nodes.push_back(node);
+	return tree.nodes.size() - 1;
+}
+
+static void NB_BuildSubtree(size_t index, void *data)
+{
+	nbtree_t *tree = (nbtree_t *)data + index;
+	tree->root = NB_Build(*tree, tree->input, 0);
+}
+
+static void NB_Put16(std::vector<byte> &out, int value)
+{
+	out.push_back(value & 0xff);
+	out.push_back((value >> 8) & 0xff);
+}
+
+static void NB_Put32(std::vector<byte> &out, unsigned int value)
+{
+	out.push_back(value & 0xff);
+	out.push_back((value >> 8) & 0xff);
+	out.push_back((value >> 16) & 0xff);
+	out.push_back((value >> 24) & 0xff);
+}
+
+//
+// NB_WriteXNOD
+//
+// Joins the top of the tree and the subtrees below it into one set of
+// ZDBSP extended nodes. New vertices, subsectors and segs go in the order
+// top, then subtrees; nodes go subtrees first so that the root is last.
+//
+static void NB_WriteXNOD(const nbtree_t &top, const std::vector<nbtree_t> &subtrees,
+						 std::vector<byte> &out)
+{
+	// vertices that subtrees share with the top of the tree
+	const size_t numshared = top.shared->size() + top.vertexes.size();
+	std::vector<size_t> vertexshift(subtrees.size()), subbase(subtrees.size()), nodebase(subtrees.size());
+	size_t numnewvert = top.vertexes.size();
+	size_t nsubsectors = top.subsectors.size();
+	size_t nsegs = top.segs.size();
+	size_t nnodes = 0;
+
+	for (size_t i = 0; i < subtrees.size(); i++)
+	{
+		vertexshift[i] = numnewvert - top.vertexes.size();
+		subbase[i] = nsubsectors;
+		nodebase[i] = nnodes;
+		numnewvert += subtrees[i].vertexes.size();
+		nsubsectors += subtrees[i].subsectors.size();
+		nsegs += subtrees[i].segs.size();
+		nnodes += subtrees[i].nodes.size();
+	}
+
+	const size_t topbase = nnodes;
+	nnodes += top.nodes.size();
+
+	out.clear();
+	out.reserve(16 + numnewvert * 8 + nsubsectors * 4 + nsegs * 11 + nnodes * 32);
+	out.push_back('X'); out.push_back('N'); out.push_back('O'); out.push_back('D');
+
+	NB_Put32(out, numvertexes);
+	NB_Put32(out, numnewvert);
+	for (size_t i = 0; i < top.vertexes.size(); i++)
+	{
+		NB_Put32(out, top.vertexes[i].x);
+		NB_Put32(out, top.vertexes[i].y);
+	}
+	for (size_t i = 0; i < subtrees.size(); i++)
+	{
+		for (size_t j = 0; j < subtrees[i].vertexes.size(); j++)
+		{
+			NB_Put32(out, subtrees[i].vertexes[j].x);
+			NB_Put32(out, subtrees[i].vertexes[j].y);
+		}
+	}
+
+	NB_Put32(out, nsubsectors);
+	for (size_t i = 0; i < top.subsectors.size(); i++)
+		NB_Put32(out, top.subsectors[i]);
+	for (size_t i = 0; i < subtrees.size(); i++)
+		for (size_t j = 0; j < subtrees[i].subsectors.size(); j++)
+			NB_Put32(out, subtrees[i].subsectors[j]);
+
+	NB_Put32(out, nsegs);
+	for (size_t i = 0; i <= subtrees.size(); i++)
+	{
+		const nbtree_t &tree = i == 0 ? top : subtrees[i - 1];
+		const size_t shift = i == 0 ? 0 : vertexshift[i - 1];
+
+		for (size_t j = 0; j < tree.segs.size(); j++)
+		{
+			const nbseg_t &seg = tree.segs[j];
+			NB_Put32(out, seg.v1 + ((size_t)seg.v1 >= numshared ? shift : 0));
+			NB_Put32(out, seg.v2 + ((size_t)seg.v2 >= numshared ? shift : 0));
+			NB_Put16(out, seg.linedef);
+			out.push_back(seg.side);
+		}
+	}
+
+	NB_Put32(out, nnodes);
+	for (size_t i = 0; i <= subtrees.size(); i++)
+	{
+		const nbtree_t &tree = i < subtrees.size() ? subtrees[i] : top;
+
+		for (size_t j = 0; j < tree.nodes.size(); j++)
+		{
+			const nbnode_t &node = tree.nodes[j];
+
+			NB_Put16(out, node.x >> FRACBITS);
+			NB_Put16(out, node.y >> FRACBITS);
+			NB_Put16(out, node.dx >> FRACBITS);
+			NB_Put16(out, node.dy >> FRACBITS);
+
+			// round the boxes outwards to whole map units
+			for (int k = 0; k < 2; k++)
+			{
+				NB_Put16(out, (node.bbox[k][BOXTOP] + FRACUNIT - 1) >> FRACBITS);
+				NB_Put16(out, node.bbox[k][BOXBOTTOM] >> FRACBITS);
+				NB_Put16(out, node.bbox[k][BOXLEFT] >> FRACBITS);
+				NB_Put16(out, (node.bbox[k][BOXRIGHT] + FRACUNIT - 1) >> FRACBITS);
+			}
+
+			for (int k = 0; k < 2; k++)
+			{
+				unsigned int child = node.children[k];
+				size_t sub = i;
+
+				if (i == subtrees.size())
+				{
+					if (child & NF_SUBSECTOR)
+					{
+						NB_Put32(out, child);
+						continue;
+					}
+					if (!(child & NB_SUBTREE))
+					{
+						NB_Put32(out, child + topbase);
+						continue;
+					}
+					sub = child & ~NB_SUBTREE;
+					child = subtrees[sub].root;
+				}
+
+				if (child & NF_SUBSECTOR)
+					NB_Put32(out, ((child & ~NF_SUBSECTOR) + subbase[sub]) | NF_SUBSECTOR);
+				else
+					NB_Put32(out, child + nodebase[sub]);
+			}
+		}
+	}
+}
+
+//
+// NB_BuildNodes
+//
+// Builds nodes for the current map as a ZDBSP extended nodes lump.
+// Returns the number of subtrees that were built on other threads.
+//
+static size_t NB_BuildNodes(std::vector<byte> &xnod)
+{
+	std::vector<nbvertex_t> original(numvertexes);
+	for (int i = 0; i < numvertexes; i++)
+	{
+		original[i].x = vertexes[i].x;
+		original[i].y = vertexes[i].y;
+	}
+
+	nbtree_t top;
+	top.shared = &original;
+	top.subtrees = NULL;
+	top.subtreedepth = 0;
+
+	for (int i = 0; i < numlines; i++)
+	{
+		const line_t *line = &lines[i];
+
+		// zero length lines can not be drawn or divide anything
+		if (line->v1->x == line->v2->x && line->v1->y == line->v2->y)
+			continue;
+
+		for (int side = 0; side < 2; side++)
+		{
+			if (line->sidenum[side] == R_NOSIDE)
+				continue;
+
+			nbseg_t seg;
+			seg.v1 = (side ? line->v2 : line->v1) - vertexes;
+			seg.v2 = (side ? line->v1 : line->v2) - vertexes;
+			seg.linedef = i;
+			seg.side = side;
+			top.input.push_back(seg);
+		}
+	}
+
+	if (top.input.empty())
+		I_Error("P_BuildNodes: map has no lines to build nodes from");
+
+	// split into a few subtrees for each thread, once there are enough
+	// segs for that to be worthwhile
+	std::vector<nbtree_t> subtrees;
+	const size_t threads = M_ParallelThreads();
+
+	if (threads > 1 && top.input.size() >= NB_PARALLEL_SEGS)
+	{
+		top.subtrees = &subtrees;
+		top.subtreedepth = 1;
+		while ((1u << top.subtreedepth) < threads * 4)
+			top.subtreedepth++;
+	}
+
+	top.root = NB_Build(top, top.input, 0);
+
+	// the subtrees build on everything the top of the tree made
+	std::vector<nbvertex_t> shared(original);
+	shared.insert(shared.end(), top.vertexes.begin(), top.vertexes.end());
+
+	for (size_t i = 0; i < subtrees.size(); i++)
+	{
+		subtrees[i].shared = &shared;
+		subtrees[i].subtrees = NULL;
+		subtrees[i].subtreedepth = 0;
+	}
+
+	if (!subtrees.empty())
+		M_ParallelFor(subtrees.size(), NB_BuildSubtree, &subtrees[0]);
+
+	NB_WriteXNOD(top, subtrees, xnod);
+
+	return subtrees.size();
+}
+
+//
+// P_BuildNodes
+//
+// Gives the current map nodes, subsectors and segs, either from the
+// cache or by building them.
+//
+void P_BuildNodes(size_t lumpnum, std::string &maphash)
+{
+	dtime_t start = I_GetTime();
+
+	std::string cachefile = I_GetUserFileName(
+		("nodes-" + P_MapGeometryHash(lumpnum, maphash) + ".cache").c_str());
+
+	if (M_FileExists(cachefile))
+	{
+		BYTE *data = NULL;
+		QWORD length = M_ReadFile(cachefile, &data);
+		bool loaded = data != NULL && P_LoadXNODData(data, length);
+
+		if (data != NULL)
+			Z_Free(data);
+
+		if (loaded)
+		{
+			DPrintf("P_BuildNodes: loaded %d nodes from the cache in %.1f ms\n",
+					numnodes, (double)(I_GetTime() - start) / 1000000.0);
+			return;
+		}
+	}
+
+	std::vector<byte> xnod;
+	size_t subtrees = NB_BuildNodes(xnod);
+
+	if (!P_LoadXNODData(&xnod[0], xnod.size()))
+		I_Error("P_BuildNodes: could not build nodes for this map");
+
+	M_WriteFile(cachefile, &xnod[0], xnod.size());
+
+	DPrintf("P_BuildNodes: built %d nodes, %d subsectors and %d segs in %.1f ms (%d subtrees)\n",
+			numnodes, numsubsectors, numsegs,
+			(double)(I_GetTime() - start) / 1000000.0, (int)subtrees);
+}
+
+VERSION_CONTROL (p_nodebuild_cpp, "$Id$")
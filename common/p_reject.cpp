@@ -0,0 +1,413 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2015 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	REJECT table builder for maps that ship an empty one.
+//
+//	Sight between two sectors is only possible if some straight line can
+//	get from one to the other through two-sided linedefs. For every sector
+//	we flood outwards through the two-sided lines ("portals"), only
+//	following a portal when a straight line that came through the
+//	previous portal and the first portal could still pass through it.
+//	Every sector that is not reached gets its bit set in the table.
+//
+//	The tests are done loosely so that the table errs on the side of
+//	letting P_CheckSight do the real work. Sector heights are ignored
+//	since doors and lifts move. Maps whose sectors are not closed
+//	(self-referencing sector tricks and the like) are left alone.
+//
+//-----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "doomtype.h"
+#include "doomstat.h"
+#include "c_cvars.h"
+#include "i_system.h"
+#include "m_fileio.h"
+#include "m_parallel.h"
+#include "p_local.h"
+#include "p_setup.h"
+#include "r_state.h"
+#include "w_wad.h"
+#include "z_zone.h"
+
+EXTERN_CVAR (sv_buildreject)
+
+// Distance in map units by which a portal may miss a test and still be
+// considered passable.
+static const double REJECT_EPSILON = 1.0;
+
+static const char REJECT_CACHE_MAGIC[4] = { 'O', 'R', 'J', '1' };
+
+struct rportal_t
+{
+	double	x1, y1, x2, y2;
+	double	dx, dy, len;
+	double	sign;			// +1 when crossing from the front to the back side
+	int		line;
+	int		from, to;		// sector numbers
+};
+
+struct rejectbuild_t
+{
+	std::vector<rportal_t>				portals;
+	std::vector<std::vector<int> >		exits;		// portals leaving each sector
+	std::vector<std::vector<int> >		follows;	// portals that can come after each portal
+	size_t								rowwords;
+	std::vector<DWORD>					visible;	// one bit row per sector
+	size_t								chunks;
+};
+
+//
+// RJ_Dist
+//
+// Signed distance of (x, y) from the portal's line, positive on the side
+// the portal leads to.
+//
+static inline double RJ_Dist(const rportal_t &p, double x, double y)
+{
+	return p.sign * (p.dx * (y - p.y1) - p.dy * (x - p.x1)) / p.len;
+}
+
+//
+// RJ_Reaches
+//
+// Can a line that went through portal a go on to pass through portal b?
+// Some part of b has to lie beyond a, and some part of a has to lie in
+// front of b.
+//
+static inline bool RJ_Reaches(const rportal_t &a, const rportal_t &b)
+{
+	if (a.line == b.line)
+		return false;
+
+	if (std::max(RJ_Dist(a, b.x1, b.y1), RJ_Dist(a, b.x2, b.y2)) <= -REJECT_EPSILON)
+		return false;
+
+	if (std::min(RJ_Dist(b, a.x1, a.y1), RJ_Dist(b, a.x2, a.y2)) >= REJECT_EPSILON)
+		return false;
+
+	return true;
+}
+
+//
+// RJ_SectorsClosed
+//
+// Every vertex on the outline of a well formed sector is shared by an even
+// number of its outline lines. Maps that break this rule rely on tricks
+// that let things see across lines which do not connect their sectors.
+//
+static bool RJ_SectorsClosed()
+{
+	std::vector<std::pair<int, int> > ends;
+	std::vector<bool> hasoutline(numsectors, false);
+	std::vector<bool> used(numsectors, false);
+
+	for (int i = 0; i < numlines; i++)
+	{
+		const line_t *li = &lines[i];
+		const int v1 = li->v1 - vertexes, v2 = li->v2 - vertexes;
+
+		for (int side = 0; side < 2; side++)
+		{
+			const sector_t *sec = side ? li->backsector : li->frontsector;
+			const sector_t *other = side ? li->frontsector : li->backsector;
+
+			if (sec == NULL)
+				continue;
+
+			const int secnum = sec - sectors;
+			used[secnum] = true;
+
+			if (sec == other)
+				continue;
+
+			hasoutline[secnum] = true;
+			ends.push_back(std::make_pair(secnum, v1));
+			ends.push_back(std::make_pair(secnum, v2));
+		}
+	}
+
+	for (int i = 0; i < numsectors; i++)
+		if (used[i] && !hasoutline[i])
+			return false;
+
+	std::sort(ends.begin(), ends.end());
+
+	for (size_t i = 0; i < ends.size(); )
+	{
+		size_t j = i;
+		while (j < ends.size() && ends[j] == ends[i])
+			j++;
+		if ((j - i) & 1)
+			return false;
+		i = j;
+	}
+
+	return true;
+}
+
+//
+// RJ_BuildPortals
+//
+static void RJ_BuildPortals(rejectbuild_t &rb)
+{
+	rb.exits.resize(numsectors);
+
+	for (int i = 0; i < numlines; i++)
+	{
+		const line_t *li = &lines[i];
+
+		if (li->frontsector == NULL || li->backsector == NULL ||
+			li->frontsector == li->backsector)
+			continue;
+
+		rportal_t p;
+		p.x1 = FIXED2DOUBLE(li->v1->x);
+		p.y1 = FIXED2DOUBLE(li->v1->y);
+		p.x2 = FIXED2DOUBLE(li->v2->x);
+		p.y2 = FIXED2DOUBLE(li->v2->y);
+		p.dx = p.x2 - p.x1;
+		p.dy = p.y2 - p.y1;
+		p.len = sqrt(p.dx * p.dx + p.dy * p.dy);
+		p.line = i;
+
+		// a zero length line passes every test
+		if (p.len == 0.0)
+		{
+			p.dx = p.dy = 0.0;
+			p.len = 1.0;
+		}
+
+		p.sign = 1.0;
+		p.from = li->frontsector - sectors;
+		p.to = li->backsector - sectors;
+		rb.exits[p.from].push_back(rb.portals.size());
+		rb.portals.push_back(p);
+
+		p.sign = -1.0;
+		std::swap(p.from, p.to);
+		rb.exits[p.from].push_back(rb.portals.size());
+		rb.portals.push_back(p);
+	}
+}
+
+//
+// RJ_LinkPortals
+//
+static void RJ_LinkPortals(size_t index, void *data)
+{
+	rejectbuild_t &rb = *(rejectbuild_t *)data;
+
+	for (size_t a = index; a < rb.portals.size(); a += rb.chunks)
+	{
+		const std::vector<int> &next = rb.exits[rb.portals[a].to];
+
+		for (size_t i = 0; i < next.size(); i++)
+			if (RJ_Reaches(rb.portals[a], rb.portals[next[i]]))
+				rb.follows[a].push_back(next[i]);
+	}
+}
+
+//
+// RJ_FloodSectors
+//
+// Marks every sector that can be seen from the sectors handled by this chunk.
+//
+static void RJ_FloodSectors(size_t index, void *data)
+{
+	rejectbuild_t &rb = *(rejectbuild_t *)data;
+
+	std::vector<unsigned int> seen(rb.portals.size(), 0);
+	std::vector<int> queue;
+	unsigned int stamp = 0;
+
+	for (size_t s = index; s < (size_t)numsectors; s += rb.chunks)
+	{
+		DWORD *row = &rb.visible[s * rb.rowwords];
+		row[s >> 5] |= (DWORD)1 << (s & 31);
+
+		const std::vector<int> &start = rb.exits[s];
+
+		for (size_t i = 0; i < start.size(); i++)
+		{
+			const rportal_t &first = rb.portals[start[i]];
+
+			stamp++;
+			queue.clear();
+			queue.push_back(start[i]);
+			seen[start[i]] = stamp;
+
+			while (!queue.empty())
+			{
+				const int a = queue.back();
+				queue.pop_back();
+
+				const int to = rb.portals[a].to;
+				row[to >> 5] |= (DWORD)1 << (to & 31);
+
+				const std::vector<int> &next = rb.follows[a];
+				for (size_t j = 0; j < next.size(); j++)
+				{
+					const int b = next[j];
+					if (seen[b] != stamp && RJ_Reaches(first, rb.portals[b]))
+					{
+						seen[b] = stamp;
+						queue.push_back(b);
+					}
+				}
+			}
+		}
+	}
+}
+
+//
+// P_GenerateReject
+//
+// Fills reject (which must be large enough for numsectors^2 bits) and
+// returns false if the map can not be handled.
+//
+static bool P_GenerateReject(byte *reject)
+{
+	if (!RJ_SectorsClosed())
+		return false;
+
+	rejectbuild_t rb;
+
+	RJ_BuildPortals(rb);
+
+	rb.chunks = M_ParallelThreads() * 4;
+	rb.follows.resize(rb.portals.size());
+	M_ParallelFor(rb.chunks, RJ_LinkPortals, &rb);
+
+	rb.rowwords = (numsectors + 31) / 32;
+	rb.visible.assign(rb.rowwords * numsectors, 0);
+	M_ParallelFor(rb.chunks, RJ_FloodSectors, &rb);
+
+	// a pair is only rejected if neither sector can see the other
+	for (int i = 0; i < numsectors; i++)
+	{
+		const DWORD *row = &rb.visible[i * rb.rowwords];
+
+		for (int j = 0; j < numsectors; j++)
+		{
+			const DWORD *col = &rb.visible[j * rb.rowwords];
+
+			if (!(row[j >> 5] & ((DWORD)1 << (j & 31))) &&
+				!(col[i >> 5] & ((DWORD)1 << (i & 31))))
+			{
+				const size_t pnum = (size_t)i * numsectors + j;
+				reject[pnum >> 3] |= 1 << (pnum & 7);
+			}
+		}
+	}
+
+	return true;
+}
+
+//
+// P_RejectIsEmpty
+//
+// Returns true if the map's REJECT lump does not reject anything.
+//
+static bool P_RejectIsEmpty(size_t lumpnum)
+{
+	if (rejectempty)
+		return true;
+
+	const size_t size = W_LumpLength(lumpnum + ML_REJECT);
+	for (size_t i = 0; i < size; i++)
+		if (rejectmatrix[i])
+			return false;
+
+	return true;
+}
+
+//
+// P_BuildReject
+//
+// Replaces an empty or missing REJECT table with one built from the map's
+// geometry. Tables are cached in the user's directory keyed by the hash of
+// the map lumps, so each map is only processed once.
+//
+// Demos are always played and recorded with the map's own table, since a
+// built one changes which sight checks are skipped.
+//
+void P_BuildReject(size_t lumpnum, std::string &maphash)
+{
+	if (!sv_buildreject || numsectors == 0 || demoplayback || demorecording)
+		return;
+
+	const size_t size = ((size_t)numsectors * numsectors + 7) / 8;
+
+	if (!P_RejectIsEmpty(lumpnum))
+		return;
+
+	dtime_t start = I_GetTime();
+
+	std::string cachefile = I_GetUserFileName(
+		("reject-" + P_MapGeometryHash(lumpnum, maphash) + ".cache").c_str());
+
+	byte *reject = (byte *)Z_Malloc(size, PU_LEVEL, 0);
+	bool cached = false;
+
+	if (M_FileExists(cachefile))
+	{
+		BYTE *data = NULL;
+		QWORD length = M_ReadFile(cachefile, &data);
+
+		if (data != NULL && length == size + sizeof(REJECT_CACHE_MAGIC) &&
+			memcmp(data, REJECT_CACHE_MAGIC, sizeof(REJECT_CACHE_MAGIC)) == 0)
+		{
+			memcpy(reject, data + sizeof(REJECT_CACHE_MAGIC), size);
+			cached = true;
+		}
+
+		if (data != NULL)
+			Z_Free(data);
+	}
+
+	if (!cached)
+	{
+		memset(reject, 0, size);
+
+		if (!P_GenerateReject(reject))
+		{
+			DPrintf("P_BuildReject: sectors are not closed, leaving REJECT empty\n");
+			Z_Free(reject);
+			return;
+		}
+
+		std::vector<byte> data(REJECT_CACHE_MAGIC, REJECT_CACHE_MAGIC + sizeof(REJECT_CACHE_MAGIC));
+		data.insert(data.end(), reject, reject + size);
+		M_WriteFile(cachefile, &data[0], data.size());
+	}
+
+	rejectmatrix = reject;
+	rejectempty = false;
+
+	DPrintf("P_BuildReject: %s REJECT for %d sectors in %.1f ms\n",
+			cached ? "loaded" : "built", numsectors,
+			(double)(I_GetTime() - start) / 1000000.0);
+}
+
+VERSION_CONTROL (p_reject_cpp, "$Id$")
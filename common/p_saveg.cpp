@@ -146,8 +146,9 @@ void P_SerializeWorld (FArchive &arc)
 			arc << li->flags
 				<< li->special
 				<< li->lucency
-				<< li->id
-				<< li->args[0] << li->args[1] << li->args[2] << li->args[3] << li->args[4] << (WORD)0;
+				<< li->id;
+			arc.WriteArray(li->args, 5);
+			arc << (WORD)0;
 
 			for (j = 0; j < 2; j++)
 			{
@@ -248,8 +249,9 @@ void P_SerializeWorld (FArchive &arc)
 			arc >> li->flags
 				>> li->special
 				>> li->lucency
-				>> li->id
-				>> li->args[0] >> li->args[1] >> li->args[2] >> li->args[3] >> li->args[4] >> dummy;
+				>> li->id;
+			arc.ReadArray(li->args, 5);
+			arc >> dummy;
 
 			for (j = 0; j < 2; j++)
 			{
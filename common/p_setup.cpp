@@ -26,7 +26,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <algorithm>
+#include <map>
 #include <set>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
 
 #include "m_alloc.h"
 #include "m_vectors.h"
@@ -47,6 +53,10 @@
 #include "c_console.h"
 
 #include "p_setup.h"
+#include "c_dispatch.h"
+#include "md5.h"
+#include "m_parallel.h"
+#include "m_fileio.h"
 
 void SV_PreservePlayer(player_t &player);
 void P_SpawnMapThing (mapthing2_t *mthing, int position);
@@ -146,7 +156,7 @@ mapthing2_t		*redteam_p;
 //
 void P_LoadVertexes (int lump)
 {
-	byte *data;
+	const byte *data;
 	int i;
 
 	// Determine number of vertices:
@@ -157,7 +167,7 @@ void P_LoadVertexes (int lump)
 	vertexes = (vertex_t *)Z_Malloc (numvertexes*sizeof(vertex_t), PU_LEVEL, 0);
 
 	// Load data into cache.
-	data = (byte *)W_CacheLumpNum (lump, PU_STATIC);
+	data = (const byte *)W_MapLumpNum (lump);
 
 	// Copy and convert vertex coordinates,
 	// internal representation as fixed.
@@ -168,7 +178,7 @@ void P_LoadVertexes (int lump)
 	}
 
 	// Free buffer memory.
-	Z_Free (data);
+	W_UnmapLumpNum (lump);
 }
 
 
@@ -181,12 +191,12 @@ void P_LoadVertexes (int lump)
 void P_LoadSegs (int lump)
 {
 	int  i;
-	byte *data;
+	const byte *data;
 
 	numsegs = W_LumpLength (lump) / sizeof(mapseg_t);
 	segs = (seg_t *)Z_Malloc (numsegs*sizeof(seg_t), PU_LEVEL, 0);
 	memset (segs, 0, numsegs*sizeof(seg_t));
-	data = (byte *)W_CacheLumpNum (lump, PU_STATIC);
+	data = (const byte *)W_MapLumpNum (lump);
 
 	for (i = 0; i < numsegs; i++)
 	{
@@ -253,7 +263,7 @@ void P_LoadSegs (int lump)
 		li->length = FLOAT2FIXED(sqrt(dx * dx + dy* dy));
 	}
 
-	Z_Free (data);
+	W_UnmapLumpNum (lump);
 }
 
 
@@ -262,12 +272,12 @@ void P_LoadSegs (int lump)
 //
 void P_LoadSubsectors (int lump)
 {
-	byte *data;
+	const byte *data;
 	int i;
 
 	numsubsectors = W_LumpLength (lump) / sizeof(mapsubsector_t);
 	subsectors = (subsector_t *)Z_Malloc (numsubsectors*sizeof(subsector_t),PU_LEVEL,0);
-	data = (byte *)W_CacheLumpNum (lump,PU_STATIC);
+	data = (const byte *)W_MapLumpNum (lump);
 
 	memset (subsectors, 0, numsubsectors*sizeof(subsector_t));
 
@@ -277,7 +287,7 @@ void P_LoadSubsectors (int lump)
 		subsectors[i].firstline = (unsigned short)LESHORT(((mapsubsector_t *)data)[i].firstseg);
 	}
 
-	Z_Free (data);
+	W_UnmapLumpNum (lump);
 }
 
 
@@ -287,7 +297,7 @@ void P_LoadSubsectors (int lump)
 //
 void P_LoadSectors (int lump)
 {
-	byte*				data;
+	const byte*			data;
 	int 				i;
 	mapsector_t*		ms;
 	sector_t*			ss;
@@ -302,7 +312,7 @@ void P_LoadSectors (int lump)
 	sectors = new sector_t[numsectors];
 	memset(sectors, 0, sizeof(sector_t)*numsectors);
 
-	data = (byte *)W_CacheLumpNum (lump, PU_STATIC);
+	data = (const byte *)W_MapLumpNum (lump);
 
 	if (level.flags & LEVEL_SNDSEQTOTALCTRL)
 		defSeqType = 0;
@@ -380,7 +390,7 @@ void P_LoadSectors (int lump)
 		ss->movefactor = ORIG_FRICTION_FACTOR;
 	}
 
-	Z_Free (data);
+	W_UnmapLumpNum (lump);
 }
 
 
@@ -389,7 +399,7 @@ void P_LoadSectors (int lump)
 //
 void P_LoadNodes (int lump)
 {
-	byte*		data;
+	const byte*	data;
 	int 		i;
 	int 		j;
 	int 		k;
@@ -398,7 +408,7 @@ void P_LoadNodes (int lump)
 
 	numnodes = W_LumpLength (lump) / sizeof(mapnode_t);
 	nodes = (node_t *)Z_Malloc (numnodes*sizeof(node_t), PU_LEVEL, 0);
-	data = (byte *)W_CacheLumpNum (lump, PU_STATIC);
+	data = (const byte *)W_MapLumpNum (lump);
 
 	mn = (mapnode_t *)data;
 	no = nodes;
@@ -426,7 +436,149 @@ void P_LoadNodes (int lump)
 		}
 	}
 
-	Z_Free (data);
+	W_UnmapLumpNum (lump);
+}
+
+//
+// P_NodeLumpsValid
+//
+// Checks that the map has NODES, SSECTORS and SEGS lumps that the loaders
+// below can use without erroring out or indexing past the end of an array.
+// Anything they used to accept, such as empty subsectors, maps without
+// nodes or missing children, still loads from the lumps.
+//
+static bool P_NodeLumpsValid(size_t lumpnum)
+{
+	if (!W_CheckLumpName(lumpnum + ML_SEGS, "SEGS") ||
+		!W_CheckLumpName(lumpnum + ML_SSECTORS, "SSECTORS") ||
+		!W_CheckLumpName(lumpnum + ML_NODES, "NODES"))
+		return false;
+
+	int nsegs = W_LumpLength(lumpnum + ML_SEGS) / sizeof(mapseg_t);
+	int nsubsectors = W_LumpLength(lumpnum + ML_SSECTORS) / sizeof(mapsubsector_t);
+	int nnodes = W_LumpLength(lumpnum + ML_NODES) / sizeof(mapnode_t);
+
+	if (nsegs == 0 || nsubsectors == 0)
+		return false;
+
+	bool valid = true;
+	int i;
+
+	const mapseg_t *ml = (const mapseg_t *)W_MapLumpNum(lumpnum + ML_SEGS);
+	for (i = 0; valid && i < nsegs; i++)
+	{
+		unsigned short v1 = LESHORT(ml[i].v1), v2 = LESHORT(ml[i].v2);
+		unsigned short linedef = LESHORT(ml[i].linedef);
+		int side = LESHORT(ml[i].side) == 0 ? 0 : 1;
+
+		valid = v1 < numvertexes && v2 < numvertexes && linedef < numlines &&
+				lines[linedef].sidenum[side] != R_NOSIDE;
+	}
+	W_UnmapLumpNum(lumpnum + ML_SEGS);
+
+	const mapsubsector_t *ms = (const mapsubsector_t *)W_MapLumpNum(lumpnum + ML_SSECTORS);
+	for (i = 0; valid && i < nsubsectors; i++)
+	{
+		unsigned short first = LESHORT(ms[i].firstseg);
+		unsigned short count = LESHORT(ms[i].numsegs);
+
+		valid = first < nsegs && first + count <= nsegs;
+	}
+	W_UnmapLumpNum(lumpnum + ML_SSECTORS);
+
+	const mapnode_t *mn = (const mapnode_t *)W_MapLumpNum(lumpnum + ML_NODES);
+	for (i = 0; valid && i < nnodes; i++)
+	{
+		for (int j = 0; j < 2; j++)
+		{
+			unsigned short child = LESHORT(mn[i].children[j]);
+
+			if (child == 0xffff)
+				continue;
+			else if (child & 0x8000)
+				valid = valid && (child & ~0x8000) < nsubsectors;
+			else
+				valid = valid && child < nnodes;
+		}
+	}
+	W_UnmapLumpNum(lumpnum + ML_NODES);
+
+	return valid;
+}
+
+//
+// P_ValidXNOD
+//
+// Checks that the counts and indices in a set of ZDBSP extended nodes fit
+// each other and the map, so that P_LoadXNODData can trust them.
+//
+static bool P_ValidXNOD(const byte *data, size_t len)
+{
+	const byte *p = data;
+	const byte *end = data + len;
+
+	if (len < 12 || memcmp(data, "XNOD", 4) != 0)
+		return false;
+	p += 4;
+
+	unsigned int numorgvert = LELONG(*(const unsigned int *)p); p += 4;
+	unsigned int numnewvert = LELONG(*(const unsigned int *)p); p += 4;
+	QWORD numverts = (QWORD)numorgvert + numnewvert;
+
+	if (numorgvert != (unsigned int)numvertexes || (QWORD)(end - p) < (QWORD)numnewvert * 8 + 4)
+		return false;
+	p += numnewvert * 8;
+
+	unsigned int nsubsectors = LELONG(*(const unsigned int *)p); p += 4;
+	if (nsubsectors == 0 || (QWORD)(end - p) < (QWORD)nsubsectors * 4 + 4)
+		return false;
+
+	QWORD totalsegs = 0;
+	for (unsigned int i = 0; i < nsubsectors; i++)
+	{
+		unsigned int count = LELONG(*(const unsigned int *)p); p += 4;
+		if (count == 0)
+			return false;
+		totalsegs += count;
+	}
+
+	unsigned int nsegs = LELONG(*(const unsigned int *)p); p += 4;
+	if (nsegs != totalsegs || (QWORD)(end - p) < (QWORD)nsegs * 11 + 4)
+		return false;
+
+	for (unsigned int i = 0; i < nsegs; i++, p += 11)
+	{
+		unsigned int v1 = LELONG(*(const unsigned int *)p);
+		unsigned int v2 = LELONG(*(const unsigned int *)(p + 4));
+		unsigned short ld = LESHORT(*(const unsigned short *)(p + 8));
+		int side = p[10] == 0 ? 0 : 1;
+
+		if (v1 >= numverts || v2 >= numverts || ld >= numlines ||
+			lines[ld].sidenum[side] == R_NOSIDE)
+			return false;
+	}
+
+	unsigned int nnodes = LELONG(*(const unsigned int *)p); p += 4;
+	if ((nnodes == 0 && nsubsectors > 1) || (QWORD)(end - p) < (QWORD)nnodes * 32)
+		return false;
+
+	for (unsigned int i = 0; i < nnodes; i++, p += 32)
+	{
+		for (int j = 0; j < 2; j++)
+		{
+			unsigned int child = LELONG(*(const unsigned int *)(p + 24 + j * 4));
+
+			if (child & NF_SUBSECTOR)
+			{
+				if ((child & ~NF_SUBSECTOR) >= nsubsectors)
+					return false;
+			}
+			else if (child >= nnodes)
+				return false;
+		}
+	}
+
+	return true;
 }
 
 //
@@ -435,20 +587,35 @@ void P_LoadNodes (int lump)
 //
 bool P_LoadXNOD(int lump)
 {
+	if ((unsigned)lump >= numlumps)
+		return false;
+
 	size_t len = W_LumpLength(lump);
-	byte *data = (byte *) W_CacheLumpNum(lump, PU_STATIC);
+	const byte *data = (const byte *)W_MapLumpNum(lump);
 
-	if (len < 4 || memcmp(data, "XNOD", 4) != 0)
-	{
-		Z_Free(data);
+	bool loaded = P_LoadXNODData(data, len);
+
+	W_UnmapLumpNum(lump);
+
+	return loaded;
+}
+
+//
+// P_LoadXNODData
+//
+// Loads a set of ZDBSP extended nodes from memory. Returns false, leaving
+// the level untouched, if they are not valid for this map.
+//
+bool P_LoadXNODData(const byte *data, size_t len)
+{
+	if (!P_ValidXNOD(data, len))
 		return false;
-	}
 
-	byte *p = data + 4; // skip the magic number
+	const byte *p = data + 4; // skip the magic number
 
 	// Load vertices
-	unsigned int numorgvert = LELONG(*(unsigned int *)p); p += 4;
-	unsigned int numnewvert = LELONG(*(unsigned int *)p); p += 4;
+	unsigned int numorgvert = LELONG(*(const unsigned int *)p); p += 4;
+	unsigned int numnewvert = LELONG(*(const unsigned int *)p); p += 4;
 
 	vertex_t *newvert = (vertex_t *) Z_Malloc((numorgvert + numnewvert)*sizeof(*newvert), PU_LEVEL, 0);
 
@@ -458,8 +625,8 @@ bool P_LoadXNOD(int lump)
 	for (unsigned int i = 0; i < numnewvert; i++)
 	{
 		vertex_t *v = &newvert[numorgvert+i];
-		v->x = LELONG(*(int *)p); p += 4;
-		v->y = LELONG(*(int *)p); p += 4;
+		v->x = LELONG(*(const int *)p); p += 4;
+		v->y = LELONG(*(const int *)p); p += 4;
 	}
 
 	// Adjust linedefs - since we reallocated the vertex array,
@@ -478,7 +645,7 @@ bool P_LoadXNOD(int lump)
 
 	// Load subsectors
 
-	numsubsectors = LELONG(*(unsigned int *)p); p += 4;
+	numsubsectors = LELONG(*(const unsigned int *)p); p += 4;
 	subsectors = (subsector_t *) Z_Malloc(numsubsectors * sizeof(*subsectors), PU_LEVEL, 0);
 	memset(subsectors, 0, numsubsectors * sizeof(*subsectors));
 
@@ -487,22 +654,22 @@ bool P_LoadXNOD(int lump)
 	for (int i = 0; i < numsubsectors; i++)
 	{
 		subsectors[i].firstline = first_seg;
-		subsectors[i].numlines = LELONG(*(unsigned int *)p); p += 4;
+		subsectors[i].numlines = LELONG(*(const unsigned int *)p); p += 4;
 		first_seg += subsectors[i].numlines;
 	}
 
 	// Load segs
 
-	numsegs = LELONG(*(unsigned int *)p); p += 4;
+	numsegs = LELONG(*(const unsigned int *)p); p += 4;
 	segs = (seg_t *) Z_Malloc(numsegs * sizeof(*segs), PU_LEVEL, 0);
 	memset(segs, 0, numsegs * sizeof(*segs));
 
 	for (int i = 0; i < numsegs; i++)
 	{
-		unsigned int v1 = LELONG(*(unsigned int *)p); p += 4;
-		unsigned int v2 = LELONG(*(unsigned int *)p); p += 4;
-		unsigned short ld = LESHORT(*(unsigned short *)p); p += 2;
-		unsigned char side = *(unsigned char *)p; p += 1;
+		unsigned int v1 = LELONG(*(const unsigned int *)p); p += 4;
+		unsigned int v2 = LELONG(*(const unsigned int *)p); p += 4;
+		unsigned short ld = LESHORT(*(const unsigned short *)p); p += 2;
+		unsigned char side = *(const unsigned char *)p; p += 1;
 
 		if (side != 0 && side != 1)
 			side = 1;
@@ -533,7 +700,7 @@ bool P_LoadXNOD(int lump)
 
 	// Load nodes
 
-	numnodes = LELONG(*(unsigned int *)p); p += 4;
+	numnodes = LELONG(*(const unsigned int *)p); p += 4;
 	nodes = (node_t *) Z_Malloc(numnodes * sizeof(*nodes), PU_LEVEL, 0);
 	memset(nodes, 0, numnodes * sizeof(*nodes));
 
@@ -541,27 +708,25 @@ bool P_LoadXNOD(int lump)
 	{
 		node_t *node = &nodes[i];
 
-		node->x = LESHORT(*(short *)p)<<FRACBITS; p += 2;
-		node->y = LESHORT(*(short *)p)<<FRACBITS; p += 2;
-		node->dx = LESHORT(*(short *)p)<<FRACBITS; p += 2;
-		node->dy = LESHORT(*(short *)p)<<FRACBITS; p += 2;
+		node->x = LESHORT(*(const short *)p)<<FRACBITS; p += 2;
+		node->y = LESHORT(*(const short *)p)<<FRACBITS; p += 2;
+		node->dx = LESHORT(*(const short *)p)<<FRACBITS; p += 2;
+		node->dy = LESHORT(*(const short *)p)<<FRACBITS; p += 2;
 
 		for (int j = 0; j < 2; j++)
 		{
 			for (int k = 0; k < 4; k++)
 			{
-				node->bbox[j][k] = LESHORT(*(short *)p)<<FRACBITS; p += 2;
+				node->bbox[j][k] = LESHORT(*(const short *)p)<<FRACBITS; p += 2;
 			}
 		}
 
 		for (int j = 0; j < 2; j++)
 		{
-			node->children[j] = LELONG(*(unsigned int *)p); p += 4;
+			node->children[j] = LELONG(*(const unsigned int *)p); p += 4;
 		}
 	}
 
-	Z_Free(data);
-
 	return true;
 }
 
@@ -571,9 +736,9 @@ bool P_LoadXNOD(int lump)
 void P_LoadThings (int lump)
 {
 	mapthing2_t mt2;		// [RH] for translation
-	byte *data = (byte *)W_CacheLumpNum (lump, PU_STATIC);
-	mapthing_t *mt = (mapthing_t *)data;
-	mapthing_t *lastmt = (mapthing_t *)(data + W_LumpLength (lump));
+	const byte *data = (const byte *)W_MapLumpNum (lump);
+	const mapthing_t *mt = (const mapthing_t *)data;
+	const mapthing_t *lastmt = (const mapthing_t *)(data + W_LumpLength (lump));
 
 	playerstarts.clear();
 	voodoostarts.clear();
@@ -605,7 +770,7 @@ void P_LoadThings (int lump)
 		P_SpawnMapThing (&mt2, 0);
 	}
 
-	Z_Free (data);
+	W_UnmapLumpNum (lump);
 }
 
 // [RH]
@@ -618,9 +783,10 @@ void P_LoadThings (int lump)
 //
 void P_LoadThings2 (int lump, int position)
 {
-	byte *data = (byte *)W_CacheLumpNum (lump, PU_STATIC);
-	mapthing2_t *mt = (mapthing2_t *)data;
-	mapthing2_t *lastmt = (mapthing2_t *)(data + W_LumpLength (lump));
+	const byte *data = (const byte *)W_MapLumpNum (lump);
+	const mapthing2_t *mt = (const mapthing2_t *)data;
+	const mapthing2_t *lastmt = (const mapthing2_t *)(data + W_LumpLength (lump));
+	mapthing2_t mt2;
 
 	playerstarts.clear();
 	voodoostarts.clear();
@@ -632,18 +798,19 @@ void P_LoadThings2 (int lump, int position)
 		//		handle these and more cases better, so we just pass it
 		//		everything and let it decide what to do with them.
 
-		mt->thingid = LESHORT(mt->thingid);
-		mt->x = LESHORT(mt->x);
-		mt->y = LESHORT(mt->y);
-		mt->z = LESHORT(mt->z);
-		mt->angle = LESHORT(mt->angle);
-		mt->type = LESHORT(mt->type);
-		mt->flags = LESHORT(mt->flags);
+		mt2 = *mt;
+		mt2.thingid = LESHORT(mt->thingid);
+		mt2.x = LESHORT(mt->x);
+		mt2.y = LESHORT(mt->y);
+		mt2.z = LESHORT(mt->z);
+		mt2.angle = LESHORT(mt->angle);
+		mt2.type = LESHORT(mt->type);
+		mt2.flags = LESHORT(mt->flags);
 
-		P_SpawnMapThing (mt, position);
+		P_SpawnMapThing (&mt2, position);
 	}
 
-	Z_Free (data);
+	W_UnmapLumpNum (lump);
 }
 
 //
@@ -761,14 +928,14 @@ void P_FinishLoadingLineDefs (void)
 
 void P_LoadLineDefs (int lump)
 {
-	byte *data;
+	const byte *data;
 	int i;
 	line_t *ld;
 
 	numlines = W_LumpLength (lump) / sizeof(maplinedef_t);
 	lines = (line_t *)Z_Malloc (numlines*sizeof(line_t), PU_LEVEL, 0);
 	memset (lines, 0, numlines*sizeof(line_t));
-	data = (byte *)W_CacheLumpNum (lump, PU_STATIC);
+	data = (const byte *)W_MapLumpNum (lump);
 
 	ld = lines;
 	for (i=0 ; i<numlines ; i++, ld++)
@@ -804,13 +971,13 @@ void P_LoadLineDefs (int lump)
 		P_AdjustLine (ld);
 	}
 
-	Z_Free (data);
+	W_UnmapLumpNum (lump);
 }
 
 // [RH] Same as P_LoadLineDefs() except it uses Hexen-style LineDefs.
 void P_LoadLineDefs2 (int lump)
 {
-	byte*				data;
+	const byte*			data;
 	int 				i;
 	maplinedef2_t*		mld;
 	line_t* 			ld;
@@ -818,7 +985,7 @@ void P_LoadLineDefs2 (int lump)
 	numlines = W_LumpLength (lump) / sizeof(maplinedef2_t);
 	lines = (line_t *)Z_Malloc (numlines*sizeof(line_t), PU_LEVEL,0 );
 	memset (lines, 0, numlines*sizeof(line_t));
-	data = (byte *)W_CacheLumpNum (lump, PU_STATIC);
+	data = (const byte *)W_MapLumpNum (lump);
 
 	mld = (maplinedef2_t *)data;
 	ld = lines;
@@ -857,7 +1024,76 @@ void P_LoadLineDefs2 (int lump)
 		P_AdjustLine (ld);
 	}
 
-	Z_Free (data);
+	W_UnmapLumpNum (lump);
+}
+
+//
+// Texture numbers for the top, middle and bottom of every sidedef, looked
+// up on another thread while the linedefs load. Each distinct name is only
+// looked up once, as R_CheckTextureNumForName searches every texture.
+//
+struct sidetextures_t
+{
+	int lump;
+	const mapsidedef_t *msd;
+	int count;
+	std::vector<short> textures;	// top, mid, bottom for each side; -1 if not found
+};
+
+static sidetextures_t *sidetextures = NULL;
+static paralleltask_t *sidetexturetask = NULL;
+
+static void P_LookupSideTexturesTask(size_t, void *data)
+{
+	sidetextures_t *st = (sidetextures_t *)data;
+	std::map<std::string, short> found;
+
+	st->textures.resize(st->count * 3);
+
+	for (int i = 0; i < st->count; i++)
+	{
+		const mapsidedef_t *msd = st->msd + i;
+		const char *names[3] = { msd->toptexture, msd->midtexture, msd->bottomtexture };
+
+		for (int j = 0; j < 3; j++)
+		{
+			char name[9];
+			strncpy(name, names[j], 8);
+			name[8] = '\0';
+			for (char *c = name; *c; c++)
+				*c = toupper((unsigned char)*c);
+
+			std::map<std::string, short>::iterator it = found.find(name);
+			if (it == found.end())
+				it = found.insert(std::make_pair(std::string(name), (short)R_CheckTextureNumForName(name))).first;
+
+			st->textures[i * 3 + j] = it->second;
+		}
+	}
+
+	W_EndBackgroundRead();
+}
+
+//
+// P_FinishSideTextures
+//
+// Waits for the texture lookups started by P_LoadSideDefs. Frees them
+// instead if free is set.
+//
+static void P_FinishSideTextures(bool free)
+{
+	if (sidetextures == NULL)
+		return;
+
+	M_FinishParallelTask(sidetexturetask);
+	sidetexturetask = NULL;
+
+	if (free)
+	{
+		W_UnmapLumpNum(sidetextures->lump);
+		delete sidetextures;
+		sidetextures = NULL;
+	}
 }
 
 //
@@ -869,6 +1105,35 @@ void P_LoadSideDefs (int lump)
 	numsides = W_LumpLength (lump) / sizeof(mapsidedef_t);
 	sides = (side_t *)Z_Malloc (numsides*sizeof(side_t), PU_LEVEL, 0);
 	memset (sides, 0, numsides*sizeof(side_t));
+
+	sidetextures = new sidetextures_t;
+	sidetextures->lump = lump;
+	sidetextures->msd = (const mapsidedef_t *)W_MapLumpNum(lump);
+	sidetextures->count = numsides;
+	W_BeginBackgroundRead();
+	sidetexturetask = M_StartParallelTask(P_LookupSideTexturesTask, sidetextures);
+}
+
+//
+// P_SideTextureNum
+//
+// R_TextureNumForName using the lookups made by P_LoadSideDefs
+//
+static short P_SideTextureNum(int side, int tier, const char *name)
+{
+	short texnum = sidetextures->textures[side * 3 + tier];
+
+	if (texnum == -1)
+	{
+		char namet[9];
+		strncpy (namet, name, 8);
+		namet[8] = 0;
+		// [RH] Return empty texture if it wasn't found.
+		Printf (PRINT_HIGH, "Texture %s not found\n", namet);
+		return 0;
+	}
+
+	return texnum;
 }
 
 
@@ -979,7 +1244,8 @@ static void SetTextureNoErr (short *texture, unsigned int *color, char *name)
 
 void P_LoadSideDefs2 (int lump)
 {
-	byte* data = (byte*)W_CacheLumpNum(lump, PU_STATIC);
+	P_FinishSideTextures(false);
+	const byte* data = (const byte*)sidetextures->msd;
 
 	for (int i = 0; i < numsides; i++)
 	{
@@ -1043,13 +1309,14 @@ void P_LoadSideDefs2 (int lump)
 			break;
 */
 		  default:			// normal cases
-			sd->midtexture = R_TextureNumForName(msd->midtexture);
-			sd->toptexture = R_TextureNumForName(msd->toptexture);
-			sd->bottomtexture = R_TextureNumForName(msd->bottomtexture);
+			sd->midtexture = P_SideTextureNum(i, 1, msd->midtexture);
+			sd->toptexture = P_SideTextureNum(i, 0, msd->toptexture);
+			sd->bottomtexture = P_SideTextureNum(i, 2, msd->bottomtexture);
 			break;
 		}
 	}
-	Z_Free (data);
+
+	P_FinishSideTextures(true);
 }
 
 
@@ -1065,57 +1332,48 @@ void P_LoadSideDefs2 (int lump)
                                  // jff 10/8/98 use guardband>0
                                  // jff 10/12/98 0 ok with + 1 in rows,cols
 
-typedef struct linelist_t        // type used to list lines in each block
-{
-	int		num;
-	struct	linelist_t *next;
-} linelist_t;
-
 //
-// Subroutine to add a line number to a block list
-// It simply returns if the line is already in the block
+// Copy of the level geometry the blockmap is built from, so that the build
+// can run on another thread while the rest of the level loads.
 //
-
-static void AddBlockLine
-(
-	linelist_t **lists,
-	int *count,
-	int *done,
-	int blockno,
-	DWORD lineno
-)
+struct blockmapbuild_t
 {
-	linelist_t *l;
+	std::vector<fixed_t> vertexes;	// x, y pairs
+	std::vector<int> lines;			// x1, y1, x2, y2 in map units
+	std::vector<int> lump;			// the finished blockmap
+	std::string cachefile;			// where to save it once finished
+};
 
-	if (done[blockno])
-		return;
+static void P_SnapshotBlockMapGeometry(blockmapbuild_t *build)
+{
+	build->vertexes.resize(numvertexes * 2);
+	for (int i = 0; i < numvertexes; i++)
+	{
+		build->vertexes[i * 2] = vertexes[i].x;
+		build->vertexes[i * 2 + 1] = vertexes[i].y;
+	}
 
-	l = new linelist_t;
-	l->num = lineno;
-	l->next = lists[blockno];
-	lists[blockno] = l;
-	count[blockno]++;
-	done[blockno] = 1;
+	build->lines.resize(numlines * 4);
+	for (int i = 0; i < numlines; i++)
+	{
+		build->lines[i * 4] = lines[i].v1->x >> FRACBITS;
+		build->lines[i * 4 + 1] = lines[i].v1->y >> FRACBITS;
+		build->lines[i * 4 + 2] = lines[i].v2->x >> FRACBITS;
+		build->lines[i * 4 + 3] = lines[i].v2->y >> FRACBITS;
+	}
 }
 
 //
-// Actually construct the blockmap lump from the level data
-//
-// This finds the intersection of each linedef with the column and
-// row lines at the left and bottom of each blockmap cell. It then
-// adds the line to all block lists touching the intersection.
+// Blockmap dimensions enclosing every vertex of the map
 //
+struct blockmapgrid_t
+{
+	int xorg, yorg;					// blockmap origin (lower left)
+	int ncols, nrows;				// blockmap dimensions
+};
 
-void P_CreateBlockMap()
+static void P_BlockMapGrid(const blockmapbuild_t *build, blockmapgrid_t *grid)
 {
-	int xorg,yorg;					// blockmap origin (lower left)
-	int nrows,ncols;				// blockmap dimensions
-	linelist_t **blocklists=NULL;	// array of pointers to lists of lines
-	int *blockcount=NULL;			// array of counters of line lists
-	int *blockdone=NULL;			// array keeping track of blocks/line
-	int NBlocks;					// number of cells = nrows*ncols
-	DWORD linetotal=0;				// total length of all blocklists
-	int i,j;
 	int map_minx=MAXINT;			// init for map limits search
 	int map_miny=MAXINT;
 	int map_maxx=MININT;
@@ -1123,15 +1381,17 @@ void P_CreateBlockMap()
 
 	// scan for map limits, which the blockmap must enclose
 
-	for (i = 0; i < numvertexes; i++)
+	const int numverts = build->vertexes.size() / 2;
+
+	for (int i = 0; i < numverts; i++)
 	{
 		fixed_t t;
 
-		if ((t=vertexes[i].x) < map_minx)
+		if ((t=build->vertexes[i*2]) < map_minx)
 			map_minx = t;
 		else if (t > map_maxx)
 			map_maxx = t;
-		if ((t=vertexes[i].y) < map_miny)
+		if ((t=build->vertexes[i*2+1]) < map_miny)
 			map_miny = t;
 		else if (t > map_maxy)
 			map_maxy = t;
@@ -1143,252 +1403,389 @@ void P_CreateBlockMap()
 
 	// set up blockmap area to enclose level plus margin
 
-	xorg = map_minx-blkmargin;
-	yorg = map_miny-blkmargin;
-	ncols = (map_maxx+blkmargin-xorg+1+blkmask)>>blkshift;	//jff 10/12/98
-	nrows = (map_maxy+blkmargin-yorg+1+blkmask)>>blkshift;	//+1 needed for
-	NBlocks = ncols*nrows;									//map exactly 1 cell
+	grid->xorg = map_minx-blkmargin;
+	grid->yorg = map_miny-blkmargin;
+	grid->ncols = (map_maxx+blkmargin-grid->xorg+1+blkmask)>>blkshift;	//jff 10/12/98
+	grid->nrows = (map_maxy+blkmargin-grid->yorg+1+blkmask)>>blkshift;	//+1 needed for
+																		//map exactly 1 cell
+}
 
-	// create the array of pointers on NBlocks to blocklists
-	// also create an array of linelist counts on NBlocks
-	// finally make an array in which we can mark blocks done per line
+//
+// P_BlockLineCells
+//
+// Appends the cells of the blockmap that line touches to cells, each one
+// once. Only the columns and rows within the line's bounding box are
+// visited.
+//
+static void P_BlockLineCells(const blockmapgrid_t &grid, const int *line,
+							 std::vector<int> &cells)
+{
+	const int xorg = grid.xorg, yorg = grid.yorg;
+	const int ncols = grid.ncols, nrows = grid.nrows;
+	int x1 = line[0];
+	int y1 = line[1];
+	int x2 = line[2];
+	int y2 = line[3];
+	int dx = x2-x1;
+	int dy = y2-y1;
+	int vert = !dx;
+	int horiz = !dy;
+	int spos = (dx^dy) > 0;
+	int sneg = (dx^dy) < 0;
+	int minx = x1>x2? x2 : x1;
+	int maxx = x1>x2? x1 : x2;
+	int miny = y1>y2? y2 : y1;
+	int maxy = y1>y2? y1 : y2;
+	size_t start = cells.size();
+	int j;
+
+	// The line always belongs to the blocks containing its endpoints
+
+	cells.push_back(((y1-yorg)>>blkshift)*ncols + ((x1-xorg)>>blkshift));
+	cells.push_back(((y2-yorg)>>blkshift)*ncols + ((x2-xorg)>>blkshift));
+
+	// Intersections with the left edge of each column the line spans
+
+	if (!vert)
+	{
+		int first = MAX(0, (minx-xorg+blkmask)>>blkshift);
+		int last = MIN(ncols-1, (maxx-xorg)>>blkshift);
 
-	blocklists = new linelist_t *[NBlocks];
-	memset (blocklists, 0, NBlocks*sizeof(linelist_t *));
-	blockcount = new int[NBlocks];
-	memset (blockcount, 0, NBlocks*sizeof(int));
-	blockdone = new int[NBlocks];
+		for (j = first; j <= last; j++)
+		{
+			int x = xorg+(j<<blkshift);
+			int y = (dy*(x-x1))/dx+y1;
+			int yb = (y-yorg)>>blkshift;
+			int yp = (y-yorg)&blkmask;
 
-	// initialize each blocklist, and enter the trailing -1 in all blocklists
-	// note the linked list of lines grows backwards
+			if (yb<0 || yb>nrows-1)
+				continue;
 
-	for (i = 0; i < NBlocks; i++)
-	{
-		blocklists[i] = new linelist_t;
-		blocklists[i]->num = -1;
-		blocklists[i]->next = NULL;
-		blockcount[i]++;
+			cells.push_back(ncols*yb+j);
+
+			if (yp==0)
+			{
+				if (sneg)
+				{
+					if (yb>0 && miny<y)
+						cells.push_back(ncols*(yb-1)+j);
+					if (j>0 && minx<x)
+						cells.push_back(ncols*yb+j-1);
+				}
+				else if (spos)
+				{
+					if (yb>0 && j>0 && minx<x)
+						cells.push_back(ncols*(yb-1)+j-1);
+				}
+				else if (horiz)
+				{
+					if (j>0 && minx<x)
+						cells.push_back(ncols*yb+j-1);
+				}
+			}
+			else if (j>0 && minx<x)
+				cells.push_back(ncols*yb+j-1);
+		}
 	}
 
-	// For each linedef in the wad, determine all blockmap blocks it touches,
-	// and add the linedef number to the blocklists for those blocks
+	// Intersections with the bottom edge of each row the line spans
 
-	for (i = 0; i < numlines; i++)
+	if (!horiz)
 	{
-		int x1 = lines[i].v1->x>>FRACBITS;		// lines[i] map coords
-		int y1 = lines[i].v1->y>>FRACBITS;
-		int x2 = lines[i].v2->x>>FRACBITS;
-		int y2 = lines[i].v2->y>>FRACBITS;
-		int dx = x2-x1;
-		int dy = y2-y1;
-		int vert = !dx;							// lines[i] slopetype
-		int horiz = !dy;
-		int spos = (dx^dy) > 0;
-		int sneg = (dx^dy) < 0;
-		int bx,by;								// block cell coords
-		int minx = x1>x2? x2 : x1;				// extremal lines[i] coords
-		int maxx = x1>x2? x1 : x2;
-		int miny = y1>y2? y2 : y1;
-		int maxy = y1>y2? y1 : y2;
-
-		// no blocks done for this linedef yet
+		int first = MAX(0, (miny-yorg+blkmask)>>blkshift);
+		int last = MIN(nrows-1, (maxy-yorg)>>blkshift);
 
-		memset (blockdone, 0, NBlocks*sizeof(int));
-
-		// The line always belongs to the blocks containing its endpoints
+		for (j = first; j <= last; j++)
+		{
+			int y = yorg+(j<<blkshift);
+			int x = (dx*(y-y1))/dy+x1;
+			int xb = (x-xorg)>>blkshift;
+			int xp = (x-xorg)&blkmask;
 
-		bx = (x1-xorg) >> blkshift;
-		by = (y1-yorg) >> blkshift;
-		AddBlockLine (blocklists, blockcount, blockdone, by*ncols+bx, i);
-		bx = (x2-xorg) >> blkshift;
-		by = (y2-yorg) >> blkshift;
-		AddBlockLine (blocklists, blockcount, blockdone, by*ncols+bx, i);
+			if (xb<0 || xb>ncols-1)
+				continue;
 
-		// For each column, see where the line along its left edge, which
-		// it contains, intersects the Linedef i. Add i to each corresponding
-		// blocklist.
+			cells.push_back(ncols*j+xb);
 
-		if (!vert)    // don't interesect vertical lines with columns
-		{
-			for (j=0;j<ncols;j++)
+			if (xp==0)
 			{
-				// intersection of Linedef with x=xorg+(j<<blkshift)
-				// (y-y1)*dx = dy*(x-x1)
-				// y = dy*(x-x1)+y1*dx;
+				if (sneg)
+				{
+					if (j>0 && miny<y)
+						cells.push_back(ncols*(j-1)+xb);
+					if (xb>0 && minx<x)
+						cells.push_back(ncols*j+xb-1);
+				}
+				else if (vert)
+				{
+					if (j>0 && miny<y)
+						cells.push_back(ncols*(j-1)+xb);
+				}
+				else if (spos)
+				{
+					if (xb>0 && j>0 && miny<y)
+						cells.push_back(ncols*(j-1)+xb-1);
+				}
+			}
+			else if (j>0 && miny<y)
+				cells.push_back(ncols*(j-1)+xb);
+		}
+	}
 
-				int x = xorg+(j<<blkshift);		// (x,y) is intersection
-				int y = (dy*(x-x1))/dx+y1;
-				int yb = (y-yorg)>>blkshift;	// block row number
-				int yp = (y-yorg)&blkmask;		// y position within block
+	std::sort(cells.begin() + start, cells.end());
+	cells.erase(std::unique(cells.begin() + start, cells.end()), cells.end());
+}
 
-				if (yb<0 || yb>nrows-1)			// outside blockmap, continue
-					continue;
+// Maps with fewer lines than this are binned on a single thread.
+static const int BLOCKMAP_PARALLEL_LINES = 4096;
 
-				if (x<minx || x>maxx)			// line doesn't touch column
-					continue;
+//
+// A run of consecutive lines binned by one thread
+//
+struct blockmapchunk_t
+{
+	const blockmapbuild_t *build;
+	const blockmapgrid_t *grid;
+	int first, last;				// lines [first, last)
+	std::vector<int> cells;			// cells touched, line after line
+	std::vector<size_t> ends;		// end of each line's cells
+};
+
+static void P_BinBlockMapChunk(size_t index, void *data)
+{
+	blockmapchunk_t *chunk = (blockmapchunk_t *)data + index;
 
-				// The cell that contains the intersection point is always added
+	chunk->ends.reserve(chunk->last - chunk->first);
+	for (int i = chunk->first; i < chunk->last; i++)
+	{
+		P_BlockLineCells(*chunk->grid, &chunk->build->lines[i * 4], chunk->cells);
+		chunk->ends.push_back(chunk->cells.size());
+	}
+}
 
-				AddBlockLine(blocklists,blockcount,blockdone,ncols*yb+j,i);
+//
+// P_CreateBlockMap
+//
+// Builds the blockmap lump into contiguous arrays. The cells each line
+// touches are found first, split across the worker threads on large maps.
+// The lists are then sized from a count of lines per cell and filled in a
+// second pass, last line first, to keep the original linked-list
+// builder's ordering of 0, lines in descending order, -1.
+//
+static void P_CreateBlockMap(blockmapbuild_t *build)
+{
+	blockmapgrid_t grid;
+	P_BlockMapGrid(build, &grid);
 
-				// if the intersection is at a corner it depends on the slope
-				// (and whether the line extends past the intersection) which
-				// blocks are hit
+	const int numblines = build->lines.size() / 4;
+	const int NBlocks = grid.ncols * grid.nrows;
+	int i;
 
-				if (yp==0)			// intersection at a corner
-				{
-					if (sneg)		//   \ - blocks x,y-, x-,y
-					{
-						if (yb>0 && miny<y)
-							AddBlockLine(blocklists, blockcount, blockdone, ncols*(yb-1)+j, i);
-						if (j>0 && minx<x)
-							AddBlockLine(blocklists, blockcount, blockdone, ncols*yb+j-1, i);
-					}
-					else if (spos)	//   / - block x-,y-
-					{
-						if (yb>0 && j>0 && minx<x)
-							AddBlockLine(blocklists,blockcount,blockdone,ncols*(yb-1)+j-1,i);
-					}
-					else if (horiz)	//   - - block x-,y
-					{
-						if (j>0 && minx<x)
-							AddBlockLine(blocklists,blockcount,blockdone,ncols*yb+j-1,i);
-					}
-				}
-				else if (j>0 && minx<x)	// else not at corner: x-,y
-					AddBlockLine(blocklists,blockcount,blockdone,ncols*yb+j-1,i);
-			}
-		}
+	size_t numchunks = 1;
+	if (numblines >= BLOCKMAP_PARALLEL_LINES)
+		numchunks = M_ParallelThreads() * 4;
 
-		// For each row, see where the line along its bottom edge, which
-		// it contains, intersects the Linedef i. Add i to all the corresponding
-		// blocklists.
+	std::vector<blockmapchunk_t> chunks(numchunks);
+	for (size_t c = 0; c < numchunks; c++)
+	{
+		chunks[c].build = build;
+		chunks[c].grid = &grid;
+		chunks[c].first = (int)((QWORD)numblines * c / numchunks);
+		chunks[c].last = (int)((QWORD)numblines * (c + 1) / numchunks);
+	}
 
-		if (!horiz)
-		{
-			for (j=0;j<nrows;j++)
-			{
-				// intersection of Linedef with y=yorg+(j<<blkshift)
-				// (x,y) on Linedef i satisfies: (y-y1)*dx = dy*(x-x1)
-				// x = dx*(y-y1)/dy+x1;
+	M_ParallelFor(numchunks, P_BinBlockMapChunk, &chunks[0]);
 
-				int y = yorg+(j<<blkshift);		// (x,y) is intersection
-				int x = (dx*(y-y1))/dy+x1;
-				int xb = (x-xorg)>>blkshift;	// block column number
-				int xp = (x-xorg)&blkmask;		// x position within block
+	// first pass: every list holds its lines plus a leading 0 and a
+	// trailing -1
+	std::vector<int> count(NBlocks, 2);
+	DWORD linetotal = 2 * NBlocks;
 
-				if (xb<0 || xb>ncols-1)			// outside blockmap, continue
-					continue;
+	for (size_t c = 0; c < numchunks; c++)
+	{
+		const std::vector<int> &cells = chunks[c].cells;
+		for (size_t k = 0; k < cells.size(); k++)
+			count[cells[k]]++;
+		linetotal += cells.size();
+	}
 
-				if (y<miny || y>maxy)			 // line doesn't touch row
-					continue;
+	build->lump.resize(4+NBlocks+linetotal);
+	int *lump = &build->lump[0];
 
-				// The cell that contains the intersection point is always added
+	// blockmap header (bmap* are set up from it in P_FinishBlockMap)
+	lump[0] = grid.xorg;
+	lump[1] = grid.yorg;
+	lump[2] = grid.ncols;
+	lump[3] = grid.nrows;
 
-				AddBlockLine (blocklists, blockcount, blockdone, ncols*j+xb, i);
+	// offsets to lists; count becomes the position of each list's next line
+	DWORD offs = 4+NBlocks;
+	for (i = 0; i < NBlocks; i++)
+	{
+		lump[4+i] = offs;
+		lump[offs] = 0;
+		lump[offs+count[i]-1] = -1;
+		offs += count[i];
+		count[i] = lump[4+i] + 1;
+	}
 
-				// if the intersection is at a corner it depends on the slope
-				// (and whether the line extends past the intersection) which
-				// blocks are hit
+	// second pass: fill in the lines
+	for (size_t c = numchunks; c-- > 0; )
+	{
+		const blockmapchunk_t &chunk = chunks[c];
 
-				if (xp==0)			// intersection at a corner
-				{
-					if (sneg)       //   \ - blocks x,y-, x-,y
-					{
-						if (j>0 && miny<y)
-							AddBlockLine (blocklists, blockcount, blockdone, ncols*(j-1)+xb, i);
-						if (xb>0 && minx<x)
-							AddBlockLine (blocklists, blockcount, blockdone, ncols*j+xb-1, i);
-					}
-					else if (vert)  //   | - block x,y-
-					{
-						if (j>0 && miny<y)
-							AddBlockLine (blocklists, blockcount, blockdone, ncols*(j-1)+xb, i);
-					}
-					else if (spos)  //   / - block x-,y-
-					{
-						if (xb>0 && j>0 && miny<y)
-							AddBlockLine (blocklists, blockcount, blockdone, ncols*(j-1)+xb-1, i);
-					}
-				}
-				else if (j>0 && miny<y) // else not on a corner: x,y-
-					AddBlockLine (blocklists, blockcount, blockdone, ncols*(j-1)+xb, i);
-			}
+		for (i = chunk.last - 1; i >= chunk.first; i--)
+		{
+			size_t k = i > chunk.first ? chunk.ends[i - chunk.first - 1] : 0;
+			size_t end = chunk.ends[i - chunk.first];
+
+			for (; k < end; k++)
+				lump[count[chunk.cells[k]]++] = i;
 		}
 	}
+}
 
-	// Add initial 0 to all blocklists
-	// count the total number of lines (and 0's and -1's)
-	memset (blockdone, 0, NBlocks*sizeof(int));
-	for (i = 0, linetotal = 0; i < NBlocks; i++)
-	{
-		AddBlockLine (blocklists, blockcount, blockdone, i, 0);
-		linetotal += blockcount[i];
-	}
-
-	// Create the blockmap lump
-	blockmaplump = (int *)Z_Malloc(sizeof(*blockmaplump) * (4+NBlocks+linetotal), PU_LEVEL, 0);
-
-	// blockmap header
-	//
-	// Rjy: P_CreateBlockMap should not initialise bmaporg{x,y} as P_LoadBlockMap
-	// does so again, resulting in their being left-shifted by FRACBITS twice.
-	//
-	// Thus any map having its blockmap built by the engine would have its
-	// origin at (0,0) regardless of where the walls and monsters actually are,
-	// breaking all collision detection.
-	//
-	// Instead have P_CreateBlockMap create blockmaplump only, so that both
-	// clauses of the conditional in P_LoadBlockMap have the same effect, and
-	// bmap* are only initialised from blockmaplump[0..3] once in the latter.
-	//
-	blockmaplump[0] = xorg;
-	blockmaplump[1] = yorg;
-	blockmaplump[2] = ncols;
-	blockmaplump[3] = nrows;
-
-	// offsets to lists and block lists
-	for (i = 0; i < NBlocks; i++)
+// jff 10/6/98
+// End new code added to speed up calculation of internal blockmap
+
+// Bumped whenever a built blockmap can differ from one built before
+static const char BLOCKMAP_CACHE_MAGIC[4] = { 'O', 'B', 'M', '2' };
+
+//
+// P_ReadBlockMapCache
+//
+// Loads a blockmap saved by P_WriteBlockMapCache into blockmaplump.
+// Returns false if there is no cache file or it is not a sane blockmap:
+// every list must start after the offsets, hold only lines of the map and
+// end with -1 inside the lump.
+//
+static bool P_ReadBlockMapCache(const std::string &cachefile)
+{
+	if (!M_FileExists(cachefile))
+		return false;
+
+	BYTE *data = NULL;
+	QWORD length = M_ReadFile(cachefile, &data);
+	bool ok = false;
+
+	if (data != NULL && length >= sizeof(BLOCKMAP_CACHE_MAGIC) + 4 * sizeof(int) &&
+		(length - sizeof(BLOCKMAP_CACHE_MAGIC)) % sizeof(int) == 0 &&
+		memcmp(data, BLOCKMAP_CACHE_MAGIC, sizeof(BLOCKMAP_CACHE_MAGIC)) == 0)
 	{
-		linelist_t *bl = blocklists[i];
-		DWORD offs = blockmaplump[4+i] =   // set offset to block's list
-			(i? blockmaplump[4+i-1] : 4+NBlocks) + (i? blockcount[i-1] : 0);
+		size_t count = (length - sizeof(BLOCKMAP_CACHE_MAGIC)) / sizeof(int);
+		int *lump = (int *)Z_Malloc(count * sizeof(int), PU_LEVEL, 0);
 
-		// add the lines in each block's list to the blockmaplump
-		// delete each list node as we go
+		memcpy(lump, data + sizeof(BLOCKMAP_CACHE_MAGIC), count * sizeof(int));
+		for (size_t i = 0; i < count; i++)
+			lump[i] = LELONG(lump[i]);
 
-		while (bl)
+		QWORD nblocks = (QWORD)MAX(lump[2], 0) * MAX(lump[3], 0);
+		ok = nblocks > 0 && 4 + nblocks <= count;
+		for (QWORD i = 0; ok && i < nblocks; i++)
 		{
-			linelist_t *tmp = bl->next;
-			blockmaplump[offs++] = bl->num;
-			delete[] bl;
-			bl = tmp;
+			ok = lump[4 + i] >= 4 + (int)nblocks && (size_t)lump[4 + i] < count;
+
+			size_t j = lump[4 + i];
+			while (ok && lump[j] != -1)
+				ok = lump[j] >= 0 && lump[j] < numlines && ++j < count;
 		}
+
+		if (ok)
+			blockmaplump = lump;
+		else
+			Z_Free(lump);
 	}
 
-	// free all temporary storage
-	delete[] blocklists;
-	delete[] blockcount;
-	delete[] blockdone;
+	if (data != NULL)
+		Z_Free(data);
+
+	return ok;
 }
 
-// jff 10/6/98
-// End new code added to speed up calculation of internal blockmap
+static void P_WriteBlockMapCache(const std::string &cachefile, const std::vector<int> &lump)
+{
+	std::vector<byte> data(BLOCKMAP_CACHE_MAGIC,
+		BLOCKMAP_CACHE_MAGIC + sizeof(BLOCKMAP_CACHE_MAGIC));
+	data.resize(sizeof(BLOCKMAP_CACHE_MAGIC) + lump.size() * sizeof(int));
+
+	for (size_t i = 0; i < lump.size(); i++)
+	{
+		int value = LELONG(lump[i]);
+		memcpy(&data[sizeof(BLOCKMAP_CACHE_MAGIC) + i * sizeof(int)], &value, sizeof(int));
+	}
+
+	M_WriteFile(cachefile, &data[0], data.size());
+}
+
+static blockmapbuild_t *blockmapbuild = NULL;
+static paralleltask_t *blockmaptask = NULL;
+
+static void P_CreateBlockMapTask(size_t, void *data)
+{
+	P_CreateBlockMap((blockmapbuild_t *)data);
+}
+
+//
+// P_FinishBuildingBlockMap
+//
+// Waits for a blockmap build started by P_LoadBlockMap and, if keep is
+// set, hands the result to the zone heap as the level's blockmap.
+//
+static void P_FinishBuildingBlockMap(bool keep)
+{
+	if (blockmapbuild == NULL)
+		return;
+
+	M_FinishParallelTask(blockmaptask);
+	blockmaptask = NULL;
+
+	if (keep)
+	{
+		size_t size = blockmapbuild->lump.size() * sizeof(*blockmaplump);
+		blockmaplump = (int *)Z_Malloc(size, PU_LEVEL, 0);
+		memcpy(blockmaplump, &blockmapbuild->lump[0], size);
+
+		if (!blockmapbuild->cachefile.empty())
+			P_WriteBlockMapCache(blockmapbuild->cachefile, blockmapbuild->lump);
+	}
+
+	delete blockmapbuild;
+	blockmapbuild = NULL;
+}
 
 //
 // P_LoadBlockMap
 //
 // [RH] Changed this some
 //
-void P_LoadBlockMap (int lump)
+// If the map needs its blockmap built, the build is started in the
+// background; P_FinishBlockMap must be called before the blockmap is used.
+// Built blockmaps are cached in the user's directory keyed by the hash of
+// the map lumps.
+//
+void P_LoadBlockMap (int lump, std::string &maphash)
 {
 	int count;
 
 	if (Args.CheckParm("-blockmap") || (count = W_LumpLength(lump)/2) >= 0x10000 || count < 4)
-		P_CreateBlockMap();
+	{
+		std::string cachefile = I_GetUserFileName(
+			("blockmap-" + P_MapGeometryHash(lump - ML_BLOCKMAP, maphash) + ".cache").c_str());
+
+		if (P_ReadBlockMapCache(cachefile))
+		{
+			DPrintf("P_LoadBlockMap: loaded cached blockmap\n");
+			return;
+		}
+
+		blockmapbuild = new blockmapbuild_t;
+		blockmapbuild->cachefile = cachefile;
+		P_SnapshotBlockMapGeometry(blockmapbuild);
+		blockmaptask = M_StartParallelTask(P_CreateBlockMapTask, blockmapbuild);
+	}
 	else
 	{
-		short *wadblockmaplump = (short *)W_CacheLumpNum (lump, PU_LEVEL);
+		const short *wadblockmaplump = (const short *)W_MapLumpNum (lump);
 		int i;
 		blockmaplump = (int *)Z_Malloc(sizeof(*blockmaplump) * count, PU_LEVEL, 0);
 
@@ -1408,8 +1805,20 @@ void P_LoadBlockMap (int lump)
 			blockmaplump[i] = t == -1 ? (DWORD)0xffffffff : (DWORD) t & 0xffff;
 		}
 
-		Z_Free (wadblockmaplump);
+		W_UnmapLumpNum (lump);
 	}
+}
+
+//
+// P_FinishBlockMap
+//
+// Sets up the blockmap globals once the blockmap lump is ready.
+//
+void P_FinishBlockMap ()
+{
+	int count;
+
+	P_FinishBuildingBlockMap(true);
 
 	bmaporgx = blockmaplump[0]<<FRACBITS;
 	bmaporgy = blockmaplump[1]<<FRACBITS;
@@ -1420,11 +1829,13 @@ void P_LoadBlockMap (int lump)
 	count = sizeof(*blocklinks) * bmapwidth*bmapheight;
 	blocklinks = (AActor **)Z_Malloc (count, PU_LEVEL, 0);
 	memset (blocklinks, 0, count);
+	P_ClearBlockThings ();
 	blockmap = blockmaplump+4;
 }
 
 
 
+
 //
 // P_GroupLines
 // Builds sector line lists and subsector sector numbers.
@@ -1600,6 +2011,47 @@ static void P_RemoveSlimeTrails()
 	Z_Free(hit);
 }
 
+//
+// P_MapGeometryHash
+//
+// Returns the MD5 of the lumps that describe the map's layout, for keying
+// data that is built from them at load time and cached on disk. The hash
+// is stored in maphash, which P_SetupLevel keeps for the whole load, so
+// it is only worked out once however many things need it.
+//
+const std::string &P_MapGeometryHash (size_t lumpnum, std::string &maphash)
+{
+	static const int maplumps[] = { ML_LINEDEFS, ML_SIDEDEFS, ML_VERTEXES, ML_SECTORS };
+
+	if (!maphash.empty())
+		return maphash;
+
+	md5_state_t state;
+	md5_init(&state);
+
+	for (size_t i = 0; i < sizeof(maplumps) / sizeof(maplumps[0]); i++)
+	{
+		const unsigned int lump = lumpnum + maplumps[i];
+		const unsigned int length = W_LumpLength(lump);
+		if (length == 0)
+			continue;
+
+		std::vector<byte> data(length);
+		W_ReadLump(lump, &data[0]);
+		md5_append(&state, (md5_byte_t *)&data[0], length);
+	}
+
+	md5_byte_t digest[16];
+	md5_finish(&state, digest);
+
+	std::stringstream hash;
+	for (int i = 0; i < 16; i++)
+		hash << std::setw(2) << std::setfill('0') << std::hex << std::uppercase << (short)digest[i];
+
+	maphash = hash.str();
+	return maphash;
+}
+
 //
 // [RH] P_LoadBehavior
 //
@@ -1644,6 +2096,85 @@ void P_AllocStarts(void)
 	redteam_p = redteamstarts;
 }
 
+//
+// Level load profiling
+//
+// P_SetupLevel notes how long each of its stages took. In debug builds the
+// 'loadprofile' command prints the stages of the most recent level load.
+//
+struct loadstage_t
+{
+	const char *name;
+	dtime_t time;
+};
+
+static std::vector<loadstage_t> loadstages;
+static std::string loadprofilemap;
+static dtime_t loadstagemark;
+
+static void P_StartLoadProfile(const char *mapname)
+{
+	loadstages.clear();
+	loadprofilemap = mapname;
+	loadstagemark = I_GetTime();
+}
+
+static void P_LoadStage(const char *name)
+{
+	dtime_t now = I_GetTime();
+	loadstage_t stage = { name, now - loadstagemark };
+	loadstages.push_back(stage);
+	loadstagemark = now;
+}
+
+static dtime_t P_LoadProfileTotal()
+{
+	dtime_t total = 0;
+	for (size_t i = 0; i < loadstages.size(); i++)
+		total += loadstages[i].time;
+	return total;
+}
+
+#if ODAMEX_DEBUG
+BEGIN_COMMAND (loadprofile)
+{
+	if (loadstages.empty())
+	{
+		Printf(PRINT_HIGH, "No level has been loaded yet.\n");
+		return;
+	}
+
+	dtime_t total = P_LoadProfileTotal();
+
+	Printf(PRINT_HIGH, "Level load profile for %s (%d worker threads):\n",
+		loadprofilemap.c_str(), (int)M_ParallelThreads() - 1);
+	for (size_t i = 0; i < loadstages.size(); i++)
+	{
+		Printf(PRINT_HIGH, "%-16s %9.3f ms %5.1f%%\n", loadstages[i].name,
+			loadstages[i].time / 1000000.0,
+			total ? 100.0 * loadstages[i].time / total : 0.0);
+	}
+	Printf(PRINT_HIGH, "%-16s %9.3f ms\n", "total", total / 1000000.0);
+}
+END_COMMAND (loadprofile)
+#endif	// ODAMEX_DEBUG
+
+//
+// P_FinishLevelTasks
+//
+void P_FinishLevelTasks ()
+{
+	P_FinishSideTextures(true);
+	P_FinishBuildingBlockMap(false);
+}
+
+// Joins the level load's worker tasks if P_SetupLevel is left early by an
+// error, so none of them outlive the data they read.
+struct levelloadguard_t
+{
+	~levelloadguard_t() { P_FinishLevelTasks(); }
+};
+
 //
 // P_SetupLevel
 //
@@ -1653,6 +2184,10 @@ extern polyblock_t **PolyBlockMap;
 void P_SetupLevel (char *lumpname, int position)
 {
 	size_t lumpnum;
+	std::string maphash;	// see P_MapGeometryHash
+	levelloadguard_t guard;
+
+	P_StartLoadProfile(lumpname);
 
 	level.total_monsters = level.total_items = level.total_secrets =
 		level.killed_monsters = level.found_items = level.found_secrets =
@@ -1686,7 +2221,9 @@ void P_SetupLevel (char *lumpname, int position)
 
 	DThinker::DestroyAllThinkers ();
 	Z_FreeTags (PU_LEVEL, PU_PURGELEVEL-1);
+	P_InvalidateSightCache ();
 	NormalLight.next = NULL;	// [RH] Z_FreeTags frees all the custom colormaps
+	P_LoadStage("clear");
 
 	// UNUSED W_Profile ();
 
@@ -1711,28 +2248,47 @@ void P_SetupLevel (char *lumpname, int position)
 	{
 		P_LoadBehavior (lumpnum+ML_BEHAVIOR);
 	}
+	P_LoadStage("behavior");
 
     level.time = 0;
 
+	// Stages running on other threads while this one carries on: the
+	// sidedef texture lookups (until P_LoadSideDefs2) and building a
+	// missing blockmap (until P_FinishBlockMap). Their results are only
+	// used once they are joined, so the level comes out the same.
 	P_LoadVertexes (lumpnum+ML_VERTEXES);
+	P_LoadStage("vertexes");
 	P_LoadSectors (lumpnum+ML_SECTORS);
+	P_LoadStage("sectors");
 	P_LoadSideDefs (lumpnum+ML_SIDEDEFS);
 	if (!HasBehavior)
 		P_LoadLineDefs (lumpnum+ML_LINEDEFS);
 	else
 		P_LoadLineDefs2 (lumpnum+ML_LINEDEFS);	// [RH] Load Hexen-style linedefs
+	P_LoadStage("linedefs");
 	P_LoadSideDefs2 (lumpnum+ML_SIDEDEFS);
+	P_LoadStage("sidedefs");
 	P_FinishLoadingLineDefs ();
-	P_LoadBlockMap (lumpnum+ML_BLOCKMAP);
+	P_LoadBlockMap (lumpnum+ML_BLOCKMAP, maphash);
+	P_LoadStage("blockmap start");
 
+	// maps without usable nodes get them built (or loaded from the cache)
 	if (!P_LoadXNOD(lumpnum+ML_NODES))
 	{
-		P_LoadSubsectors (lumpnum+ML_SSECTORS);
-		P_LoadNodes (lumpnum+ML_NODES);
-		P_LoadSegs (lumpnum+ML_SEGS);
+		if (P_NodeLumpsValid(lumpnum))
+		{
+			P_LoadSubsectors (lumpnum+ML_SSECTORS);
+			P_LoadNodes (lumpnum+ML_NODES);
+			P_LoadSegs (lumpnum+ML_SEGS);
+		}
+		else
+			P_BuildNodes (lumpnum, maphash);
 	}
+	P_LoadStage("nodes");
 
-	rejectmatrix = (byte *)W_CacheLumpNum (lumpnum+ML_REJECT, PU_LEVEL);
+	// REJECT is only ever read, so it can stay in the WAD mapping
+	rejectmatrix = (byte *)W_MapLumpNum (lumpnum+ML_REJECT, PU_LEVEL);
+	rejectempty = false;
 	{
 		// [SL] 2011-07-01 - Check to see if the reject table is of the proper size
 		// If it's too short, the reject table should be ignored when
@@ -1743,13 +2299,24 @@ void P_SetupLevel (char *lumpname, int position)
 			rejectempty = true;
 		}
 	}
+	P_LoadStage("reject");
+
+	P_FinishBlockMap ();
+	P_LoadStage("blockmap finish");
+
 	P_GroupLines ();
+	P_LoadStage("group lines");
+
+	// build a REJECT table if the map did not come with a usable one
+	P_BuildReject (lumpnum, maphash);
+	P_LoadStage("build reject");
 
 	// [SL] don't move seg vertices if compatibility is cruical
 	if (!demoplayback && !demorecording)
 		P_RemoveSlimeTrails();
 
 	P_SetupSlopes();
+	P_LoadStage("slopes");
 
     po_NumPolyobjs = 0;
 
@@ -1762,8 +2329,10 @@ void P_SetupLevel (char *lumpname, int position)
 
 	if (!HasBehavior)
 		P_TranslateTeleportThings ();	// [RH] Assign teleport destination TIDs
+	P_LoadStage("things");
 
     PO_Init ();
+	P_LoadStage("polyobjs");
 
     if (serverside)
     {
@@ -1788,6 +2357,7 @@ void P_SetupLevel (char *lumpname, int position)
 
 	// set up world state
 	P_SpawnSpecials ();
+	P_LoadStage("specials");
 
 	// build subsector connect matrix
 	//	UNUSED P_ConnectSubsectors ();
@@ -1796,7 +2366,10 @@ void P_SetupLevel (char *lumpname, int position)
 	// preload graphics
 	if (precache)
 		R_PrecacheLevel ();
+	P_LoadStage("precache");
 #endif
+
+	DPrintf ("%s loaded in %.3f ms\n", lumpname, P_LoadProfileTotal () / 1000000.0);
 }
 
 //
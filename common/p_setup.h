@@ -25,6 +25,7 @@
 #ifndef __P_SETUP__
 #define __P_SETUP__
 
+#include <string>
 
 
 // NOT called by W_Ticker. Fixme.
@@ -34,6 +35,14 @@
 //		of single-player start spots should be spawned in the level.
 void P_SetupLevel (char *mapname, int position);
 
+// Waits for and throws away any work P_SetupLevel left running on other
+// threads. Must be called before the WAD files are closed.
+void P_FinishLevelTasks ();
+
+// MD5 of the lumps describing the layout of the map starting at lumpnum,
+// worked out into maphash the first time it is needed.
+const std::string &P_MapGeometryHash (size_t lumpnum, std::string &maphash);
+
 // Called by startup code.
 void P_Init (void);
 
@@ -24,6 +24,8 @@
 //-----------------------------------------------------------------------------
 
 
+#include <vector>
+
 #include "doomdef.h"
 
 #include "i_system.h"
@@ -31,6 +33,8 @@
 #include "m_random.h"
 #include "m_bbox.h"
 #include "m_vectors.h"
+#include "c_dispatch.h"
+#include "m_parallel.h"
 
 // State.
 #include "r_state.h"
@@ -38,19 +42,74 @@
 //
 // P_CheckSight
 //
-fixed_t		sightzstart;		// eye z of looker
-fixed_t		topslope;
-fixed_t		bottomslope;		// slopes to top and bottom of target
+// Everything a sight check writes to while tracing lives in a sighttrace_t,
+// so that checks can be run on several threads at once (see
+// P_FlushSightChecks). Lines and polyobjects are marked as checked in the
+// trace's own arrays instead of with validcount.
+//
+struct sighttrace_t
+{
+	fixed_t		sightzstart;		// eye z of looker
+	fixed_t		topslope;
+	fixed_t		bottomslope;		// slopes to top and bottom of target
+
+	divline_t	strace;			// from t1 to t2
+	fixed_t		t2x;
+	fixed_t		t2y;
+
+	divline_t	trace;			// [ZDoom] blockmap trace and its lines
+	std::vector<intercept_t> intercepts;
+
+	std::vector<unsigned int> linechecked;
+	std::vector<unsigned int> polychecked;
+	unsigned int checkcount;
+
+	int			sightcounts[2];
+	int			sightcounts2[3];
 
-divline_t	strace;			// from t1 to t2
-fixed_t		t2x;
-fixed_t		t2y;
+	sighttrace_t() : checkcount(0)
+	{
+		sightcounts[0] = sightcounts[1] = 0;
+		sightcounts2[0] = sightcounts2[1] = sightcounts2[2] = 0;
+	}
+};
 
-int		sightcounts[2];
-int		sightcounts2[3];
+// used for all checks made from the game thread
+static sighttrace_t gamesight;
+
+//
+// P_NewSightTrace
+//
+// Starts a new pass over the level's lines, taking the place of validcount++.
+//
+static void P_NewSightTrace(sighttrace_t &st)
+{
+	if (st.linechecked.size() != (size_t)numlines ||
+		st.polychecked.size() != (size_t)po_NumPolyobjs || ++st.checkcount == 0)
+	{
+		st.linechecked.assign(numlines, 0);
+		st.polychecked.assign(po_NumPolyobjs, 0);
+		st.checkcount = 1;
+	}
+}
+
+//
+// P_SightCheckLine
+//
+// Returns false if the line was already looked at by the current trace.
+//
+static inline bool P_SightCheckLine(sighttrace_t &st, const line_t *ld)
+{
+	unsigned int &mark = st.linechecked[ld - lines];
+	if (mark == st.checkcount)
+		return false;
+	mark = st.checkcount;
+	return true;
+}
 
 extern bool HasBehavior;
 EXTERN_CVAR (co_zdoomphys)
+EXTERN_CVAR (sv_sightcache)
 
 /*
 ==============
@@ -60,7 +119,7 @@ EXTERN_CVAR (co_zdoomphys)
 ==============
 */
 
-bool PTR_SightTraverse (intercept_t *in)
+static bool PTR_SightTraverse (sighttrace_t &st, intercept_t *in)
 {
 	line_t  *li;
 	fixed_t slope;
@@ -76,30 +135,32 @@ bool PTR_SightTraverse (intercept_t *in)
 //
 // crosses a two sided line
 //
-	fixed_t crossx = trace.x + FixedMul(trace.dx, in->frac);
-	fixed_t crossy = trace.y + FixedMul(trace.dy, in->frac);	
-	P_LineOpening(li, crossx, crossy);
+	fixed_t crossx = st.trace.x + FixedMul(st.trace.dx, in->frac);
+	fixed_t crossy = st.trace.y + FixedMul(st.trace.dy, in->frac);	
+	lineopening_t open;
+	if (!P_GetLineOpening(&open, li, crossx, crossy))
+		return false;
 
-	if (openbottom >= opentop)		// quick test for totally closed doors
+	if (open.bottom >= open.top)		// quick test for totally closed doors
 		return false;	// stop
 
 	if (P_FloorHeight(crossx, crossy, li->frontsector) !=
 		P_FloorHeight(crossx, crossy, li->backsector))
 	{
-		slope = FixedDiv (openbottom - sightzstart , in->frac);
-		if (slope > bottomslope)
-			bottomslope = slope;
+		slope = FixedDiv (open.bottom - st.sightzstart , in->frac);
+		if (slope > st.bottomslope)
+			st.bottomslope = slope;
 	}
 
 	if (P_CeilingHeight(crossx, crossy, li->frontsector) !=
 		P_CeilingHeight(crossx, crossy, li->backsector))
 	{
-		slope = FixedDiv (opentop - sightzstart , in->frac);
-		if (slope < topslope)
-			topslope = slope;
+		slope = FixedDiv (open.top - st.sightzstart , in->frac);
+		if (slope < st.topslope)
+			st.topslope = slope;
 	}
 
-	if (topslope <= bottomslope)
+	if (st.topslope <= st.bottomslope)
 		return false;	// stop
 
 	return true;	// keep going
@@ -113,7 +174,7 @@ bool PTR_SightTraverse (intercept_t *in)
 ===================
 */
 
-bool P_SightBlockLinesIterator (int x, int y)
+static bool P_SightBlockLinesIterator (sighttrace_t &st, int x, int y)
 {
 	int offset;
 	int *list;
@@ -134,24 +195,24 @@ bool P_SightBlockLinesIterator (int x, int y)
 	{
 		if(polyLink->polyobj)
 		{ // only check non-empty links
-			if(polyLink->polyobj->validcount != validcount)
+			unsigned int &polymark = st.polychecked[polyLink->polyobj - polyobjs];
+			if(polymark != st.checkcount)
 			{
 				segList = polyLink->polyobj->segs;
 				for(i = 0; i < polyLink->polyobj->numsegs; i++, segList++)
 				{
 					ld = (*segList)->linedef;
-					if(ld->validcount == validcount)
+					if(!P_SightCheckLine(st, ld))
 					{
 						continue;
 					}
-					ld->validcount = validcount;
-					s1 = P_PointOnDivlineSide (ld->v1->x, ld->v1->y, &trace);
-					s2 = P_PointOnDivlineSide (ld->v2->x, ld->v2->y, &trace);
+					s1 = P_PointOnDivlineSide (ld->v1->x, ld->v1->y, &st.trace);
+					s2 = P_PointOnDivlineSide (ld->v2->x, ld->v2->y, &st.trace);
 					if (s1 == s2)
 						continue;		// line isn't crossed
 					P_MakeDivline (ld, &dl);
-					s1 = P_PointOnDivlineSide (trace.x, trace.y, &dl);
-					s2 = P_PointOnDivlineSide (trace.x+trace.dx, trace.y+trace.dy, &dl);
+					s1 = P_PointOnDivlineSide (st.trace.x, st.trace.y, &dl);
+					s2 = P_PointOnDivlineSide (st.trace.x+st.trace.dx, st.trace.y+st.trace.dy, &dl);
 					if (s1 == s2)
 						continue;		// line isn't crossed
 
@@ -163,9 +224,9 @@ bool P_SightBlockLinesIterator (int x, int y)
 					intercept_t intercept;
 					intercept.d.line = ld;
 					intercept.isaline = true;
-					intercepts.Push(intercept);
+					st.intercepts.push_back(intercept);
 				}
-				polyLink->polyobj->validcount = validcount;
+				polymark = st.checkcount;
 			}
 		}
 		polyLink = polyLink->next;
@@ -176,17 +237,16 @@ bool P_SightBlockLinesIterator (int x, int y)
 	for (list = blockmaplump + offset; *list != -1; list++)
 	{
 		ld = &lines[*list];
-		if (ld->validcount == validcount)
+		if (!P_SightCheckLine(st, ld))
 			continue;				// line has already been checked
-		ld->validcount = validcount;
 
-		s1 = P_PointOnDivlineSide (ld->v1->x, ld->v1->y, &trace);
-		s2 = P_PointOnDivlineSide (ld->v2->x, ld->v2->y, &trace);
+		s1 = P_PointOnDivlineSide (ld->v1->x, ld->v1->y, &st.trace);
+		s2 = P_PointOnDivlineSide (ld->v2->x, ld->v2->y, &st.trace);
 		if (s1 == s2)
 			continue;				// line isn't crossed
 		P_MakeDivline (ld, &dl);
-		s1 = P_PointOnDivlineSide (trace.x, trace.y, &dl);
-		s2 = P_PointOnDivlineSide (trace.x+trace.dx, trace.y+trace.dy, &dl);
+		s1 = P_PointOnDivlineSide (st.trace.x, st.trace.y, &dl);
+		s2 = P_PointOnDivlineSide (st.trace.x+st.trace.dx, st.trace.y+st.trace.dy, &dl);
 		if (s1 == s2)
 			continue;				// line isn't crossed
 
@@ -198,7 +258,7 @@ bool P_SightBlockLinesIterator (int x, int y)
        	intercept_t intercept;
        	intercept.d.line = ld;
 		intercept.isaline = true;
-       	intercepts.Push(intercept);
+       	st.intercepts.push_back(intercept);
 	}
 
 	return true;			// everything was checked
@@ -212,9 +272,9 @@ bool P_SightBlockLinesIterator (int x, int y)
 ====================
 */
 
-bool P_SightTraverseIntercepts ( void )
+static bool P_SightTraverseIntercepts (sighttrace_t &st)
 {
-	size_t  count = intercepts.Size();
+	size_t  count = st.intercepts.size();
 	fixed_t dist;
 	size_t	scan;
 	intercept_t *in = 0;
@@ -222,13 +282,13 @@ bool P_SightTraverseIntercepts ( void )
 //
 // calculate intercept distance
 //
-	for (scan = 0 ; scan < intercepts.Size(); scan++)
+	for (scan = 0 ; scan < st.intercepts.size(); scan++)
 	{
-		if (!intercepts[scan].isaline)
+		if (!st.intercepts[scan].isaline)
 			I_Error ("P_SightTraverseIntercepts: non-line intercept\n");
 
-		P_MakeDivline (intercepts[scan].d.line, &dl);
-		intercepts[scan].frac = P_InterceptVector (&trace, &dl);
+		P_MakeDivline (st.intercepts[scan].d.line, &dl);
+		st.intercepts[scan].frac = P_InterceptVector (&st.trace, &dl);
 	}
 
 //
@@ -237,14 +297,14 @@ bool P_SightTraverseIntercepts ( void )
 	while (count--)
 	{
 		dist = MAXINT;
-		for (scan = 0 ; scan < intercepts.Size(); scan++)
-			if (intercepts[scan].frac < dist)
+		for (scan = 0 ; scan < st.intercepts.size(); scan++)
+			if (st.intercepts[scan].frac < dist)
 			{
-				dist = intercepts[scan].frac;
-				in = &intercepts[scan];
+				dist = st.intercepts[scan].frac;
+				in = &st.intercepts[scan];
 			}
 
-		if ( !PTR_SightTraverse (in) )
+		if ( !PTR_SightTraverse (st, in) )
 			return false;					// don't bother going farther
 			
 		in->frac = MAXINT;
@@ -263,7 +323,7 @@ bool P_SightTraverseIntercepts ( void )
 ==================
 */
 
-bool P_SightPathTraverse (fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2)
+static bool P_SightPathTraverse (sighttrace_t &st, fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2)
 {
 	fixed_t xt1,yt1,xt2,yt2;
 	fixed_t xstep,ystep;
@@ -272,17 +332,17 @@ bool P_SightPathTraverse (fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2)
 	int mapx, mapy, mapxstep, mapystep;
 	int count;
 
-	validcount++;
-	intercepts.Clear();
+	P_NewSightTrace(st);
+	st.intercepts.clear();
 
 	if ( ((x1-bmaporgx)&(MAPBLOCKSIZE-1)) == 0)
 		x1 += FRACUNIT;							// don't side exactly on a line
 	if ( ((y1-bmaporgy)&(MAPBLOCKSIZE-1)) == 0)
 		y1 += FRACUNIT;							// don't side exactly on a line
-	trace.x = x1;
-	trace.y = y1;
-	trace.dx = x2 - x1;
-	trace.dy = y2 - y1;
+	st.trace.x = x1;
+	st.trace.y = y1;
+	st.trace.dx = x2 - x1;
+	st.trace.dy = y2 - y1;
 
 	x1 -= bmaporgx;
 	y1 -= bmaporgy;
@@ -351,9 +411,9 @@ bool P_SightPathTraverse (fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2)
 
 	for (count = 0 ; count < 64 ; count++)
 	{
-		if (!P_SightBlockLinesIterator (mapx, mapy))
+		if (!P_SightBlockLinesIterator (st, mapx, mapy))
 		{
-			sightcounts2[1]++;
+			st.sightcounts2[1]++;
 			return false;	// early out
 		}
 
@@ -381,9 +441,9 @@ bool P_SightPathTraverse (fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2)
 //
 // couldn't early out, so go through the sorted list
 //
-	sightcounts2[2]++;
+	st.sightcounts2[2]++;
 
-	return P_SightTraverseIntercepts ( );
+	return P_SightTraverseIntercepts (st);
 }
 
 /*
@@ -397,7 +457,7 @@ bool P_SightPathTraverse (fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2)
 =====================
 */
 
-bool P_CheckSightZDoom(const AActor *t1, const AActor *t2)
+static bool P_CheckSightZDoom(sighttrace_t &st, const AActor *t1, const AActor *t2)
 {
 	if(!t1 || !t2 || !t1->subsector || !t2->subsector)
 		return false;
@@ -410,7 +470,7 @@ bool P_CheckSightZDoom(const AActor *t1, const AActor *t2)
 	// check for trivial rejection
 	//
 	if (!rejectempty && rejectmatrix[pnum>>3] & (1 << (pnum & 7))) {
-		sightcounts2[0]++;
+		st.sightcounts2[0]++;
 		return false;			// can't possibly be connected
 	}
 	//
@@ -440,13 +500,11 @@ bool P_CheckSightZDoom(const AActor *t1, const AActor *t2)
 		   t1->z + t2->height <= s2_ceilingheight_t1))))
 		return false;
 
-	validcount++;
-
-	sightzstart = t1->z + t1->height - (t1->height >> 2);
-	bottomslope = (t2->z) - sightzstart;
-	topslope = bottomslope + t2->height;
+	st.sightzstart = t1->z + t1->height - (t1->height >> 2);
+	st.bottomslope = (t2->z) - st.sightzstart;
+	st.topslope = st.bottomslope + t2->height;
 
-	return P_SightPathTraverse (t1->x, t1->y, t2->x, t2->y);
+	return P_SightPathTraverse (st, t1->x, t1->y, t2->x, t2->y);
 }
 
 /*
@@ -460,7 +518,7 @@ bool P_CheckSightZDoom(const AActor *t1, const AActor *t2)
 =====================
 */
 
-bool P_CheckSightEdgesZDoom(const AActor *t1, const AActor *t2, float radius_boost)
+static bool P_CheckSightEdgesZDoom(sighttrace_t &st, const AActor *t1, const AActor *t2, float radius_boost)
 {
 	const sector_t *s1 = t1->subsector->sector;
 	const sector_t *s2 = t2->subsector->sector;
@@ -470,7 +528,7 @@ bool P_CheckSightEdgesZDoom(const AActor *t1, const AActor *t2, float radius_boo
 	// check for trivial rejection
 	//
 	if (!rejectempty && rejectmatrix[pnum>>3] & (1 << (pnum & 7))) {
-		sightcounts2[0]++;
+		st.sightcounts2[0]++;
 		return false;                   // can't possibly be connected
 	}
 
@@ -501,9 +559,9 @@ bool P_CheckSightEdgesZDoom(const AActor *t1, const AActor *t2, float radius_boo
 		   t1->z + t2->height <= s2_ceilingheight_t1))))
 		return false;
 
-	sightzstart = t1->z + t1->height - (t1->height >> 2);
-	bottomslope = (t2->z) - sightzstart;
-	topslope = bottomslope + t2->height;
+	st.sightzstart = t1->z + t1->height - (t1->height >> 2);
+	st.bottomslope = (t2->z) - st.sightzstart;
+	st.topslope = st.bottomslope + t2->height;
 
 	// d = normalized euclidian distance between points
 	// r = normalized vector perpendicular to d
@@ -516,9 +574,9 @@ bool P_CheckSightEdgesZDoom(const AActor *t1, const AActor *t2, float radius_boo
 	M_SetVec3(&r, -d.y, d.x, 0.0);
 	M_ScaleVec3(&w, &r, FIXED2FLOAT(t2->radius));
 
-	return P_SightPathTraverse (t1->x, t1->y, t2->x, t2->y)
-		|| P_SightPathTraverse(t1->x, t1->y, t2->x + FLOAT2FIXED(w.x), t2->y + FLOAT2FIXED(w.y))
-		|| P_SightPathTraverse(t1->x, t1->y, t2->x - FLOAT2FIXED(w.x), t2->y - FLOAT2FIXED(w.y));
+	return P_SightPathTraverse (st, t1->x, t1->y, t2->x, t2->y)
+		|| P_SightPathTraverse(st, t1->x, t1->y, t2->x + FLOAT2FIXED(w.x), t2->y + FLOAT2FIXED(w.y))
+		|| P_SightPathTraverse(st, t1->x, t1->y, t2->x - FLOAT2FIXED(w.x), t2->y - FLOAT2FIXED(w.y));
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -608,9 +666,9 @@ P_InterceptVector2
 //
 // P_CrossSubsector
 // Returns true
-//  if strace crosses the given subsector successfully.
+//  if st.strace crosses the given subsector successfully.
 //
-bool P_CrossSubsector (int num)
+static bool P_CrossSubsector (sighttrace_t &st, int num)
 {
     seg_t*		seg;
     line_t*		line;
@@ -646,15 +704,13 @@ bool P_CrossSubsector (int num)
 		line = seg->linedef;
 		
 		// allready checked other side?
-		if (line->validcount == validcount)
+		if (!P_SightCheckLine(st, line))
 			continue;
 		
-		line->validcount = validcount;
-		
 		v1 = line->v1;
 		v2 = line->v2;
-		s1 = P_DivlineSide (v1->x,v1->y, &strace);
-		s2 = P_DivlineSide (v2->x, v2->y, &strace);
+		s1 = P_DivlineSide (v1->x,v1->y, &st.strace);
+		s2 = P_DivlineSide (v2->x, v2->y, &st.strace);
 		
 		// line isn't crossed?
 		if (s1 == s2)
@@ -664,15 +720,15 @@ bool P_CrossSubsector (int num)
 		divl.y = v1->y;
 		divl.dx = v2->x - v1->x;
 		divl.dy = v2->y - v1->y;
-		s1 = P_DivlineSide (strace.x, strace.y, &divl);
-		s2 = P_DivlineSide (t2x, t2y, &divl);
+		s1 = P_DivlineSide (st.strace.x, st.strace.y, &divl);
+		s2 = P_DivlineSide (st.t2x, st.t2y, &divl);
 		
 		// line isn't crossed?
 		if (s1 == s2)
 			continue;	
 		
 		// stop because it is not two sided anyway
-		// might do this after updating validcount?
+		// might do this after marking the line?
 		if ( !(line->flags & ML_TWOSIDED) )
 			return false;
 		
@@ -680,7 +736,7 @@ bool P_CrossSubsector (int num)
 		front = seg->frontsector;
 		back = seg->backsector;
 
-		frac = P_InterceptVector2 (&strace, &divl);
+		frac = P_InterceptVector2 (&st.strace, &divl);
 		
 		// no wall to block sight with?
 		fixed_t crossx = divl.x + FixedMul(frac, divl.dx);
@@ -713,19 +769,19 @@ bool P_CrossSubsector (int num)
 		
 		if (ff != bf)
 		{
-			slope = FixedDiv (openbottom - sightzstart , frac);
-			if (slope > bottomslope)
-				bottomslope = slope;
+			slope = FixedDiv (openbottom - st.sightzstart , frac);
+			if (slope > st.bottomslope)
+				st.bottomslope = slope;
 		}
 		
 		if (fc != bc)
 		{
-			slope = FixedDiv (opentop - sightzstart , frac);
-			if (slope < topslope)
-				topslope = slope;
+			slope = FixedDiv (opentop - st.sightzstart , frac);
+			if (slope < st.topslope)
+				st.topslope = slope;
 		}
 		
-		if (topslope <= bottomslope)
+		if (st.topslope <= st.bottomslope)
 			return false;		// stop				
     }
     // passed the subsector ok
@@ -737,9 +793,9 @@ bool P_CrossSubsector (int num)
 //
 // P_CrossBSPNode
 // Returns true
-//  if strace crosses the given node successfully.
+//  if st.strace crosses the given node successfully.
 //
-bool P_CrossBSPNode (int bspnum)
+static bool P_CrossBSPNode (sighttrace_t &st, int bspnum)
 {
     node_t*	bsp;
     int		side;
@@ -747,31 +803,31 @@ bool P_CrossBSPNode (int bspnum)
     if (bspnum & NF_SUBSECTOR)
     {
 		if (bspnum == -1)
-			return P_CrossSubsector (0);
+			return P_CrossSubsector (st, 0);
 		else
-			return P_CrossSubsector (bspnum&(~NF_SUBSECTOR));
+			return P_CrossSubsector (st, bspnum&(~NF_SUBSECTOR));
     }
 	
     bsp = &nodes[bspnum];
     
     // decide which side the start point is on
-    side = P_DivlineSide (strace.x, strace.y, (divline_t *)bsp);
+    side = P_DivlineSide (st.strace.x, st.strace.y, (divline_t *)bsp);
     if (side == 2)
 		side = 0;	// an "on" should cross both sides
 	
     // cross the starting side
-    if (!P_CrossBSPNode (bsp->children[side]) )
+    if (!P_CrossBSPNode (st, bsp->children[side]) )
 		return false;
 	
     // the partition plane is crossed here
-    if (side == P_DivlineSide (t2x, t2y,(divline_t *)bsp))
+    if (side == P_DivlineSide (st.t2x, st.t2y,(divline_t *)bsp))
     {
 		// the line doesn't touch the other side
 		return true;
     }
     
     // cross the ending side		
-    return P_CrossBSPNode (bsp->children[side^1]);
+    return P_CrossBSPNode (st, bsp->children[side^1]);
 }
 
 
@@ -781,7 +837,7 @@ bool P_CrossBSPNode (int bspnum)
 //  if a straight line between t1 and t2 is unobstructed.
 // Uses REJECT.
 //
-bool P_CheckSightDoom(const AActor* t1, const AActor* t2)
+static bool P_CheckSightDoom(sighttrace_t &st, const AActor* t1, const AActor* t2)
 {
     int		s1;
     int		s2;
@@ -804,7 +860,7 @@ bool P_CheckSightDoom(const AActor* t1, const AActor* t2)
     // Check in REJECT table.
     if (!rejectempty && rejectmatrix[bytenum]&bitnum)
     {
-		sightcounts[0]++;
+		st.sightcounts[0]++;
 		
 		// can't possibly be connected
 		return false;	
@@ -812,23 +868,23 @@ bool P_CheckSightDoom(const AActor* t1, const AActor* t2)
 	
     // An unobstructed LOS is possible.
     // Now look from eyes of t1 to any part of t2.
-    sightcounts[1]++;
+    st.sightcounts[1]++;
 	
-    validcount++;
+    P_NewSightTrace(st);
 	
-    sightzstart = t1->z + t1->height - (t1->height>>2);
-    topslope = (t2->z+t2->height) - sightzstart;
-    bottomslope = (t2->z) - sightzstart;
+    st.sightzstart = t1->z + t1->height - (t1->height>>2);
+    st.topslope = (t2->z+t2->height) - st.sightzstart;
+    st.bottomslope = (t2->z) - st.sightzstart;
 	
-    strace.x = t1->x;
-    strace.y = t1->y;
-    t2x = t2->x;
-    t2y = t2->y;
-    strace.dx = t2->x - t1->x;
-    strace.dy = t2->y - t1->y;
+    st.strace.x = t1->x;
+    st.strace.y = t1->y;
+    st.t2x = t2->x;
+    st.t2y = t2->y;
+    st.strace.dx = t2->x - t1->x;
+    st.strace.dy = t2->y - t1->y;
 	
     // the head node is the last node output
-    return P_CrossBSPNode (numnodes-1);	
+    return P_CrossBSPNode (st, numnodes-1);	
 }
 
 //
@@ -838,7 +894,8 @@ bool P_CheckSightDoom(const AActor* t1, const AActor* t2)
 // Uses REJECT.
 //
 static bool P_CheckSightDoom
-( fixed_t x1, fixed_t y1, fixed_t z1, fixed_t h1,
+( sighttrace_t &st,
+  fixed_t x1, fixed_t y1, fixed_t z1, fixed_t h1,
   fixed_t x2, fixed_t y2, fixed_t z2, fixed_t h2 )
 {
     int		s1;
@@ -859,7 +916,7 @@ static bool P_CheckSightDoom
     // Check in REJECT table.
     if (!rejectempty && rejectmatrix[bytenum]&bitnum)
     {
-		sightcounts[0]++;
+		st.sightcounts[0]++;
 		
 		// can't possibly be connected
 		return false;	
@@ -867,32 +924,263 @@ static bool P_CheckSightDoom
 	
     // An unobstructed LOS is possible.
     // Now look from eyes of t1 to any part of t2.
-    sightcounts[1]++;
+    st.sightcounts[1]++;
 	
-    validcount++;
+    P_NewSightTrace(st);
 	
-    sightzstart = z1 + h1 - (h1>>2);
-    topslope = (z2+h2) - sightzstart;
-    bottomslope = (z2) - sightzstart;
+    st.sightzstart = z1 + h1 - (h1>>2);
+    st.topslope = (z2+h2) - st.sightzstart;
+    st.bottomslope = (z2) - st.sightzstart;
 	
-    strace.x = x1;
-    strace.y = y1;
-    t2x = x2;
-    t2y = y2;
-    strace.dx = x2 - x1;
-    strace.dy = y2 - y1;
+    st.strace.x = x1;
+    st.strace.y = y1;
+    st.t2x = x2;
+    st.t2y = y2;
+    st.strace.dx = x2 - x1;
+    st.strace.dy = y2 - y1;
 	
     // the head node is the last node output
-    return P_CrossBSPNode (numnodes-1);	
+    return P_CrossBSPNode (st, numnodes-1);	
+}
+
+//
+// Sight check cache
+//
+// Monsters check sight against the same targets many times per tic from
+// A_Look, A_Chase and their attack checks. The result of P_CheckSight only
+// depends on the position, size and sector of both actors and on the level
+// geometry, so it is remembered until either actor moves, a sector or
+// polyobject moves, or the tic ends.
+//
+struct sightcache_t
+{
+	unsigned int	stamp;
+	const AActor*	t1;
+	const AActor*	t2;
+	const sector_t*	s1;
+	const sector_t*	s2;
+	fixed_t			x1, y1, z1, h1;
+	fixed_t			x2, y2, z2, h2;
+	bool			zdoom;
+	bool			result;
+	bool			batched;		// stored by P_FlushSightChecks, not yet used
+};
+
+static const size_t SIGHTCACHE_SIZE = 4096;
+static sightcache_t sightcache[SIGHTCACHE_SIZE];
+static unsigned int sightcache_stamp = 1;
+
+static unsigned int sightcache_hits, sightcache_misses;
+static unsigned int sightcache_tichits, sightcache_ticmisses;
+static unsigned int sightcache_lasthits, sightcache_lastmisses;
+static unsigned int sightbatch_queued, sightbatch_used;
+
+void P_InvalidateSightCache()
+{
+	if (++sightcache_stamp == 0)
+	{
+		memset(sightcache, 0, sizeof(sightcache));
+		sightcache_stamp = 1;
+	}
+}
+
+//
+// P_SightCacheTick
+//
+// Called at the start of every tic to throw away the previous tic's
+// results and roll over the per-tic hit counters.
+//
+void P_SightCacheTick()
+{
+	P_InvalidateSightCache();
+
+	sightcache_lasthits = sightcache_tichits;
+	sightcache_lastmisses = sightcache_ticmisses;
+	sightcache_tichits = sightcache_ticmisses = 0;
+}
+
+static sightcache_t *P_SightCacheEntry(const AActor* t1, const AActor* t2)
+{
+	unsigned int hash = (unsigned int)(((size_t)t1 >> 4) * 31 + ((size_t)t2 >> 4));
+	hash ^= (t1->x >> FRACBITS) * 73856093 ^ (t1->y >> FRACBITS) * 19349663;
+	hash ^= (t2->x >> FRACBITS) * 83492791 ^ (t2->y >> FRACBITS) * 2654435761u;
+	return &sightcache[(hash ^ (hash >> 16)) & (SIGHTCACHE_SIZE - 1)];
+}
+
+static bool P_SightCacheMatches(const sightcache_t *entry, const AActor* t1, const AActor* t2, bool zdoom)
+{
+	return entry->stamp == sightcache_stamp && entry->t1 == t1 && entry->t2 == t2 &&
+		entry->s1 == t1->subsector->sector && entry->s2 == t2->subsector->sector &&
+		entry->zdoom == zdoom &&
+		entry->x1 == t1->x && entry->y1 == t1->y && entry->z1 == t1->z && entry->h1 == t1->height &&
+		entry->x2 == t2->x && entry->y2 == t2->y && entry->z2 == t2->z && entry->h2 == t2->height;
+}
+
+static void P_SightCacheStore(sightcache_t *entry, const AActor* t1, const AActor* t2,
+							  bool zdoom, bool result, bool batched)
+{
+	entry->stamp = sightcache_stamp;
+	entry->t1 = t1;
+	entry->t2 = t2;
+	entry->s1 = t1->subsector->sector;
+	entry->s2 = t2->subsector->sector;
+	entry->x1 = t1->x;
+	entry->y1 = t1->y;
+	entry->z1 = t1->z;
+	entry->h1 = t1->height;
+	entry->x2 = t2->x;
+	entry->y2 = t2->y;
+	entry->z2 = t2->z;
+	entry->h2 = t2->height;
+	entry->zdoom = zdoom;
+	entry->result = result;
+	entry->batched = batched;
+}
+
+static bool P_SightTrace(sighttrace_t &st, const AActor* t1, const AActor* t2, bool zdoom)
+{
+	return zdoom ? P_CheckSightZDoom(st, t1, t2) : P_CheckSightDoom(st, t1, t2);
 }
 
 bool P_CheckSight(const AActor* t1, const AActor* t2)
 {
-	if (co_zdoomphys || HasBehavior)
-		return P_CheckSightZDoom(t1, t2);
-	else
-		return P_CheckSightDoom(t1, t2);
+	bool zdoom = co_zdoomphys || HasBehavior;
+
+	if (!sv_sightcache || !t1 || !t2 || !t1->subsector || !t2->subsector)
+		return P_SightTrace(gamesight, t1, t2, zdoom);
+
+	sightcache_t *entry = P_SightCacheEntry(t1, t2);
+
+	if (P_SightCacheMatches(entry, t1, t2, zdoom))
+	{
+		sightcache_hits++;
+		sightcache_tichits++;
+		if (entry->batched)
+		{
+			sightbatch_used++;
+			entry->batched = false;
+		}
+		return entry->result;
+	}
+
+	sightcache_misses++;
+	sightcache_ticmisses++;
+
+	bool result = P_SightTrace(gamesight, t1, t2, zdoom);
+	P_SightCacheStore(entry, t1, t2, zdoom, result, false);
+
+	return result;
+}
+
+//
+// Batched sight checks
+//
+// Checks that are known to be coming up this tic can be queued with
+// P_QueueSightCheck and traced all at once on the worker pool by
+// P_FlushSightChecks. The results are put in the sight cache in the order
+// they were queued, where P_CheckSight picks them up as long as neither
+// actor has moved in the meantime. Anything that has moved is traced again
+// as usual, so the game plays out the same with or without batching.
+//
+struct sightquery_t
+{
+	const AActor*	t1;
+	const AActor*	t2;
+	bool			result;
+};
+
+struct sightbatch_t
+{
+	std::vector<sightquery_t>	queries;
+	std::vector<sighttrace_t>	traces;		// one per chunk of queries
+	size_t						chunks;
+	bool						zdoom;
+};
+
+static sightbatch_t sightbatch;
+
+EXTERN_CVAR (sv_sightbatch)
+
+void P_QueueSightCheck(const AActor* t1, const AActor* t2)
+{
+	if (!sv_sightcache || !sv_sightbatch || !t1 || !t2 || !t1->subsector || !t2->subsector)
+		return;
+
+	if (P_SightCacheMatches(P_SightCacheEntry(t1, t2), t1, t2, co_zdoomphys || HasBehavior))
+		return;
+
+	sightquery_t query;
+	query.t1 = t1;
+	query.t2 = t2;
+	query.result = false;
+	sightbatch.queries.push_back(query);
+}
+
+static void P_TraceSightChunk(size_t index, void *data)
+{
+	sightbatch_t &batch = *(sightbatch_t *)data;
+	sighttrace_t &st = batch.traces[index];
+
+	for (size_t i = index; i < batch.queries.size(); i += batch.chunks)
+	{
+		sightquery_t &query = batch.queries[i];
+		query.result = P_SightTrace(st, query.t1, query.t2, batch.zdoom);
+	}
+}
+
+void P_FlushSightChecks()
+{
+	std::vector<sightquery_t> &queries = sightbatch.queries;
+
+	if (queries.empty())
+		return;
+
+	// small batches are not worth waking the workers for
+	const size_t chunks = MIN<size_t>(M_ParallelThreads(), (queries.size() + 7) / 8);
+
+	if (sightbatch.traces.size() < chunks)
+		sightbatch.traces.resize(chunks);
+
+	sightbatch.chunks = chunks;
+	sightbatch.zdoom = co_zdoomphys || HasBehavior;
+
+	M_ParallelFor(chunks, P_TraceSightChunk, &sightbatch);
+
+	for (size_t i = 0; i < queries.size(); i++)
+	{
+		const sightquery_t &query = queries[i];
+		P_SightCacheStore(P_SightCacheEntry(query.t1, query.t2),
+						  query.t1, query.t2, sightbatch.zdoom, query.result, true);
+	}
+
+	sightbatch_queued += queries.size();
+	queries.clear();
+}
+
+BEGIN_COMMAND (sightcache)
+{
+	if (argc > 1 && stricmp(argv[1], "reset") == 0)
+	{
+		sightcache_hits = sightcache_misses = 0;
+		sightbatch_queued = sightbatch_used = 0;
+		return;
+	}
+
+	unsigned int total = sightcache_hits + sightcache_misses;
+	unsigned int lasttotal = sightcache_lasthits + sightcache_lastmisses;
+
+	Printf(PRINT_HIGH, "Sight cache is %s.\n", sv_sightcache ? "enabled" : "disabled");
+	Printf(PRINT_HIGH, "Last tic: %u hits, %u misses (%.1f%% hit rate)\n",
+		   sightcache_lasthits, sightcache_lastmisses,
+		   lasttotal ? 100.0 * sightcache_lasthits / lasttotal : 0.0);
+	Printf(PRINT_HIGH, "Total: %u hits, %u misses (%.1f%% hit rate)\n",
+		   sightcache_hits, sightcache_misses,
+		   total ? 100.0 * sightcache_hits / total : 0.0);
+	Printf(PRINT_HIGH, "Batched: %u checks traced ahead, %u used (%.1f%%)\n",
+		   sightbatch_queued, sightbatch_used,
+		   sightbatch_queued ? 100.0 * sightbatch_used / sightbatch_queued : 0.0);
 }
+END_COMMAND (sightcache)
 
 //
 // denis - P_CheckSightEdgesDoom
@@ -900,8 +1188,9 @@ bool P_CheckSight(const AActor* t1, const AActor* t2)
 // any part of t2 is unobstructed.
 // Uses REJECT.
 //
-bool P_CheckSightEdgesDoom
-( const AActor*	t1,
+static bool P_CheckSightEdgesDoom
+( sighttrace_t &st,
+  const AActor*	t1,
   const AActor*	t2,
   float radius_boost )
 {
@@ -920,13 +1209,13 @@ bool P_CheckSightEdgesDoom
 
 	bool contact = false;
 
-	contact |= P_CheckSightDoom(t1->x, t1->y, t1->z, t1->height,
+	contact |= P_CheckSightDoom(st, t1->x, t1->y, t1->z, t1->height,
 							t2->x, t2->y, t2->z, t2->height);
 
-	contact |= P_CheckSightDoom(t1->x, t1->y, t1->z, t1->height,
+	contact |= P_CheckSightDoom(st, t1->x, t1->y, t1->z, t1->height,
 							t2->x - FLOAT2FIXED(w.x), t2->y - FLOAT2FIXED(w.y), t2->z, t2->height);
 
-	contact |= P_CheckSightDoom(t1->x, t1->y, t1->z, t1->height,
+	contact |= P_CheckSightDoom(st, t1->x, t1->y, t1->z, t1->height,
 							t2->x + FLOAT2FIXED(w.x), t2->y + FLOAT2FIXED(w.y), t2->z, t2->height);
 
 	return contact;
@@ -935,9 +1224,9 @@ bool P_CheckSightEdgesDoom
 bool P_CheckSightEdges(const AActor* t1, const AActor* t2, float radius_boost)
 {
 	if (co_zdoomphys || HasBehavior)
-		return P_CheckSightEdgesZDoom(t1, t2, radius_boost);
+		return P_CheckSightEdgesZDoom(gamesight, t1, t2, radius_boost);
 	else
-		return P_CheckSightEdgesDoom(t1, t2, radius_boost);
+		return P_CheckSightEdgesDoom(gamesight, t1, t2, radius_boost);
 }
 
 VERSION_CONTROL (p_sight_cpp, "$Id$")
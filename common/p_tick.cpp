@@ -50,6 +50,8 @@ void P_Ticker (void)
 	if(paused)
 		return;
 
+	P_SightCacheTick ();
+
 #ifdef CLIENT_APP
 	// Game pauses when in the menu and not online/demo
 	if (!multiplayer
@@ -78,6 +80,9 @@ void P_Ticker (void)
 		P_AnimationTick(it->mo);
 	}
 
+	// trace this tic's monster sight checks ahead of time
+	P_QueueMonsterSightChecks ();
+
 	DThinker::RunThinkers ();
 	
 	P_UpdateSpecials ();
@@ -62,19 +62,54 @@ static player_t nullplayer;		// used to indicate 'player not found' when searchi
 EXTERN_CVAR (sv_allowmovebob)
 EXTERN_CVAR (cl_movebob)
 
-player_t &idplayer(byte id)
+//
+// Players::find
+//
+player_t *Players::find(byte id)
 {
-	// Put a cached lookup mechanism in here.
+	player_t *player = byid[id];
+	if (player && player->id == id)
+		return player;
 
 	// full search
-	for (Players::iterator it = players.begin();it != players.end();++it)
+	for (iterator it = list.begin();it != list.end();++it)
 	{
 		// Add to the cache while we search
 		if (it->id == id)
-			return *it;
+		{
+			byid[id] = &*it;
+			return &*it;
+		}
 	}
 
-	return nullplayer;
+	return NULL;
+}
+
+//
+// Players::erase
+//
+Players::iterator Players::erase(iterator it)
+{
+	// the player may still be indexed under an id it has since given up
+	for (size_t i = 0; i < 256; i++)
+	{
+		if (byid[i] == &*it)
+			byid[i] = NULL;
+	}
+
+	return list.erase(it);
+}
+
+void Players::ClearIndex()
+{
+	for (size_t i = 0; i < 256; i++)
+		byid[i] = NULL;
+}
+
+player_t &idplayer(byte id)
+{
+	player_t *player = players.find(id);
+	return player ? *player : nullplayer;
 }
 
 /**
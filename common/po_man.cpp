@@ -723,6 +723,8 @@ BOOL PO_MovePolyobj (int num, int x, int y)
 		I_Error ("PO_MovePolyobj: Invalid polyobj number: %d\n", num);
 	}
 
+	P_InvalidateSightCache ();
+
 	UnLinkPolyobj (po);
 	DoMovePolyobj (po, x, y);
 
@@ -832,6 +834,7 @@ BOOL PO_RotatePolyobj (int num, angle_t angle)
 	{
 		I_Error("PO_RotatePolyobj: Invalid polyobj number: %d\n", num);
 	}
+	P_InvalidateSightCache();
 	an = (po->angle+angle)>>ANGLETOFINESHIFT;
 
 	UnLinkPolyobj(po);
@@ -44,7 +44,7 @@
 // earlier than this version.
 #define SAVESIG "ODAMEXSAVE081   "	// Needs to be exactly 16 chars long
 
-#define NETDEMOVER 3
+#define NETDEMOVER 4
 
 // denis - per-file svn version stamps
 class file_version
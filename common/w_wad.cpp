@@ -26,6 +26,8 @@
 #include <ctype.h>
 #include <cstring>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <errno.h>
 #ifndef O_BINARY
 #define O_BINARY		0
 #endif
@@ -50,6 +52,8 @@
 #include "cmdlib.h"
 #include "m_argv.h"
 #include "md5.h"
+#include "c_cvars.h"
+#include "c_dispatch.h"
 
 #include "w_wad.h"
 
@@ -60,6 +64,13 @@
 #include <vector>
 #include <iostream>
 #include <iomanip>
+#include <fstream>
+#include <map>
+#include <condition_variable>
+#include <mutex>
+#include <ctime>
+
+EXTERN_CVAR (wad_hashcache)
 
 
 //
@@ -74,6 +85,20 @@ void**			lumpcache;
 
 static unsigned	stdisk_lumpnum;
 
+// Memory mappings of the open WAD files, released by W_Close.
+struct wadmapping_t
+{
+	void	*base;
+	size_t	length;
+};
+
+static std::vector<wadmapping_t> wadmappings;
+
+// Threads other than the main one reading from the mappings
+static size_t wadbackgroundreads = 0;
+static std::mutex wadreadmutex;
+static std::condition_variable wadreadsdone;
+
 //
 // W_LumpNameHash
 //
@@ -140,9 +165,9 @@ void uppercopy (char *to, const char *from)
 
 
 // denis - Standard MD5SUM
-std::string W_MD5(std::string filename)
+static std::string W_ComputeMD5(const std::string &filename)
 {
-	const int file_chunk_size = 8192;
+	const int file_chunk_size = 65536;
 	FILE *fp = fopen(filename.c_str(), "rb");
 
 	if(!fp)
@@ -152,10 +177,10 @@ std::string W_MD5(std::string filename)
 	md5_init(&state);
 
 	unsigned n = 0;
-	unsigned char buf[file_chunk_size];
+	std::vector<unsigned char> buf(file_chunk_size);
 
-	while((n = fread(buf, 1, sizeof(buf), fp)))
-		md5_append(&state, (unsigned char *)buf, n);
+	while((n = fread(&buf[0], 1, buf.size(), fp)))
+		md5_append(&state, &buf[0], n);
 
 	md5_byte_t digest[16];
 	md5_finish(&state, digest);
@@ -170,6 +195,192 @@ std::string W_MD5(std::string filename)
 	return hash.str();
 }
 
+//
+// WAD hash cache
+//
+// MD5 sums of WAD files keyed by canonical path, size and modification time,
+// so that a file is read and hashed only once each time it changes rather
+// than on every wad reboot, IWAD check and download search.  The cache is
+// kept in wadhash.cache in the user directory as lines of
+// "md5 size mtime path".
+//
+// Entries for files that no longer exist are dropped when the cache is
+// loaded, and it is held to WAD_HASH_CACHE_SIZE entries by forgetting the
+// files that have gone longest without changing.  New hashes are written
+// out once per wad reboot, or at exit, rather than one file write each.
+//
+struct wadhashentry_t
+{
+	QWORD		size;
+	QWORD		mtime;
+	std::string	md5;
+};
+
+typedef std::map<std::string, wadhashentry_t> wadhashcache_t;
+
+static const size_t WAD_HASH_CACHE_SIZE = 1024;
+
+static wadhashcache_t wadhashcache;
+static bool wadhashcacheloaded = false;
+static bool wadhashcachedirty = false;
+static std::mutex wadhashmutex;
+
+static std::string W_CanonicalPath(const std::string &filename)
+{
+#ifdef UNIX
+	char *resolved = realpath(filename.c_str(), NULL);
+	if (resolved)
+	{
+		std::string path(resolved);
+		free(resolved);
+		return path;
+	}
+#elif defined(_WIN32)
+	char resolved[_MAX_PATH];
+	if (_fullpath(resolved, filename.c_str(), _MAX_PATH))
+		return StdStringToLower(resolved);
+#endif
+	return filename;
+}
+
+static void W_LoadHashCache()
+{
+	wadhashcacheloaded = true;
+
+	std::ifstream in(I_GetUserFileName("wadhash.cache").c_str());
+	std::string line;
+
+	while (std::getline(in, line))
+	{
+		std::istringstream fields(line);
+		wadhashentry_t entry;
+		std::string path;
+
+		if (!(fields >> entry.md5 >> entry.size >> entry.mtime))
+			continue;
+
+		fields.ignore(1);
+		std::getline(fields, path);
+
+		struct stat info;
+		if (entry.md5.length() == 32 && !path.empty() && stat(path.c_str(), &info) == 0)
+			wadhashcache[path] = entry;
+		else
+			wadhashcachedirty = true;
+	}
+}
+
+//
+// W_TrimHashCache
+//
+// Drops the entries with the oldest modification times until the cache
+// fits in WAD_HASH_CACHE_SIZE.
+//
+static void W_TrimHashCache()
+{
+	while (wadhashcache.size() > WAD_HASH_CACHE_SIZE)
+	{
+		wadhashcache_t::iterator oldest = wadhashcache.begin();
+		for (wadhashcache_t::iterator it = wadhashcache.begin(); it != wadhashcache.end(); ++it)
+			if (it->second.mtime < oldest->second.mtime)
+				oldest = it;
+
+		wadhashcache.erase(oldest);
+		wadhashcachedirty = true;
+	}
+}
+
+static void W_SaveHashCache()
+{
+	std::ofstream out(I_GetUserFileName("wadhash.cache").c_str(), std::ios::trunc);
+
+	for (wadhashcache_t::const_iterator it = wadhashcache.begin(); it != wadhashcache.end(); ++it)
+		out << it->second.md5 << ' ' << it->second.size << ' ' << it->second.mtime
+			<< ' ' << it->first << '\n';
+
+	wadhashcachedirty = false;
+}
+
+//
+// W_FlushHashCache
+//
+// Writes out the hash cache if it has changed since it was last saved.
+//
+static void STACK_ARGS W_FlushHashCache()
+{
+	std::lock_guard<std::mutex> lock(wadhashmutex);
+
+	if (wadhashcachedirty)
+		W_SaveHashCache();
+}
+
+std::string W_MD5(std::string filename)
+{
+	if (!wad_hashcache)
+		return W_ComputeMD5(filename);
+
+	struct stat info;
+	if (stat(filename.c_str(), &info) != 0)
+		return "";
+
+	const std::string path = W_CanonicalPath(filename);
+
+	{
+		std::lock_guard<std::mutex> lock(wadhashmutex);
+
+		if (!wadhashcacheloaded)
+			W_LoadHashCache();
+
+		wadhashcache_t::const_iterator it = wadhashcache.find(path);
+		if (it != wadhashcache.end() && it->second.size == (QWORD)info.st_size &&
+			it->second.mtime == (QWORD)info.st_mtime)
+			return it->second.md5;
+	}
+
+	std::string md5 = W_ComputeMD5(filename);
+
+	// A file modified within the last couple of seconds may still be being
+	// written to without its size or mtime changing, so don't remember it.
+	if (md5.empty() || info.st_mtime + 2 > time(NULL))
+		return md5;
+
+	wadhashentry_t entry;
+	entry.size = info.st_size;
+	entry.mtime = info.st_mtime;
+	entry.md5 = md5;
+
+	std::lock_guard<std::mutex> lock(wadhashmutex);
+	wadhashcache[path] = entry;
+	wadhashcachedirty = true;
+	W_TrimHashCache();
+
+	return md5;
+}
+
+#if ODAMEX_DEBUG
+BEGIN_COMMAND (wadhashcache)
+{
+	std::lock_guard<std::mutex> lock(wadhashmutex);
+
+	if (argc > 1 && stricmp(argv[1], "clear") == 0)
+	{
+		wadhashcache.clear();
+		wadhashcacheloaded = true;
+		W_SaveHashCache();
+		Printf(PRINT_HIGH, "WAD hash cache cleared.\n");
+		return;
+	}
+
+	if (!wadhashcacheloaded)
+		W_LoadHashCache();
+
+	for (wadhashcache_t::const_iterator it = wadhashcache.begin(); it != wadhashcache.end(); ++it)
+		Printf(PRINT_HIGH, "%s %s\n", it->second.md5.c_str(), it->first.c_str());
+	Printf(PRINT_HIGH, "%u cached WAD hashes.\n", (unsigned int)wadhashcache.size());
+}
+END_COMMAND (wadhashcache)
+#endif	// ODAMEX_DEBUG
+
 
 //
 // LUMP BASED ROUTINES.
@@ -181,8 +392,43 @@ std::string W_MD5(std::string filename)
 // Adds lumps from the array of filelump_t. If clientonly is true,
 // only certain lumps will be added.
 //
+//
+// W_MapFile
+//
+// Maps a whole WAD file read-only, so that lumps can be served straight from
+// the page cache, which is shared between every process with the file open.
+// Returns NULL where mapping is unsupported or fails; lumps are then read
+// with fread as before.
+//
+static const byte* W_MapFile(FILE* handle, size_t length)
+{
+#ifdef UNIX
+	if (length == 0)
+		return NULL;
+
+	void* base = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fileno(handle), 0);
+	if (base == MAP_FAILED)
+	{
+		DPrintf("W_MapFile: %s, reading lumps from the file instead\n", strerror(errno));
+		return NULL;
+	}
+
+	wadmapping_t mapping;
+	mapping.base = base;
+	mapping.length = length;
+	wadmappings.push_back(mapping);
+
+	return (const byte*)base;
+#else
+	return NULL;
+#endif
+}
+
 void W_AddLumps(FILE* handle, filelump_t* fileinfo, size_t newlumps, bool clientonly)
 {
+	const size_t filelength = M_FileLength(handle);
+	const byte* mapping = W_MapFile(handle, filelength);
+
 	lumpinfo = (lumpinfo_t*)Realloc(lumpinfo, (numlumps + newlumps) * sizeof(lumpinfo_t));
 	if (!lumpinfo)
 		I_Error("Couldn't realloc lumpinfo");
@@ -197,12 +443,201 @@ void W_AddLumps(FILE* handle, filelump_t* fileinfo, size_t newlumps, bool client
 		lump->size = info->size;
 		strncpy(lump->name, info->name, 8);
 
+		// lumps that run past the end of the file are left to W_ReadLump,
+		// which reports them; unaligned lumps are read into zone copies so
+		// that callers can cast them to structures
+		if (mapping && info->filepos >= 0 && info->size >= 0 &&
+			(info->filepos & 3) == 0 &&
+			(size_t)info->filepos + info->size <= filelength)
+			lump->data = mapping + info->filepos;
+		else
+			lump->data = NULL;
+
 		lump++;
 		numlumps++;
 	}
 }
 
 
+//
+// W_ReadDirectory
+//
+// Reads the lump directory described by a WAD header, converting it to the
+// target byte order and capitalizing the lump names. Returns false if the
+// directory is larger than the file.
+//
+static bool W_ReadDirectory(FILE* handle, wadinfo_t header, std::vector<filelump_t>& fileinfo)
+{
+	header.numlumps = LELONG(header.numlumps);
+	header.infotableofs = LELONG(header.infotableofs);
+
+	if (header.numlumps < 0 ||
+		(size_t)header.numlumps * sizeof(filelump_t) > (unsigned)M_FileLength(handle))
+		return false;
+
+	fileinfo.resize(header.numlumps);
+	if (fileinfo.empty())
+		return true;
+
+	fseek(handle, header.infotableofs, SEEK_SET);
+	fread(&fileinfo[0], fileinfo.size() * sizeof(filelump_t), 1, handle);
+
+	for (size_t i = 0; i < fileinfo.size(); i++)
+	{
+		fileinfo[i].filepos = LELONG(fileinfo[i].filepos);
+		fileinfo[i].size = LELONG(fileinfo[i].size);
+		std::transform(fileinfo[i].name, fileinfo[i].name + 8, fileinfo[i].name, toupper);
+	}
+
+	return true;
+}
+
+
+//
+// Prefetched WAD files
+//
+// W_PrefetchFile does the part of W_AddFile that only depends on the file
+// itself - hashing it and reading its directory - and asks the OS to read
+// ahead the lumps of the given map. It is meant to be run on a background
+// thread before a wad reboot, so it must not print or touch the lump table.
+// W_AddFile then picks up the result, provided the file's size and mtime
+// have not changed in between.
+//
+struct wadprefetch_t
+{
+	QWORD					size;
+	QWORD					mtime;
+	std::string				md5;
+	std::vector<filelump_t>	fileinfo;
+};
+
+typedef std::map<std::string, wadprefetch_t> wadprefetches_t;
+
+static wadprefetches_t wadprefetches;
+static std::mutex wadprefetchmutex;
+
+// Lumps that follow a map marker, in any order.
+static const char* maplumpnames[] = {
+	"THINGS", "LINEDEFS", "SIDEDEFS", "VERTEXES", "SEGS", "SSECTORS",
+	"NODES", "SECTORS", "REJECT", "BLOCKMAP", "BEHAVIOR", "SCRIPTS", NULL
+};
+
+static bool W_IsMapLumpName(const char* name)
+{
+	for (int i = 0; maplumpnames[i]; i++)
+		if (strncmp(name, maplumpnames[i], 8) == 0)
+			return true;
+	return false;
+}
+
+static void W_ReadAheadMap(FILE* handle, const std::vector<filelump_t>& fileinfo,
+						   const std::string& mapname)
+{
+	char marker[8];
+	strncpy(marker, StdStringToUpper(mapname).c_str(), 8);
+
+	size_t i = 0;
+	while (i < fileinfo.size() && strncmp(fileinfo[i].name, marker, 8) != 0)
+		i++;
+
+	if (i == fileinfo.size())
+		return;
+
+	size_t start = fileinfo[i].filepos, end = start + fileinfo[i].size;
+	for (i++; i < fileinfo.size() && W_IsMapLumpName(fileinfo[i].name); i++)
+	{
+		start = std::min(start, (size_t)fileinfo[i].filepos);
+		end = std::max(end, (size_t)fileinfo[i].filepos + fileinfo[i].size);
+	}
+
+	if (end <= start)
+		return;
+
+#if defined(UNIX) && defined(POSIX_FADV_WILLNEED)
+	posix_fadvise(fileno(handle), start, end - start, POSIX_FADV_WILLNEED);
+#else
+	std::vector<byte> buf(65536);
+	fseek(handle, start, SEEK_SET);
+	for (size_t left = end - start; left > 0; )
+	{
+		size_t n = fread(&buf[0], 1, std::min(left, buf.size()), handle);
+		if (n == 0)
+			break;
+		left -= n;
+	}
+#endif
+}
+
+void W_PrefetchFile(const std::string& filename, const std::string& mapname)
+{
+	struct stat info;
+	if (stat(filename.c_str(), &info) != 0)
+		return;
+
+	FILE* handle = fopen(filename.c_str(), "rb");
+	if (handle == NULL)
+		return;
+
+	wadprefetch_t prefetch;
+	prefetch.size = info.st_size;
+	prefetch.mtime = info.st_mtime;
+
+	wadinfo_t header;
+	bool iswad = fread(&header, sizeof(header), 1, handle) == 1 &&
+		(LELONG(header.identification) == IWAD_ID || LELONG(header.identification) == PWAD_ID);
+
+	if (!iswad || !W_ReadDirectory(handle, header, prefetch.fileinfo))
+	{
+		fclose(handle);
+		return;
+	}
+
+	if (!mapname.empty())
+		W_ReadAheadMap(handle, prefetch.fileinfo, mapname);
+
+	fclose(handle);
+
+	prefetch.md5 = W_MD5(filename);
+
+	std::lock_guard<std::mutex> lock(wadprefetchmutex);
+	wadprefetches[W_CanonicalPath(filename)] = prefetch;
+}
+
+//
+// W_TakePrefetchedFile
+//
+// Hands over and forgets the prefetched directory and hash of a file.
+// Returns false if the file was not prefetched or has since changed.
+//
+static bool W_TakePrefetchedFile(const std::string& filename,
+								 std::vector<filelump_t>& fileinfo, std::string& md5)
+{
+	struct stat info;
+	if (stat(filename.c_str(), &info) != 0)
+		return false;
+
+	const std::string path = W_CanonicalPath(filename);
+
+	std::lock_guard<std::mutex> lock(wadprefetchmutex);
+
+	wadprefetches_t::iterator it = wadprefetches.find(path);
+	if (it == wadprefetches.end())
+		return false;
+
+	bool valid = it->second.size == (QWORD)info.st_size &&
+				 it->second.mtime == (QWORD)info.st_mtime;
+
+	if (valid)
+	{
+		fileinfo.swap(it->second.fileinfo);
+		md5 = it->second.md5;
+	}
+
+	wadprefetches.erase(it);
+	return valid;
+}
+
+
 //
 // W_AddFile
 //
@@ -217,7 +652,8 @@ void W_AddLumps(FILE* handle, filelump_t* fileinfo, size_t newlumps, bool client
 std::string W_AddFile(std::string filename)
 {
 	FILE*			handle;
-	filelump_t*		fileinfo;
+	std::vector<filelump_t>	fileinfo;
+	std::string		md5;
 
 	FixPathSeparator(filename);
 
@@ -229,59 +665,45 @@ std::string W_AddFile(std::string filename)
 
 	Printf(PRINT_HIGH, "adding %s", filename.c_str());
 
-	size_t newlumps;
-
 	wadinfo_t header;
-	fread(&header, sizeof(header), 1, handle);
-	header.identification = LELONG(header.identification);
 
-	if (header.identification != IWAD_ID && header.identification != PWAD_ID)
+	if (W_TakePrefetchedFile(filename, fileinfo, md5))
+	{
+		DPrintf("W_AddFile: using the prefetched directory of %s\n", filename.c_str());
+		Printf(PRINT_HIGH, " (%d lumps)\n", (int)fileinfo.size());
+	}
+	else if (fread(&header, sizeof(header), 1, handle) != 1 ||
+		(LELONG(header.identification) != IWAD_ID && LELONG(header.identification) != PWAD_ID))
 	{
 		// raw lump file
 		std::string lumpname;
 		M_ExtractFileBase(filename, lumpname);
 
-		fileinfo = new filelump_t[1];	
-		fileinfo->filepos = 0;
-		fileinfo->size = M_FileLength(handle);
-		std::transform(lumpname.c_str(), lumpname.c_str() + 8, fileinfo->name, toupper);
+		fileinfo.resize(1);
+		fileinfo[0].filepos = 0;
+		fileinfo[0].size = M_FileLength(handle);
+		std::transform(lumpname.c_str(), lumpname.c_str() + 8, fileinfo[0].name, toupper);
 
-		newlumps = 1;
 		Printf(PRINT_HIGH, " (single lump)\n");
 	}
 	else
 	{
 		// WAD file
-		header.numlumps = LELONG(header.numlumps);
-		header.infotableofs = LELONG(header.infotableofs);
-		size_t length = header.numlumps * sizeof(filelump_t);
-
-		if (length > (unsigned)M_FileLength(handle))
+		if (!W_ReadDirectory(handle, header, fileinfo))
 		{
 			Printf(PRINT_HIGH, "\nbad number of lumps for %s\n", filename.c_str());
 			fclose(handle);
 			return "";
 		}
 
-		fileinfo = new filelump_t[header.numlumps];
-		fseek(handle, header.infotableofs, SEEK_SET);
-		fread(fileinfo, length, 1, handle);
-
-		// convert from little-endian to target arch and capitalize lump name
-		for (int i = 0; i < header.numlumps; i++)
-		{
-			fileinfo[i].filepos = LELONG(fileinfo[i].filepos);
-			fileinfo[i].size = LELONG(fileinfo[i].size);
-			std::transform(fileinfo[i].name, fileinfo[i].name + 8, fileinfo[i].name, toupper);
-		}
-
-		newlumps = header.numlumps;	
-		Printf(PRINT_HIGH, " (%d lumps)\n", header.numlumps);
+		Printf(PRINT_HIGH, " (%d lumps)\n", (int)fileinfo.size());
 	}
 
-	W_AddLumps(handle, fileinfo, newlumps, false);
+	if (!fileinfo.empty())
+		W_AddLumps(handle, &fileinfo[0], fileinfo.size(), false);
 
-	delete [] fileinfo;
+	if (!md5.empty())
+		return md5;
 
 	return W_MD5(filename);
 }
@@ -363,6 +785,7 @@ void W_MergeLumps (const char *start, const char *end, int space)
 					newlumps++;
 					strncpy (newlumpinfos[0].name, ustart, 8);
 					newlumpinfos[0].handle = NULL;
+					newlumpinfos[0].data = NULL;
 					newlumpinfos[0].position =
 						newlumpinfos[0].size = 0;
 					newlumpinfos[0].namespc = ns_global;
@@ -431,6 +854,7 @@ void W_MergeLumps (const char *start, const char *end, int space)
 
 		strncpy (lumpinfo[numlumps].name, uend, 8);
 		lumpinfo[numlumps].handle = NULL;
+		lumpinfo[numlumps].data = NULL;
 		lumpinfo[numlumps].position =
 			lumpinfo[numlumps].size = 0;
 		lumpinfo[numlumps].namespc = ns_global;
@@ -479,6 +903,17 @@ std::vector<std::string> W_InitMultipleFiles (std::vector<std::string> &filename
 	filenames = loaded;
 	hashes.resize(j);
 
+	// save the hashes of the files just added, and anything else hashed
+	// since the last wad reboot
+	W_FlushHashCache();
+
+	static bool registered = false;
+	if (!registered)
+	{
+		atterm(W_FlushHashCache);
+		registered = true;
+	}
+
 	if (!numlumps)
 		I_Error ("W_InitFiles: no files found");
 
@@ -597,6 +1032,12 @@ void W_ReadLump(unsigned int lump, void* dest)
 
 	l = lumpinfo + lump;
 
+	if (l->data)
+	{
+		memcpy(dest, l->data, l->size);
+		return;
+	}
+
 	if (lump != stdisk_lumpnum)
     	I_BeginRead();
 
@@ -699,6 +1140,38 @@ void* W_CacheLumpName(const char* name, int tag)
 	return W_CacheLumpNum (W_GetNumForName(name), tag);
 }
 
+//
+// W_MapLumpNum
+//
+// Returns the lump's bytes inside the WAD mapping, falling back to a cached
+// zone copy with the given tag when the WAD is not mapped.
+//
+const void* W_MapLumpNum(unsigned int lump, int tag)
+{
+	if (lump >= numlumps)
+		I_Error ("W_MapLumpNum: %u >= numlumps", lump);
+
+	if (lumpinfo[lump].data)
+		return lumpinfo[lump].data;
+
+	return W_CacheLumpNum(lump, tag);
+}
+
+//
+// W_UnmapLumpNum
+//
+// Done with a lump from W_MapLumpNum. A fallback zone copy is left
+// purgable, the same as a PU_CACHE lump.
+//
+void W_UnmapLumpNum(unsigned int lump)
+{
+	if (lump >= numlumps)
+		I_Error ("W_UnmapLumpNum: %u >= numlumps", lump);
+
+	if (!lumpinfo[lump].data && lumpcache[lump])
+		Z_ChangeTag(lumpcache[lump], PU_CACHE);
+}
+
 size_t R_CalculateNewPatchSize(patch_t *patch, size_t length);
 void R_ConvertPatch(patch_t *rawpatch, patch_t *newpatch);
 
@@ -716,11 +1189,21 @@ patch_t* W_CachePatch(unsigned lumpnum, int tag)
 
 	if (!lumpcache[lumpnum])
 	{
-		// temporary storage of the raw patch in the old format
-		byte *rawlumpdata = new byte[W_LumpLength(lumpnum)];
+		// the raw patch in the old format, converted straight from the WAD
+		// mapping when there is one, otherwise from temporary storage
+		byte *rawlumpdata = NULL;
+		patch_t *rawpatch;
 
-		W_ReadLump(lumpnum, rawlumpdata);
-		patch_t *rawpatch = (patch_t*)(rawlumpdata);
+		if (lumpinfo[lumpnum].data)
+		{
+			rawpatch = (patch_t*)lumpinfo[lumpnum].data;
+		}
+		else
+		{
+			rawlumpdata = new byte[W_LumpLength(lumpnum)];
+			W_ReadLump(lumpnum, rawlumpdata);
+			rawpatch = (patch_t*)(rawlumpdata);
+		}
 
 		size_t newlumplen = R_CalculateNewPatchSize(rawpatch, W_LumpLength(lumpnum));
 
@@ -783,6 +1266,26 @@ int W_FindLump (const char *name, int lastlump)
 	return -1;
 }
 
+//
+// W_BeginBackgroundRead
+//
+// Called on the main thread before handing lumps from W_MapLumpNum to
+// another thread, which calls W_EndBackgroundRead once it no longer
+// reads them.
+//
+void W_BeginBackgroundRead ()
+{
+	std::lock_guard<std::mutex> lock(wadreadmutex);
+	wadbackgroundreads++;
+}
+
+void W_EndBackgroundRead ()
+{
+	std::lock_guard<std::mutex> lock(wadreadmutex);
+	if (--wadbackgroundreads == 0)
+		wadreadsdone.notify_all();
+}
+
 //
 // W_Close
 //
@@ -791,6 +1294,22 @@ int W_FindLump (const char *name, int lastlump)
 
 void W_Close ()
 {
+	{
+		// the mappings must outlive every thread still reading them
+		std::unique_lock<std::mutex> lock(wadreadmutex);
+		while (wadbackgroundreads > 0)
+			wadreadsdone.wait(lock);
+	}
+
+#ifdef UNIX
+	for (size_t i = 0; i < wadmappings.size(); i++)
+		munmap(wadmappings[i].base, wadmappings[i].length);
+#endif
+	wadmappings.clear();
+
+	for (size_t i = 0; i < numlumps; i++)
+		lumpinfo[i].data = NULL;
+
 	// store closed handles, so that fclose isn't called multiple times
 	// for the same handle
 	std::vector<FILE *> handles;
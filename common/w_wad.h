@@ -70,6 +70,10 @@ typedef struct lumpinfo_s
 	int			position;
 	int			size;
 
+	// lump contents inside the file's memory mapping, or NULL if the file
+	// could not be mapped or the lump does not start on a 4-byte boundary
+	const byte	*data;
+
 	// [RH] Hashing stuff
 	int			next;
 	int			index;
@@ -90,6 +94,7 @@ extern	lumpinfo_t*	lumpinfo;
 extern	size_t	numlumps;
 
 std::string W_MD5(std::string filename);
+void W_PrefetchFile(const std::string &filename, const std::string &mapname = "");
 std::vector<std::string> W_InitMultipleFiles (std::vector<std::string> &filenames);
 
 int		W_CheckNumForName (const char *name, int ns = ns_global);
@@ -101,6 +106,19 @@ unsigned	W_ReadChunk (const char *file, unsigned offs, unsigned len, void *dest,
 
 void *W_CacheLumpNum (unsigned lump, int tag);
 void *W_CacheLumpName (const char *name, int tag);
+
+// Read-only access to a lump without copying it.  The pointer stays valid
+// until W_UnmapLumpNum or W_Close, and the data is not NUL-terminated.
+// It is aligned to 4 bytes, so it can be cast to the map lump structures.
+// Where the WAD is not memory mapped, or the lump is not aligned in the
+// file, this falls back to a zone copy cached with the given tag.
+const void *W_MapLumpNum (unsigned lump, int tag = PU_STATIC);
+void W_UnmapLumpNum (unsigned lump);
+
+// Other threads reading lumps from W_MapLumpNum must be counted with these,
+// so that W_Close can wait for them before it unmaps the files.
+void W_BeginBackgroundRead ();
+void W_EndBackgroundRead ();
 patch_t* W_CachePatch (unsigned lump, int tag = PU_CACHE);
 patch_t* W_CachePatch (const char *name, int tag = PU_CACHE);
 
@@ -43,9 +43,14 @@
 #include "sv_main.h"
 #include "doomstat.h"
 #include "gi.h"
+#include "i_crash.h"
 
 #include <string>
 #include <vector>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 static const int MAX_LINE_LENGTH = 8192;
 
@@ -69,6 +74,8 @@ static struct History *HistTail = NULL;
 #define PRINTLEVELS 5
 
 EXTERN_CVAR (log_fulltimestamps)
+EXTERN_CVAR (log_async)
+EXTERN_CVAR (log_flushinterval)
 
 char *TimeStamp()
 {
@@ -105,6 +112,283 @@ char *TimeStamp()
 	return stamp;
 }
 
+//
+// Log writer
+//
+// With log_async on, VPrintf copies each line into a ring buffer and a
+// background thread writes it to LOG, so that a slow disk never holds up a
+// tic.  Any thread may print, but VPrintf holds printmutex while it queues
+// a line, so the ring only ever has one producer at a time, and the writer
+// thread is its only consumer, so the ring itself needs no lock.  Both
+// positions count bytes since startup and are wrapped only when indexing
+// the buffer.
+//
+// The writer wakes every log_flushinterval milliseconds and writes all
+// queued output as one batch followed by a single flush.  A printing thread
+// only waits if the writer falls a whole ring behind.
+//
+
+static const size_t LOG_RING_SIZE = 1 << 20;
+
+static char logring[LOG_RING_SIZE];
+static std::atomic<size_t> logqueued(0);		// advanced under printmutex
+static std::atomic<size_t> logwritten(0);		// advanced by the writer thread
+static std::atomic<int> loginterval(100);
+static std::atomic<bool> logquit(false);
+static std::atomic<bool> logcrashed(false);		// set by C_CrashFlushLog
+static std::atomic<bool> logwriterbusy(false);	// the writer is writing a batch
+static bool logwriterstarted = false;			// guarded by printmutex
+static bool logwriterrunning = false;			// guarded by logmutex
+
+// Serialises everything VPrintf sends out.  Recursive because stopping or
+// flushing the log writer can happen while it is held.
+static std::recursive_mutex printmutex;
+static const std::thread::id mainthread = std::this_thread::get_id();
+
+static std::mutex logmutex;
+static std::condition_variable logwake;			// output to write
+static std::condition_variable logprogress;		// the writer finished a batch
+
+// Statistics for logstats
+static size_t logmessages = 0;
+static size_t logstalls = 0;
+static dtime_t logstalltime = 0;
+static size_t logmaxbacklog = 0;
+static std::atomic<size_t> logbatches(0);
+static std::atomic<dtime_t> logmaxwrite(0);
+
+static void C_LogWriterLoop()
+{
+	while (true)
+	{
+		size_t start = logwritten.load(std::memory_order_relaxed);
+		size_t end = logqueued.load(std::memory_order_acquire);
+
+		if (start == end)
+		{
+			std::unique_lock<std::mutex> lock(logmutex);
+			logprogress.notify_all();
+
+			if (logquit)
+			{
+				logwriterrunning = false;
+				return;
+			}
+
+			int interval = loginterval.load(std::memory_order_relaxed);
+			logwake.wait_for(lock, std::chrono::milliseconds(interval ? interval : 1000));
+			continue;
+		}
+
+		// once C_CrashFlushLog has seen the writer idle, the ring is its own
+		logwriterbusy = true;
+		if (logcrashed)
+		{
+			logwriterbusy = false;
+			return;
+		}
+
+		dtime_t starttime = I_GetTime();
+
+		size_t from = start & (LOG_RING_SIZE - 1);
+		size_t len = end - start;
+		size_t first = MIN(len, LOG_RING_SIZE - from);
+
+		if (LOG.is_open())
+		{
+			LOG.write(logring + from, first);
+			if (len > first)
+				LOG.write(logring, len - first);
+			LOG.flush();
+		}
+
+		dtime_t elapsed = I_GetTime() - starttime;
+		if (elapsed > logmaxwrite.load(std::memory_order_relaxed))
+			logmaxwrite.store(elapsed, std::memory_order_relaxed);
+		logbatches++;
+
+		logwritten.store(end, std::memory_order_release);
+		logwriterbusy = false;
+	}
+}
+
+//
+// C_CrashFlushLog
+//
+// Called from the crash handler.  Stops the writer thread and writes
+// whatever it had not got to yet straight to the log file.  If the writer
+// does not finish the batch it is on within a second, it is most likely the
+// thread that crashed, and the log file is left alone.
+//
+static void C_CrashFlushLog()
+{
+	logcrashed = true;
+	for (int i = 0; logwriterbusy; i++)
+	{
+		if (i == 1000)
+			return;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	size_t start = logwritten.load(std::memory_order_acquire);
+	size_t end = logqueued.load(std::memory_order_acquire);
+
+	if (!LOG.is_open())
+		return;
+
+	for (; start < end; start++)
+		LOG.put(logring[start & (LOG_RING_SIZE - 1)]);
+	LOG.flush();
+}
+
+static void STACK_ARGS C_StopLogWriter()
+{
+	std::lock_guard<std::recursive_mutex> printlock(printmutex);
+
+	if (!logwriterstarted)
+		return;
+
+	C_FlushLog();
+
+	std::unique_lock<std::mutex> lock(logmutex);
+	logquit = true;
+	logwake.notify_one();
+	while (logwriterrunning)
+		logprogress.wait(lock);
+
+	logwriterstarted = false;
+}
+
+static void C_StartLogWriter()
+{
+	logquit = false;
+	logwriterrunning = true;
+	std::thread(C_LogWriterLoop).detach();
+	logwriterstarted = true;
+
+	static bool registered = false;
+	if (!registered)
+	{
+		atterm(C_StopLogWriter);
+		I_SetCrashHook(C_CrashFlushLog);
+		registered = true;
+	}
+}
+
+//
+// C_QueueLog
+//
+// Copies a line into the ring for the writer thread.  Must be called with
+// printmutex held.
+//
+static void C_QueueLog(const std::string &str)
+{
+	if (!logwriterstarted)
+		C_StartLogWriter();
+
+	size_t len = MIN(str.length(), LOG_RING_SIZE);
+	size_t queued = logqueued.load(std::memory_order_relaxed);
+
+	loginterval.store(log_flushinterval.asInt(), std::memory_order_relaxed);
+
+	if (queued + len - logwritten.load(std::memory_order_acquire) > LOG_RING_SIZE)
+	{
+		// The writer has fallen a whole ring behind, so wait for room.
+		dtime_t starttime = I_GetTime();
+
+		std::unique_lock<std::mutex> lock(logmutex);
+		logwake.notify_one();
+		while (queued + len - logwritten.load(std::memory_order_acquire) > LOG_RING_SIZE)
+			logprogress.wait(lock);
+
+		logstalls++;
+		logstalltime += I_GetTime() - starttime;
+	}
+
+	size_t to = queued & (LOG_RING_SIZE - 1);
+	size_t first = MIN(len, LOG_RING_SIZE - to);
+	memcpy(logring + to, str.data(), first);
+	memcpy(logring, str.data() + first, len - first);
+
+	logqueued.store(queued + len, std::memory_order_release);
+
+	size_t backlog = queued + len - logwritten.load(std::memory_order_relaxed);
+	logmaxbacklog = MAX(logmaxbacklog, backlog);
+	logmessages++;
+
+	// Without a flush interval, or with the ring filling up, wake the
+	// writer now instead of letting it sleep out its interval.
+	if (log_flushinterval.asInt() == 0 || backlog > LOG_RING_SIZE / 2)
+	{
+		std::lock_guard<std::mutex> lock(logmutex);
+		logwake.notify_one();
+	}
+}
+
+void C_FlushLog()
+{
+	std::lock_guard<std::recursive_mutex> printlock(printmutex);
+
+	if (logwriterstarted)
+	{
+		std::unique_lock<std::mutex> lock(logmutex);
+		logwake.notify_one();
+		while (logwritten.load(std::memory_order_acquire) != logqueued.load(std::memory_order_relaxed))
+			logprogress.wait(lock);
+	}
+	else if (LOG.is_open())
+	{
+		LOG.flush();
+	}
+}
+
+//
+// C_CloseLog / C_OpenLog
+//
+// Holding printmutex keeps any thread from queueing another line, so once
+// the writer has drained the ring it leaves LOG alone until we are done.
+//
+void C_CloseLog()
+{
+	std::lock_guard<std::recursive_mutex> printlock(printmutex);
+
+	C_FlushLog();
+	LOG.close();
+}
+
+bool C_OpenLog(const char *filename)
+{
+	std::lock_guard<std::recursive_mutex> printlock(printmutex);
+
+	C_FlushLog();
+	if (LOG.is_open())
+		LOG.close();
+
+	LOG.open(filename, std::ios::app);
+	if (!LOG.is_open())
+		return false;
+
+	LOG << std::endl;
+	LOG.flush();
+	return true;
+}
+
+BEGIN_COMMAND (logstats)
+{
+	size_t backlog = logqueued - logwritten;
+
+	Printf(PRINT_HIGH, "Log writer: %s, flushing every %d ms\n",
+		   logwriterstarted ? "running" : "stopped", log_flushinterval.asInt());
+	Printf(PRINT_HIGH, "%u messages, %u bytes queued, %u bytes waiting (at most %u)\n",
+		   (unsigned int)logmessages, (unsigned int)logqueued.load(),
+		   (unsigned int)backlog, (unsigned int)logmaxbacklog);
+	Printf(PRINT_HIGH, "%u batches written, longest took %.3f ms\n",
+		   (unsigned int)logbatches.load(), logmaxwrite.load() / 1000000.0);
+	Printf(PRINT_HIGH, "%u stalls waiting for the writer, %.3f ms in total\n",
+		   (unsigned int)logstalls, logstalltime / 1000000.0);
+}
+END_COMMAND (logstats)
+
 /* Provide our own Printf() that is sensitive of the
  * console status (in or out of game)
  */
@@ -127,6 +411,8 @@ int VPrintf(int printlevel, const char* format, va_list parms)
 		if (outline[i] == 0x07)
 			outline[i] = '.';
 
+	std::lock_guard<std::recursive_mutex> printlock(printmutex);
+
 	std::string str(TimeStamp());
 	str.append(" ");
 	str.append(outline);
@@ -134,22 +420,35 @@ int VPrintf(int printlevel, const char* format, va_list parms)
 	if (str[str.length() - 1] != '\n')
 		str += '\n';
 
-	// send to any rcon players
-	for (Players::iterator it = players.begin(); it != players.end(); ++it)
+	// send to any rcon players (only from the main thread, which owns
+	// their buffers)
+	if (std::this_thread::get_id() == mainthread)
 	{
-		client_t* cl = &(it->client);
-
-		if (cl->allow_rcon)
+		for (Players::iterator it = players.begin(); it != players.end(); ++it)
 		{
-			MSG_WriteMarker(&cl->reliablebuf, svc_print);
-			MSG_WriteByte(&cl->reliablebuf, PRINT_MEDIUM);
-			MSG_WriteString(&cl->reliablebuf, (char*)str.c_str());
+			client_t* cl = &(it->client);
+
+			if (cl->allow_rcon)
+			{
+				MSG_WriteMarker(&cl->reliablebuf, svc_print);
+				MSG_WriteByte(&cl->reliablebuf, PRINT_MEDIUM);
+				MSG_WriteString(&cl->reliablebuf, (char*)str.c_str());
+			}
 		}
 	}
 
-	if (LOG.is_open()) {
-		LOG << str;
-		LOG.flush();
+	if (LOG.is_open())
+	{
+		if (log_async)
+		{
+			C_QueueLog(str);
+		}
+		else
+		{
+			C_StopLogWriter();
+			LOG << str;
+			LOG.flush();
+		}
 	}
 
 	return PrintString(printlevel, str.c_str());
@@ -84,8 +84,6 @@ EXTERN_CVAR (sv_fastmonsters)
 
 extern size_t got_heapsize;
 
-void C_DoCommand (const char *cmd);
-
 #ifdef UNIX
 void daemon_init();
 #endif
@@ -226,6 +224,7 @@ void STACK_ARGS D_Shutdown()
 	GStrings.FreeData();
 
 	// close all open WAD files
+	P_FinishLevelTasks();
 	W_Close();
 
 	R_ShutdownColormaps();
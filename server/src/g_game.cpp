@@ -586,7 +586,10 @@ void G_DoReborn (player_t &player)
 	// respawn at the start
 	// first disassociate the corpse
 	if (player.mo)
+	{
 		player.mo->player = NULL;
+		SV_QueueCorpse(player.mo);
+	}
 
 	// spawn at random team spot if in team game
 	if(sv_gametype == GM_TEAMDM || sv_gametype == GM_CTF)
@@ -192,6 +192,22 @@ std::string G_NextMap(void) {
 	return next;
 }
 
+// Timing of the current maplist change, logged by G_DoNewGame once the new
+// map has been loaded.
+static dtime_t mapchange_start = 0;
+static dtime_t mapchange_wadtime = 0;
+static bool mapchange_prefetched = false;
+
+// Load the WADs of a maplist entry and defer loading its map.
+static void G_LoadMaplistEntry(const maplist_entry_t &maplist_entry) {
+	mapchange_start = I_GetTime();
+	mapchange_prefetched = Maplist_FinishPrefetch(maplist_entry);
+
+	G_LoadWad(JoinStrings(maplist_entry.wads, " "), maplist_entry.map);
+
+	mapchange_wadtime = I_GetTime() - mapchange_start;
+}
+
 // Determine the "next map" and change to it.
 void G_ChangeMap() {
 	unnatural_level_progression = false;
@@ -213,7 +229,7 @@ void G_ChangeMap() {
 			maplist_entry_t maplist_entry;
 			Maplist::instance().get_map_by_index(next_index, maplist_entry);
 
-			G_LoadWad(JoinStrings(maplist_entry.wads, " "), maplist_entry.map);
+			G_LoadMaplistEntry(maplist_entry);
 
 			// Set the new map as the current map
 			Maplist::instance().set_index(next_index);
@@ -237,7 +253,7 @@ void G_ChangeMap(size_t index) {
 		return;
 	}
 
-	G_LoadWad(JoinStrings(maplist_entry.wads, " "), maplist_entry.map);
+	G_LoadMaplistEntry(maplist_entry);
 
 	// Set the new map as the current map
 	Maplist::instance().set_index(index);
@@ -295,9 +311,20 @@ void G_DoNewGame (void)
 
 	sv_curmap.ForceSet(d_mapname);
 
+	dtime_t levelstart = I_GetTime();
+
 	G_InitNew (d_mapname);
 	gameaction = ga_nothing;
 
+	if (mapchange_start)
+	{
+		dtime_t now = I_GetTime();
+		Printf(PRINT_HIGH, "Map change to %s took %.1f ms (WADs %.1f ms%s, level %.1f ms)\n",
+			d_mapname, (now - mapchange_start) / 1000000.0, mapchange_wadtime / 1000000.0,
+			mapchange_prefetched ? " prefetched" : "", (now - levelstart) / 1000000.0);
+		mapchange_start = 0;
+	}
+
 	// run script at the start of each map
 	// [ML] 8/22/2010: There are examples in the wiki that outright don't work
 	// when onlcvars (addcommandstring's second param) is true.  Is there a
@@ -704,6 +731,7 @@ void G_DoLoadLevel (int position)
 		lastposition = position;
 
 	G_InitLevelLocals ();
+	SV_ClearCorpses ();
 
 	if (firstmapinit) {
 		Printf (PRINT_HIGH, "--- %s: \"%s\" ---\n", level.mapname, level.level_name);
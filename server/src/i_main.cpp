@@ -164,6 +164,7 @@ int __cdecl main(int argc, char *argv[])
     {
 		if (LOG.is_open())
         {
+            C_FlushLog();
             LOG << error.GetMsg() << std::endl;
             LOG << std::endl;
         }
@@ -287,6 +288,7 @@ int main (int argc, char **argv)
 
 	if (LOG.is_open())
         {
+            C_FlushLog();
             LOG << error.GetMsg() << std::endl;
             LOG << std::endl;
         }
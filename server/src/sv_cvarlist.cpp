@@ -36,6 +36,13 @@ CVAR(			log_fulltimestamps, "0", "Extended timestamp info (dd/mm/yyyy hh:mm:ss)"
 CVAR(			log_packetdebug, "0", "Print debugging messages for each packet sent",
 				CVARTYPE_BOOL, CVAR_SERVERARCHIVE)
 
+CVAR(			log_async, "1", "Write the log file from a background thread",
+				CVARTYPE_BOOL, CVAR_SERVERARCHIVE)
+
+CVAR_RANGE(		log_flushinterval, "100", "Milliseconds between writes to the log file when log_async " \
+				"is enabled (0 writes every message as soon as it is printed)",
+				CVARTYPE_INT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 0.0f, 10000.0f)
+
 // Server administrative settings
 // ------------------------------
 
@@ -117,6 +124,17 @@ CVAR_RANGE_FUNC_DECL(sv_maxrate, "200", "Forces clients to be on or below this r
 CVAR_RANGE_FUNC_DECL(sv_waddownloadcap, "200", "Cap wad file downloading to a specific rate",
 				CVARTYPE_INT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 7.0f, 100000.0f)
 
+CVAR_RANGE(		sv_downloadmtu, "1400", "Largest packet in bytes to send wad file downloads in",
+				CVARTYPE_INT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 576.0f, 8192.0f)
+
+CVAR_RANGE(		sv_downloadwindow, "256", "Kilobytes of a wad file download that may be in flight to " \
+				"a client at once",
+				CVARTYPE_INT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 16.0f, 16384.0f)
+
+CVAR(			sv_downloadcompress, "1", "Send wad file downloads to clients that acknowledge " \
+				"them as blocks from a cache of precompressed wads",
+				CVARTYPE_BOOL, CVAR_SERVERARCHIVE)
+
 #ifdef ODA_HAVE_MINIUPNP
 CVAR(			sv_upnp, "1", "Enable UPnP support",
 				CVARTYPE_BOOL, CVAR_SERVERARCHIVE)
@@ -244,8 +262,10 @@ CVAR(			sv_dmfarspawn, "0", "EXPERIMENTAL: When enabled in DM, players will spaw
                 "from each other.",
 				CVARTYPE_BOOL, CVAR_SERVERARCHIVE | CVAR_LATCH | CVAR_SERVERINFO)
 
-CVAR(sv_download_test, "0", "Experimental download optimization testing",
-	CVARTYPE_BOOL, CVAR_SERVERARCHIVE)
+CVAR_RANGE(		sv_prefetchmaps, "2", "EXPERIMENTAL: Minutes before the time limit at which the WADs of the " \
+				"next maplist entry are prefetched in the background (0 disables).",
+				CVARTYPE_FLOAT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 0.0f, 60.0f)
+
 
 // Hacky abominations that should be purged with fire and brimstone
 // =================================================================
@@ -0,0 +1,1128 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2015 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Serverside WAD downloads.
+//
+//	Every WAD being downloaded is opened once and its handle shared by all
+//	the clients downloading it, and closed when the last of them stops.
+//	Each client reads ahead of its position through a buffer of its own,
+//	so that most chunks are copied from memory rather than read with a
+//	seek and a small fread.  Chunks are sized to what the client may
+//	receive in a tic, up to what fits in a packet of sv_downloadmtu bytes.
+//
+//	Clients that acknowledge what they have received with clc_wadack get
+//	a windowed transfer: up to sv_downloadwindow KB past the end of what
+//	they have in one piece are kept in flight, ranges they report missing
+//	are sent again before anything new, and chunks are paced by a byte
+//	budget that refills at the capped rate every tic.  Other clients are
+//	streamed to as before and go back to the first missing byte with a
+//	new clc_wantwad when they lose a chunk.
+//
+//	Each WAD offered for download is also compressed once, in the
+//	background, into a cache file named after its MD5 sum.  The file is
+//	split into blocks that can each be decompressed on their own and fit
+//	in a packet, and windowed clients are sent those blocks as they are
+//	rather than raw chunks that have to be compressed with every packet.
+//	Blocks that do not compress are kept as they are and sent raw.  The
+//	WAD is compressed a block at a time straight into the cache file, and
+//	only the list of blocks is kept in memory while it is being sent.
+//
+//-----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sv_download.h"
+
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "d_main.h"
+#include "d_player.h"
+#include "doomstat.h"
+#include "i_net.h"
+#include "i_system.h"
+#include "m_fileio.h"
+#include "minilzo.h"
+#include "sv_main.h"
+
+EXTERN_CVAR(sv_waddownloadcap)
+EXTERN_CVAR(sv_downloadmtu)
+EXTERN_CVAR(sv_downloadwindow)
+EXTERN_CVAR(sv_downloadcompress)
+
+// Bytes of each packet taken up by the packet header and the
+// svc_wadinfo and svc_wadchunk headers.
+static const size_t DOWNLOAD_PACKET_OVERHEAD = 32;
+
+// Most missing ranges a client may report in one clc_wadack.
+static const size_t DOWNLOAD_MAX_NAKS = 32;
+
+// Most separate missing ranges a client may have waiting to be sent again.
+// Only a client that is lying about what it lost can get near it with the
+// default window, so one that goes over is dropped.
+static const size_t DOWNLOAD_MAX_MISSING = 4096;
+
+// Size of each client's read-ahead buffer.
+static const size_t DOWNLOAD_READAHEAD = 64 * 1024;
+
+// Compressed blocks are grown a WAD_BLOCK_SIZE at a time for as long as
+// they compress to no more than DOWNLOAD_ZBLOCK_TARGET bytes, up to
+// DOWNLOAD_ZBLOCK_MAX bytes of the WAD.
+static const size_t DOWNLOAD_ZBLOCK_TARGET = 1024;
+static const size_t DOWNLOAD_ZBLOCK_MAX = 16 * 1024;
+
+// Longest run of data that does not compress kept as one block.
+static const size_t DOWNLOAD_STORED_MAX = 32 * 1024;
+
+// The compressed data comes before the block list, which is only
+// known once the whole WAD has been compressed.
+static const char DOWNLOAD_CACHE_MAGIC[4] = { 'O', 'W', 'Z', '2' };
+
+struct downloadblock_t
+{
+	DWORD	offset;		// offset of the block in the WAD
+	DWORD	zoffset;	// offset of its compressed data in the cache
+	WORD	len;		// length in the WAD
+	WORD	zlen;		// compressed length, 0 if the block is stored
+};
+
+// Only the block list is kept in memory, the compressed data is read
+// from the cache file as it is sent.
+struct downloadcache_t
+{
+	size_t							length;		// of the WAD
+	std::vector<downloadblock_t>	blocks;
+	FILE*							handle;
+	size_t							dataoffset;	// of the compressed data in the file
+
+	downloadcache_t() : length(0), handle(NULL), dataoffset(0) { }
+	~downloadcache_t()
+	{
+		if (handle)
+			fclose(handle);
+	}
+};
+
+// A cache being built by a background thread
+struct downloadbuild_t
+{
+	std::thread			thread;
+	std::atomic<bool>	done;
+	std::atomic<bool>	cancel;
+	bool				ok;
+
+	downloadbuild_t() : done(false), cancel(false), ok(false) { }
+};
+
+struct downloadfile_t
+{
+	FILE*				handle;
+	size_t				length;
+	int					refcount;
+	std::string			md5;
+	std::string			cachepath;
+	downloadcache_t*	cache;
+};
+
+struct downloadclient_t
+{
+	std::string		name;
+	downloadfile_t*	file;
+
+	std::vector<byte>	readahead;
+	size_t			readoffset;		// file offset of readahead[0]
+	size_t			readlength;		// bytes of readahead that are valid
+
+	size_t			chunksize;
+	size_t			bytessent;
+	size_t			chunkssent;
+	size_t			wiresent;		// bytes of chunks, as compressed
+	dtime_t			starttime;
+	bool			finished;
+	int				lasttic;		// last gametic the client downloaded
+
+	// windowed transfers
+	bool			windowed;		// client sends clc_wadack
+	size_t			acked;			// client has everything before this
+	double			budget;			// bytes that may be sent this tic
+	size_t			resent;
+	std::map<size_t, size_t> missing;	// start -> end of ranges to send again
+
+	downloadclient_t() :
+		file(NULL), readoffset(0), readlength(0), chunksize(0),
+		bytessent(0), chunkssent(0), wiresent(0), starttime(0), finished(false), lasttic(0),
+		windowed(false), acked(0), budget(0.0), resent(0)
+	{ }
+};
+
+typedef std::map<std::string, downloadfile_t> downloadfiles_t;
+typedef std::map<byte, downloadclient_t> downloadclients_t;
+typedef std::map<std::string, std::shared_ptr<downloadbuild_t> > downloadbuilds_t;
+
+static downloadfiles_t downloadfiles;
+static downloadclients_t downloadclients;
+static downloadbuilds_t downloadbuilds;
+
+#if ODAMEX_DEBUG
+// Totals since startup, for downloadstats
+static QWORD downloadtotalbytes = 0;
+static QWORD downloadtotalwire = 0;
+static QWORD downloadtotalreads = 0;
+#endif	// ODAMEX_DEBUG
+
+//
+// SV_CompressDownloadFile
+//
+// Splits a WAD into blocks, each compressed as far as it will go while
+// still fitting in a packet, or stored if it does not compress. The WAD
+// is read DOWNLOAD_ZBLOCK_MAX bytes at a time and the compressed data
+// written to handle as it goes, adding up to datasize bytes.
+//
+static bool SV_CompressDownloadFile(const std::string& name, FILE* out_handle,
+									std::vector<downloadblock_t>& blocks, size_t& length,
+									size_t& datasize, const std::atomic<bool>& cancel)
+{
+	FILE* handle = fopen(name.c_str(), "rb");
+	if (handle == NULL)
+		return false;
+
+	length = M_FileLength(handle);
+	datasize = 0;
+	blocks.clear();
+
+	// part of the WAD being compressed, starting at winoffset
+	std::vector<byte> window(DOWNLOAD_ZBLOCK_MAX);
+	size_t winoffset = 0, winlength = 0;
+
+	// wrkmem is not shared with the packet compression on the main thread
+	std::vector<byte> wrkmem(LZO1X_1_MEM_COMPRESS);
+	const size_t outsize = DOWNLOAD_ZBLOCK_MAX + DOWNLOAD_ZBLOCK_MAX / 16 + 64 + 3;
+	std::vector<byte> out(outsize), best(outsize);
+
+	const size_t maxblocks = DOWNLOAD_ZBLOCK_MAX / WAD_BLOCK_SIZE;
+	size_t guess = 4;
+	bool ok = true;
+
+	for (size_t offset = 0; ok && offset < length; )
+	{
+		if (cancel)
+		{
+			ok = false;
+			break;
+		}
+
+		const size_t remain = length - offset;
+
+		// move what is left of the window to its start and refill it
+		if (offset + std::min(remain, window.size()) > winoffset + winlength)
+		{
+			const size_t keep = winoffset + winlength - offset;
+
+			memmove(window.data(), window.data() + (offset - winoffset), keep);
+			winoffset = offset;
+			winlength = keep + fread(window.data() + keep, 1, window.size() - keep, handle);
+
+			if (winlength < std::min(remain, window.size()))
+			{
+				ok = false;
+				break;
+			}
+		}
+
+		const byte* wad = window.data() + (offset - winoffset);
+
+		// Search for the most WAD blocks that compress to fit, starting from
+		// how many did for the previous block.
+		size_t fit = 0, nofit = maxblocks + 1, n = guess;
+		lzo_uint bestlen = 0;
+
+		for (;;)
+		{
+			size_t rawlen = std::min(n * WAD_BLOCK_SIZE, remain);
+			lzo_uint zlen = 0;
+
+			if (lzo1x_1_compress(wad, rawlen, &out[0], &zlen, &wrkmem[0]) != LZO_E_OK)
+			{
+				ok = false;
+				break;
+			}
+
+			if (zlen <= DOWNLOAD_ZBLOCK_TARGET)
+			{
+				fit = n;
+				bestlen = zlen;
+				out.swap(best);
+
+				if (rawlen == remain)
+					break;
+			}
+			else
+				nofit = n;
+
+			if (nofit - fit <= 1)
+				break;
+
+			n = (nofit > maxblocks) ? std::min(fit * 2, maxblocks) : (fit + nofit) / 2;
+		}
+
+		if (!ok)
+			break;
+
+		guess = std::max(fit, (size_t)1);
+
+		size_t rawlen = std::min(std::max(fit, (size_t)1) * WAD_BLOCK_SIZE, remain);
+
+		if (fit && bestlen < rawlen - rawlen / 8)
+		{
+			downloadblock_t block;
+			block.offset = offset;
+			block.zoffset = datasize;
+			block.len = rawlen;
+			block.zlen = bestlen;
+
+			blocks.push_back(block);
+			ok = fwrite(&best[0], 1, bestlen, out_handle) == bestlen;
+			datasize += bestlen;
+		}
+		else if (!blocks.empty() && blocks.back().zlen == 0 &&
+				 blocks.back().len + rawlen <= DOWNLOAD_STORED_MAX)
+		{
+			blocks.back().len += rawlen;
+		}
+		else
+		{
+			downloadblock_t block;
+			block.offset = offset;
+			block.zoffset = 0;
+			block.len = rawlen;
+			block.zlen = 0;
+
+			blocks.push_back(block);
+		}
+
+		offset += rawlen;
+	}
+
+	fclose(handle);
+	return ok;
+}
+
+//
+// SV_WriteDownloadCache
+//
+// Compresses a WAD into its cache file. The header is written again
+// once the size of the compressed data and the blocks are known.
+//
+static bool SV_WriteDownloadCache(const std::string& name, const std::string& path,
+								  const std::string& md5, const std::atomic<bool>& cancel)
+{
+	std::string temp = path + ".tmp";
+
+	FILE* handle = fopen(temp.c_str(), "wb");
+	if (handle == NULL)
+		return false;
+
+	std::vector<downloadblock_t> blocks;
+	size_t length = 0, datasize = 0;
+
+	DWORD header[3] = { 0, 0, 0 };
+	char hash[32] = { 0 };
+	strncpy(hash, md5.c_str(), sizeof(hash));
+
+	bool ok = fwrite(DOWNLOAD_CACHE_MAGIC, sizeof(DOWNLOAD_CACHE_MAGIC), 1, handle) == 1 &&
+			  fwrite(header, sizeof(header), 1, handle) == 1 &&
+			  fwrite(hash, sizeof(hash), 1, handle) == 1 &&
+			  SV_CompressDownloadFile(name, handle, blocks, length, datasize, cancel) &&
+			  (blocks.empty() || fwrite(&blocks[0], sizeof(downloadblock_t),
+										blocks.size(), handle) == blocks.size());
+
+	if (ok)
+	{
+		header[0] = length;
+		header[1] = blocks.size();
+		header[2] = datasize;
+
+		ok = fseek(handle, sizeof(DOWNLOAD_CACHE_MAGIC), SEEK_SET) == 0 &&
+			 fwrite(header, sizeof(header), 1, handle) == 1;
+	}
+
+	ok = (fclose(handle) == 0) && ok;
+
+	if (!ok)
+	{
+		remove(temp.c_str());
+		return false;
+	}
+
+	// rename() will not replace an existing file everywhere
+	remove(path.c_str());
+
+	if (rename(temp.c_str(), path.c_str()) != 0)
+	{
+		remove(temp.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+//
+// SV_ReadDownloadCache
+//
+// Reads the block list of a WAD, if its cache is there, is for the same
+// WAD and covers all of it, and keeps the cache open to send from.
+//
+static bool SV_ReadDownloadCache(const std::string& path, const std::string& md5,
+								 size_t length, downloadcache_t& cache)
+{
+	FILE* handle = fopen(path.c_str(), "rb");
+	if (handle == NULL)
+		return false;
+
+	char magic[sizeof(DOWNLOAD_CACHE_MAGIC)];
+	DWORD header[3];
+	char hash[32];
+	const size_t dataoffset = sizeof(magic) + sizeof(header) + sizeof(hash);
+
+	bool ok = fread(magic, sizeof(magic), 1, handle) == 1 &&
+			  fread(header, sizeof(header), 1, handle) == 1 &&
+			  fread(hash, sizeof(hash), 1, handle) == 1 &&
+			  memcmp(magic, DOWNLOAD_CACHE_MAGIC, sizeof(magic)) == 0 &&
+			  strncmp(hash, md5.c_str(), sizeof(hash)) == 0 &&
+			  header[0] == length &&
+			  (size_t)M_FileLength(handle) == dataoffset + header[2] +
+				header[1] * sizeof(downloadblock_t);
+
+	if (ok)
+	{
+		cache.length = length;
+		cache.blocks.resize(header[1]);
+
+		ok = fseek(handle, dataoffset + header[2], SEEK_SET) == 0 &&
+			 (cache.blocks.empty() || fread(&cache.blocks[0], sizeof(downloadblock_t),
+											cache.blocks.size(), handle) == cache.blocks.size());
+	}
+
+	// the blocks must follow each other to the end of the WAD
+	size_t offset = 0;
+	for (size_t i = 0; ok && i < cache.blocks.size(); i++)
+	{
+		const downloadblock_t& block = cache.blocks[i];
+
+		ok = block.offset == offset && block.len > 0 && block.zlen <= DOWNLOAD_ZBLOCK_TARGET &&
+			 (size_t)block.zoffset + block.zlen <= header[2];
+		offset += block.len;
+	}
+
+	if (!ok || offset != length)
+	{
+		fclose(handle);
+		return false;
+	}
+
+	cache.handle = handle;
+	cache.dataoffset = dataoffset;
+	return true;
+}
+
+//
+// SV_ReadDownloadBlock
+//
+// Reads the compressed data of a block from the cache file into dest,
+// which must have room for DOWNLOAD_ZBLOCK_TARGET bytes.
+//
+static bool SV_ReadDownloadBlock(const downloadcache_t& cache, const downloadblock_t& block,
+								 byte* dest)
+{
+#if ODAMEX_DEBUG
+	downloadtotalreads++;
+#endif
+
+	return fseek(cache.handle, cache.dataoffset + block.zoffset, SEEK_SET) == 0 &&
+		   fread(dest, 1, block.zlen, cache.handle) == block.zlen;
+}
+
+static void SV_BuildDownloadCache(std::string name, std::string path, std::string md5,
+								  downloadbuild_t* build)
+{
+	build->ok = SV_WriteDownloadCache(name, path, md5, build->cancel);
+	build->done = true;
+}
+
+//
+// SV_StopDownloadBuilds
+//
+// Stops the caches still being built and waits for their threads.
+//
+static void STACK_ARGS SV_StopDownloadBuilds()
+{
+	for (downloadbuilds_t::iterator it = downloadbuilds.begin(); it != downloadbuilds.end(); ++it)
+		it->second->cancel = true;
+
+	for (downloadbuilds_t::iterator it = downloadbuilds.begin(); it != downloadbuilds.end(); ++it)
+	{
+		if (it->second->thread.joinable())
+			it->second->thread.join();
+	}
+
+	downloadbuilds.clear();
+}
+
+//
+// SV_LoadDownloadCache
+//
+// Loads the compressed blocks of a WAD being downloaded, or starts
+// building them in the background if they have not been yet. Called
+// every tic until there is a cache or building it has failed.
+//
+static void SV_LoadDownloadCache(downloadfile_t& file, const std::string& name)
+{
+	if (file.cache || file.cachepath.empty() || !sv_downloadcompress)
+		return;
+
+	downloadbuilds_t::iterator it = downloadbuilds.find(file.cachepath);
+
+	if (it != downloadbuilds.end())
+	{
+		// still being built
+		if (!it->second->done)
+			return;
+
+		if (it->second->thread.joinable())
+			it->second->thread.join();
+
+		// could not be
+		if (!it->second->ok)
+			return;
+	}
+
+	downloadcache_t* cache = new downloadcache_t;
+
+	if (SV_ReadDownloadCache(file.cachepath, file.md5, file.length, *cache))
+	{
+		file.cache = cache;
+
+		if (it != downloadbuilds.end())
+			downloadbuilds.erase(it);
+
+		DPrintf("Sending %s in %u compressed blocks\n", D_CleanseFileName(name).c_str(),
+				(unsigned)cache->blocks.size());
+		return;
+	}
+
+	delete cache;
+
+	if (it != downloadbuilds.end())
+	{
+		// built, but could not be read back
+		it->second->ok = false;
+		return;
+	}
+
+	DPrintf("Compressing %s for download\n", D_CleanseFileName(name).c_str());
+
+	static bool registered = false;
+	if (!registered)
+	{
+		atterm(SV_StopDownloadBuilds);
+		registered = true;
+	}
+
+	std::shared_ptr<downloadbuild_t> build(new downloadbuild_t);
+	downloadbuilds[file.cachepath] = build;
+
+	build->thread = std::thread(SV_BuildDownloadCache, name, file.cachepath, file.md5, build.get());
+}
+
+//
+// SV_AcquireDownloadFile
+//
+// Returns the shared handle of a WAD file, opening it if no other client
+// is downloading it. Returns NULL if the file could not be opened.
+//
+static downloadfile_t* SV_AcquireDownloadFile(const std::string& name)
+{
+	downloadfiles_t::iterator it = downloadfiles.find(name);
+
+	if (it == downloadfiles.end())
+	{
+		FILE* handle = fopen(name.c_str(), "rb");
+		if (handle == NULL)
+		{
+			DPrintf("Unable to open %s for download\n", name.c_str());
+			return NULL;
+		}
+
+		downloadfile_t file;
+		file.handle = handle;
+		file.length = M_FileLength(handle);
+		file.refcount = 0;
+		file.cache = NULL;
+
+		for (size_t i = 0; i < wadfiles.size() && i < wadhashes.size(); i++)
+		{
+			if (wadfiles[i] == name && !wadhashes[i].empty())
+			{
+				file.md5 = wadhashes[i];
+				file.cachepath = I_GetUserFileName((file.md5 + ".wadz").c_str());
+				break;
+			}
+		}
+
+		it = downloadfiles.insert(std::make_pair(name, file)).first;
+		SV_LoadDownloadCache(it->second, name);
+	}
+
+	it->second.refcount++;
+	return &it->second;
+}
+
+static void SV_ReleaseDownloadFile(downloadfile_t* file)
+{
+	if (file == NULL || --file->refcount > 0)
+		return;
+
+	for (downloadfiles_t::iterator it = downloadfiles.begin(); it != downloadfiles.end(); ++it)
+	{
+		if (&it->second == file)
+		{
+			fclose(file->handle);
+			delete file->cache;
+			downloadfiles.erase(it);
+			return;
+		}
+	}
+}
+
+//
+// SV_ReadDownloadChunk
+//
+// Copies up to len bytes at offset in the client's file into dest,
+// refilling the client's read-ahead buffer if the chunk is not in it.
+// Returns the number of bytes copied.
+//
+static size_t SV_ReadDownloadChunk(downloadclient_t& dl, size_t offset, size_t len, byte* dest)
+{
+	if (offset >= dl.file->length)
+		return 0;
+
+	len = std::min(len, dl.file->length - offset);
+
+	if (offset < dl.readoffset || offset + len > dl.readoffset + dl.readlength)
+	{
+		dl.readahead.resize(DOWNLOAD_READAHEAD);
+		dl.readoffset = offset;
+		dl.readlength = 0;
+
+		if (fseek(dl.file->handle, offset, SEEK_SET) == 0)
+			dl.readlength = fread(&dl.readahead[0], 1, dl.readahead.size(), dl.file->handle);
+
+#if ODAMEX_DEBUG
+		downloadtotalreads++;
+#endif
+
+		len = std::min(len, dl.readlength);
+		if (len == 0)
+			return 0;
+	}
+
+	memcpy(dest, &dl.readahead[offset - dl.readoffset], len);
+	return len;
+}
+
+//
+// SV_DownloadClient
+//
+// Returns the download state of a client, (re)starting it if the client
+// has asked for a different file or is new.
+//
+static downloadclient_t* SV_DownloadClient(player_t& player)
+{
+	client_t* cl = &player.client;
+	downloadclient_t& dl = downloadclients[player.id];
+
+	if (dl.file == NULL || dl.name != cl->download.name)
+	{
+		SV_ReleaseDownloadFile(dl.file);
+
+		dl.name = cl->download.name;
+		dl.file = SV_AcquireDownloadFile(dl.name);
+		dl.readahead.clear();
+		dl.readoffset = dl.readlength = 0;
+		dl.bytessent = dl.chunkssent = dl.wiresent = 0;
+		dl.starttime = I_GetTime();
+		dl.finished = false;
+		dl.acked = cl->download.next_offset;
+		dl.budget = 0.0;
+		dl.resent = 0;
+		dl.missing.clear();
+	}
+
+	dl.lasttic = gametic;
+	return dl.file ? &dl : NULL;
+}
+
+// Stop tracking clients that are gone or no longer downloading.
+static void SV_RemoveStaleDownloadClients()
+{
+	for (downloadclients_t::iterator it = downloadclients.begin(); it != downloadclients.end(); )
+	{
+		if (it->second.lasttic != gametic)
+		{
+			SV_ReleaseDownloadFile(it->second.file);
+			downloadclients.erase(it++);
+		}
+		else
+			++it;
+	}
+}
+
+static double SV_DownloadRate(const downloadclient_t& dl)
+{
+	double seconds = (I_GetTime() - dl.starttime) / 1000000000.0;
+	return seconds > 0.0 ? dl.bytessent / 1024.0 / seconds : 0.0;
+}
+
+//
+// SV_SendDownloadChunk
+//
+// Sends up to len bytes of the client's file at offset in a packet of
+// their own. Returns the number of bytes sent.
+//
+static size_t SV_SendDownloadChunk(player_t& player, downloadclient_t& dl, size_t offset, size_t len)
+{
+	client_t* cl = &player.client;
+	static byte buff[MAX_UDP_PACKET];
+
+	size_t read = SV_ReadDownloadChunk(dl, offset, std::min(len, sizeof(buff)), buff);
+
+	if (!read)
+		return 0;
+
+	// [SL] 2011-08-09 - Always send the data in netbuf and reliablebuf prior
+	// to writing a wadchunk to netbuf to keep packet sizes below the MTU.
+	// This prevents packets from getting dropped due to size on some networks.
+	if (cl->netbuf.size() + cl->reliablebuf.size())
+		SV_SendPacket(player);
+
+	if (!offset)
+	{
+		MSG_WriteMarker(&cl->netbuf, svc_wadinfo);
+		MSG_WriteLong(&cl->netbuf, dl.file->length);
+	}
+
+	MSG_WriteMarker(&cl->netbuf, svc_wadchunk);
+	MSG_WriteLong(&cl->netbuf, offset);
+	MSG_WriteShort(&cl->netbuf, read);
+	MSG_WriteChunk(&cl->netbuf, buff, read);
+
+	// Make double-sure the wadchunk is sent in its own packet
+	if (cl->netbuf.size() + cl->reliablebuf.size())
+		SV_SendPacket(player);
+
+	dl.bytessent += read;
+	dl.chunkssent++;
+	dl.wiresent += read;
+#if ODAMEX_DEBUG
+	downloadtotalbytes += read;
+	downloadtotalwire += read;
+#endif
+
+	return read;
+}
+
+static bool SV_DownloadBlockAfter(size_t offset, const downloadblock_t& block)
+{
+	return offset < block.offset;
+}
+
+//
+// SV_FindDownloadBlock
+//
+// Returns the compressed cache block holding offset in the client's file,
+// or NULL if the client is not sent compressed blocks.
+//
+static const downloadblock_t* SV_FindDownloadBlock(const downloadclient_t& dl, size_t offset)
+{
+	const downloadcache_t* cache = dl.file->cache;
+
+	if (!dl.windowed || !sv_downloadcompress || cache == NULL || offset >= cache->length)
+		return NULL;
+
+	std::vector<downloadblock_t>::const_iterator it =
+		std::upper_bound(cache->blocks.begin(), cache->blocks.end(), offset, SV_DownloadBlockAfter);
+
+	return it == cache->blocks.begin() ? NULL : &*(it - 1);
+}
+
+//
+// SV_DownloadChunkLength
+//
+// Shortens a raw chunk so that it does not run into the next block,
+// which can then still be sent compressed.
+//
+static size_t SV_DownloadChunkLength(const downloadclient_t& dl, size_t offset, size_t len)
+{
+	const downloadblock_t* block = SV_FindDownloadBlock(dl, offset);
+
+	if (block == NULL)
+		return len;
+
+	return std::min(len, (size_t)block->offset + block->len - offset);
+}
+
+//
+// SV_SendDownloadBlock
+//
+// Sends the compressed block that starts at offset in the client's file
+// in a packet of its own, if there is one within span bytes of offset
+// that fits in a packet. Returns the number of bytes of the file sent,
+// and the compressed size in wire.
+//
+static size_t SV_SendDownloadBlock(player_t& player, downloadclient_t& dl, size_t offset,
+								   size_t span, size_t& wire)
+{
+	client_t* cl = &player.client;
+	const downloadblock_t* block = SV_FindDownloadBlock(dl, offset);
+
+	if (block == NULL || block->offset != offset || block->zlen == 0 || block->len > span ||
+		block->zlen > (size_t)sv_downloadmtu.asInt() - DOWNLOAD_PACKET_OVERHEAD)
+		return 0;
+
+	byte zdata[DOWNLOAD_ZBLOCK_TARGET];
+	if (!SV_ReadDownloadBlock(*dl.file->cache, *block, zdata))
+		return 0;
+
+	if (cl->netbuf.size() + cl->reliablebuf.size())
+		SV_SendPacket(player);
+
+	if (!offset)
+	{
+		MSG_WriteMarker(&cl->netbuf, svc_wadinfo);
+		MSG_WriteLong(&cl->netbuf, dl.file->length);
+	}
+
+	MSG_WriteMarker(&cl->netbuf, svc_wadzchunk);
+	MSG_WriteLong(&cl->netbuf, offset);
+	MSG_WriteShort(&cl->netbuf, block->len);
+	MSG_WriteShort(&cl->netbuf, block->zlen);
+	MSG_WriteChunk(&cl->netbuf, zdata, block->zlen);
+
+	// Already as small as it gets
+	SV_SendPacket(player, false);
+
+	dl.bytessent += block->len;
+	dl.chunkssent++;
+	dl.wiresent += block->zlen;
+#if ODAMEX_DEBUG
+	downloadtotalbytes += block->len;
+	downloadtotalwire += block->zlen;
+#endif
+
+	wire = block->zlen;
+	return block->len;
+}
+
+//
+// SV_SendDownloadWindow
+//
+// Spends the client's byte budget on the ranges it reported missing,
+// then on new chunks while they fit in the window.
+//
+static void SV_SendDownloadWindow(player_t& player, downloadclient_t& dl, int download_rate)
+{
+	client_t* cl = &player.client;
+	const size_t window = (size_t)sv_downloadwindow.asInt() * 1024;
+
+	// Don't let a budget that could not be spent build up into a burst
+	dl.budget = std::min(dl.budget + (double)download_rate / TICRATE,
+						 std::max((double)download_rate / 4, (double)dl.chunksize));
+
+	while (dl.budget >= dl.chunksize)
+	{
+		size_t sent, wire = 0;
+
+		if (!dl.missing.empty())
+		{
+			size_t start = dl.missing.begin()->first;
+			size_t end = dl.missing.begin()->second;
+
+			sent = SV_SendDownloadBlock(player, dl, start, end - start, wire);
+
+			if (sent == 0)
+			{
+				size_t len = SV_DownloadChunkLength(dl, start,
+													std::min(end - start, dl.chunksize));
+				sent = wire = SV_SendDownloadChunk(player, dl, start, len);
+			}
+
+			dl.missing.erase(dl.missing.begin());
+			if (sent != 0 && sent < end - start)
+				dl.missing[start + sent] = end;
+
+			dl.resent += sent;
+		}
+		else if (cl->download.next_offset < dl.acked + window)
+		{
+			size_t offset = cl->download.next_offset;
+
+			sent = SV_SendDownloadBlock(player, dl, offset, dl.file->length - offset, wire);
+
+			if (sent == 0)
+				sent = wire = SV_SendDownloadChunk(player, dl, offset,
+												  SV_DownloadChunkLength(dl, offset, dl.chunksize));
+
+			if (sent == 0)
+				break;
+
+			cl->download.next_offset += sent;
+		}
+		else
+			break;
+
+		dl.budget -= std::max(wire, (size_t)1);
+	}
+}
+
+//
+// SV_WadDownloads
+//
+void SV_WadDownloads()
+{
+	for (downloadfiles_t::iterator it = downloadfiles.begin(); it != downloadfiles.end(); ++it)
+		SV_LoadDownloadCache(it->second, it->first);
+
+	for (Players::iterator it = players.begin(); it != players.end(); ++it)
+	{
+		if (it->playerstate != PST_DOWNLOAD)
+			continue;
+
+		client_t *cl = &(it->client);
+
+		if (!cl->download.name.length())
+			continue;
+
+		downloadclient_t* dl = SV_DownloadClient(*it);
+		if (dl == NULL)
+			continue;
+
+		// maximum rate client can download at (in bytes per second)
+		int download_rate = (sv_waddownloadcap > cl->rate) ? cl->rate * 1000 : sv_waddownloadcap * 1000;
+
+		// Send what the client may receive in a tic, within a single packet,
+		// in whole blocks
+		dl->chunksize = std::min(
+			(size_t)download_rate / TICRATE,
+			(size_t)sv_downloadmtu.asInt() - DOWNLOAD_PACKET_OVERHEAD);
+		dl->chunksize = std::max(dl->chunksize / WAD_BLOCK_SIZE, (size_t)1) * WAD_BLOCK_SIZE;
+
+		if (dl->windowed)
+		{
+			SV_SendDownloadWindow(*it, *dl, download_rate);
+		}
+		else
+		{
+			do
+			{
+				size_t sent = SV_SendDownloadChunk(*it, *dl, cl->download.next_offset, dl->chunksize);
+
+				if (!sent)
+					break;
+
+				cl->download.next_offset += sent;
+			} while (
+				(double)(cl->reliable_bps + cl->unreliable_bps) * TICRATE
+				/ (double)(gametic % TICRATE)	// bps already used
+				+ (double)dl->chunksize / TICRATE 	// bps this chunk will use
+				< (double)download_rate);
+		}
+
+		if (!dl->finished && cl->download.next_offset >= dl->file->length &&
+			(!dl->windowed || dl->acked >= dl->file->length))
+		{
+			dl->finished = true;
+			Printf(PRINT_HIGH, "> client %d sent %s at %.1f KB/s\n", it->id,
+				D_CleanseFileName(dl->name).c_str(), SV_DownloadRate(*dl));
+		}
+	}
+
+	SV_RemoveStaleDownloadClients();
+}
+
+//
+// SV_AddMissingRange
+//
+// Queues [start, end) to be sent again, merged with any queued ranges it
+// overlaps or touches so that no byte is queued twice.
+//
+static void SV_AddMissingRange(downloadclient_t& dl, size_t start, size_t end)
+{
+	std::map<size_t, size_t>::iterator it = dl.missing.upper_bound(start);
+
+	if (it != dl.missing.begin())
+	{
+		std::map<size_t, size_t>::iterator prev = it;
+		--prev;
+
+		if (prev->second >= end)
+			return;
+		if (prev->second >= start)
+		{
+			start = prev->first;
+			it = prev;
+		}
+	}
+
+	while (it != dl.missing.end() && it->first <= end)
+	{
+		end = std::max(end, it->second);
+		dl.missing.erase(it++);
+	}
+
+	dl.missing[start] = end;
+}
+
+//
+// SV_WadAck
+//
+// A windowed client reports what it has received: everything before
+// have, the end of the furthest chunk it got, and ranges before that
+// which it is still missing.  Returns false if the client was dropped for
+// reporting more missing ranges than it could have.
+//
+bool SV_WadAck(player_t& player)
+{
+	size_t have = MSG_ReadLong();
+	size_t highest = MSG_ReadLong();
+	size_t count = MSG_ReadByte();
+
+	std::vector<std::pair<size_t, size_t> > naks;
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t offset = MSG_ReadLong();
+		size_t len = MSG_ReadLong();
+		if (naks.size() < DOWNLOAD_MAX_NAKS && len > 0)
+			naks.push_back(std::make_pair(offset, len));
+	}
+
+	downloadclients_t::iterator it = downloadclients.find(player.id);
+	if (it == downloadclients.end() || it->second.file == NULL ||
+		player.playerstate != PST_DOWNLOAD)
+		return true;
+
+	downloadclient_t& dl = it->second;
+	client_t* cl = &player.client;
+	const size_t length = dl.file->length;
+
+	dl.windowed = true;
+	dl.acked = std::max(dl.acked, std::min(have, length));
+
+	// A client resuming a download may already have chunks past the point
+	// it asked to restart from, so carry on after them.
+	if (highest > cl->download.next_offset && highest <= length)
+		cl->download.next_offset = highest;
+
+	// the client has everything before acked, so don't send it again
+	while (!dl.missing.empty() && dl.missing.begin()->first < dl.acked)
+	{
+		size_t end = dl.missing.begin()->second;
+		dl.missing.erase(dl.missing.begin());
+		if (end > dl.acked)
+			dl.missing[dl.acked] = end;
+	}
+
+	for (size_t i = 0; i < naks.size(); i++)
+	{
+		size_t offset = naks[i].first;
+		size_t end = std::min(offset + naks[i].second, (size_t)cl->download.next_offset);
+
+		if (offset < dl.acked || offset >= end)
+			continue;
+
+		SV_AddMissingRange(dl, offset, end);
+	}
+
+	if (dl.missing.size() > DOWNLOAD_MAX_MISSING)
+	{
+		Printf(PRINT_HIGH, "%s reported too many missing download ranges, dropping client.\n",
+			   NET_AdrToString(cl->address));
+		SV_DropClient(player);
+		return false;
+	}
+
+	return true;
+}
+
+//
+// SV_WadRequested
+//
+// The client has asked for its download to (re)start at next_offset,
+// dropping whatever was still queued for it.
+//
+void SV_WadRequested(player_t& player)
+{
+	downloadclients_t::iterator it = downloadclients.find(player.id);
+	if (it == downloadclients.end())
+		return;
+
+	downloadclient_t& dl = it->second;
+	dl.acked = player.client.download.next_offset;
+	dl.missing.clear();
+	dl.finished = false;
+}
+
+#if ODAMEX_DEBUG
+BEGIN_COMMAND (downloadstats)
+{
+	for (downloadclients_t::const_iterator it = downloadclients.begin(); it != downloadclients.end(); ++it)
+	{
+		const downloadclient_t& dl = it->second;
+		if (dl.file == NULL)
+			continue;
+
+		player_t& player = idplayer(it->first);
+		size_t offset = validplayer(player) ? player.client.download.next_offset : 0;
+
+		Printf(PRINT_HIGH, "%3d %-16s %s %u/%u bytes, %.1f KB/s, %u chunks of %u bytes",
+			it->first, validplayer(player) ? player.userinfo.netname.c_str() : "?",
+			D_CleanseFileName(dl.name).c_str(), (unsigned)offset, (unsigned)dl.file->length,
+			SV_DownloadRate(dl), (unsigned)dl.chunkssent, (unsigned)dl.chunksize);
+
+		if (dl.windowed)
+			Printf(PRINT_HIGH, ", %u acked, %u resent, %u bytes on the wire%s\n", (unsigned)dl.acked,
+				(unsigned)dl.resent, (unsigned)dl.wiresent, dl.file->cache ? " (compressed)" : "");
+		else
+			Printf(PRINT_HIGH, "\n");
+	}
+
+	Printf(PRINT_HIGH, "%u clients downloading %u open files, %llu bytes sent in total "
+		"as %llu bytes, %llu reads from disk\n", (unsigned)downloadclients.size(),
+		(unsigned)downloadfiles.size(), (unsigned long long)downloadtotalbytes,
+		(unsigned long long)downloadtotalwire, (unsigned long long)downloadtotalreads);
+}
+END_COMMAND (downloadstats)
+#endif	// ODAMEX_DEBUG
+
+VERSION_CONTROL (sv_download_cpp, "$Id$")
@@ -0,0 +1,37 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2015 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Serverside WAD downloads.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __SV_DOWNLOAD_H__
+#define __SV_DOWNLOAD_H__
+
+#include "d_player.h"
+
+// Send the next WAD chunks to every downloading client.
+void SV_WadDownloads();
+
+// Handle a client's clc_wadack.  Returns false if the client was dropped.
+bool SV_WadAck(player_t &player);
+
+// Called when a client (re)requests a WAD with clc_wantwad.
+void SV_WadRequested(player_t &player);
+
+#endif	// __SV_DOWNLOAD_H__
@@ -62,12 +62,14 @@
 #include "p_unlag.h"
 #include "sv_vote.h"
 #include "sv_maplist.h"
+#include "sv_download.h"
 #include "g_warmup.h"
 #include "sv_banlist.h"
 #include "d_main.h"
 #include "m_fileio.h"
 
 #include <algorithm>
+#include <deque>
 #include <sstream>
 #include <vector>
 
@@ -3056,39 +3058,82 @@ void SV_ActorTracer(AActor *actor)
 	}
 }
 
+//
+// SV_QueueCorpse
+// Remembers a player body that has just been detached from its player, or
+// left behind by a player leaving the game, so SV_RemoveCorpses can find
+// the oldest ones without walking every thinker.
+//
+static std::deque<AActor::AActorPtr> corpsequeue;
+
+void SV_QueueCorpse(AActor *mo)
+{
+	if (!mo || mo->type != MT_PLAYER)
+		return;
+
+	// Drop bodies that have already been destroyed by other means
+	while (!corpsequeue.empty() && !(AActor *)corpsequeue.front())
+		corpsequeue.pop_front();
+
+	// A player leaving the game while dead is queued by P_PlayerLeavesGame
+	// and then again by G_DoReborn
+	if (!corpsequeue.empty() && (AActor *)corpsequeue.back() == mo)
+		return;
+
+	corpsequeue.push_back(mo->ptr());
+}
+
+//
+// SV_ClearCorpses
+// Forgets every queued corpse (the level is going away)
+//
+void SV_ClearCorpses()
+{
+	corpsequeue.clear();
+}
+
 //
 // SV_RemoveCorpses
-// Removes some corpses
+// Removes the oldest detached player bodies until at most sv_maxcorpses
+// player corpses remain
 //
 void SV_RemoveCorpses (void)
 {
-	AActor *mo;
-	int     corpses = 0;
-
 	// joek - Number of corpses infinite
 	if(sv_maxcorpses <= 0)
 		return;
 
 	if (!P_AtInterval(TICRATE))
 		return;
-	else
+
+	// Dead players who have not respawned yet still count against the limit
+	int corpses = 0;
+	for (Players::iterator it = players.begin(); it != players.end(); ++it)
 	{
-		TThinkerIterator<AActor> iterator;
-		while ( (mo = iterator.Next() ) )
-		{
-			if (mo->type == MT_PLAYER && (!mo->player || mo->health <=0) )
-				corpses++;
-		}
+		if (it->mo && it->mo->health <= 0)
+			corpses++;
 	}
 
-	TThinkerIterator<AActor> iterator;
-	while (corpses > sv_maxcorpses && (mo = iterator.Next() ) )
+	// Bodies destroyed by other means are dropped once they reach the front,
+	// and do not count against the limit until then
+	for (std::deque<AActor::AActorPtr>::iterator it = corpsequeue.begin(); it != corpsequeue.end(); ++it)
 	{
-		if (mo->type == MT_PLAYER && !mo->player)
-		{
+		if ((AActor *)*it)
+			corpses++;
+	}
+
+	while (corpses > sv_maxcorpses && !corpsequeue.empty())
+	{
+		AActor *mo = corpsequeue.front();
+		corpsequeue.pop_front();
+
+		if (!mo)
+			continue;
+
+		corpses--;
+
+		if (!mo->player)
 			mo->Destroy();
-			corpses--;
-		}
 	}
 }
 
@@ -3273,6 +3318,17 @@ void SV_WriteCommands(void)
 	Unlag::getInstance().recordPlayerPositions();
 	Unlag::getInstance().recordSectorPositions();
 
+	// Gather the players whose positions get sent out once, rather than
+	// filtering the whole list again for every client.
+	// GhostlyDeath -- Screw spectators
+	static std::vector<player_t*> movers;
+	movers.clear();
+	for (Players::iterator it = players.begin(); it != players.end(); ++it)
+	{
+		if (it->ingame() && it->mo && !it->spectator)
+			movers.push_back(&*it);
+	}
+
 	for (Players::iterator it = players.begin(); it != players.end(); ++it)
 	{
 		client_t *cl = &(it->client);
@@ -3283,17 +3339,12 @@ void SV_WriteCommands(void)
 		if (it->ingame())
 			SV_SendGametic(cl);
 
-		for (Players::iterator pit = players.begin();pit != players.end();++pit)
+		for (size_t i = 0; i < movers.size(); i++)
 		{
-			if (!(pit->ingame()) || !(pit->mo))
-				continue;
+			player_t *pit = movers[i];
 
 			// a player is updated about their own position elsewhere
-			if (&*it == &*pit)
-				continue;
-
-			// GhostlyDeath -- Screw spectators
-			if (pit->spectator)
+			if (&*it == pit)
 				continue;
 
 			if(!SV_IsPlayerAllowedToSee(*it, pit->mo))
@@ -3594,9 +3645,10 @@ void SV_Spectate(player_t &player)
 		}
 
 		// GhostlyDeath -- Code 5! Anyway, this just updates the player for "antiwallhack" fun
-		player.mo->x = MSG_ReadLong();
-		player.mo->y = MSG_ReadLong();
-		player.mo->z = MSG_ReadLong();
+		fixed_t x = MSG_ReadLong();
+		fixed_t y = MSG_ReadLong();
+		fixed_t z = MSG_ReadLong();
+		player.mo->SetOrigin(x, y, z);
 	}
 	else
 	{
@@ -4090,6 +4142,7 @@ void SV_WantWad(player_t &player)
 	cl->download.name = wadfiles[i];
 	cl->download.next_offset = next_offset;
 	player.playerstate = PST_DOWNLOAD;
+	SV_WadRequested(player);
 }
 
 //
@@ -4219,6 +4272,11 @@ void SV_ParseCommands(player_t &player)
 			SV_WantWad(player);
 			break;
 
+		case clc_wadack:
+			if (!SV_WadAck(player))
+				return;
+			break;
+
 		case clc_cheat:
 			SV_Cheat(player);
 			break;
@@ -4283,165 +4341,6 @@ void SV_WinCheck (void)
 	}
 }
 
-EXTERN_CVAR (sv_waddownloadcap)
-EXTERN_CVAR (sv_download_test)
-
-void SV_OptimizedDownloadTest()
-{
-	// nobody around?
-	if (players.empty())
-		return;
-
-	FILE* file = NULL;
-	std::string lastDownloadName;
-
-	// wad downloading
-	for (Players::iterator it = players.begin(); it != players.end(); ++it)
-	{
-		if (it->playerstate != PST_DOWNLOAD)
-			continue;
-
-		client_t *cl = &(it->client);
-
-		if (!cl->download.name.length())
-			continue;
-
-		static char buff[1024];
-		// Smaller buffer for slower clients
-		int chunk_size = (sizeof(buff) > (unsigned)cl->rate * 1000 / TICRATE) ? cl->rate * 1000 / TICRATE : sizeof(buff);
-
-		// maximum rate client can download at (in bytes per second)
-		int download_rate = (sv_waddownloadcap > cl->rate) ? cl->rate * 1000 : sv_waddownloadcap * 1000;
-
-		//Try to open/close the download file as little as possible.
-		//Too many fopen/fclose calls is inefficient and can choke out the game loop causing the server to be choppy with multiple clients downloading
-		if (lastDownloadName != cl->download.name)
-		{
-			if (file)
-				fclose(file);
-			file = fopen(cl->download.name.c_str(), "rb");
-			lastDownloadName = cl->download.name;
-		}
-
-		if (!file)
-			return;
-
-		do
-		{
-			// [SL] 2011-08-09 - Always send the data in netbuf and reliablebuf prior
-			// to writing a wadchunk to netbuf to keep packet sizes below the MTU.
-			// This prevents packets from getting dropped due to size on some networks.
-			if (cl->netbuf.size() + cl->reliablebuf.size())
-				SV_SendPacket(*it);
-
-			if (!cl->download.next_offset)
-			{
-				MSG_WriteMarker(&cl->netbuf, svc_wadinfo);
-				MSG_WriteLong(&cl->netbuf, M_FileLength(file));
-			}
-
-			fseek(file, cl->download.next_offset, SEEK_SET);
-			size_t read = fread(buff, 1, chunk_size, file);
-
-			if (!read)
-				break;
-
-			MSG_WriteMarker(&cl->netbuf, svc_wadchunk);
-			MSG_WriteLong(&cl->netbuf, cl->download.next_offset);
-			MSG_WriteShort(&cl->netbuf, read);
-			MSG_WriteChunk(&cl->netbuf, buff, read);
-
-			// Make double-sure the wadchunk is sent in its own packet
-			if (cl->netbuf.size() + cl->reliablebuf.size())
-				SV_SendPacket(*it);
-
-			cl->download.next_offset += read;
-		} while (
-			(double)(cl->reliable_bps + cl->unreliable_bps) * TICRATE
-			/ (double)(gametic % TICRATE)	// bps already used
-			+ (double)chunk_size / TICRATE 	// bps this chunk will use
-			< (double)download_rate);
-	}
-
-	if (file)
-		fclose(file);
-}
-
-void SV_DownloadOriginal()
-{
-	// nobody around?
-	if (players.empty())
-		return;
-
-	// wad downloading
-	for (Players::iterator it = players.begin(); it != players.end(); ++it)
-	{
-		if (it->playerstate != PST_DOWNLOAD)
-			continue;
-
-		client_t *cl = &(it->client);
-
-		if (!cl->download.name.length())
-			continue;
-
-		static char buff[1024];
-		// Smaller buffer for slower clients
-		int chunk_size = (sizeof(buff) > (unsigned)cl->rate * 1000 / TICRATE) ? cl->rate * 1000 / TICRATE : sizeof(buff);
-
-		// maximum rate client can download at (in bytes per second)
-		int download_rate = (sv_waddownloadcap > cl->rate) ? cl->rate * 1000 : sv_waddownloadcap * 1000;
-
-		do
-		{
-			// read next bit of wad
-			unsigned int read;
-			unsigned int filelen = 0;
-			read = W_ReadChunk(cl->download.name.c_str(), cl->download.next_offset, chunk_size, buff, filelen);
-
-			if (!read)
-				break;
-
-			// [SL] 2011-08-09 - Always send the data in netbuf and reliablebuf prior
-			// to writing a wadchunk to netbuf to keep packet sizes below the MTU.
-			// This prevents packets from getting dropped due to size on some networks.
-			if (cl->netbuf.size() + cl->reliablebuf.size())
-				SV_SendPacket(*it);
-
-			if (!cl->download.next_offset)
-			{
-				MSG_WriteMarker(&cl->netbuf, svc_wadinfo);
-				MSG_WriteLong(&cl->netbuf, filelen);
-			}
-
-			MSG_WriteMarker(&cl->netbuf, svc_wadchunk);
-			MSG_WriteLong(&cl->netbuf, cl->download.next_offset);
-			MSG_WriteShort(&cl->netbuf, read);
-			MSG_WriteChunk(&cl->netbuf, buff, read);
-
-			// Make double-sure the wadchunk is sent in its own packet
-			if (cl->netbuf.size() + cl->reliablebuf.size())
-				SV_SendPacket(*it);
-
-			cl->download.next_offset += read;
-		} while (
-			(double)(cl->reliable_bps + cl->unreliable_bps) * TICRATE
-			/ (double)(gametic % TICRATE)	// bps already used
-			+ (double)chunk_size / TICRATE 	// bps this chunk will use
-			< (double)download_rate);
-	}
-}
-
-//
-// SV_WadDownloads
-//
-void SV_WadDownloads (void)
-{
-	if (sv_download_test)
-		SV_OptimizedDownloadTest();
-	else
-		SV_DownloadOriginal();
-}
-
 //
 //	SV_WinningTeam					[Toke - teams]
 //
@@ -4567,9 +4466,11 @@ void SV_GameTics (void)
 			SV_WinCheck();
 			SV_TimelimitCheck();
 			Vote_Runtic();
+			Maplist_PrefetchTic();
 		break;
 		case GS_INTERMISSION:
 			SV_IntermissionTimeCheck();
+			Maplist_PrefetchTic();
 		break;
 
 		default:
@@ -66,13 +66,15 @@ void SV_CheckTimeouts (void);
 void SV_ConnectClient(void);
 void SV_WriteCommands(void);
 void SV_ClearClientsBPS(void);
-bool SV_SendPacket(player_t &pl);
+bool SV_SendPacket(player_t &pl, bool compress = true);
 void SV_AcknowledgePacket(player_t &player);
 void SV_DisplayTics();
 void SV_RunTics();
 void SV_ParseCommands(player_t &player);
 short SV_FindClientByAddr(void);
 void SV_UpdateFrags (player_t &player);
+void SV_QueueCorpse(AActor *mo);
+void SV_ClearCorpses();
 void SV_RemoveCorpses (void);
 void SV_DropClient(player_t &who);
 void SV_PlayerTriedToCheat(player_t &player);
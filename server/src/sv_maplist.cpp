@@ -21,7 +21,10 @@
 //-----------------------------------------------------------------------------
 
 #include <algorithm>
+#include <atomic>
+#include <exception>
 #include <sstream>
+#include <thread>
 
 #include "c_maplist.h"
 #include "sv_maplist.h"
@@ -29,13 +32,19 @@
 #include "c_cvars.h"
 #include "c_dispatch.h"
 #include "cmdlib.h"
+#include "d_main.h"
+#include "errors.h"
 #include "g_level.h"
 #include "i_system.h"
 #include "m_fileio.h"
+#include "p_tick.h"
 #include "sv_main.h"
 #include "sv_vote.h"
 #include "w_wad.h"
 
+EXTERN_CVAR(sv_prefetchmaps)
+EXTERN_CVAR(sv_timelimit)
+
 //////// MAPLIST METHODS ////////
 
 // Shuffle the maplist.
@@ -646,6 +655,125 @@ void Maplist_Disconnect(player_t &player) {
 	Maplist::instance().clear_timeout(player.id);
 }
 
+//////// PREFETCHING ////////
+
+// Since the next maplist entry is known in advance, its WAD files are
+// resolved on the main thread during the last sv_prefetchmaps minutes of a
+// timed map, or during intermission, and a background thread then hashes
+// them, reads their directories and has the OS read ahead the map's lumps.
+// The wad reboot at the map change picks all of that up from W_AddFile.
+
+static std::thread prefetchthread;
+static std::atomic<bool> prefetchdone(false);
+static std::string prefetchkey;		// entry being or last prefetched
+static std::string prefetcherror;	// set by the thread before prefetchdone
+
+static std::string Maplist_PrefetchKey(const maplist_entry_t &entry) {
+	return JoinStrings(entry.wads, " ") + " " + entry.map;
+}
+
+static void Maplist_PrefetchThread(std::vector<std::string> files, std::string map) {
+	// I_Error and I_FatalError throw, and an exception escaping a thread
+	// ends the process, so failures are left for the main thread to report.
+	try {
+		for (size_t i = 0; i < files.size(); i++)
+			W_PrefetchFile(files[i], map);
+	} catch (CDoomError &error) {
+		prefetcherror = error.GetMsg();
+	} catch (std::exception &error) {
+		prefetcherror = error.what();
+	}
+
+	prefetchdone = true;
+}
+
+// Wait for the prefetch thread. Returns false if it failed.
+static bool Maplist_JoinPrefetch() {
+	prefetchthread.join();
+
+	if (prefetcherror.empty())
+		return true;
+
+	Printf(PRINT_HIGH, "Prefetching the next map failed: %s\n", prefetcherror.c_str());
+	prefetcherror.clear();
+	return false;
+}
+
+static void STACK_ARGS Maplist_StopPrefetch() {
+	if (prefetchthread.joinable())
+		Maplist_JoinPrefetch();
+}
+
+// Start prefetching the next maplist entry once it is close to being loaded.
+void Maplist_PrefetchTic() {
+	if (sv_prefetchmaps <= 0 || !P_AtInterval(TICRATE) ||
+		level.flags & LEVEL_LOBBYSPECIAL)
+		return;
+
+	if (gamestate == GS_LEVEL && (!sv_timelimit ||
+		level.timeleft > sv_prefetchmaps * 60 * TICRATE))
+		return;
+
+	size_t index;
+	maplist_entry_t entry;
+	if (!Maplist::instance().get_next_index(index) ||
+		!Maplist::instance().get_map_by_index(index, entry))
+		return;
+
+	std::string key = Maplist_PrefetchKey(entry);
+	if (key == prefetchkey)
+		return;
+
+	// Still busy with an entry that is no longer next.
+	if (prefetchthread.joinable()) {
+		if (!prefetchdone)
+			return;
+		Maplist_JoinPrefetch();
+	}
+
+	// The current odamex.wad and IWAD are reloaded by every wad reboot.
+	std::vector<std::string> files(wadfiles.begin(),
+		wadfiles.begin() + std::min<size_t>(wadfiles.size(), 2));
+
+	for (size_t i = 0; i < entry.wads.size(); i++) {
+		std::string filename(entry.wads[i]);
+		std::string ext;
+
+		if (!M_ExtractFileExtension(filename, ext))
+			M_AppendExtension(filename, ".wad");
+		else if (!iequals(ext, "wad"))
+			continue;
+
+		std::string path = D_FindResourceFile(filename);
+		if (!path.empty() && std::find(files.begin(), files.end(), path) == files.end())
+			files.push_back(path);
+	}
+
+	static bool registered = false;
+	if (!registered) {
+		atterm(Maplist_StopPrefetch);
+		registered = true;
+	}
+
+	DPrintf("Prefetching %s for %s\n", JoinStrings(entry.wads, " ").c_str(),
+		entry.map.c_str());
+
+	prefetchkey = key;
+	prefetchdone = false;
+	prefetchthread = std::thread(Maplist_PrefetchThread, files, entry.map);
+}
+
+// Wait for any prefetch to finish before a wad reboot. Returns true if
+// it was for the given entry.
+bool Maplist_FinishPrefetch(const maplist_entry_t &entry) {
+	if (!prefetchthread.joinable())
+		return false;
+
+	bool hit = Maplist_JoinPrefetch() && Maplist_PrefetchKey(entry) == prefetchkey;
+	prefetchkey.clear();
+	return hit;
+}
+
 //////// CONSOLE COMMANDS ////////
 
 BEGIN_COMMAND (maplist) {
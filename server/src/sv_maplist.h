@@ -78,6 +78,8 @@ void SV_Maplist(player_t &player);
 void SV_MaplistUpdate(player_t &player);
 
 void Maplist_Disconnect(player_t &player);
+void Maplist_PrefetchTic();
+bool Maplist_FinishPrefetch(const maplist_entry_t &entry);
 
 bool CMD_Randmap(std::string &error);
 
@@ -145,7 +145,10 @@ void SV_SendPacketDelayed(buf_t& packet, player_t& pl)
 //
 // SV_SendPacket
 //
-bool SV_SendPacket(player_t &pl)
+// Packets that are mostly data compressed beforehand can be sent without
+// trying to compress them again.
+//
+bool SV_SendPacket(player_t &pl, bool compress)
 {
 	int				bps = 0; // bytes per second, not bits per second
 
@@ -214,7 +217,7 @@ bool SV_SendPacket(player_t &pl)
 	SZ_Clear(&cl->reliablebuf);
 	
 	// compress the packet, but not the sequence id
-	if (sendd.size() > sizeof(int))
+	if (compress && sendd.size() > sizeof(int))
 		SV_CompressPacket(sendd, sizeof(int), cl);
 
 	if (log_packetdebug)
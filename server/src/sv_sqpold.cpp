@@ -283,6 +283,9 @@ void SV_SendServerInfo()
     for (size_t i = 0; i < patchfiles.size(); ++i)
         MSG_WriteString(&ml_message, D_CleanseFileName(patchfiles[i]).c_str());
 
+	// older clients and launchers stop reading before this
+	MSG_WriteLong(&ml_message, SVCAP_WADACK);
+
 	NET_SendPacket(ml_message, net_from);
 }
 
@@ -0,0 +1,215 @@
+# ACS test programs for acstest.wad, written in the p-code assembly that
+# mkwad.py assembles.  They are not ACC source: several checks need p-codes
+# ACC never emits, such as the byte-operand forms in every lump format and
+# an unknown p-code.
+#
+# Every script reports through Print, which the client writes to its log
+# as "tag=value".  See README for how the expected values are captured.
+
+OPEN, CLOSED = 1, 0
+
+# tid x y z angle type flags special args
+FLAGS = 0x7e7
+THINGS = [
+    (0, 128, 128, 0, 0, 1, FLAGS, 0, 0, 0, 0, 0, 0),        # player 1 start
+    (0, 160, 128, 0, 0, 11, FLAGS, 0, 0, 0, 0, 0, 0),       # dm start
+    (5, 300, 64, 0, 0, 2014, FLAGS, 0, 0, 0, 0, 0, 0),      # health bonus tid 5
+    (5, 400, 64, 0, 0, 2014, FLAGS, 0, 0, 0, 0, 0, 0),      # health bonus tid 5
+    (6, 600, 64, 0, 0, 2015, FLAGS, 0, 0, 0, 0, 0, 0),      # armor bonus tid 6
+]
+
+def pnum(n):
+    return [('PUSHNUMBER', n)]
+
+import json, os
+REF = {}
+# tags whose value depends on the game setup rather than the interpreter
+UNCHECKED = ('players', 'gametype', 'skill', 'rand', 'randd', 'randb', 'args', 's2', 'restart', 'fails')
+
+def load_ref(fmt, refs):
+    """Loads the expected values for a lump format, unless refs is False."""
+    global REF
+    REF = {}
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'ref_%s.json' % fmt)
+    if refs and os.path.exists(path):
+        REF = json.load(open(path))
+
+def printnum(tag, ops):
+    """Print 'tag=<value>' where ops leave one value on the stack.  If the
+    reference run recorded a value for tag, count a mismatch in map var 0."""
+    out = [('BEGINPRINT',)]
+    for ch in tag + '=':
+        out += [('PUSHBYTE', ord(ch)), ('PRINTCHARACTER',)]
+    if tag in REF and tag not in UNCHECKED:
+        out += ops + [('DUP',), ('PRINTNUMBER',), ('ENDPRINTBOLD',)]
+        out += pnum(REF[tag]) + [('NE',), ('ADDMAPVAR', 0)]
+    else:
+        out += ops + [('PRINTNUMBER',), ('ENDPRINTBOLD',)]
+    return out
+
+def elapsed():
+    return [('TIMER',), ('PUSHMAPVAR', 1), ('SUBTRACT',)]
+
+def program(fmt, refs=True):
+    load_ref(fmt, refs)
+    enh = fmt != 'old'
+    scripts = []
+
+    # ---- script 1: OPEN; arithmetic, control flow, variables
+    s = [('TIMER',), ('ASSIGNMAPVAR', 1)]
+    s += printnum('add', pnum(1234) + pnum(-34) + [('ADD',)])
+    s += printnum('sub', pnum(7) + pnum(100) + [('SUBTRACT',)])
+    s += printnum('mul', pnum(-13) + pnum(11) + [('MULTIPLY',)])
+    s += printnum('div', pnum(-100) + pnum(7) + [('DIVIDE',)])
+    s += printnum('mod', pnum(100) + pnum(7) + [('MODULUS',)])
+    s += printnum('cmp', pnum(3) + pnum(4) + [('LT',)] + pnum(3) + pnum(4) + [('GE',), ('ADD',)]
+                  + pnum(5) + pnum(5) + [('EQ',), ('ADD',)] + pnum(5) + pnum(6) + [('NE',), ('ADD',)]
+                  + pnum(5) + pnum(6) + [('GT',), ('ADD',)] + pnum(6) + pnum(6) + [('LE',), ('ADD',)])
+    s += printnum('bits', pnum(0xf0f0) + pnum(0x0ff0) + [('ANDBITWISE',)] + pnum(0x1) + [('ORBITWISE',)]
+                  + pnum(0xffff) + [('EORBITWISE',)] + pnum(3) + [('LSHIFT',)] + pnum(1) + [('RSHIFT',)])
+    s += printnum('logic', pnum(0) + [('NEGATELOGICAL',)] + pnum(2) + [('ANDLOGICAL',)] + pnum(0)
+                  + [('ORLOGICAL',)] + pnum(9) + [('UNARYMINUS',), ('ADD',)])
+    s += printnum('fixed', pnum(3 << 16) + pnum(0x8000) + [('FIXEDMUL',)] + pnum(5 << 16) + [('FIXEDDIV',)])
+    s += printnum('trig', pnum(0x2000) + [('SIN',)] + pnum(0x2000) + [('COS',), ('ADD',)]
+                  + pnum(3 << 16) + pnum(4 << 16) + [('VECTORANGLE',), ('ADD',)])
+    s += printnum('bytes', [('PUSHBYTE', 200), ('PUSH2BYTES', 1, 2), ('ADD',), ('ADD',),
+                            ('PUSH3BYTES', 3, 4, 5), ('ADD',), ('ADD',), ('ADD',),
+                            ('PUSH4BYTES', 6, 7, 8, 9), ('ADD',), ('ADD',), ('ADD',), ('ADD',),
+                            ('PUSH5BYTES', 10, 11, 12, 13, 14), ('ADD',), ('ADD',), ('ADD',), ('ADD',), ('ADD',),
+                            ('PUSHBYTES', 20, 30, 40), ('MULTIPLY',), ('SUBTRACT',), ('ADD',)])
+    s += printnum('dupswap', pnum(5) + pnum(9) + [('SWAP',), ('SUBTRACT',), ('DUP',), ('MULTIPLY',)])
+    # loop: sum of i*i for i in 0..19 using script vars 0 (i) and 1 (sum)
+    s += pnum(0) + [('ASSIGNSCRIPTVAR', 0)] + pnum(0) + [('ASSIGNSCRIPTVAR', 1)]
+    s += [('label', 'l1')]
+    s += [('PUSHSCRIPTVAR', 0), ('PUSHSCRIPTVAR', 0), ('MULTIPLY',), ('ADDSCRIPTVAR', 1),
+          ('INCSCRIPTVAR', 0), ('PUSHSCRIPTVAR', 0)] + pnum(20) + [('LT',), ('IFGOTO', 'l1')]
+    s += printnum('loop', [('PUSHSCRIPTVAR', 1)])
+    # script var ops
+    s += pnum(50) + [('ASSIGNSCRIPTVAR', 2)] + pnum(3) + [('SUBSCRIPTVAR', 2)] + pnum(4) + [('MULSCRIPTVAR', 2)]
+    s += pnum(5) + [('DIVSCRIPTVAR', 2)] + pnum(7) + [('MODSCRIPTVAR', 2), ('DECSCRIPTVAR', 2)]
+    s += printnum('svar', [('PUSHSCRIPTVAR', 2)])
+    # map/world/global vars
+    for kind, idx in (('MAP', 3), ('WORLD', 4), ('GLOBAL', 5)):
+        s += pnum(1000) + [('ASSIGN%sVAR' % kind, idx)] + pnum(9) + [('ADD%sVAR' % kind, idx)]
+        s += pnum(3) + [('SUB%sVAR' % kind, idx)] + pnum(6) + [('MUL%sVAR' % kind, idx)]
+        s += pnum(7) + [('DIV%sVAR' % kind, idx)] + pnum(100) + [('MOD%sVAR' % kind, idx)]
+        s += [('INC%sVAR' % kind, idx), ('INC%sVAR' % kind, idx), ('DEC%sVAR' % kind, idx)]
+        s += printnum(kind.lower(), [('PUSH%sVAR' % kind, idx)])
+    if enh:
+        # map array 0 lives in map var 10; init from AINI
+        s += printnum('aini', pnum(2) + [('PUSHMAPARRAY', 10)])
+        s += pnum(4) + pnum(77) + [('ASSIGNMAPARRAY', 10)]
+        s += pnum(4) + pnum(3) + [('ADDMAPARRAY', 10)]
+        s += pnum(4) + pnum(2) + [('SUBMAPARRAY', 10)]
+        s += pnum(4) + pnum(5) + [('MULMAPARRAY', 10)]
+        s += pnum(4) + pnum(3) + [('DIVMAPARRAY', 10)]
+        s += pnum(4) + pnum(50) + [('MODMAPARRAY', 10)]
+        s += pnum(4) + [('INCMAPARRAY', 10)] + pnum(4) + [('INCMAPARRAY', 10)] + pnum(4) + [('DECMAPARRAY', 10)]
+        s += printnum('array', pnum(4) + [('PUSHMAPARRAY', 10)])
+        s += printnum('mini', [('PUSHMAPVAR', 11)])
+    # casegoto dispatch over several values
+    s += pnum(0) + [('ASSIGNSCRIPTVAR', 0)]
+    s += [('label', 'c_top'), ('PUSHSCRIPTVAR', 0),
+          ('CASEGOTO', 0, 'c0'), ('CASEGOTO', 2, 'c2'), ('CASEGOTO', 3, 'c3'), ('DROP',)]
+    s += printnum('case_default', [('PUSHSCRIPTVAR', 0)]) + [('GOTO', 'c_next')]
+    s += [('label', 'c0')] + printnum('case0', [('PUSHSCRIPTVAR', 0)]) + [('GOTO', 'c_next')]
+    s += [('label', 'c2')] + printnum('case2', [('PUSHSCRIPTVAR', 0)]) + [('GOTO', 'c_next')]
+    s += [('label', 'c3')] + printnum('case3', [('PUSHSCRIPTVAR', 0)])
+    s += [('label', 'c_next'), ('INCSCRIPTVAR', 0), ('PUSHSCRIPTVAR', 0)] + pnum(5) + [('GE',), ('IFNOTGOTO', 'c_top')]
+    # random is deterministic across identical runs
+    s += printnum('rand', pnum(1) + pnum(100) + [('RANDOM',)])
+    s += printnum('randd', [('RANDOMDIRECT', 5, 500)])
+    s += printnum('randb', [('RANDOMDIRECTB', 3, 9)])
+    # thing counts
+    s += printnum('tc5', [('THINGCOUNTDIRECT', 0, 5)])
+    s += printnum('tc6', pnum(0) + pnum(6) + [('THINGCOUNT',)])
+    s += printnum('players', [('PLAYERCOUNT',)])
+    s += printnum('gametype', [('GAMETYPE',)])
+    s += printnum('skill', [('GAMESKILL',)])
+    s += printnum('line', [('LINESIDE',)])
+    s += [('CLEARLINESPECIAL',), ('NOP',)]
+    # delays and timer
+    s += [('DELAYDIRECT', 5)] + printnum('t1', elapsed())
+    s += [('DELAYDIRECTB', 3)] + printnum('t2', elapsed())
+    s += pnum(2) + [('DELAY',)] + printnum('t3', elapsed())
+    # start script 2 with args through the various lspec forms
+    s += pnum(2) + pnum(0) + pnum(11) + pnum(22) + pnum(33) + [('LSPEC5', 80)]
+    s += [('SCRIPTWAITDIRECT', 2)] + printnum('w2', elapsed())
+    s += [('LSPEC5DIRECT', 80, 2, 0, 44, 55, 66)]
+    s += pnum(2) + [('SCRIPTWAIT',)] + printnum('w2b', elapsed())
+    s += [('LSPEC3DIRECTB', 226, 2, 0, 77), ('DELAYDIRECTB', 4)]
+    s += [('LSPEC1DIRECT', 80, 2)] + [('SCRIPTWAITDIRECT', 2)] + printnum('w2c', elapsed())
+    s += printnum('argsum', [('PUSHMAPVAR', 13)])
+    # lower the tagged floor and wait for it
+    s += pnum(1) + pnum(16) + pnum(64) + [('LSPEC3', 20)]
+    s += [('TAGWAITDIRECT', 1)] + printnum('tag1', elapsed())
+    s += [('LSPEC3DIRECT', 20, 2, 32, 32)] + pnum(2) + [('TAGWAIT',)] + printnum('tag2', elapsed())
+    # functions
+    if enh:
+        s += printnum('fact', pnum(6) + [('CALL', 0)])
+        s += pnum(3) + [('CALLDISCARD', 1)]
+        s += printnum('fn2', [('PUSHMAPVAR', 12)])
+    # strings
+    s += [('BEGINPRINT',)] + pnum(0) + [('PRINTSTRING',)] + pnum(1) + [('PRINTSTRING',)]
+    s += pnum(0x18000) + [('PRINTFIXED',), ('ENDPRINTBOLD',)]
+    # other scripts: restart counter, suspend/resume, terminate, runaway, unknown
+    s += pnum(4) + pnum(0) + [('LSPEC2', 80)]
+    s += [('DELAYDIRECT', 4)] + pnum(4) + pnum(0) + [('LSPEC2', 80)]
+    s += [('DELAYDIRECT', 2)] + pnum(5) + pnum(0) + [('LSPEC2', 80)]
+    s += [('DELAYDIRECT', 1)] + pnum(5) + pnum(0) + [('LSPEC2', 82)]
+    s += [('LSPEC2DIRECT', 80, 6, 0), ('LSPEC2DIRECT', 80, 7, 0), ('DELAYDIRECT', 1)]
+    s += [('LSPEC2DIRECT', 80, 8, 0), ('DELAYDIRECT', 1)]
+    s += printnum('done', elapsed())
+    # Sink the player's sector by 64, plus 8 for every mismatch, so a demo
+    # played on this map ends at z = -64 only if every check passed
+    s += printnum('fails', [('PUSHMAPVAR', 0)])
+    s += pnum(3) + pnum(64) + [('PUSHMAPVAR', 0)] + pnum(8) + [('MULTIPLY',)] + pnum(64) + [('ADD',), ('LSPEC3', 20)]
+    s += [('TERMINATE',)]
+    scripts.append((1, OPEN, 0, s))
+
+    # ---- script 2: prints its args; locals are the args
+    s = printnum('args', [('PUSHSCRIPTVAR', 0)] + pnum(10000) + [('MULTIPLY',), ('PUSHSCRIPTVAR', 1)]
+                 + pnum(100) + [('MULTIPLY',), ('ADD',), ('PUSHSCRIPTVAR', 2), ('ADD',), ('DUP',), ('ADDMAPVAR', 13)])
+    s += [('DELAYDIRECT', 3)] + printnum('s2', elapsed()) + [('TERMINATE',)]
+    scripts.append((2, CLOSED, 3, s))
+
+    # ---- script 4: restarts itself until map var 6 reaches 3, then suspends
+    s = [('INCMAPVAR', 6)] + printnum('restart', [('PUSHMAPVAR', 6)])
+    s += [('PUSHMAPVAR', 6)] + pnum(3) + [('LT',), ('IFNOTGOTO', 's4a'), ('DELAYDIRECTB', 1), ('RESTART',)]
+    s += [('label', 's4a'), ('SUSPEND',)] + printnum('resumed', elapsed()) + [('TERMINATE',)]
+    scripts.append((4, CLOSED, 0, s))
+
+    # ---- script 5: long wait loop, terminated from script 1
+    s = [('label', 's5'), ('DELAYDIRECTB', 1), ('INCMAPVAR', 7), ('GOTO', 's5')]
+    scripts.append((5, CLOSED, 0, s))
+
+    # ---- script 6: runaway
+    s = [('label', 's6'), ('NOP',), ('GOTO', 's6')]
+    scripts.append((6, CLOSED, 0, s))
+
+    # ---- script 7: unknown p-code
+    s = printnum('before_bad', pnum(7)) + [('RAW', 249)] + printnum('after_bad', pnum(7)) + [('INCMAPVAR', 0)]
+    scripts.append((7, CLOSED, 0, s))
+
+    # ---- script 8: report how long script 5 ran; falls off into script 9
+    s = printnum('s5ran', [('PUSHMAPVAR', 7)])
+    scripts.append((8, CLOSED, 0, s))
+    s = printnum('fell', pnum(9)) + [('TERMINATE',)]
+    scripts.append((9, CLOSED, 0, s))
+
+    functions = []
+    if enh:
+        # fact(n): n <= 1 ? 1 : n * fact(n - 1)
+        f = [('PUSHSCRIPTVAR', 0)] + pnum(1) + [('LE',), ('IFNOTGOTO', 'f0')] + pnum(1) + [('RETURNVAL',)]
+        f += [('label', 'f0'), ('PUSHSCRIPTVAR', 0), ('PUSHSCRIPTVAR', 0)] + pnum(1) + [('SUBTRACT',), ('CALL', 0), ('MULTIPLY',), ('RETURNVAL',)]
+        functions.append((1, 0, 1, f))
+        # fn2(n): mapvar12 = n * 7 + local
+        f = pnum(5) + [('ASSIGNSCRIPTVAR', 1), ('PUSHSCRIPTVAR', 0)] + pnum(7) + [('MULTIPLY',), ('PUSHSCRIPTVAR', 1), ('ADD',), ('ASSIGNMAPVAR', 12), ('RETURNVOID',)]
+        functions.append((1, 1, 0, f))
+
+    prog = dict(scripts=scripts, strings=['Hello, ', 'world '])
+    if enh:
+        prog['functions'] = functions
+        prog['mapvars'] = [0] * 11 + [4242]
+        prog['arrays'] = [(10, 8, [1, 2, 3])]
+    return prog
@@ -0,0 +1,17 @@
+#!/usr/bin/env python3
+# Writes acstest1.lmp to acstest3.lmp: vanilla demos of MAP01 to MAP03 of
+# acstest.wad in which one player stands still for long enough for every
+# script to finish.
+#
+#   mklmp.py [output directory]
+import os, struct, sys
+
+TICS = 210
+
+outdir = sys.argv[1] if len(sys.argv) > 1 else os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+for m in (1, 2, 3):
+    # version, skill, episode, map, deathmatch, respawn, fast, nomonsters,
+    # consoleplayer, playeringame[4]
+    header = struct.pack('<13B', 109, 2, 1, m, 0, 0, 0, 0, 0, 1, 0, 0, 0)
+    data = header + b'\0' * (4 * TICS) + b'\x80'
+    open(os.path.join(outdir, 'acstest%d.lmp' % m), 'wb').write(data)
@@ -0,0 +1,24 @@
+#!/usr/bin/env python3
+# Captures the expected values for acstest.wad from the logs of a client
+# that played acstest1.lmp to acstest3.lmp, and writes them to ref_*.json.
+#
+#   mkref.py acstest1.log acstest2.log acstest3.log
+#
+# Tags printed more than once with different values are left out.
+import json, os, re, sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+if len(sys.argv) != 4:
+    sys.exit('usage: mkref.py acstest1.log acstest2.log acstest3.log')
+
+for fmt, log in zip(('old', 'E', 'e'), sys.argv[1:]):
+    ref = {}
+    for line in open(log):
+        m = re.match(r'^(?:\[\d+\] )?(\w+)=(-?\d+)$', line.strip())
+        if m:
+            k, v = m.group(1), int(m.group(2))
+            ref[k] = v if k not in ref or ref[k] == v else None
+    ref = dict((k, v) for k, v in ref.items() if v is not None)
+    json.dump(ref, open(os.path.join(HERE, 'ref_%s.json' % fmt), 'w'), indent=1)
+    print('%s: %d values' % (fmt, len(ref)))
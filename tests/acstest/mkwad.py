@@ -0,0 +1,277 @@
+#!/usr/bin/env python3
+# Builds acstest.wad: Hexen-format maps whose BEHAVIOR lumps exercise the
+# ACS interpreter in the three lump formats (ACS0, ACSE, ACSe).
+#
+#   mkwad.py [--norefs] [output.wad]
+#
+# --norefs leaves out the comparisons against ref_*.json, for capturing
+# new expected values.  See README.
+import os, re, struct, sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+def read_pcodes():
+    """Numbers the p-codes in the order of the enum in common/p_acs.h."""
+    src = open(os.path.join(HERE, '..', '..', 'common', 'p_acs.h')).read()
+    src = re.sub(r'/\*.*?\*/', '', src, flags=re.S)
+    src = re.sub(r'//[^\n]*', '', src)
+    body = re.search(r'enum\s*\{\s*(PCD_NOP\b.*?)PCODE_COMMAND_COUNT', src, re.S).group(1)
+    names = [n.strip() for n in body.split(',') if n.strip()]
+    return dict((n, i) for i, n in enumerate(names))
+
+P = read_pcodes()
+
+def pc(name):
+    return P['PCD_' + name]
+
+# ---------------------------------------------------------------- assembler
+class Asm:
+    """Assembles a list of ops into one of the three formats.
+
+    Operations are tuples: ('OP', args...) with args ints or label names.
+    ('label', name) defines a label.
+    """
+    def __init__(self, fmt):
+        self.fmt = fmt      # 'old', 'E', 'e'
+        self.code = bytearray()
+        self.labels = {}
+        self.fixups = []
+
+    def code_word(self, v):
+        if self.fmt == 'e':
+            self.code += struct.pack('<B', v & 0xff)
+        else:
+            self.code += struct.pack('<i', v)
+
+    def word(self, v):
+        self.code += struct.pack('<i', v)
+
+    def byte(self, v):
+        self.code += struct.pack('<B', v & 0xff)
+
+    def target(self, name):
+        self.fixups.append((len(self.code), name))
+        self.code += b'\0\0\0\0'
+
+    def emit(self, ops, base):
+        for op in ops:
+            name = op[0]
+            a = op[1:]
+            if name == 'label':
+                self.labels[a[0]] = base + len(self.code)
+                continue
+            if name == 'RAW':           # raw p-code number (unknown codes)
+                self.code_word(a[0])
+                continue
+            n = pc(name)
+            self.code_word(n)
+            if name in ('PUSHNUMBER', 'DELAYDIRECT', 'TAGWAITDIRECT', 'POLYWAITDIRECT',
+                        'SCRIPTWAITDIRECT'):
+                self.word(a[0])
+            elif name in ('PUSHBYTE', 'DELAYDIRECTB'):
+                self.byte(a[0])
+            elif name in ('PUSH2BYTES', 'PUSH3BYTES', 'PUSH4BYTES', 'PUSH5BYTES'):
+                for v in a: self.byte(v)
+            elif name == 'PUSHBYTES':
+                self.byte(len(a))
+                for v in a: self.byte(v)
+            elif name.startswith('LSPEC') and name.endswith('DIRECTB'):
+                for v in a: self.byte(v)
+            elif name.startswith('LSPEC') and name.endswith('DIRECT'):
+                self.code_word(a[0])
+                for v in a[1:]: self.word(v)
+            elif name.startswith('LSPEC') or name in ('CALL', 'CALLDISCARD') or \
+                    any(name.startswith(p) and (name.endswith('VAR') or name.endswith('ARRAY'))
+                        for p in ('ASSIGN', 'PUSH', 'ADD', 'SUB', 'MUL', 'DIV', 'MOD', 'INC', 'DEC')):
+                self.code_word(a[0])
+            elif name == 'RANDOMDIRECTB':
+                self.byte(a[0]); self.byte(a[1])
+            elif name in ('RANDOMDIRECT', 'THINGCOUNTDIRECT'):
+                self.word(a[0]); self.word(a[1])
+            elif name in ('GOTO', 'IFGOTO', 'IFNOTGOTO'):
+                self.target(a[0])
+            elif name == 'CASEGOTO':
+                self.word(a[0]); self.target(a[1])
+            else:
+                assert not a, op
+
+    def resolve(self, base):
+        for ofs, name in self.fixups:
+            struct.pack_into('<i', self.code, ofs, self.labels[name])
+
+
+def build_behavior(fmt, scripts, functions=(), strings=(), mapvars=None, arrays=()):
+    """scripts: list of (number, type, argc, ops); functions: (argc, locals, hasret, ops)"""
+    asm = Asm(fmt)
+    base = 8
+    addrs = []
+    for s in scripts:
+        addrs.append(base + len(asm.code))
+        asm.emit(s[3], base)
+    faddrs = []
+    for f in functions:
+        faddrs.append(base + len(asm.code))
+        asm.emit(f[3], base)
+    asm.resolve(base)
+    code = bytes(asm.code)
+
+    if fmt == 'old':
+        out = bytearray(b'ACS\0' + b'\0\0\0\0' + code)
+        while len(out) % 4: out.append(0)
+        # string data
+        strofs = []
+        for st in strings:
+            strofs.append(len(out))
+            out += st.encode() + b'\0'
+        while len(out) % 4: out.append(0)
+        dirofs = len(out)
+        out += struct.pack('<i', len(scripts))
+        for s, a in zip(scripts, addrs):
+            out += struct.pack('<iii', s[1] * 1000 + s[0], a, s[2])
+        out += struct.pack('<i', len(strings))
+        for o in strofs:
+            out += struct.pack('<i', o)
+        struct.pack_into('<i', out, 4, dirofs)
+        return bytes(out)
+
+    out = bytearray((b'ACSE' if fmt == 'E' else b'ACSe') + b'\0\0\0\0' + code)
+    while len(out) % 4: out.append(0)
+    chunks = bytearray()
+
+    def chunk(cid, data):
+        chunks.extend(cid + struct.pack('<i', len(data)) + data)
+
+    sptr = bytearray()
+    for s, a in zip(scripts, addrs):
+        sptr += struct.pack('<HHii', s[0], s[1], a, s[2])
+    chunk(b'SPTR', bytes(sptr))
+    if functions:
+        func = bytearray()
+        for f, a in zip(functions, faddrs):
+            func += struct.pack('<BBBBi', f[0], f[1], f[2], 0, a)
+        chunk(b'FUNC', bytes(func))
+    if mapvars:
+        chunk(b'MINI', struct.pack('<i', 0) + b''.join(struct.pack('<i', v) for v in mapvars))
+    if arrays:
+        chunk(b'ARAY', b''.join(struct.pack('<ii', var, size) for var, size, init in arrays))
+        for var, size, init in arrays:
+            if init:
+                chunk(b'AINI', struct.pack('<i', var) + b''.join(struct.pack('<i', v) for v in init))
+    if strings:
+        # langid 0, count, next link, offsets relative to the list start
+        head = 12 + 4 * len(strings)
+        data = bytearray()
+        offs = []
+        for st in strings:
+            offs.append(head + len(data))
+            data += st.encode() + b'\0'
+        lst = struct.pack('<iii', 0, len(strings), 0) + b''.join(struct.pack('<i', o) for o in offs) + data
+        while len(lst) % 4: lst += b'\0'
+        chunk(b'STRL', lst)
+    struct.pack_into('<i', out, 4, len(out))
+    return bytes(out + chunks)
+
+# ---------------------------------------------------------------- map
+def build_map(behavior, things):
+    # Three 256x256 sectors in a row along x; sector 1 has tag 1, sector 2 tag 2
+    verts = [(0, 0), (256, 0), (512, 0), (768, 0), (768, 256), (512, 256), (256, 256), (0, 256)]
+    # sidedefs: one per line side
+    sides = []
+    def side(sector):
+        sides.append(struct.pack('<hh8s8s8sh', 0, 0, b'-', b'-', b'STARTAN3', sector))
+        return len(sides) - 1
+    lines = []
+    def line(v1, v2, front, back=-1, special=0, args=(0, 0, 0, 0, 0), flags=1):
+        lines.append(struct.pack('<hhhB5Bhh', v1, v2, flags, special, *args, front, back))
+    # outer walls
+    line(0, 1, side(0)); line(1, 2, side(1)); line(2, 3, side(2))
+    line(3, 4, side(2)); line(4, 5, side(2)); line(5, 6, side(1)); line(6, 7, side(0)); line(7, 0, side(0))
+    # shared two-sided lines: x=256 (line 8) and x=512 (line 9), pointing up
+    line(1, 6, side(1), side(0), flags=4)
+    line(2, 5, side(2), side(1), flags=4)
+    sectors = [
+        struct.pack('<hh8s8shhh', 0, 128, b'FLOOR4_8', b'CEIL3_5', 160, 0, 3),
+        struct.pack('<hh8s8shhh', 0, 128, b'FLOOR4_8', b'CEIL3_5', 160, 0, 1),
+        struct.pack('<hh8s8shhh', 0, 128, b'FLOOR4_8', b'CEIL3_5', 160, 0, 2),
+    ]
+    # segs: v1 v2 angle linedef side offset
+    def ang(v1, v2):
+        import math
+        x1, y1 = verts[v1]; x2, y2 = verts[v2]
+        a = math.atan2(y2 - y1, x2 - x1)
+        return int(round(a / (2 * math.pi) * 65536)) & 0xffff
+    def seg(v1, v2, ld, sd):
+        a = ang(v1, v2)
+        return struct.pack('<hhhhhh', v1, v2, a - 65536 if a > 32767 else a, ld, sd, 0)
+    # subsector 0: sector 0 (lines 0,8(back: 6->1),6,7)
+    segs = [seg(0, 1, 0, 0), seg(6, 1, 8, 1), seg(6, 7, 6, 0), seg(7, 0, 7, 0),
+            # subsector 1: sector 1 (lines 1, 9 back, 5, 8 front)
+            seg(1, 2, 1, 0), seg(5, 2, 9, 1), seg(5, 6, 5, 0), seg(1, 6, 8, 0),
+            # subsector 2: sector 2 (lines 2, 3, 4, 9 front)
+            seg(2, 3, 2, 0), seg(3, 4, 3, 0), seg(4, 5, 4, 0), seg(2, 5, 9, 0)]
+    ssectors = struct.pack('<hh', 4, 0) + struct.pack('<hh', 4, 4) + struct.pack('<hh', 4, 8)
+    SS = 0x8000
+    def bbox(x1, x2):
+        return struct.pack('<hhhh', 256, 0, x1, x2)  # top bottom left right
+    # node 0: partition x=256, dy>0: right (x>256) = subsector 1, left = subsector 0
+    # node 1 (root): partition x=512: right = subsector 2, left = node 0
+    nodes = (struct.pack('<hhhh', 256, 0, 0, 256) + bbox(256, 512) + bbox(0, 256) + struct.pack('<HH', SS | 1, SS | 0) +
+             struct.pack('<hhhh', 512, 0, 0, 256) + bbox(512, 768) + bbox(0, 512) + struct.pack('<HH', SS | 2, 0))
+    vertexes = b''.join(struct.pack('<hh', x, y) for x, y in verts)
+    # blockmap: origin (0,0), 6x2 blocks of 128
+    bw, bh = 6, 2
+    blocks = []
+    import itertools
+    def line_in_block(li, bx, by):
+        v1, v2 = struct.unpack_from('<hh', lines[li])
+        (x1, y1), (x2, y2) = verts[v1], verts[v2]
+        lx, hx = bx * 128, bx * 128 + 128
+        ly, hy = by * 128, by * 128 + 128
+        return max(x1, x2) >= lx and min(x1, x2) <= hx and max(y1, y2) >= ly and min(y1, y2) <= hy
+    for by in range(bh):
+        for bx in range(bw):
+            blocks.append([li for li in range(len(lines)) if line_in_block(li, bx, by)])
+    head = 4 + bw * bh
+    bm = [0, 0, bw, bh]
+    offs = []
+    lists = []
+    pos = head
+    for b in blocks:
+        offs.append(pos)
+        lst = [0] + b + [-1]
+        lists += lst
+        pos += len(lst)
+    blockmap = struct.pack('<%dh' % (4 + len(offs) + len(lists)), *(bm + offs + lists))
+    reject = b'\0' * 2
+    thingdata = b''.join(struct.pack('<hhhhhhhB5B', *t) for t in things)
+    return [(b'THINGS', thingdata), (b'LINEDEFS', b''.join(lines)), (b'SIDEDEFS', b''.join(sides)),
+            (b'VERTEXES', vertexes), (b'SEGS', b''.join(segs)), (b'SSECTORS', ssectors),
+            (b'NODES', nodes), (b'SECTORS', b''.join(sectors)), (b'REJECT', reject),
+            (b'BLOCKMAP', blockmap), (b'BEHAVIOR', behavior)]
+
+
+def write_wad(path, maps):
+    lumps = []
+    for name, mlumps in maps:
+        lumps.append((name, b''))
+        lumps += mlumps
+    data = bytearray(b'PWAD' + struct.pack('<ii', len(lumps), 0))
+    dirents = []
+    for name, d in lumps:
+        dirents.append(struct.pack('<ii8s', len(data), len(d), name))
+        data += d
+    struct.pack_into('<i', data, 8, len(data))
+    data += b''.join(dirents)
+    open(path, 'wb').write(data)
+
+if __name__ == '__main__':
+    sys.path.insert(0, HERE)
+    import acsprog
+    args = sys.argv[1:]
+    refs = '--norefs' not in args
+    args = [a for a in args if a != '--norefs']
+    maps = []
+    for i, fmt in enumerate(('old', 'E', 'e')):
+        prog = acsprog.program(fmt, refs)
+        maps.append((b'MAP%02d' % (i + 1), build_map(build_behavior(fmt, **prog), acsprog.THINGS)))
+    write_wad(args[0] if args else os.path.join(HERE, '..', 'acstest.wad'), maps)